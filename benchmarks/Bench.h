@@ -0,0 +1,70 @@
+/**
+    @file      Bench.h
+    @brief     Small helpers shared by the benchmarks: timing of repeated runs and latency statistics
+**/
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+	/**
+		@struct Stats
+		@brief  Latency statistics of a set of runs, in microseconds
+	**/
+	struct Stats
+	{
+		double mean = 0;
+		double p50 = 0;
+		double p99 = 0;
+		double min = 0;
+		double max = 0;
+	};
+
+	/**
+		@brief  Runs the given function the given number of times, timing every run
+		@param  iterations - Number of timed runs
+		@param  f          - The function to time
+		@retval            - The statistics of the runs
+	**/
+	template<typename F>
+	Stats measure(int iterations, F f)
+	{
+		std::vector<double> samples;
+		samples.reserve(iterations);
+
+		for (int i = 0; i < iterations; ++i)
+		{
+			auto begin = std::chrono::steady_clock::now();
+			f();
+			auto end = std::chrono::steady_clock::now();
+			samples.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+		}
+
+		Stats stats;
+		if (samples.empty()) return stats;
+
+		std::sort(samples.begin(), samples.end());
+		for (double s : samples) stats.mean += s;
+		stats.mean /= samples.size();
+		stats.p50 = samples[samples.size() / 2];
+		stats.p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+		stats.min = samples.front();
+		stats.max = samples.back();
+		return stats;
+	}
+
+	inline void print_header()
+	{
+		std::printf("%-40s %12s %12s %12s %12s %12s\n", "benchmark", "mean [us]", "p50 [us]", "p99 [us]", "min [us]", "max [us]");
+	}
+
+	inline void print(const std::string& name, const Stats& s)
+	{
+		std::printf("%-40s %12.1f %12.1f %12.1f %12.1f %12.1f\n", name.c_str(), s.mean, s.p50, s.p99, s.min, s.max);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+* Compares running N commands one after the other with Shell::execute against
+* starting all of them with Shell::execute_async and waiting for the futures.
+*
+* Usage: async_benchmark [--iterations N] [--commands N] [command args...]
+*   command      the program to run (default: sleep 0.05, i.e. a command dominated by its wait time)
+*/
+#include "Shell.h"
+#include "Bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = 5;
+	int commands = 100;
+	Shell::Argv command;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--commands") == 0 && i + 1 < argc)
+		{
+			commands = std::atoi(argv[++i]);
+		}
+		else
+		{
+			command.emplace_back(argv[i]);
+		}
+	}
+	if (command.empty())
+	{
+		command = { "sleep", "0.05" };
+	}
+
+	std::string line;
+	for (auto& arg : command) line += (line.empty() ? "" : " ") + arg;
+	std::cout << "command: " << line << "\ncommands per run: " << commands << "\n" << std::endl;
+
+	Shell shell;
+	int failures = 0;
+
+	bench::print_header();
+	auto sequential = bench::measure(iterations, [&]() {
+		for (int i = 0; i < commands; ++i)
+		{
+			if (shell.execute(command).exitCode != Shell::SUCCESS) ++failures;
+		}
+	});
+	bench::print("sequential execute", sequential);
+
+	auto concurrent = bench::measure(iterations, [&]() {
+		std::vector<std::future<Shell::Output>> results;
+		results.reserve(commands);
+		for (int i = 0; i < commands; ++i)
+		{
+			results.push_back(Shell::execute_async(command));
+		}
+		for (auto& result : results)
+		{
+			if (result.get().exitCode != Shell::SUCCESS) ++failures;
+		}
+	});
+	bench::print("execute_async + wait all", concurrent);
+
+	std::cout << "\nspeedup (mean): " << sequential.mean / concurrent.mean << "x" << std::endl;
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,175 @@
+/*
+* Measures how fast a CLI::Create template is serialized for many containers, each one
+* with its own name. The frozen builder serializes the options once, while the reference
+* builder reproduces the previous approach: the command string grown by appending temporaries
+* at every option, and the whole command and argument vector rebuilt at every call.
+*
+* Usage: builder_benchmark [--iterations N] [--containers N]
+*/
+#include "Docker.h"
+#include "Bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+namespace
+{
+	/*
+	* The previous serialization of Create, kept as a reference
+	*/
+	struct ReferenceCreate
+	{
+		std::string command = "docker create";
+		std::string image = "ubuntu:22.04";
+		std::string entrypoint = "sleep infinity";
+		std::string name;
+		docker::CLI::Create::Options options;
+
+		ReferenceCreate()
+		{
+			command += " -t";
+			options.tty = true;
+			command += " -w /home";
+			options.workdir = "/home";
+			for (int i = 0; i < 8; ++i)
+			{
+				std::string n = "VARIABLE_" + std::to_string(i);
+				std::string v = "value_" + std::to_string(i);
+				command += " -e " + n + "=\"" + v + "\"";
+				options.env.emplace_back(n, v);
+			}
+			for (int i = 0; i < 4; ++i)
+			{
+				command += " -p " + std::to_string(8000 + i);
+				command += ":" + std::to_string(80 + i);
+				command += "/tcp";
+				options.ports.push_back({ 8000 + i, 80 + i, docker::CLI::Create::TCP });
+			}
+			command += " --volume=\"/data:/data:ro\"";
+			options.binds.emplace_back("/data:/data:ro");
+			command += " --network host";
+			options.network = "host";
+		}
+
+		std::string str()
+		{
+			std::string exec = command;
+			exec += " --name=" + name;
+			exec += " --hostname=" + name;
+			exec += " " + image + " " + entrypoint;
+			return exec;
+		}
+
+		Shell::Argv argv()
+		{
+			Shell::Argv args{ "docker", "create" };
+			if (options.tty) args.emplace_back("-t");
+			args.emplace_back("-w");
+			args.emplace_back(options.workdir);
+			for (auto& port : options.ports)
+			{
+				args.emplace_back("-p");
+				args.emplace_back(std::to_string(port.host_port) + ":" + std::to_string(port.container_port) + "/tcp");
+			}
+			for (auto& [n, v] : options.env)
+			{
+				args.emplace_back("-e");
+				args.emplace_back(n + "=" + v);
+			}
+			for (auto& bind : options.binds)
+			{
+				args.emplace_back("--volume=" + bind);
+			}
+			args.emplace_back("--network");
+			args.emplace_back(options.network);
+			args.emplace_back("--name=" + name);
+			args.emplace_back("--hostname=" + name);
+			args.emplace_back(image);
+			docker::utils::split_string(entrypoint, ' ', [&args](std::string s) { if (!s.empty()) args.emplace_back(s); });
+			return args;
+		}
+	};
+
+	docker::CLI::Create make_template()
+	{
+		auto create = docker::CLI::Create("ubuntu:22.04").add_tty().workdir("/home");
+		for (int i = 0; i < 8; ++i)
+		{
+			create.set_env("VARIABLE_" + std::to_string(i), "value_" + std::to_string(i));
+		}
+		for (int i = 0; i < 4; ++i)
+		{
+			create.port_map(8000 + i, 80 + i, docker::CLI::Create::TCP);
+		}
+		create.volume_bind_mount("/data", "/data", docker::CLI::Create::RO);
+		create.network_driver(docker::CLI::Create::HOST);
+		std::string entrypoint = "sleep infinity";
+		create.set_entrypoint(entrypoint);
+		return create;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = 20;
+	int containers = 10000;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--containers") == 0 && i + 1 < argc)
+		{
+			containers = std::atoi(argv[++i]);
+		}
+	}
+
+	std::vector<std::string> names;
+	for (int i = 0; i < containers; ++i) names.push_back("container_" + std::to_string(i));
+
+	std::cout << "containers per run: " << containers << "\n" << std::endl;
+
+	size_t sink = 0;
+	ReferenceCreate reference;
+	auto frozen = make_template();
+
+	bench::print_header();
+
+	auto ref_build = bench::measure(iterations, [&]() {
+		for (int i = 0; i < containers; ++i) sink += ReferenceCreate().command.size();
+	});
+	bench::print("reference: build template", ref_build);
+	auto build = bench::measure(iterations, [&]() {
+		for (int i = 0; i < containers; ++i) sink += make_template().get_options().env.size();
+	});
+	bench::print("frozen: build template", build);
+
+	auto ref_str = bench::measure(iterations, [&]() {
+		for (auto& name : names) { reference.name = name; sink += reference.str().size(); }
+	});
+	bench::print("reference: str() per name", ref_str);
+	auto str = bench::measure(iterations, [&]() {
+		for (auto& name : names) { frozen.set_container_unique_name(name); sink += frozen.str().size(); }
+	});
+	bench::print("frozen: str() per name", str);
+
+	auto ref_argv = bench::measure(iterations, [&]() {
+		for (auto& name : names) { reference.name = name; sink += reference.argv().size(); }
+	});
+	bench::print("reference: argv() per name", ref_argv);
+	auto args = bench::measure(iterations, [&]() {
+		for (auto& name : names) { frozen.set_container_unique_name(name); sink += frozen.argv().size(); }
+	});
+	bench::print("frozen: argv() per name", args);
+
+	std::cout << "\nspeedup str(): " << ref_str.mean / str.mean << "x, argv(): " << ref_argv.mean / args.mean << "x"
+		<< " (" << sink << ")" << std::endl;
+
+	return 0;
+}
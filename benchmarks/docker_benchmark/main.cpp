@@ -0,0 +1,241 @@
+/*
+* End to end benchmark of the library against the stub docker executable (see stub_docker),
+* so that the results are reproducible and do not need a docker daemon. It measures:
+*   - the raw Shell::execute overhead, through bash and through posix_spawn
+*   - the latency of every CLI command, with the SHELL and SPAWN backends
+*   - the throughput of the Container lifecycle (create, start, status, stop, remove)
+*   - commands run in a container: one docker exec each, or through the exec sessions of Container::exec
+*   - the parsing of the docker outputs: typed inspect and registry / fleet refresh
+*   - the throughput of Container::follow_logs (stub only)
+*   - pulling a set of images one after the other and with ImagePuller (stub only)
+*
+* Usage: docker_benchmark [--iterations N] [--latency-ms N] [--output-bytes N] [--containers N] [--real-docker]
+*   --latency-ms N    time spent by the stub before answering (default 0, i.e. pure library and process overhead)
+*   --output-bytes N  extra payload in the inspect outputs (default 0)
+*   --containers N    containers listed by docker ps (default 1000)
+*   --real-docker     uses the docker of the PATH instead of the stub
+*/
+#include "Docker.h"
+#include "Bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifndef STUB_DOCKER_DIR
+	#define STUB_DOCKER_DIR "."
+#endif
+
+using namespace docker;
+
+
+namespace
+{
+	void set_variable(const char* name, const std::string& value)
+	{
+#ifdef _WIN32
+		::_putenv_s(name, value.c_str());
+#else
+		::setenv(name, value.c_str(), 1);
+#endif // _WIN32
+	}
+
+	void use_stub_docker()
+	{
+#ifdef _WIN32
+		const char separator = ';';
+#else
+		const char separator = ':';
+#endif // _WIN32
+		const char* path = std::getenv("PATH");
+		set_variable("PATH", std::string(STUB_DOCKER_DIR) + separator + (path ? path : ""));
+	}
+
+	int failures = 0;
+
+	void check(const Shell::Output& out, const char* what)
+	{
+		if (out.exitCode != Shell::SUCCESS)
+		{
+			if (failures++ < 10)
+			{
+				std::cerr << what << " failed: " << out.result << std::endl;
+			}
+		}
+	}
+
+	void bench_commands(const std::string& backend_name, int iterations)
+	{
+		auto run = [&](const std::string& name, CLI::I_Command&& command) {
+			bench::print(backend_name + " " + name, bench::measure(iterations, [&]() { check(command.execute(), name.c_str()); }));
+		};
+
+		CLI::Create create("ubuntu:22.04");
+		create.set_env("VARIABLE", "value").workdir("/home");
+		run("create", std::move(create));
+		run("start", CLI::Start("bench_container"));
+		run("stop", CLI::Stop("bench_container"));
+		run("kill", CLI::Kill("bench_container"));
+		run("pause", CLI::Pause("bench_container"));
+		run("unpause", CLI::Unpause("bench_container"));
+		run("remove", CLI::Remove("bench_container"));
+		run("inspect status", std::move(CLI::Inspect("bench_container").extract(CLI::Inspect::STATUS)));
+		run("images", CLI::Images());
+		run("ps", CLI::Ps());
+
+		CLI::Inspect inspect("bench_container");
+		CLI::InspectInfo info;
+		bench::print(backend_name + " inspect typed", bench::measure(iterations, [&]() {
+			check(inspect.execute_typed<CLI::InspectInfo::STATE | CLI::InspectInfo::PID>(info), "inspect typed");
+		}));
+	}
+
+	void bench_lifecycle(const std::string& name, Container::CachePolicy policy, int iterations)
+	{
+		int n = 0;
+		auto stats = bench::measure(iterations, [&]() {
+			Container container(CLI::Create("ubuntu:22.04"), "bench_lifecycle_" + std::to_string(n++));
+			container.set_cache_policy(policy);
+			check(container.exec_create(), "lifecycle create");
+			check(container.exec_start(), "lifecycle start");
+			container.get_status();
+			container.get_runtime_infos();
+			check(container.exec_stop(), "lifecycle stop");
+			check(container.exec_remove(), "lifecycle remove");
+		});
+		bench::print(name, stats);
+		std::cout << "         throughput: " << 1e6 / stats.mean << " containers/s" << std::endl;
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = 100;
+	std::string latency_ms = "0";
+	std::string output_bytes = "0";
+	std::string containers = "1000";
+	bool real_docker = false;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--latency-ms") == 0 && i + 1 < argc)
+		{
+			latency_ms = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--output-bytes") == 0 && i + 1 < argc)
+		{
+			output_bytes = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--containers") == 0 && i + 1 < argc)
+		{
+			containers = argv[++i];
+		}
+		else if (std::strcmp(argv[i], "--real-docker") == 0)
+		{
+			real_docker = true;
+		}
+	}
+
+	if (!real_docker)
+	{
+		use_stub_docker();
+		set_variable("DOCKER_STUB_LATENCY_MS", latency_ms);
+		set_variable("DOCKER_STUB_OUTPUT_BYTES", output_bytes);
+		set_variable("DOCKER_STUB_CONTAINERS", containers);
+	}
+
+	Shell shell;
+	Shell::Output version = shell.execute(Shell::Argv{ "docker", "--version" });
+	std::cout << "docker: " << version.result << "\n"
+		<< "iterations: " << iterations << "\nstub latency: " << latency_ms << " ms\nstub output: " << output_bytes
+		<< " bytes\nlisted containers: " << containers << "\n" << std::endl;
+	if (version.exitCode != Shell::SUCCESS)
+	{
+		std::cerr << "docker executable not found" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	bench::print_header();
+
+	// Shell overhead
+	bench::print("shell  bash -c", bench::measure(iterations, [&]() { check(shell.execute("docker --version"), "bash"); }));
+	bench::print("shell  posix_spawn", bench::measure(iterations, [&]() { check(shell.execute(Shell::Argv{ "docker", "--version" }), "spawn"); }));
+
+	// commands
+	set_backend(Backend::SHELL);
+	bench_commands("SHELL ", iterations);
+	set_backend(Backend::SPAWN);
+	bench_commands("SPAWN ", iterations);
+
+	// container lifecycle
+	bench_lifecycle("lifecycle EAGER", Container::CachePolicy::EAGER, iterations);
+	bench_lifecycle("lifecycle LAZY", Container::CachePolicy::LAZY, iterations);
+
+	// commands in a container
+	bench::print("exec   docker exec", bench::measure(iterations, [&]() { check(CLI::Exec("bench_container", "echo x").execute(), "exec"); }));
+	Container exec_container(CLI::Create("ubuntu:22.04"), "bench_container");
+	check(exec_container.exec("true"), "exec session open");
+	bench::print("exec   session", bench::measure(iterations * 10, [&]() { check(exec_container.exec("echo x"), "exec session"); }));
+
+	// output parsing, without process
+	std::string inspect_output = shell.execute(Shell::Argv{ "docker", "inspect", "bench_container" }).result;
+	CLI::InspectInfo info;
+	bench::print("parse  inspect STATE", bench::measure(iterations * 100, [&]() { info.parse<CLI::InspectInfo::STATE>(inspect_output); }));
+	bench::print("parse  inspect ALL", bench::measure(iterations * 100, [&]() { info.parse<CLI::InspectInfo::ALL>(inspect_output); }));
+
+	ContainerRegistry registry;
+	Fleet fleet;
+	int listed = std::atoi(containers.c_str());
+	for (int i = 0; i < listed; ++i)
+	{
+		std::string name = "stub_" + std::to_string(i);
+		registry.add(CLI::Create("ubuntu:22.04"), name);
+		fleet.add(name, "ubuntu:22.04");
+	}
+	bench::print("refresh registry (" + containers + ")", bench::measure(iterations, [&]() { check(registry.refresh(), "registry refresh"); }));
+	bench::print("refresh fleet (" + containers + ")", bench::measure(iterations, [&]() { check(fleet.refresh(), "fleet refresh"); }));
+
+	// logs ingestion: the stub prints lines of 80 bytes
+	if (!real_docker)
+	{
+		const size_t log_mb = 256;
+		set_variable("DOCKER_STUB_OUTPUT_BYTES", std::to_string(log_mb * 1024 * 1024));
+		uint64_t lines = 0;
+		auto follow = bench::measure(3, [&]() {
+			LogFollower follower = exec_container.follow_logs([&lines](const std::vector<LogLine>& batch) { lines += batch.size(); return true; });
+			check(follower.wait(), "follow logs");
+		});
+		bench::print("logs   follow " + std::to_string(log_mb) + " MB", follow);
+		std::cout << "         throughput: " << log_mb / (follow.mean / 1e6) << " MB/s" << std::endl;
+		set_variable("DOCKER_STUB_OUTPUT_BYTES", output_bytes);
+	}
+
+	// node warm-up: 8 images of 100 ms each
+	if (!real_docker)
+	{
+		std::vector<std::string> images;
+		for (int i = 0; i < 8; ++i) images.push_back("bench_image_" + std::to_string(i) + ":1.0");
+		set_variable("DOCKER_STUB_PULL_MS", "100");
+		bench::print("pull   8 images serial", bench::measure(3, [&]() {
+			for (auto& image : images) check(CLI::Pull(image).execute(), "pull");
+		}));
+		bench::print("pull   8 images ImagePuller(8)", bench::measure(3, [&]() {
+			ImagePuller puller(8);
+			for (auto& output : puller.pull_all(images)) check(output, "parallel pull");
+		}));
+		set_variable("DOCKER_STUB_PULL_MS", "0");
+	}
+
+	if (failures > 0)
+	{
+		std::cerr << failures << " failed commands" << std::endl;
+	}
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,68 @@
+/*
+* Measures the output throughput of Shell::execute with children writing
+* several MB on stdout and stderr at the same time, i.e. far more than a pipe buffer.
+* Each run checks that the whole output has been received.
+*
+* Usage: drain_benchmark [--iterations N] [--mb N]...
+*/
+#include "Shell.h"
+#include "Bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = 10;
+	std::vector<size_t> sizes_mb;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--mb") == 0 && i + 1 < argc)
+		{
+			sizes_mb.push_back(std::strtoull(argv[++i], nullptr, 10));
+		}
+	}
+	if (sizes_mb.empty())
+	{
+		sizes_mb = { 1, 8, 64 };
+	}
+
+	Shell shell;
+	int failures = 0;
+
+	bench::print_header();
+	for (size_t mb : sizes_mb)
+	{
+		size_t bytes = mb * 1024 * 1024;
+		std::string n = std::to_string(bytes);
+
+		// both streams are written concurrently by two processes
+		std::string script = "head -c " + n + " /dev/zero >&2 & head -c " + n + " /dev/zero; wait";
+
+		auto check = [&](const Shell::Output& out) {
+			if (out.exitCode != Shell::SUCCESS || out.result.size() != bytes)
+			{
+				++failures;
+				std::cerr << "unexpected output: exit " << out.exitCode << ", " << out.result.size() << " bytes instead of " << bytes << std::endl;
+			}
+		};
+
+		auto bash = bench::measure(iterations, [&]() { check(shell.execute(script)); });
+		bench::print("bash   " + std::to_string(mb) + " MB stdout + stderr", bash);
+		std::cout << "         throughput: " << (2.0 * mb) / (bash.mean / 1e6) << " MB/s" << std::endl;
+
+		auto spawn = bench::measure(iterations, [&]() { check(shell.execute(Shell::Argv{ "sh", "-c", script })); });
+		bench::print("spawn  " + std::to_string(mb) + " MB stdout + stderr", spawn);
+		std::cout << "         throughput: " << (2.0 * mb) / (spawn.mean / 1e6) << " MB/s" << std::endl;
+	}
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,100 @@
+/*
+* Counts the memory allocations and the bytes allocated per command, and the latency, of the
+* paths returning the output of a command:
+*   - execute()       a copy of the output in the returned Output
+*   - execute_view()  views of the buffers of the Shell object, reused by every execution
+* The allocations of the whole process are counted by replacing the global operator new.
+*
+* Usage: output_benchmark [--iterations N] [--bytes N]...
+*/
+#include "Shell.h"
+#include "Bench.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+	std::atomic<uint64_t> allocations{ 0 };
+	std::atomic<uint64_t> allocated_bytes{ 0 };
+}
+
+void* operator new(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = 200;
+	std::vector<size_t> sizes;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--bytes") == 0 && i + 1 < argc)
+		{
+			sizes.push_back(std::strtoull(argv[++i], nullptr, 10));
+		}
+	}
+	if (sizes.empty())
+	{
+		sizes = { 100, 64 * 1024, 1024 * 1024 };
+	}
+
+	Shell shell;
+	int failures = 0;
+
+	bench::print_header();
+	for (size_t bytes : sizes)
+	{
+		Shell::Argv command{ "head", "-c", std::to_string(bytes), "/dev/zero" };
+
+		auto run = [&](const std::string& name, auto execute) {
+			execute(); // warm up: buffers, caches and per thread state
+			uint64_t count = allocations;
+			uint64_t total = allocated_bytes;
+			bench::print(name + " " + std::to_string(bytes) + " B", bench::measure(iterations, execute));
+			std::cout << "         allocations per command: " << double(allocations - count) / iterations
+				<< ", bytes allocated per command: " << double(allocated_bytes - total) / iterations << std::endl;
+		};
+
+		run("execute     ", [&]() {
+			Shell::Output out = shell.execute(command);
+			if (out.exitCode != Shell::SUCCESS || out.result.size() != bytes) ++failures;
+		});
+		run("execute_view", [&]() {
+			Shell::View out = shell.execute_view(command);
+			if (out.exitCode != Shell::SUCCESS || out.out.size() != bytes) ++failures;
+		});
+	}
+
+	if (failures > 0)
+	{
+		std::cerr << failures << " unexpected outputs" << std::endl;
+	}
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,96 @@
+/*
+* Compares the latency of the bash execution path (fork + bash -c) with the
+* posix_spawn path that runs the argument vector directly.
+*
+* Usage: spawn_benchmark [--iterations N] [--rss-mb N] [--fork-server] [command args...]
+*   --rss-mb N     grows the benchmark process by N MB before measuring, to show how
+*                  the fork cost depends on the size of the calling process.
+*   --fork-server  starts the fork server while the process is still small, then measures both
+*                  paths through the server and again without it. Combine with --rss-mb.
+*   command      the program to run (default: docker --version if docker is in the PATH, uname -r otherwise)
+*/
+#include "Shell.h"
+#include "Bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+
+int main(int argc, char* argv[])
+{
+	int iterations = 200;
+	size_t rss_mb = 0;
+	bool fork_server = false;
+	Shell::Argv command;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (std::strcmp(argv[i], "--rss-mb") == 0 && i + 1 < argc)
+		{
+			rss_mb = std::strtoull(argv[++i], nullptr, 10);
+		}
+		else if (std::strcmp(argv[i], "--fork-server") == 0)
+		{
+			fork_server = true;
+		}
+		else
+		{
+			command.emplace_back(argv[i]);
+		}
+	}
+
+	if (command.empty())
+	{
+		if (Shell::prompt(Shell::Argv{ "docker", "--version" }).exitCode == Shell::SUCCESS)
+		{
+			command = { "docker", "--version" };
+		}
+		else
+		{
+			command = { "uname", "-r" };
+		}
+	}
+
+	// the server is a fork of the process: start it before the ballast
+	if (fork_server && !Shell::start_fork_server())
+	{
+		std::cerr << "the fork server could not be started" << std::endl;
+		return 1;
+	}
+
+	// touched memory, so that the page tables have to be copied by fork
+	std::vector<char> ballast(rss_mb * 1024 * 1024);
+	for (size_t i = 0; i < ballast.size(); i += 4096) ballast[i] = 1;
+
+	std::string line;
+	for (auto& arg : command) line += (line.empty() ? "" : " ") + arg;
+
+	std::cout << "command: " << line << "\niterations: " << iterations << "\nextra RSS: " << rss_mb << " MB\n" << std::endl;
+
+	Shell shell;
+	shell.execute(command); // warm up the executable cache
+
+	bench::print_header();
+	if (fork_server)
+	{
+		auto served_bash = bench::measure(iterations, [&]() { shell.execute(line); });
+		bench::print("bash -c, fork server", served_bash);
+		auto served_spawn = bench::measure(iterations, [&]() { shell.execute(command); });
+		bench::print("posix_spawn, fork server", served_spawn);
+		Shell::stop_fork_server();
+	}
+	auto bash = bench::measure(iterations, [&]() { shell.execute(line); });
+	bench::print("bash -c (fork + exec bash)", bash);
+	auto spawn = bench::measure(iterations, [&]() { shell.execute(command); });
+	bench::print("posix_spawn (argv)", spawn);
+
+	std::cout << "\nspeedup (mean): " << bash.mean / spawn.mean << "x" << std::endl;
+
+	return 0;
+}
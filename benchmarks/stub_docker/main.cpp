@@ -0,0 +1,316 @@
+/*
+* Stand-in for the docker CLI, used by the benchmarks to get reproducible results on
+* machines without a docker daemon. It answers the commands used by the library with
+* outputs shaped like the real ones.
+*
+* Environment:
+*   DOCKER_STUB_LATENCY_MS    time spent before answering (default 0)
+*   DOCKER_STUB_OUTPUT_BYTES  extra payload in inspect and logs outputs (default 0)
+*   DOCKER_STUB_CONTAINERS    number of containers listed by ps (default 100), named stub_0, stub_1, ...
+*   DOCKER_STUB_STATUS        status reported by inspect and ps (default running)
+*   DOCKER_STUB_PULL_MS       time spent by pull, spread over its layers (default 0)
+*   DOCKER_STUB_IMAGES        images listed by images in JSON, besides ubuntu:22.04 (default 0), named stub_image_0, ...
+*
+* docker exec runs the program on the host, in place of the stub.
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+
+namespace
+{
+	long env_number(const char* name, long fallback)
+	{
+		const char* value = std::getenv(name);
+		return value ? std::atol(value) : fallback;
+	}
+
+	std::string env_text(const char* name, const char* fallback)
+	{
+		const char* value = std::getenv(name);
+		return value ? value : fallback;
+	}
+
+	std::string container_id(const std::string& name)
+	{
+		// stable 64 hex digits per name
+		char id[65];
+		size_t h = std::hash<std::string>()(name);
+		for (int i = 0; i < 64; ++i)
+		{
+			h = h * 6364136223846793005ULL + 1442695040888963407ULL;
+			id[i] = "0123456789abcdef"[(h >> 60) & 0xF];
+		}
+		id[64] = '\0';
+		return id;
+	}
+
+	std::string inspect_json(const std::string& name, const std::string& status, size_t padding)
+	{
+		return "{\"Id\":\"" + container_id(name) + "\",\"Created\":\"2024-01-01T00:00:00.000000000Z\",\"Path\":\"sleep\",\"Args\":[\"infinity\"],"
+			"\"State\":{\"Status\":\"" + status + "\",\"Running\":" + (status == "running" ? "true" : "false") + ",\"Paused\":false,"
+			"\"Restarting\":false,\"OOMKilled\":false,\"Dead\":false,\"Pid\":4242,\"ExitCode\":0,\"Error\":\"\","
+			"\"StartedAt\":\"2024-01-01T00:00:01.000000000Z\",\"FinishedAt\":\"0001-01-01T00:00:00Z\"},"
+			"\"Image\":\"sha256:" + container_id("image") + "\",\"Name\":\"/" + name + "\",\"RestartCount\":0,"
+			"\"Mounts\":[{\"Type\":\"bind\",\"Source\":\"/data\",\"Destination\":\"/data\",\"Mode\":\"\",\"RW\":false,\"Propagation\":\"rprivate\"}],"
+			"\"Config\":{\"Hostname\":\"" + name + "\",\"Image\":\"ubuntu:22.04\",\"Env\":[\"PADDING=" + std::string(padding, 'x') + "\"]},"
+			"\"NetworkSettings\":{\"Networks\":{\"bridge\":{\"IPAddress\":\"172.17.0.2\",\"Gateway\":\"172.17.0.1\",\"MacAddress\":\"02:42:ac:11:00:02\"}}}}";
+	}
+
+	/**
+		@brief  Arguments that are not options, i.e. the container names
+	**/
+	std::vector<std::string> operands(int argc, char* argv[], int first)
+	{
+		std::vector<std::string> result;
+		for (int i = first; i < argc; ++i)
+		{
+			if (argv[i][0] == '-')
+			{
+				if (std::strcmp(argv[i], "--format") == 0 || std::strcmp(argv[i], "--filter") == 0) ++i;
+				continue;
+			}
+			result.emplace_back(argv[i]);
+		}
+		return result;
+	}
+
+	std::string option(int argc, char* argv[], const char* name)
+	{
+		for (int i = 1; i + 1 < argc; ++i)
+		{
+			if (std::strcmp(argv[i], name) == 0) return argv[i + 1];
+		}
+		return {};
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	long latency_ms = env_number("DOCKER_STUB_LATENCY_MS", 0);
+	size_t output_bytes = static_cast<size_t>(env_number("DOCKER_STUB_OUTPUT_BYTES", 0));
+	long containers = env_number("DOCKER_STUB_CONTAINERS", 100);
+	std::string status = env_text("DOCKER_STUB_STATUS", "running");
+
+	if (latency_ms > 0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(latency_ms));
+	}
+
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "Usage:  docker [OPTIONS] COMMAND\n");
+		return 1;
+	}
+
+	std::string command = argv[1];
+
+	if (command == "--version")
+	{
+		std::printf("Docker version 24.0.0-stub, build stub\n");
+	}
+	else if (command == "create" || command == "run")
+	{
+		// the container name is given as --name=NAME
+		std::string name = "stub";
+		for (int i = 2; i < argc; ++i)
+		{
+			if (std::strncmp(argv[i], "--name=", 7) == 0) name = argv[i] + 7;
+		}
+		std::printf("%s\n", container_id(name).c_str());
+	}
+	else if (command == "start" || command == "stop" || command == "kill" || command == "rm" || command == "pause" || command == "unpause")
+	{
+		for (auto& name : operands(argc, argv, 2))
+		{
+			std::printf("%s\n", name.c_str());
+		}
+	}
+	else if (command == "inspect")
+	{
+		std::string format = option(argc, argv, "--format");
+		auto names = operands(argc, argv, 2);
+		if (format.find("State.Status") != std::string::npos)
+		{
+			for (size_t i = 0; i < names.size(); ++i) std::printf("%s\n", status.c_str());
+		}
+		else if (format.find(".Id") != std::string::npos)
+		{
+			for (auto& name : names) std::printf("%s\n", container_id(name).c_str());
+		}
+		else if (format.find("Config.Image") != std::string::npos)
+		{
+			for (size_t i = 0; i < names.size(); ++i) std::printf("ubuntu:22.04\n");
+		}
+		else
+		{
+			std::string out = "[";
+			for (auto& name : names)
+			{
+				out += (out.size() > 1 ? "," : "") + inspect_json(name, status, output_bytes);
+			}
+			std::printf("%s]\n", out.c_str());
+		}
+	}
+	else if (command == "ps")
+	{
+		std::string out;
+		for (long i = 0; i < containers; ++i)
+		{
+			std::string name = "stub_" + std::to_string(i);
+			out += "{\"Command\":\"\\\"sleep infinity\\\"\",\"CreatedAt\":\"2024-01-01 00:00:00 +0000 UTC\",\"ID\":\"" + container_id(name)
+				+ "\",\"Image\":\"ubuntu:22.04\",\"Labels\":\"\",\"Names\":\"" + name + "\",\"State\":\"" + status + "\",\"Status\":\"Up 1 hour\"}\n";
+		}
+		std::fwrite(out.data(), 1, out.size(), stdout);
+	}
+	else if (command == "images")
+	{
+		if (option(argc, argv, "--format").find("json") == std::string::npos)
+		{
+			std::printf("REPOSITORY   TAG       IMAGE ID       CREATED       SIZE\n");
+			std::printf("ubuntu       22.04     %.12s   2 weeks ago   77.8MB\n", container_id("image").c_str());
+			return 0;
+		}
+
+		// ubuntu:22.04 and stub_image_N:latest, restricted to the repository:tag given by the reference filters
+		std::vector<std::string> references;
+		for (int i = 2; i + 1 < argc; ++i)
+		{
+			if (std::strcmp(argv[i], "--filter") == 0 && std::strncmp(argv[i + 1], "reference=", 10) == 0) references.emplace_back(argv[i + 1] + 10);
+		}
+		std::vector<std::pair<std::string, std::string>> images = { { "ubuntu", "22.04" } };
+		for (long i = 0; i < env_number("DOCKER_STUB_IMAGES", 0); ++i)
+		{
+			images.emplace_back("stub_image_" + std::to_string(i), "latest");
+		}
+
+		std::string out;
+		for (auto& image : images)
+		{
+			std::string reference = image.first + ":" + image.second;
+			if (!references.empty() && std::find(references.begin(), references.end(), reference) == references.end())
+			{
+				continue;
+			}
+			std::string id = container_id(image.first == "ubuntu" ? "image" : reference);
+			out += "{\"Containers\":\"N/A\",\"CreatedAt\":\"2024-01-01 00:00:00 +0000 UTC\",\"CreatedSince\":\"2 weeks ago\","
+				"\"Digest\":\"sha256:" + container_id(reference + "@") + "\",\"ID\":\"sha256:" + id + "\",\"Repository\":\"" + image.first
+				+ "\",\"SharedSize\":\"N/A\",\"Size\":\"77.8MB\",\"Tag\":\"" + image.second + "\",\"UniqueSize\":\"N/A\",\"VirtualSize\":\"77.8MB\"}\n";
+		}
+		std::fwrite(out.data(), 1, out.size(), stdout);
+	}
+	else if (command == "pull")
+	{
+		// three layers, each printing the steps of a real pull; the references starting with missing do not exist
+		auto names = operands(argc, argv, 2);
+		std::string reference = names.empty() ? "" : names.back();
+		if (reference.compare(0, 7, "missing") == 0)
+		{
+			std::fprintf(stderr, "Error response from daemon: pull access denied for %s, repository does not exist\n", reference.c_str());
+			return 1;
+		}
+		size_t colon = reference.rfind(':');
+		std::string repository = colon == std::string::npos ? reference : reference.substr(0, colon);
+		std::string tag = colon == std::string::npos ? "latest" : reference.substr(colon + 1);
+		long step_ms = env_number("DOCKER_STUB_PULL_MS", 0) / 3;
+
+		std::printf("%s: Pulling from library/%s\n", tag.c_str(), repository.c_str());
+		std::string layers[3];
+		for (int l = 0; l < 3; ++l)
+		{
+			layers[l] = container_id(reference + std::to_string(l)).substr(0, 12);
+			std::printf("%s: Pulling fs layer\n", layers[l].c_str());
+		}
+		for (auto& layer : layers)
+		{
+			std::fflush(stdout);
+			std::this_thread::sleep_for(std::chrono::milliseconds(step_ms));
+			std::printf("%s: Downloading [=========================>                         ]  14.7MB/29.5MB\n", layer.c_str());
+			std::printf("%s: Download complete\n%s: Pull complete\n", layer.c_str(), layer.c_str());
+		}
+		std::printf("Digest: sha256:%s\n", container_id(reference + "@").c_str());
+		std::printf("Status: Downloaded newer image for %s:%s\n", repository.c_str(), tag.c_str());
+		std::printf("docker.io/library/%s:%s\n", repository.c_str(), tag.c_str());
+	}
+	else if (command == "exec")
+	{
+		int first = 2;
+		while (first < argc && argv[first][0] == '-')
+		{
+			if (std::strcmp(argv[first], "--user") == 0 || std::strcmp(argv[first], "-u") == 0
+				|| std::strcmp(argv[first], "--workdir") == 0 || std::strcmp(argv[first], "-w") == 0
+				|| std::strcmp(argv[first], "--env") == 0 || std::strcmp(argv[first], "-e") == 0) ++first;
+			++first;
+		}
+		if (first + 1 >= argc)
+		{
+			std::fprintf(stderr, "\"docker exec\" requires at least 2 arguments.\n");
+			return 1;
+		}
+		if (status != "running")
+		{
+			std::fprintf(stderr, "Error response from daemon: container %s is not running\n", container_id(argv[first]).c_str());
+			return 1;
+		}
+		::execvp(argv[first + 1], argv + first + 1);
+		std::perror("exec");
+		return 126;
+	}
+	else if (command == "stats")
+	{
+		// usage drifting with time, so that consecutive samples differ
+		auto names = operands(argc, argv, 2);
+		if (names.empty() && status == "running")
+		{
+			for (long i = 0; i < containers; ++i) names.push_back("stub_" + std::to_string(i));
+		}
+		long long tick = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count() / 100;
+		std::string out;
+		char line[512];
+		for (size_t i = 0; i < names.size(); ++i)
+		{
+			long long t = tick + static_cast<long long>(i) * 7;
+			std::snprintf(line, sizeof(line),
+				"{\"BlockIO\":\"%.3gMB / 0B\",\"CPUPerc\":\"%.2f%%\",\"Container\":\"%s\",\"ID\":\"%s\",\"MemPerc\":\"%.2f%%\","
+				"\"MemUsage\":\"%.4gMiB / 7.667GiB\",\"Name\":\"%s\",\"NetIO\":\"%.3gkB / 0B\",\"PIDs\":\"%lld\"}\n",
+				static_cast<double>(t % 1000) / 10.0, static_cast<double>(t % 400) / 4.0, names[i].c_str(), container_id(names[i]).c_str(),
+				static_cast<double>(t % 50) / 10.0, 3.5 + static_cast<double>(t % 64), names[i].c_str(),
+				static_cast<double>(tick % 100000) / 10.0, 1 + t % 4);
+			out += line;
+		}
+		std::fwrite(out.data(), 1, out.size(), stdout);
+	}
+	else if (command == "logs")
+	{
+		// lines of 80 bytes, written 1 MB at a time
+		bool timestamps = false;
+		for (int i = 2; i < argc; ++i) timestamps = timestamps || std::strcmp(argv[i], "--timestamps") == 0 || std::strcmp(argv[i], "-t") == 0;
+		std::string line = timestamps ? "2024-01-01T00:00:00.000000000Z " : "";
+		line.append(80 - line.size() - 1, 'x').push_back('\n');
+
+		std::string chunk;
+		while (chunk.size() + line.size() <= 1024 * 1024) chunk += line;
+		for (size_t written = 0; written < output_bytes;)
+		{
+			size_t n = std::min(chunk.size(), output_bytes - written);
+			std::fwrite(chunk.data(), 1, n, stdout);
+			written += n;
+		}
+	}
+	else
+	{
+		std::fprintf(stderr, "docker: '%s' is not a docker command.\n", command.c_str());
+		return 1;
+	}
+
+	return 0;
+}
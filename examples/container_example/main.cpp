@@ -68,9 +68,12 @@ int main(int, char* [])
 
 		if (strings.front() == "inspect")
 		{
-			std::cout << CLI::Inspect(test_container.get_runtime_infos().name).extract(CLI::Inspect::Extract::ID).execute().result << "\n"
-				<< CLI::Inspect(test_container.get_runtime_infos().name).extract(CLI::Inspect::Extract::IMAGE_ID).execute().result << "\n"
-				<< CLI::Inspect(test_container.get_runtime_infos().name).extract(CLI::Inspect::Extract::STATUS).execute().result << std::endl;
+			// a single inspect for all the fields
+			CLI::InspectInfo info;
+			CLI::Inspect(test_container.get_runtime_infos().name).execute_typed<CLI::InspectInfo::STATE | CLI::InspectInfo::IMAGE>(info);
+			std::cout << info.id << "\n"
+				<< info.image << "\n"
+				<< info.status << std::endl;
 		}
 
 		if (strings.front() == "start")
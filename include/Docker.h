@@ -17,17 +17,66 @@
 #endif
 
 #include "Shell.h"
+#include "Metrics.h"
 #include <string>
 #include <array>
+#include <chrono>
 #include <memory>
 #include <iostream>
 #include <sstream>
 #include <functional>
+#include <future>
 #include <list>
+#include <vector>
+#include <initializer_list>
+#include <optional>
 #include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <string_view>
+#include <unordered_map>
 
 namespace docker
 {
+	/**
+		@enum  docker::Backend
+		@brief Selects how the CLI commands reach the docker engine.
+			   SHELL:      every command is run as a docker CLI invocation through the system shell (default).
+			   SPAWN:      every command is run as a docker CLI invocation launched directly with posix_spawn from its
+			               argument vector. No shell is involved and the docker binary is resolved only once. Option
+			               values are passed verbatim, i.e. they are not expanded by a shell.
+			   ENGINE_API: commands are sent as HTTP/1.1 requests to the Docker Engine API over its unix socket,
+			               reusing keep-alive connections. No process is spawned. Option values are passed
+			               verbatim, i.e. they are not expanded by a shell.
+			   COPROCESS:  every command is run as a docker CLI invocation through long lived bash coprocesses
+			               (see Shell::execute_coprocess), saving the start of a new bash at every command.
+			               Streamed and asynchronous commands go through the system shell.
+	**/
+	enum class Backend
+	{
+		SHELL,
+		SPAWN,
+		ENGINE_API,
+		COPROCESS,
+	};
+
+	/**
+		@brief Select the backend used by all the CLI commands (and thus by the Container objects).
+		@param backend     - The backend to use
+		@param socket_path - Path of the docker engine unix socket, used only by the ENGINE_API backend. When not given
+		                     the socket in use is kept (/var/run/docker.sock unless changed).
+	**/
+	DOCKERAPI void set_backend(Backend backend, std::optional<std::string> socket_path = std::nullopt);
+
+	/**
+		@brief  Get the currently selected backend
+		@retval  - The backend in use
+	**/
+	DOCKERAPI Backend get_backend();
+
 	namespace CLI
 	{
 		/**
@@ -36,6 +85,47 @@ namespace docker
 		**/
 		DOCKERAPI Shell::Output destroy_all_containers();
 
+		/**
+			@brief  The outputs of a bulk operation: one per container, in the same order as the given containers
+		**/
+		typedef std::vector<std::pair<std::string, Shell::Output>> BulkOutput;
+
+		enum class BulkAction
+		{
+			START, STOP, KILL, REMOVE, FORCE_REMOVE,
+		};
+
+		/**
+			@struct BulkLimits
+			@brief  Bounds of a bulk operation, applied to each docker invocation (or request) as I_Command::set_timeout and
+			        I_Command::set_cancel_token do
+		**/
+		struct BulkLimits
+		{
+			std::chrono::milliseconds			timeout{ 0 };	// zero for no limit
+			std::optional<Shell::CancelToken>	cancel_token;
+		};
+
+		/**
+			@brief  Applies the same action to many containers.
+			        Containers are passed to a few multi-argument docker invocations, each one well below ARG_MAX, run in parallel.
+					With the ENGINE_API backend the requests are sent in parallel over several connections.
+					Each invocation is recorded in the docker_command metrics series of its subcommand.
+			@param  action      - What to do with the containers
+			@param  containers  - Names or IDs of the containers
+			@param  parallelism - Maximum number of docker invocations (or requests) running at the same time
+			@param  limits      - Timeout and cancellation token of each invocation
+			@retval             - The output of each container: its name on success, the docker error otherwise. A container
+			                      of an invocation that timed out or was cancelled gets TIMEOUT or CANCELLED, unless docker
+								  reported it done before.
+		**/
+		DOCKERAPI BulkOutput bulk(BulkAction action, const std::vector<std::string>& containers, size_t parallelism = 4, const BulkLimits& limits = {});
+
+		inline BulkOutput bulk_start(const std::vector<std::string>& containers)	{ return bulk(BulkAction::START, containers); }
+		inline BulkOutput bulk_stop(const std::vector<std::string>& containers)	{ return bulk(BulkAction::STOP, containers); }
+		inline BulkOutput bulk_kill(const std::vector<std::string>& containers)	{ return bulk(BulkAction::KILL, containers); }
+		inline BulkOutput bulk_remove(const std::vector<std::string>& containers, bool force = false) { return bulk(force ? BulkAction::FORCE_REMOVE : BulkAction::REMOVE, containers); }
+
 		/**
 
 			@class   I_Command
@@ -59,15 +149,100 @@ namespace docker
 			virtual std::string str();
 
 			/**
-				@brief  Executes the command through the shell interface
+				@brief  Get the currently constructed command as an argument vector, ready to be executed without a shell
+				@retval  - The docker executable followed by its arguments
+			**/
+			virtual Shell::Argv argv();
+
+			/**
+				@brief  Executes the command through the selected backend (see docker::set_backend)
 				@retval  - Command execution exit status and standard output result
 			**/
 			virtual Shell::Output execute();
 
+			/**
+				@brief  Executes the command delivering its output to the callback while it runs, e.g. for docker logs -f or docker events.
+				        The ENGINE_API backend streams through the docker CLI.
+				@param  callback - Receives the output lines (or chunks). Return false to stop the command
+				@param  framing  - Deliver whole lines or raw chunks
+				@retval          - The handle to wait for or cancel the command
+			**/
+			virtual Shell::Stream stream(Shell::StreamCallback callback, Shell::Framing framing = Shell::LINES);
+
+			/**
+				@brief  Starts the command and returns without waiting for it, so that many commands can run at once.
+				        The ENGINE_API backend performs the request on a pool of worker threads, queued while all of them
+						are busy, within the timeout and the cancellation token of the command.
+				@retval  - The exit status and output, available once the command has ended
+			**/
+			std::future<Shell::Output> execute_async();
+
+			/**
+				@brief  As execute_async() but the result is delivered to the callback. The callback runs on the
+				        shell reactor thread (the worker thread with the ENGINE_API backend): keep it short and do not
+						wait on other commands inside it.
+				@param  on_complete - Receives the exit status and output of the command
+			**/
+			void execute_async(Shell::Completion on_complete);
+
 			/**
 				@brief Erases all the added command options to reset the command to the basic one
 			**/
 			virtual void reset_command_options() {};
+
+			/**
+				@brief  Bounds the duration of execute(): once expired the docker invocation is killed (the Engine API
+				        request abandoned) and the output has the TIMEOUT status. Streamed executions, and the
+						asynchronous ones through the docker CLI, are not bounded.
+				@param  timeout - The maximum duration, zero for no limit (default)
+				@retval         - The command itself
+			**/
+			I_Command& set_timeout(std::chrono::milliseconds timeout);
+
+			/**
+				@brief  Makes execute() cancellable through the token: the output then has the CANCELLED status
+				@retval  - The command itself
+			**/
+			I_Command& set_cancel_token(Shell::CancelToken token);
+
+		protected:
+			/**
+				@brief  Gives the timeout and the cancellation token of this command to another one, executed on its behalf
+			**/
+			void limit(I_Command& other) const;
+
+			/**
+				@brief  Executes the command as a Docker Engine API request. Commands without an API 
+				        equivalent fall back to the shell execution.
+				@retval  - Exit code and the same output the docker CLI would have printed
+			**/
+			virtual Shell::Output execute_api();
+
+			/**
+				@brief  A copy of the command, run by execute_async on a worker thread once the caller's object may be gone
+			**/
+			virtual std::unique_ptr<I_Command> clone() const { return std::make_unique<I_Command>(*this); }
+
+			/**
+				@brief  Get the key of the docker_command series of this command, labelled with the docker subcommand
+			**/
+			Metrics::Key metrics_key();
+
+		private:
+			/**
+				@brief  Executes the Engine API request within the timeout and the cancellation token of the command
+				@param  begin - When the execution started, the origin of the timeout
+			**/
+			Shell::Output execute_api_limited(Metrics::Clock::time_point begin);
+
+			/**
+				@brief  The Engine API request of execute_async, recording its metrics, on a copy of the command
+			**/
+			std::function<Shell::Output()> api_task();
+
+			std::optional<Metrics::Key> _metrics_key;
+			std::chrono::milliseconds _timeout{ 0 };
+			std::optional<Shell::CancelToken> _cancel_token;
 		};
 
 		/**
@@ -124,16 +299,16 @@ namespace docker
 			std::string get_entrypoint() { return _entrypoint; }
 
 			/**
-				@brief  Executes the docker command with all the added options 
-				@retval  - Exit code and standard output resulting from the command execution
+				@brief  Get the current composed command
+				@retval  - 
 			**/
-			Shell::Output execute() override;
+			std::string str() override;
 
 			/**
-				@brief  Get the current composed command
+				@brief  Get the current composed command as an argument vector
 				@retval  - 
 			**/
-			std::string str() override;
+			Shell::Argv argv() override;
 
 			/**
 				@brief  Option to make docker engine delete the container when this will be stopped or killed.
@@ -247,11 +422,73 @@ namespace docker
 			**/
 			Create& network_driver(NetworkDriver network_driver); // TODO: add options like the ip , mac address and other stuff (see docker documentation)
 
+			/**
+				@struct Options
+				@brief  The options added to the command, kept in structured form so that they
+				        can be translated to the Engine API container configuration.
+			**/
+			struct Options
+			{
+				struct PortMap
+				{
+					int host_port;
+					int container_port;
+					NetworkProtocol protocol;
+				};
+
+				bool remove_at_exit = false;
+				bool tty = false;
+				bool nvidia_gpus = false;
+				std::string workdir;
+				std::string network;
+				std::vector<std::pair<std::string, std::string>> dns_entries;
+				std::vector<std::pair<std::string, std::string>> env;
+				std::vector<PortMap> ports;
+				std::vector<std::string> devices;
+				std::vector<std::string> binds; // source:destination[:mode]
+			};
+
+			/**
+				@brief  Get the options added so far
+				@retval  - The structured options
+			**/
+			const Options& get_options() const { return _options; }
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Create>(*this); }
+
+			/**
+				@brief  Sends the create request to the engine
+				@param  id - Filled with the ID of the created container
+				@retval    - Exit code and standard output (the ID or the daemon error)
+			**/
+			Shell::Output create_api(std::string& id);
+
+			/**
+				@brief  Builds the argument vector of the given docker subcommand followed by the options, the image and the entrypoint
+				@param  subcommand - create or run
+				@param  flags      - Subcommand specific flags, put right after the subcommand
+			**/
+			Shell::Argv build_argv(const char* subcommand, std::initializer_list<const char*> flags);
+
 		private:
+			/**
+				@brief  Serializes the options once, in both the shell and the argument vector forms. 
+				        Name, image and entrypoint are not part of it: they are applied on top at every str()/argv().
+			**/
+			void freeze();
+
 			std::string _image_name_or_ID;
 			std::string _entrypoint;
 			std::string _container_name;
 			NetworkDriver _network_driver;
+			Options _options;
+
+			// serialized options, valid until an option changes
+			bool _frozen = false;
+			std::string _frozen_str;
+			Shell::Argv _frozen_args;
 		};
 
 		/**
@@ -277,6 +514,15 @@ namespace docker
 				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
 			**/
 			Run& detached();
+
+			Shell::Argv argv() override;
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Run>(*this); }
+
+		private:
+			bool _detached = false;
 		};
 
 		/**
@@ -300,10 +546,16 @@ namespace docker
 			~Start();
 
 			/**
-				@brief  Executes the docker command.
-				@retval  - Exit code and standard output resulting from the command execution.
+				@brief  Get the current composed command
+				@retval  - 
+			**/
+			std::string str() override;
+
+			/**
+				@brief  Get the current composed command as an argument vector
+				@retval  - 
 			**/
-			Shell::Output execute() override;
+			Shell::Argv argv() override;
 
 			/**
 				@brief  Set a new container name or ID to start.
@@ -311,6 +563,10 @@ namespace docker
 				@retval                      - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
 			**/
 			Start& change_contianer_to_start(std::string container_name_or_ID);
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Start>(*this); }
 		};
 
 		/**
@@ -332,10 +588,16 @@ namespace docker
 			~Stop();
 
 			/**
-				@brief  Executes the docker command.
-				@retval  - Exit code and standard output resulting from the command execution.
+				@brief  Get the current composed command
+				@retval  - 
+			**/
+			std::string str() override;
+
+			/**
+				@brief  Get the current composed command as an argument vector
+				@retval  - 
 			**/
-			Shell::Output execute() override;
+			Shell::Argv argv() override;
 
 			/**
 				@brief  Set a new container name or ID to stop.
@@ -343,6 +605,10 @@ namespace docker
 				@retval                      - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
 			**/
 			Stop& change_contianer_to_stop(std::string container_name_or_ID);
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Stop>(*this); }
 		};
 
 		/**
@@ -365,10 +631,16 @@ namespace docker
 			~Kill();
 
 			/**
-				@brief  Executes the docker command.
-				@retval  - Exit code and standard output resulting from the command execution.
+				@brief  Get the current composed command
+				@retval  - 
+			**/
+			std::string str() override;
+
+			/**
+				@brief  Get the current composed command as an argument vector
+				@retval  - 
 			**/
-			Shell::Output execute() override;
+			Shell::Argv argv() override;
 
 			/**
 				@brief  Set a new container name or ID to kill.
@@ -376,6 +648,80 @@ namespace docker
 				@retval                      - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
 			**/
 			Kill& change_contianer_to_kill(std::string container_name_or_ID);
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Kill>(*this); }
+		};
+
+		/**
+
+			@class   Pause
+			@brief   Docker Pause command. Suspends all the processes of a running container.
+			@details ~ After a succesfull execution, the container will be in "paused" state.
+
+		**/
+		class DOCKERAPI Pause : public I_Command
+		{
+			std::string _container;
+		public:
+			/**
+				@brief Construct the command giving the container name/ID to pause.
+				@param container_name_or_ID - The assigned unique name or ID of the docker container.
+			**/
+			Pause(std::string container_name_or_ID);
+			~Pause();
+
+			/**
+				@brief  Get the current composed command
+				@retval  - 
+			**/
+			std::string str() override;
+
+			/**
+				@brief  Get the current composed command as an argument vector
+				@retval  - 
+			**/
+			Shell::Argv argv() override;
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Pause>(*this); }
+		};
+
+		/**
+
+			@class   Unpause
+			@brief   Docker Unpause command. Resumes all the processes of a paused container.
+			@details ~ After a succesfull execution, the container will be in "running" state.
+
+		**/
+		class DOCKERAPI Unpause : public I_Command
+		{
+			std::string _container;
+		public:
+			/**
+				@brief Construct the command giving the container name/ID to unpause.
+				@param container_name_or_ID - The assigned unique name or ID of the docker container.
+			**/
+			Unpause(std::string container_name_or_ID);
+			~Unpause();
+
+			/**
+				@brief  Get the current composed command
+				@retval  - 
+			**/
+			std::string str() override;
+
+			/**
+				@brief  Get the current composed command as an argument vector
+				@retval  - 
+			**/
+			Shell::Argv argv() override;
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Unpause>(*this); }
 		};
 
 		/**
@@ -389,6 +735,7 @@ namespace docker
 		class DOCKERAPI Remove : public I_Command
 		{
 			std::string _container;
+			bool _force = false;
 		public:
 
 			/**
@@ -399,10 +746,16 @@ namespace docker
 			~Remove();
 
 			/**
-				@brief  Executes the docker command.
-				@retval  - Exit code and standard output resulting from the command execution.
+				@brief  Get the current composed command
+				@retval  - 
+			**/
+			std::string str() override;
+
+			/**
+				@brief  Get the current composed command as an argument vector
+				@retval  - 
 			**/
-			Shell::Output execute() override;
+			Shell::Argv argv() override;
 
 			/**
 				@brief  Add this option to brutally destroy the container.
@@ -416,6 +769,10 @@ namespace docker
 				@retval                      - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
 			**/
 			Remove& change_contianer_to_remove(std::string container_name_or_ID);
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Remove>(*this); }
 		};
 
 		/**
@@ -458,17 +815,109 @@ namespace docker
 			
 			enum Extract
 			{
-				ID, NAME, TAG,
+				ID, NAME, TAG, JSON,
 			};
 			/**
 				@brief  Clean the output result extracting one of the informations selected from the enum
 						ID - gets the ID of the image
 						NAME - gets the repository name
 						TAG - gest the tag
+						JSON - gets a line of JSON for each repository:tag of each image, with the full ID, the digest and
+						       the size (docker images --no-trunc --digests --format '{{json .}}')
 				@param  ext - What to extract
 				@retval     - The instance of the command object itself. This way you can pipeline a multiple filters and extractions and then execute.
 			**/
 			Images& extract(Extract ext);
+
+			Shell::Argv argv() override;
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Images>(*this); }
+
+		private:
+			std::vector<std::string> _references;
+			std::optional<Extract> _extract;
+		};
+
+		/**
+
+			@struct  InspectInfo
+			@brief   The container informations decoded from a docker inspect.
+			@details ~ ID and name are always decoded. The other fields are decoded only if selected at compile time
+			         through the Fields mask of parse() and Inspect::execute_typed(), e.g. STATE | EXIT_CODE.
+
+		**/
+		struct DOCKERAPI InspectInfo
+		{
+			enum Field : unsigned
+			{
+				STATE			= 1 << 0,	// status
+				EXIT_CODE		= 1 << 1,
+				PID				= 1 << 2,
+				TIMES			= 1 << 3,	// started_at, finished_at
+				HEALTH			= 1 << 4,
+				IMAGE			= 1 << 5,	// image, image_id
+				MOUNTS			= 1 << 6,
+				NETWORKS		= 1 << 7,
+				RESTART_COUNT	= 1 << 8,
+				ALL				= (1 << 9) - 1,
+			};
+
+			struct Mount
+			{
+				std::string type;
+				std::string name;
+				std::string source;
+				std::string destination;
+				bool		read_only = false;
+			};
+
+			struct Network
+			{
+				std::string name;
+				std::string ip_address;
+				std::string gateway;
+				std::string mac_address;
+			};
+
+			std::string id;
+			std::string name;
+			std::string status;
+			int			exit_code = 0;
+			int			pid = 0;
+			std::string started_at;
+			std::string finished_at;
+			std::string health;				// empty if the container has no health check
+			std::string image;				// as given to docker create
+			std::string image_id;
+			std::vector<Mount> mounts;
+			std::vector<Network> networks;
+			int			restart_count = 0;
+
+			/**
+				@brief  Decodes the output of docker inspect (a single container). The document is scanned once.
+				@param  inspect_output - The JSON printed by docker inspect
+				@retval                - False if the output is not an inspect of a container
+			**/
+			template<unsigned Fields = ALL>
+			bool parse(std::string_view inspect_output);
+
+		private:
+			/*
+			* Raw text of the values of interest, located in one pass
+			*/
+			struct Raw
+			{
+				std::string_view id, name, status, exit_code, pid, started_at, finished_at, health;
+				std::string_view image, image_id, mounts, networks, restart_count;
+			};
+
+			static bool locate(std::string_view inspect_output, Raw& raw);
+			static std::string text(std::string_view raw);
+			static long long integer(std::string_view raw);
+			void parse_mounts(std::string_view raw);
+			void parse_networks(std::string_view raw);
 		};
 
 		/**
@@ -505,6 +954,114 @@ namespace docker
 				@retval     - The instance of the command object itself. This way you can pipeline the call to the execute.
 			**/
 			Inspect& extract(Extract ext);
+
+			/**
+				@brief  Runs a single docker inspect (whatever the extract option) and decodes the selected fields
+				@param  info - Filled with the decoded informations
+				@retval      - Exit code and standard output resulting from the command execution.
+			**/
+			template<unsigned Fields = InspectInfo::ALL>
+			Shell::Output execute_typed(InspectInfo& info);
+
+			Shell::Argv argv() override;
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Inspect>(*this); }
+
+		private:
+			std::optional<Extract> _extract;
+		};
+
+		template<unsigned Fields>
+		bool InspectInfo::parse(std::string_view inspect_output)
+		{
+			Raw raw;
+			if (!locate(inspect_output, raw))
+			{
+				return false;
+			}
+
+			id = text(raw.id);
+			name = text(raw.name);
+			if (!name.empty() && name.front() == '/') name.erase(0, 1);
+
+			if constexpr ((Fields & STATE) != 0)		status = text(raw.status);
+			if constexpr ((Fields & EXIT_CODE) != 0)	exit_code = static_cast<int>(integer(raw.exit_code));
+			if constexpr ((Fields & PID) != 0)			pid = static_cast<int>(integer(raw.pid));
+			if constexpr ((Fields & TIMES) != 0)
+			{
+				started_at = text(raw.started_at);
+				finished_at = text(raw.finished_at);
+			}
+			if constexpr ((Fields & HEALTH) != 0)		health = text(raw.health);
+			if constexpr ((Fields & IMAGE) != 0)
+			{
+				image = text(raw.image);
+				image_id = text(raw.image_id);
+			}
+			if constexpr ((Fields & MOUNTS) != 0)		parse_mounts(raw.mounts);
+			if constexpr ((Fields & NETWORKS) != 0)		parse_networks(raw.networks);
+			if constexpr ((Fields & RESTART_COUNT) != 0)	restart_count = static_cast<int>(integer(raw.restart_count));
+
+			return true;
+		}
+
+		template<unsigned Fields>
+		Shell::Output Inspect::execute_typed(InspectInfo& info)
+		{
+			Inspect inspect(_container);
+			limit(inspect);
+			Shell::Output ret = inspect.execute();
+			if (ret.exitCode == Shell::SUCCESS && !info.parse<Fields>(ret.result))
+			{
+				ret.exitCode = Shell::FAIL;
+			}
+			return ret;
+		}
+
+		/**
+
+			@class   Ps
+			@brief   Docker Ps command listing all the containers, running or not.
+			@details ~ Every container is printed as a line of JSON with (at least) the ID, Names, Image and State fields.
+			         IDs are not truncated.
+
+		**/
+		class DOCKERAPI Ps : public I_Command
+		{
+		public:
+			Ps();
+			~Ps();
+
+			Shell::Argv argv() override;
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Ps>(*this); }
+		};
+
+		/**
+
+			@class   Events
+			@brief   Docker Events command, restricted to the events of a type of objects (the containers by default).
+			@details ~ The command does not end by itself: use it with stream(). Every event is printed as a line of JSON.
+
+		**/
+		class DOCKERAPI Events : public I_Command
+		{
+			std::string _type;
+		public:
+			/**
+				@param type - The type of the objects, e.g. container or image
+			**/
+			Events(std::string type = "container");
+			~Events();
+
+			Shell::Argv argv() override;
+
+		protected:
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Events>(*this); }
 		};
 
 		/**
@@ -519,13 +1076,325 @@ namespace docker
 		public:
 			Prune();
 			~Prune();
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Prune>(*this); }
 		};
-	}
 
+		/**
 
-	/**
+			@class   Exec
+			@brief   Docker Exec command running a shell command line in a running container (docker exec <container> sh -c '<command>').
+			@details ~ Every execution starts a new docker exec. To run many commands in the same container use
+			         Container::exec, which keeps exec sessions open. Always executed through the docker CLI.
 
-		@class   Container
+		**/
+		class DOCKERAPI Exec : public I_Command
+		{
+			std::string _container;
+			std::string _shell_command;
+			std::string _user;
+			std::string _workdir;
+		public:
+			/**
+				@brief Construct the command giving the container and the command line to run
+				@param container_name_or_ID - The assigned unique name or ID of the docker container.
+				@param command              - A POSIX shell command line
+			**/
+			Exec(std::string container_name_or_ID, std::string command);
+			~Exec();
+
+			std::string str() override;
+
+			Shell::Argv argv() override;
+
+			/**
+				@brief  Run the command as another user (--user)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Exec& user(std::string user);
+
+			/**
+				@brief  Run the command in another directory (--workdir)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Exec& workdir(std::string directory);
+
+		protected:
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Exec>(*this); }
+		};
+
+		/**
+
+			@class   Logs
+			@brief   Docker Logs command printing the output of a container: its stdout on stdout and its stderr on stderr.
+			@details ~ With follow() the command does not end by itself: use it with stream(), or see Container::follow_logs.
+			         Always executed through the docker CLI.
+
+		**/
+		class DOCKERAPI Logs : public I_Command
+		{
+			std::string _container;
+			bool _follow = false;
+			bool _timestamps = false;
+			std::string _since;
+			std::string _tail;
+		public:
+			/**
+				@brief Construct the command giving the container name/ID
+				@param container_name_or_ID - The assigned unique name or ID of the docker container.
+			**/
+			Logs(std::string container_name_or_ID);
+			~Logs();
+
+			/**
+				@brief Resets to default. Cleans all options.
+			**/
+			void reset_command_options() override;
+
+			std::string str() override;
+
+			Shell::Argv argv() override;
+
+			/**
+				@brief  Keep printing the new output of the container (-f)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Logs& follow();
+
+			/**
+				@brief  Prefix every line with its RFC 3339 timestamp and a space (--timestamps)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Logs& timestamps();
+
+			/**
+				@brief  Only the output since a time, e.g. 2024-01-01T00:00:00Z or 10m (--since)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Logs& since(std::string time);
+
+			/**
+				@brief  Only the last lines of the output, e.g. 100 (--tail)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Logs& tail(std::string lines);
+
+		protected:
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Logs>(*this); }
+		};
+
+		/**
+			@struct  StatsInfo
+			@brief   Resource usage of a container, parsed from a line of docker stats --format '{{json .}}'.
+			@details ~ Sizes are in bytes. Percentages are in the docker units: cpu_percent can exceed 100 on many cores.
+		**/
+		struct DOCKERAPI StatsInfo
+		{
+			std::string	id;
+			std::string	name;
+			double		cpu_percent = 0;
+			double		memory_percent = 0;
+			uint64_t	memory_usage = 0;
+			uint64_t	memory_limit = 0;
+			uint64_t	net_rx = 0;
+			uint64_t	net_tx = 0;
+			uint64_t	block_read = 0;
+			uint64_t	block_write = 0;
+			uint64_t	pids = 0;
+
+			/**
+				@brief  Fills the fields from a line of JSON
+				@retval  - False if the line is not a JSON object
+			**/
+			bool parse(std::string_view line);
+
+			/**
+				@brief  Converts a size printed by docker (e.g. 3.797MiB, 1.02kB, 0B) into bytes. "--" is 0.
+			**/
+			static uint64_t parse_size(std::string_view text);
+		};
+
+		/**
+
+			@class   Stats
+			@brief   Docker Stats command taking a single sample of the resource usage of the containers.
+			@details ~ Every container is printed as a line of JSON, see StatsInfo. IDs are not truncated.
+			         Always executed through the docker CLI.
+
+		**/
+		class DOCKERAPI Stats : public I_Command
+		{
+			std::vector<std::string> _containers;
+		public:
+			/**
+				@brief Construct the command for all the running containers
+			**/
+			Stats();
+
+			/**
+				@brief Construct the command for the given containers
+				@param containers - Names or IDs of the containers
+			**/
+			Stats(std::vector<std::string> containers);
+			~Stats();
+
+			Shell::Argv argv() override;
+
+		protected:
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Stats>(*this); }
+		};
+
+		/**
+
+			@class   Pull
+			@brief   Docker Pull command downloading an image from its registry.
+			@details ~ docker prints a line for each step of each layer, e.g. "3153aa388d02: Pull complete", then the full reference
+			         of the image: use it with stream() to follow the progress, or see ImagePuller.
+
+		**/
+		class DOCKERAPI Pull : public I_Command
+		{
+			std::string _reference;
+			std::string _platform;
+		public:
+			/**
+				@brief Construct the command giving the image
+				@param reference - The image to pull, e.g. ubuntu:22.04 or ubuntu@sha256:... The latest tag if there is none.
+			**/
+			Pull(std::string reference);
+			~Pull();
+
+			/**
+				@brief Resets to default. Cleans all options.
+			**/
+			void reset_command_options() override;
+
+			std::string str() override;
+
+			Shell::Argv argv() override;
+
+			/**
+				@brief  Pull the image of a platform, e.g. linux/arm64 (--platform)
+				@retval  - The instance of the command object itself. This way you can call the following method in a pipeline fashon.
+			**/
+			Pull& platform(std::string platform);
+
+		protected:
+			Shell::Output execute_api() override;
+			std::unique_ptr<I_Command> clone() const override { return std::make_unique<Pull>(*this); }
+		};
+	}
+
+
+	/**
+		@struct LogLine
+		@brief  A line of the logs of a container. The views are valid only during the call of the sink.
+	**/
+	struct LogLine
+	{
+		std::string_view	timestamp;	// RFC 3339 with nanoseconds, empty without timestamps
+		std::string_view	text;		// without the line terminator
+		Shell::Channel		channel;	// the container wrote it on its stdout or its stderr
+	};
+
+	/**
+		@brief Receives a batch of log lines, in the order of each channel. Return false to stop following.
+	**/
+	typedef std::function<bool(const std::vector<LogLine>& batch)> LogSink;
+
+	/**
+		@struct LogOptions
+		@brief  Options of LogFollower
+	**/
+	struct LogOptions
+	{
+		bool		timestamps = true;
+		std::string	since;								// --since, e.g. 10m. Empty for the whole output
+		std::string	tail;								// --tail, e.g. 100. Empty for the whole output
+		size_t		buffer_size = 1024 * 1024;			// size of a read buffer: longer lines are delivered in pieces
+		size_t		buffers = 8;						// read buffers in memory
+		std::string	spill_directory = "/tmp";			// where the spill files are created. Empty to never spill
+		size_t		spill_file_size = 64 * 1024 * 1024;
+		size_t		spill_files = 16;					// once all are full, reading waits for the sink
+	};
+
+	/**
+
+		@class   LogFollower
+		@brief   Follows the logs of a container (docker logs -f), delivering them to a sink in batches of lines.
+		@details ~ The output is read into large buffers and framed in place: the lines handed to the sink are views of the
+		         buffers, nothing is copied per line. The sink runs on a thread of its own, so that a slow sink does not
+				 stop the reading: once all the buffers are waiting for the sink, the output is spilled to memory mapped
+				 files, created (and deleted at once) one after the other in the spill directory and dropped once delivered.
+				 When the spill files are full too, or spilling is disabled, the reading waits for the sink.
+				 Memory mapped spilling is available on unix only: elsewhere the reading waits.
+
+	**/
+	class DOCKERAPI LogFollower
+	{
+	public:
+		struct Stats
+		{
+			uint64_t	bytes = 0;			// read from docker logs
+			uint64_t	lines = 0;			// delivered to the sink
+			uint64_t	batches = 0;
+			uint64_t	spilled_bytes = 0;
+			size_t		spill_files = 0;	// currently in use
+		};
+
+		LogFollower();
+
+		/**
+			@brief Starts following the logs
+			@param container_name_or_ID - The assigned unique name or ID of the docker container.
+			@param sink                 - Receives the lines
+			@param options              - Buffering and docker logs options
+		**/
+		LogFollower(std::string container_name_or_ID, LogSink sink, LogOptions options = LogOptions());
+
+		/**
+			@brief Stops following, see stop()
+		**/
+		~LogFollower();
+		LogFollower(LogFollower&&) noexcept;
+		LogFollower& operator=(LogFollower&&) noexcept;
+		LogFollower(const LogFollower&) = delete;
+		LogFollower& operator=(const LogFollower&) = delete;
+
+		/**
+			@brief Terminates docker logs and drops the lines not yet delivered. Waits for the running call of the sink.
+		**/
+		void stop();
+
+		/**
+			@brief  Check if docker logs is running or lines are still to be delivered
+		**/
+		bool running() const;
+
+		/**
+			@brief  Waits for docker logs to end (the container stopped) and for all its lines to be delivered
+			@retval  - The exit status of docker logs, and what it printed on stderr if it failed
+		**/
+		Shell::Output wait();
+
+		Stats stats() const;
+
+	private:
+		struct State;
+		std::unique_ptr<State> _state;
+	};
+
+	class EventWatcher;
+	class ContainerRegistry;
+	class ContainerPool;
+	class ExecSessions;
+	class CgroupReader;
+
+	/**
+
+		@class   Container
 		@brief   A class representing the instance of a docker container. 
 		@details ~ Create the container object using a create command, act on the container using the exec_ methods, get runtime informations
 		         and get notification upon status changes providing a callback function.
@@ -580,30 +1449,77 @@ namespace docker
 		~Container();
 		Container(const Container&) = delete;
 		Container& operator=(const Container&) = delete;
-		//Container(Container&&); // TODO
-		//Container&& operator=(Container&&); // TODO
+
+		/**
+			@brief Moves the container object, callbacks and event watching included. The moved-from object must only be destroyed or assigned.
+		**/
+		Container(Container&& other);
+		Container& operator=(Container&& other);
         bool operator==(const Container& other) const;
 		std::ostream& operator<<(std::ostream& stream);
 
         /**
             @brief Set the callback function. The function will be called every time the status of the container changes, i.e., when the status of
 			       the docker container is different from the status of the container object.
+				   It runs on the thread that observed the change: the caller of a method of the object, or the events stream thread of
+				   the EventWatcher for a watched container. Both can run at once, so the function must be thread safe. The object is not
+				   locked while it runs: the function may call the object back.
             @param function - Callback function
         **/
         void set_status_callback(std::function<void()> function);
         void set_status_callback(std::function<void(Status)> function);
         void set_status_callback(std::function<void(Container*)> function);
 
+		/**
+			@enum  docker::Container::CachePolicy
+			@brief When the status and the runtime informations are refreshed from docker
+				   EAGER - after every lifecycle operation (exec_create, exec_start, ...). The default.
+				   LAZY  - lifecycle operations only invalidate them: the next get_status or get_runtime_infos refreshes.
+				   TTL   - as LAZY, and they are also refreshed when older than the time to live.
+		**/
+		enum class CachePolicy
+		{
+			EAGER,
+			LAZY,
+			TTL,
+		};
+
+		/**
+			@brief Selects when the status and the runtime informations are refreshed
+			@param policy - The caching policy
+			@param ttl    - Time to live of the cached values, for the TTL policy
+		**/
+		void set_cache_policy(CachePolicy policy, std::chrono::milliseconds ttl = std::chrono::milliseconds(1000));
+
+		/**
+			@brief Marks the cached status and runtime informations as stale. With the LAZY and TTL policies they are 
+			       refreshed by the next get_status or get_runtime_infos.
+		**/
+		void invalidate();
+
+		/**
+			@brief Bounds the duration of every docker command run by the object (see CLI::I_Command::set_timeout).
+			       A command exceeding it is killed and the exec_ method returns the TIMEOUT status.
+			@param timeout - The maximum duration of a command, zero for no limit (default)
+		**/
+		void set_timeout(std::chrono::milliseconds timeout);
+
+		/**
+			@brief Makes the docker commands run by the object cancellable through the token
+		**/
+		void set_cancel_token(Shell::CancelToken token);
+
 		/**
 			@brief  The current status of the constainer object. It may be different from the
-			        actual status of the docker container. Always update its value by calling update_status.
+			        actual status of the docker container. Always update its value by calling update_status,
+					or select a LAZY or TTL caching policy.
 			@retval  - 
 		**/
-		Status		get_status()			{ return _current_status; }
+		Status		get_status();
 
 		CLI::Create	get_create_command()	{ return _create_command; }
 
-		RuntimeInfos get_runtime_infos()	{ return _runtime_infos; }
+		RuntimeInfos get_runtime_infos();
 
 		/**
 			@brief  Create the container executing the Create command passed the the constructor.
@@ -633,6 +1549,20 @@ namespace docker
 		**/
 		Shell::Output exec_kill();
 
+		/**
+			@brief  Pauses the container. [WARNING] Need to call exec_start first!
+					Status will change from RUNNING to PAUSED (or UNKNOWN if unsuccesfull execution).
+			@retval  - Exit code and standard output resulting from the command execution.
+		**/
+		Shell::Output exec_pause();
+
+		/**
+			@brief  Resumes the paused container.
+					Status will change from PAUSED to RUNNING (or UNKNOWN if unsuccesfull execution).
+			@retval  - Exit code and standard output resulting from the command execution.
+		**/
+		Shell::Output exec_unpause();
+
 		/**
 			@brief  Removes the container. [WARNING] Need to call exec_stop or exec_kill first!
 					Status will change from EXITED to REMOVED (or UNKNOWN if unsuccesfull execution).
@@ -647,6 +1577,38 @@ namespace docker
 		**/
 		Shell::Output exec_destroy();
 
+		/**
+			@brief  Runs a command line in the running container through an exec session: a `docker exec -i <container> sh -s`
+			        kept open and reused, so that a command costs a round trip to the shell in the container instead of
+					starting a docker exec. Sessions are opened on demand (see set_exec_sessions), checked when they
+					have been idle for a while and opened again once ended. Can be called from several threads at once.
+					The command runs with stdin from /dev/null and cannot change the state of the session (cd, variables).
+					Always executed through the docker CLI, whatever the backend.
+			@param  command - A POSIX shell command line
+			@retval         - Exit code of the command and its standard output (its standard error if it failed)
+		**/
+		Shell::Output exec(const std::string& command);
+
+		/**
+			@brief Set the maximum number of exec sessions of the container (default 2) and the shell they run (default sh).
+			       Extra concurrent exec calls wait for a session.
+		**/
+		void set_exec_sessions(size_t max, std::string shell = "sh");
+
+		/**
+			@brief Closes the exec sessions of the container. The next exec opens new ones.
+		**/
+		void close_exec_sessions();
+
+		/**
+			@brief  Follows the logs of the container (docker logs -f) and delivers them to the sink in batches of lines,
+			        on a thread of the follower. See LogFollower.
+			@param  sink    - Receives the lines
+			@param  options - Buffering and docker logs options
+			@retval         - The follower: destroying it stops following
+		**/
+		LogFollower follow_logs(LogSink sink, LogOptions options = LogOptions());
+
 		/**
 			@brief  Check the status of the docker container and updates the status of the container object.
 			        If status has changed, triggers the provided function callback.
@@ -663,15 +1625,940 @@ namespace docker
 		Shell::Output inspect_ID();
 
 	private:
+		friend class EventWatcher;
+		friend class ContainerRegistry;
+		friend class ContainerPool;
+		friend class Fleet;
+		friend class CgroupReader;
+
 		Shell::Output update_runtime_infos();
 
+		/**
+			@brief Sets the status and triggers the status callback if it changed
+		**/
+		void apply_status(Status stat);
+
+		/**
+			@brief  Sets the status from its docker name ("running", "exited", ...)
+			@retval  - False if the name is not a docker status
+		**/
+		bool apply_status(const std::string& status_name);
+
+		/**
+			@brief  The ID of the docker container, read or written with the state locked
+		**/
+		std::string id() const;
+		void set_id(std::string id);
+
+		/**
+			@brief  The status, read with the state locked
+		**/
+		Status current_status() const;
+
+		// guards the state shared with the events stream thread: the runtime informations, the status, the cache state and the callbacks
+		mutable std::mutex _state_mutex;
 		RuntimeInfos _runtime_infos;
 		CLI::Create	_create_command;
 		Status _current_status = Status::UNKNOWN;
-		std::array<std::string, 7> _status_names;
+		static const std::array<std::string, 7> _status_names;
 		std::function<void()> _notify_status_changed;
 		std::function<void(Status)> _notify_and_send_status_changed;
 		std::function<void(Container*)> _notify_status_changed_with_this;
+		bool _watched = false;
+		CachePolicy _cache_policy = CachePolicy::EAGER;
+		std::chrono::milliseconds _cache_ttl{ 1000 };
+		std::chrono::steady_clock::time_point _refreshed_at;
+		bool _stale = true;
+		std::chrono::milliseconds _timeout{ 0 };
+		std::optional<Shell::CancelToken> _cancel_token;
+		std::unique_ptr<ExecSessions> _exec_sessions;
+
+		/**
+			@brief  Refreshes the status if the caching policy says so
+		**/
+		void refresh_if_stale();
+
+		/**
+			@brief  Applies the timeout and the cancellation token of the object to one of its commands
+		**/
+		template<typename Command>
+		Command& limited(Command&& command)
+		{
+			command.set_timeout(_timeout);
+			if (_cancel_token) command.set_cancel_token(*_cancel_token);
+			return command;
+		}
+
+		void move_from(Container& other);
+
+		/**
+			@brief  Moves the state guarded by _state_mutex, both objects locked
+		**/
+		void move_state_from(Container& other);
+	};
+
+	/**
+
+		@class   EventWatcher
+		@brief   Tracks the status of any number of containers from a single `docker events` stream.
+		@details ~ Watched containers are matched to the events by name (or ID) and their status callbacks are triggered as soon as
+		         docker reports the change, without spawning any process per container. 
+				 Status and callbacks are updated from the events stream thread, concurrently with the thread owning the container
+				 (see Container::set_status_callback). Do not call stop() from a status callback.
+				 If the stream ends (e.g. the docker daemon restarted), the next get_status of a watched container restarts it and
+				 the watched containers are refreshed, since their events may have been missed.
+
+	**/
+	class DOCKERAPI EventWatcher
+	{
+	public:
+		/**
+			@brief  The watcher shared by all the containers
+		**/
+		static EventWatcher& instance();
+
+		~EventWatcher();
+		EventWatcher(const EventWatcher&) = delete;
+		EventWatcher& operator=(const EventWatcher&) = delete;
+
+		/**
+			@brief  Starts following the status of the container, starting the events stream if needed.
+			        The current status is not refreshed: call update_status once if it may be stale.
+					The container must have a unique name (or a known ID). It is unwatched automatically when destroyed.
+			@param  container - The container to follow
+			@retval  - FAIL if the events stream could not be started: the container stays registered
+		**/
+		Shell::Output watch(Container& container);
+
+		/**
+			@brief  Stops following the status of the container. No callback of the container runs after the return:
+			        a callback running on the events thread is waited for, unless it is the caller.
+			@param  container - The container to forget
+		**/
+		void unwatch(Container& container);
+
+		/**
+			@brief  Starts the events stream, if not already running. watch() calls it for you.
+			        Events may have been missed while the stream was down: every watched container is marked stale.
+			@retval  - FAIL if the stream could not be started
+		**/
+		Shell::Output start();
+
+		/**
+			@brief  Terminates the events stream. The containers stay registered until the next start().
+		**/
+		void stop();
+
+		/**
+			@brief  Check if the events stream is running
+		**/
+		bool running();
+
+	private:
+		EventWatcher();
+
+		friend class Container;
+
+		/**
+			@brief  Restarts the events stream if it ended since start() (e.g. the docker daemon restarted), marking every watched
+			        container stale. Called by the watched containers before using their cached status.
+		**/
+		void recover();
+
+		/**
+			@brief  Starts the events stream if not running, _stream_mutex held
+		**/
+		Shell::Output start_stream();
+
+		/**
+			@brief  Applies one line of the events stream to the matching watched container. The callbacks run unlocked.
+		**/
+		void on_event(std::string_view line);
+
+		/**
+			@brief  Waits for the status callbacks of the container running on the events thread, _mutex held once by lock
+		**/
+		void wait_dispatched(std::unique_lock<std::recursive_mutex>& lock, Container& container);
+
+		/**
+			@brief  Moves a watched container to its new object. The registration is re-pointed with the watcher locked, so no event
+			        is lost or applied to the moved-from object, and the events stream is neither started nor stopped.
+			@param  from - The watched container, unwatched on return
+			@param  to   - The object receiving the state of from, not watched
+		**/
+		void rebind(Container& from, Container& to);
+
+		std::recursive_mutex _mutex;
+		std::unordered_map<std::string, Container*> _by_name;
+		std::unordered_map<std::string, Container*> _by_id;
+		Container* _dispatching = nullptr;			// whose callbacks run on the events thread
+		std::condition_variable_any _dispatched;
+		std::mutex _stream_mutex;
+		Shell::Stream _stream;
+		bool _started = false;						// until stop(): a stream that ended is restarted
+	};
+
+	/**
+
+		@class   ContainerRegistry
+		@brief   Owns a fleet of containers and refreshes all of them at once.
+		@details ~ refresh() lists all the docker containers with a single command (or Engine API request) and updates the
+		         runtime informations and the status of every container of the registry, triggering their status callbacks.
+
+	**/
+	class DOCKERAPI ContainerRegistry
+	{
+	public:
+		ContainerRegistry();
+		~ContainerRegistry();
+		ContainerRegistry(const ContainerRegistry&) = delete;
+		ContainerRegistry& operator=(const ContainerRegistry&) = delete;
+
+		/**
+			@brief  Adds a container to the registry. The docker container is not created.
+			@param  create_command        - The create command to use to create the container.
+			@param  container_unique_name - The unique name of the container.
+			@retval                       - The container, owned by the registry. The existing one if the name is already registered.
+		**/
+		Container& add(CLI::Create create_command, std::string container_unique_name);
+
+		/**
+			@brief  Get a container of the registry by name or ID
+			@retval  - nullptr if not registered
+		**/
+		Container* find(const std::string& name_or_id);
+
+		/**
+			@brief  Destroys the container object. The docker container is not affected.
+			@retval  - False if not registered
+		**/
+		bool remove(const std::string& name);
+
+		size_t size() const { return _containers.size(); }
+
+		/**
+			@brief  Calls f for every container of the registry
+		**/
+		void for_each(std::function<void(Container&)> f);
+
+		/**
+			@brief  Updates ID and status of all the containers with a single docker ps.
+			        Registered containers missing from the list become REMOVED (or stay UNKNOWN if never seen).
+			@retval  - Exit code and output of the docker ps command
+		**/
+		Shell::Output refresh();
+
+	private:
+		std::unordered_map<std::string, std::unique_ptr<Container>> _containers;
+	};
+
+	/**
+
+		@class   ContainerPool
+		@brief   Keeps a number of ready containers, all built from the same create command, to hand them out immediately.
+		@details ~ The containers are created (CREATED) or created, started and paused (PAUSED) in advance by a background thread,
+		         which refills the pool after every acquire and destroys the containers that are not recycled.
+				 acquire() takes a ready container in constant time: a PAUSED pool unpauses it before returning it.
+				 The pool names its containers name_prefix_<pid>_<pool>_1, name_prefix_<pid>_<pool>_2, ... where pid is the process id
+				 and pool counts the pools of the process, so that pools sharing a prefix do not collide on the host.
+				 Pooled containers use the LAZY caching policy. A released container is handed out again as a new one: its exec
+				 sessions are closed, its callbacks cleared, it is unwatched, and its limits and caching policy are reset.
+				 The containers left at destruction are removed with a bulk remove; its failures are logged on stderr.
+
+	**/
+	class DOCKERAPI ContainerPool
+	{
+	public:
+		enum class Warmth
+		{
+			CREATED,	// handed out created, to be started
+			PAUSED,		// handed out running
+		};
+
+		enum class Release
+		{
+			RECYCLE,	// back to the pool if it can be brought back to its ready state, destroyed otherwise
+			DESTROY,
+		};
+
+		/**
+			@struct Stats
+			@brief  Counters of the pool. Latencies are in milliseconds.
+		**/
+		struct Stats
+		{
+			uint64_t	hits = 0;
+			uint64_t	misses = 0;
+			uint64_t	created = 0;
+			uint64_t	failed = 0;
+			uint64_t	recycled = 0;
+			uint64_t	destroyed = 0;
+			size_t		available = 0;
+			double		refill_latency_last = 0;
+			double		refill_latency_mean = 0;
+			double		refill_latency_max = 0;
+		};
+
+		/**
+			@brief Starts filling the pool in background
+			@param create_template - The create command of every container. Its container name is ignored.
+			@param size            - Number of ready containers to keep
+			@param warmth          - How ready the containers are
+			@param name_prefix     - Prefix of the container names
+		**/
+		ContainerPool(CLI::Create create_template, size_t size, Warmth warmth = Warmth::CREATED, std::string name_prefix = "pool");
+
+		/**
+			@brief Stops the refill and destroys all the containers still owned by the pool
+		**/
+		~ContainerPool();
+		ContainerPool(const ContainerPool&) = delete;
+		ContainerPool& operator=(const ContainerPool&) = delete;
+
+		/**
+			@brief  Takes a ready container. When the pool is empty (a miss) the container is created on the calling thread.
+			@retval  - The container, nullptr if it could not be created
+		**/
+		std::unique_ptr<Container> acquire();
+
+		/**
+			@brief  Gives a container back to the pool
+			@param  container - The container, acquired from this pool. Reset before it is recycled or destroyed, so that none of
+			                    its callbacks run from the pool.
+			@param  mode      - Recycle or destroy it. Destruction happens in background.
+		**/
+		void release(std::unique_ptr<Container> container, Release mode = Release::RECYCLE);
+
+		/**
+			@brief  Changes the number of ready containers to keep. Extra ready containers are destroyed.
+		**/
+		void resize(size_t size);
+
+		Stats stats();
+
+	private:
+		/**
+			@brief  Creates a container named after the pool, brought to the pool ready state if park, or ready to use otherwise
+		**/
+		std::unique_ptr<Container> make_container(bool park);
+
+		/**
+			@brief  Brings a released container back to the state of a newly made one, but for its docker status
+		**/
+		void reset(Container& container);
+
+		void refill_loop();
+
+		CLI::Create _template;
+		Warmth _warmth;
+		std::string _prefix;
+		std::atomic<uint64_t> _sequence{ 0 };
+
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		std::deque<std::unique_ptr<Container>> _ready;
+		std::vector<std::unique_ptr<Container>> _to_destroy;
+		size_t _size;
+		size_t _creating = 0;
+		bool _stop = false;
+		Stats _stats;
+		double _latency_total = 0;
+		std::thread _refiller;
+	};
+
+	/**
+
+		@class   Fleet
+		@brief   Compact store tracking the status of a very large number of containers.
+		@details ~ Containers are referred to by a Handle (an index) instead of a Container object. Names, IDs and images are interned
+		         in a shared string arena and statuses are kept in a contiguous array, so that the memory per container is small and
+				 predictable and scans over the fleet are cache friendly.
+				 The interned strings are reference counted: those no longer used by any container (removed, or an ID replaced by
+				 refresh) are released, and the arena is compacted once half of it holds released strings, so its size follows the
+				 live containers. The views returned by name, id and image are valid until the next call modifying the fleet.
+				 There is no process, command or shell per container: refresh() and apply() go through single (bulk) docker invocations.
+
+	**/
+	class DOCKERAPI Fleet
+	{
+	public:
+		typedef uint32_t Handle;
+		static constexpr Handle INVALID = 0xFFFFFFFF;
+
+		Fleet();
+		~Fleet();
+		Fleet(const Fleet&) = delete;
+		Fleet& operator=(const Fleet&) = delete;
+		Fleet(Fleet&&) = default;
+		Fleet& operator=(Fleet&&) = default;
+
+		/**
+			@brief  Starts tracking a container. The docker container is not created.
+			@param  name  - The unique name of the container
+			@param  image - The image of the container
+			@retval       - The handle of the container, the existing one if the name is already tracked
+		**/
+		Handle add(std::string_view name, std::string_view image = {});
+
+		/**
+			@brief  Stops tracking a container. Its handle may be reused by a later add.
+		**/
+		void remove(Handle handle);
+
+		/**
+			@brief  Get the handle of a container by name or ID
+			@retval  - INVALID if not tracked
+		**/
+		Handle find(std::string_view name_or_id) const;
+
+		size_t size() const { return _size; }
+
+		std::string_view name(Handle handle) const;
+		std::string_view id(Handle handle) const;
+		std::string_view image(Handle handle) const;
+		Container::Status status(Handle handle) const;
+
+		/**
+			@brief  Number of tracked containers with the given status
+		**/
+		size_t count(Container::Status status) const;
+
+		/**
+			@brief  Handles of the tracked containers with the given status
+		**/
+		std::vector<Handle> with_status(Container::Status status) const;
+
+		/**
+			@brief  Calls f(handle) for every tracked container
+		**/
+		template<typename F>
+		void for_each(F f) const
+		{
+			for (Handle h = 0; h < _status.size(); ++h)
+			{
+				if (_name[h] != NONE) f(h);
+			}
+		}
+
+		/**
+			@brief  Set the function called when the status of a container changes (a single callback for the whole fleet)
+		**/
+		void set_status_callback(std::function<void(Handle, Container::Status)> function);
+
+		/**
+			@brief  Updates IDs and statuses of all the tracked containers with a single docker ps.
+			@retval  - Exit code and output of the docker ps command
+		**/
+		Shell::Output refresh();
+
+		/**
+			@brief  Applies a lifecycle action to the given containers with bulk docker invocations (see CLI::bulk).
+			        The statuses are updated from the outcome, without any inspect.
+			@retval  - The output of each container
+		**/
+		CLI::BulkOutput apply(CLI::BulkAction action, const std::vector<Handle>& handles);
+
+		/**
+			@brief  Approximate number of bytes used by the store
+		**/
+		size_t memory_usage() const;
+
+		/**
+			@brief  Rebuilds the string arena from the strings of the tracked containers, dropping the released ones.
+			        Done automatically when half of the arena is released: call it to trim the store at once, e.g. after
+					removing many containers. Invalidates the views returned by name, id and image.
+		**/
+		void compact();
+
+	private:
+		static constexpr uint32_t NONE = 0xFFFFFFFF;
+
+		/**
+			@brief  Gets the interned id of a string, adding it if new, and takes a reference on it
+		**/
+		uint32_t intern(std::string_view text);
+
+		/**
+			@brief  Drops a reference taken by intern, releasing the string when it was the last one
+		**/
+		void release(uint32_t interned);
+
+		/**
+			@brief  Copies a string in the arena
+		**/
+		std::string_view store(std::string_view text);
+
+		std::string_view text(uint32_t interned) const;
+		void set_status(Handle handle, Container::Status status);
+
+		// string arena: fixed size blocks never move, so the views stay valid until the next compaction
+		std::vector<std::unique_ptr<char[]>>		_blocks;
+		size_t										_block_used = 0;	// in the last block
+		std::vector<std::unique_ptr<char[]>>		_long_blocks;	// one per long string, at its size
+		size_t										_long_bytes = 0;
+		size_t										_stored_bytes = 0;	// in the arena, released strings included
+		size_t										_released_bytes = 0;
+		std::vector<std::string_view>				_strings;
+		std::vector<uint32_t>						_refs;		// references per interned string, 0 once released
+		std::vector<uint32_t>						_free_strings;
+		std::unordered_map<std::string_view, uint32_t> _interned;
+
+		// one column per attribute, indexed by handle
+		std::vector<uint32_t>						_name;
+		std::vector<uint32_t>						_id;
+		std::vector<uint32_t>						_image;
+		std::vector<int8_t>							_status;
+
+		std::unordered_map<uint32_t, Handle>		_by_name;	// interned name -> handle
+		std::unordered_map<uint32_t, Handle>		_by_id;		// interned ID -> handle
+		std::vector<Handle>							_free;
+		size_t										_size = 0;
+		std::function<void(Handle, Container::Status)> _notify_status_changed;
+	};
+
+	/**
+
+		@class   StatsSampler
+		@brief   Samples the resource usage of the tracked containers and keeps their recent history in bounded memory.
+		@details ~ Every tick is a single docker stats --no-stream call covering all the running containers, of which only the tracked
+		         ones are kept. The samples of each container are compressed (delta of deltas timestamps, XOR of consecutive values)
+				 in a ring of fixed size: once full, the oldest samples are dropped. The span of history kept thus depends on the
+				 sampling interval and on how much the values change, not on the memory given.
+				 Network and block I/O are sampled as the totals reported by docker: usage() turns them into rates.
+
+	**/
+	class DOCKERAPI StatsSampler
+	{
+	public:
+		enum class Metric
+		{
+			CPU_PERCENT,
+			MEMORY_BYTES,
+			MEMORY_PERCENT,
+			NET_RX_RATE,		// bytes per second
+			NET_TX_RATE,		// bytes per second
+			BLOCK_READ_RATE,	// bytes per second
+			BLOCK_WRITE_RATE,	// bytes per second
+			PIDS,
+		};
+
+		/**
+			@struct Usage
+			@brief  Distribution of a metric over a window. All zeroes when there are no samples.
+		**/
+		struct Usage
+		{
+			size_t	samples = 0;
+			double	min = 0;
+			double	max = 0;
+			double	mean = 0;
+			double	p50 = 0;
+			double	p99 = 0;
+		};
+
+		/**
+			@param bytes_per_container - Memory of the history of each container
+		**/
+		explicit StatsSampler(size_t bytes_per_container = 16 * 1024);
+
+		/**
+			@brief Stops the background sampling
+		**/
+		~StatsSampler();
+		StatsSampler(const StatsSampler&) = delete;
+		StatsSampler& operator=(const StatsSampler&) = delete;
+
+		/**
+			@brief Starts keeping the samples of a container
+			@param name_or_id - The name or the full ID of the container
+		**/
+		void track(std::string name_or_id);
+
+		/**
+			@brief Stops tracking a container and drops its history
+		**/
+		void untrack(const std::string& name_or_id);
+
+		/**
+			@brief  Takes a sample of all the tracked containers, with a single docker stats call
+			@retval  - Exit code and output of the docker stats command
+		**/
+		Shell::Output sample();
+
+		/**
+			@brief Samples in background every interval, until stop()
+		**/
+		void start(std::chrono::milliseconds interval);
+
+		/**
+			@brief Stops the background sampling, waiting for the running sample to end
+		**/
+		void stop();
+
+		/**
+			@brief  Get the last sample of a container
+			@retval  - Nothing if the container is not tracked or has not been sampled yet
+		**/
+		std::optional<CLI::StatsInfo> latest(const std::string& name_or_id);
+
+		/**
+			@brief  Get the distribution of a metric of a container over the last window
+			@param  name_or_id - The tracked container
+			@param  metric     - The metric
+			@param  window     - The span of history, ending now
+		**/
+		Usage usage(const std::string& name_or_id, Metric metric, std::chrono::milliseconds window);
+
+		/**
+			@brief  Memory used by the histories of all the tracked containers, in bytes
+		**/
+		size_t memory();
+
+	private:
+		struct Track;
+
+		void sample_loop(std::chrono::milliseconds interval);
+
+		const size_t _bytes_per_container;
+		std::mutex _mutex;
+		std::unordered_map<std::string, std::unique_ptr<Track>> _tracks;
+		std::condition_variable _cv;
+		bool _stop = false;
+		std::thread _sampler;
+	};
+
+	/**
+
+		@class   CgroupReader
+		@brief   Reads the resource usage of containers directly from their cgroup v2 files, without docker.
+		@details ~ The cgroup of a container is resolved once when it is added, from /proc/<pid>/cgroup of its main process or from
+		         the layouts of the systemd and cgroupfs drivers (system.slice/docker-<id>.scope, docker/<id>). Its cpu.stat,
+				 memory.current, memory.stat and io.stat files are opened then and kept open: a read is four pread calls and
+				 some parsing, with no process spawned and no daemon involved.
+				 The roots of the cgroup and proc file systems can be changed, e.g. to read a synthetic tree.
+				 Reads can run concurrently; add and remove cannot run concurrently with anything else.
+				 Available on unix only: elsewhere no container can be added.
+
+	**/
+	class DOCKERAPI CgroupReader
+	{
+	public:
+		typedef uint32_t Handle;
+		static constexpr Handle INVALID = 0xFFFFFFFF;
+
+		/**
+			@struct Usage
+			@brief  Counters of a cgroup. CPU times are in microseconds, sizes in bytes. I/O is summed over all the devices.
+			        Counters missing from the files (e.g. a controller that is not enabled) are 0.
+		**/
+		struct Usage
+		{
+			// cpu.stat
+			uint64_t	cpu_usage_usec = 0;
+			uint64_t	cpu_user_usec = 0;
+			uint64_t	cpu_system_usec = 0;
+			uint64_t	cpu_nr_periods = 0;
+			uint64_t	cpu_nr_throttled = 0;
+			uint64_t	cpu_throttled_usec = 0;
+
+			// memory.current, memory.stat
+			uint64_t	memory_current = 0;
+			uint64_t	memory_anon = 0;
+			uint64_t	memory_file = 0;
+			uint64_t	memory_kernel = 0;
+			uint64_t	memory_sock = 0;
+			uint64_t	memory_shmem = 0;
+			uint64_t	memory_pgfault = 0;
+			uint64_t	memory_pgmajfault = 0;
+
+			// io.stat
+			uint64_t	io_read_bytes = 0;
+			uint64_t	io_write_bytes = 0;
+			uint64_t	io_read_ops = 0;
+			uint64_t	io_write_ops = 0;
+		};
+
+		/**
+			@param cgroup_root - Mount point of the cgroup v2 hierarchy
+			@param proc_root   - Mount point of the proc file system
+		**/
+		explicit CgroupReader(std::string cgroup_root = "/sys/fs/cgroup", std::string proc_root = "/proc");
+
+		/**
+			@brief Closes the files of all the containers
+		**/
+		~CgroupReader();
+		CgroupReader(const CgroupReader&) = delete;
+		CgroupReader& operator=(const CgroupReader&) = delete;
+
+		/**
+			@brief  Starts reading a running container, resolving its cgroup from a single docker inspect
+			@retval  - The handle of the container, INVALID if it is not running or its cgroup is not found
+		**/
+		Handle add(Container& container);
+
+		/**
+			@brief  Starts reading a container
+			@param  id  - The full ID of the container
+			@param  pid - The PID of its main process (as seen by the host), 0 if unknown
+			@retval     - The handle of the container, INVALID if its cgroup is not found
+		**/
+		Handle add(std::string_view id, int pid = 0);
+
+		/**
+			@brief  Stops reading a container and closes its files. Its handle may be reused by a later add.
+		**/
+		void remove(Handle handle);
+
+		/**
+			@brief  Finds the cgroup of a container
+			@param  id  - The full ID of the container
+			@param  pid - The PID of its main process, 0 if unknown
+			@retval     - The path of the cgroup relative to the cgroup root, empty if not found
+		**/
+		std::string resolve(std::string_view id, int pid = 0) const;
+
+		/**
+			@brief  Reads the counters of a container
+			@retval  - False if the handle is not valid or the cgroup is gone (the container has been removed)
+		**/
+		bool read(Handle handle, Usage& usage) const;
+
+		/**
+			@brief  Reads the counters of all the containers, calling f(handle, usage) for each cgroup that could be read
+			@retval  - The number of containers read
+		**/
+		size_t read_all(const std::function<void(Handle, const Usage&)>& f) const;
+
+		/**
+			@brief  The path of the cgroup of a container, relative to the cgroup root
+		**/
+		std::string_view path(Handle handle) const;
+
+		size_t size() const { return _size; }
+
+	private:
+		enum File { CPU_STAT, MEMORY_CURRENT, MEMORY_STAT, IO_STAT, FILES };
+
+		struct Entry
+		{
+			std::string			path;			// empty when the handle is free
+			std::array<int, FILES> fds{ -1, -1, -1, -1 };
+			bool				cgroupfs = true;	// false for a synthetic tree, whose removed files stay readable
+		};
+
+		void close(Entry& entry);
+
+		const std::string	_cgroup_root;
+		const std::string	_proc_root;
+		std::vector<Entry>	_entries;
+		std::vector<Handle>	_free;
+		size_t				_size = 0;
+	};
+
+	/**
+
+		@class   ImageCatalog
+		@brief   Local images indexed by reference (repository:tag), ID and digest, loaded with a single docker images call.
+		@details ~ The whole catalog is loaded by one docker images --no-trunc --digests call into hash indexes, so that the
+		         lookups cost no process. References are normalized as docker does (ubuntu, docker.io/library/ubuntu:latest
+				 and ubuntu:latest are the same image); IDs can be full, with or without the sha256: prefix, or short (12 characters).
+				 The catalog is reloaded on the first lookup after the TTL expired, or after invalidate(). While watching, the
+				 image events keep it up to date between the reloads: deleted images are dropped, and the references pulled, tagged
+				 or untagged are reloaded at the next lookup, all of them with one docker images call filtered by reference.
+				 Thread safe. The docker calls are serialized and run without blocking the lookups of the other threads.
+
+	**/
+	class DOCKERAPI ImageCatalog
+	{
+	public:
+		/**
+			@struct Image
+			@brief  A local image
+		**/
+		struct Image
+		{
+			std::string					id;				// sha256:<64 hex>
+			std::vector<std::string>	references;		// repository:tag, empty for a dangling image
+			std::vector<std::string>	digests;		// repository@sha256:<64 hex>
+			uint64_t					size = 0;		// bytes
+			std::string					created_at;
+		};
+
+		/**
+			@param ttl - Age after which the next lookup reloads the whole catalog, zero to reload only when invalidated
+		**/
+		explicit ImageCatalog(std::chrono::milliseconds ttl = std::chrono::milliseconds(0));
+
+		/**
+			@brief Stops watching the image events
+		**/
+		~ImageCatalog();
+		ImageCatalog(const ImageCatalog&) = delete;
+		ImageCatalog& operator=(const ImageCatalog&) = delete;
+
+		/**
+			@brief  Reloads the whole catalog now. The previous content is kept if the call fails.
+			@retval  - Exit code and output of the docker images command
+		**/
+		Shell::Output refresh();
+
+		/**
+			@brief  Marks the catalog as stale: the next lookup reloads it
+		**/
+		void invalidate();
+
+		/**
+			@brief  Get an image by reference, ID or digest (repository@sha256:... or sha256:...)
+			@retval  - Nothing if there is no such image
+		**/
+		std::optional<Image> find(std::string_view key);
+
+		/**
+			@brief  Check if an image exists locally
+		**/
+		bool exists(std::string_view key);
+
+		/**
+			@brief  Get the full ID of an image
+			@retval  - Empty if there is no such image
+		**/
+		std::string id(std::string_view key);
+
+		/**
+			@brief  Get all the images
+		**/
+		std::vector<Image> images();
+
+		/**
+			@brief  Number of images
+		**/
+		size_t size();
+
+		/**
+			@brief  Starts following the image events. The catalog is reloaded at the next lookup, the images having possibly
+			        changed before the start. If the stream ends, the next lookup starts it again and reloads the catalog.
+			@retval  - FAIL if the stream could not be started
+		**/
+		Shell::Output watch();
+
+		/**
+			@brief  Stops following the image events. The catalog is refreshed on the TTL only.
+		**/
+		void unwatch();
+
+	private:
+		/**
+			@brief  Brings the catalog up to date before a lookup: full reload, or reload of the references changed by the events
+		**/
+		void update();
+
+		Shell::Output load_all();
+		Shell::Output load_references(std::vector<std::string> references, std::vector<std::string> deleted);
+		Shell::Output start_stream();
+		void on_event(std::string_view line);
+
+		// with _mutex held
+		const Image* lookup(std::string_view key) const;
+		void merge(const Image& row);
+		void erase(const std::string& id);
+		void unlink_reference(const std::string& reference);
+
+		const std::chrono::milliseconds _ttl;
+
+		std::mutex _mutex;
+		std::unordered_map<std::string, Image> _images;				// by full ID
+		std::unordered_map<std::string, std::string> _by_reference;	// normalized repository:tag -> full ID
+		std::unordered_map<std::string, std::string> _by_id;		// full, bare and short IDs -> full ID
+		std::unordered_map<std::string, std::string> _by_digest;	// repository@digest and bare digest -> full ID
+		bool _loaded = false;
+		bool _stale = false;
+		std::chrono::steady_clock::time_point _loaded_at;
+		std::vector<std::string> _pending_references;	// to reload, from the events
+		std::vector<std::string> _pending_deletes;		// IDs, from the events
+
+		std::mutex _refresh_mutex;						// serializes the docker calls
+		std::mutex _stream_mutex;
+		Shell::Stream _stream;
+		bool _watching = false;
+	};
+
+	/**
+
+		@class   ImagePuller
+		@brief   Pulls images in parallel, up to a limit, reporting the progress of each layer.
+		@details ~ Each pull is a docker pull run by one of the puller threads, so that pulling a set of images takes about as
+		         long as the slowest of them rather than their sum. A pull of a reference already queued or running is not
+				 started again: the callers share its result. References are compared in their familiar form (ubuntu is
+				 docker.io/library/ubuntu:latest). The progress callback is called from the puller threads, one call at a time.
+				 Destroying the puller cancels the pulls not done yet.
+
+	**/
+	class DOCKERAPI ImagePuller
+	{
+	public:
+		/**
+			@struct Progress
+			@brief  A step of a pull, as printed by docker pull
+		**/
+		struct Progress
+		{
+			std::string	reference;	// as given to pull()
+			std::string	layer;		// ID of the layer, empty for the steps of the whole image (e.g. Digest: sha256:...)
+			std::string	status;		// e.g. Pulling fs layer, Downloading, Download complete, Pull complete, Already exists
+			uint64_t	current = 0;	// bytes, when docker reports them
+			uint64_t	total = 0;		// bytes, when docker reports them
+		};
+
+		typedef std::function<void(const Progress&)> ProgressCallback;
+
+		/**
+			@param parallelism - Pulls running at once
+			@param on_progress - Receives the steps of all the pulls, can be empty
+		**/
+		explicit ImagePuller(size_t parallelism = 4, ProgressCallback on_progress = nullptr);
+
+		/**
+			@brief Cancels the pulls not done yet: their results have the CANCELLED status
+		**/
+		~ImagePuller();
+		ImagePuller(const ImagePuller&) = delete;
+		ImagePuller& operator=(const ImagePuller&) = delete;
+
+		/**
+			@brief  Queues the pull of an image, or joins the pull of the same reference already queued or running
+			@param  reference - The image, e.g. ubuntu:22.04
+			@retval           - The exit code and output of docker pull: the full reference, or the error
+		**/
+		std::shared_future<Shell::Output> pull(std::string reference);
+
+		/**
+			@brief  Pulls the images in parallel and waits for all of them
+			@retval  - The outputs, in the same order as the references
+		**/
+		std::vector<Shell::Output> pull_all(const std::vector<std::string>& references);
+
+		/**
+			@brief  Number of pulls queued or running
+		**/
+		size_t pending();
+
+	private:
+		struct Job;
+
+		void pull_loop();
+		Shell::Output run(Job& job);
+		void report(const Progress& progress);
+
+		ProgressCallback _on_progress;
+		std::mutex _progress_mutex;
+
+		std::mutex _mutex;
+		std::condition_variable _cv;
+		std::deque<std::shared_ptr<Job>> _queue;
+		std::unordered_map<std::string, std::shared_ptr<Job>> _pending;	// by normalized reference
+		bool _stop = false;
+		std::vector<std::thread> _pullers;
 	};
 
     // UTILIY FUNCTIONS
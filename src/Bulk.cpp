@@ -0,0 +1,280 @@
+#include "Docker.h"
+
+#include <atomic>
+#include <cctype>
+#include <future>
+#include <thread>
+#include <unordered_map>
+
+#ifdef UNIX
+#include <unistd.h>
+#endif // UNIX
+
+using namespace docker;
+using namespace CLI;
+
+
+namespace
+{
+	/**
+		@brief  Bytes of command line available to the containers of one docker invocation
+	**/
+	size_t argument_budget()
+	{
+#ifdef UNIX
+		if (get_backend() != Backend::SPAWN)
+		{
+			// the whole command is a single argument of the shell, limited to 128 KiB by linux (MAX_ARG_STRLEN)
+			return 96 * 1024;
+		}
+
+		// the environment shares ARG_MAX with the arguments: use a fraction of it
+		long arg_max = ::sysconf(_SC_ARG_MAX);
+		if (arg_max > 0)
+		{
+			return std::min<size_t>(static_cast<size_t>(arg_max) / 4, 512 * 1024);
+		}
+		return 32 * 1024;
+#else
+		return 30 * 1024; // CreateProcess command lines are limited to 32767 characters
+#endif // UNIX
+	}
+
+	Shell::Argv base_argv(BulkAction action)
+	{
+		switch (action)
+		{
+		case BulkAction::START:			return { "docker", "start" };
+		case BulkAction::STOP:			return { "docker", "stop" };
+		case BulkAction::KILL:			return { "docker", "kill" };
+		case BulkAction::REMOVE:		return { "docker", "rm" };
+		case BulkAction::FORCE_REMOVE:	return { "docker", "rm", "-f" };
+		}
+		return {};
+	}
+
+	template<typename Command>
+	Shell::Output limited(Command&& command, const BulkLimits& limits)
+	{
+		command.set_timeout(limits.timeout);
+		if (limits.cancel_token) command.set_cancel_token(*limits.cancel_token);
+		return command.execute();
+	}
+
+	Shell::Output execute_one(BulkAction action, const std::string& container, const BulkLimits& limits)
+	{
+		switch (action)
+		{
+		case BulkAction::START:			return limited(Start(container), limits);
+		case BulkAction::STOP:			return limited(Stop(container), limits);
+		case BulkAction::KILL:			return limited(Kill(container), limits);
+		case BulkAction::REMOVE:		return limited(Remove(container), limits);
+		case BulkAction::FORCE_REMOVE:	return limited(Remove(container).force(), limits);
+		}
+		return { Shell::FAIL, "Unknown action" };
+	}
+
+
+	/**
+		@brief  Check if the docker error line is about the container (and not a container whose name contains it)
+	**/
+	bool mentions(std::string_view line, const std::string& container)
+	{
+		auto is_name_char = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '-'; };
+
+		for (size_t pos = line.find(container); pos != std::string_view::npos; pos = line.find(container, pos + 1))
+		{
+			size_t end = pos + container.size();
+			if ((pos == 0 || !is_name_char(line[pos - 1])) && (end == line.size() || !is_name_char(line[end])))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+		@brief  Waits for the stream within the limits, cancelling it once they expire
+		@retval  - The status of the stream, TIMEOUT or CANCELLED if a limit expired
+	**/
+	Shell::Output wait_limited(Shell::Stream& stream, const BulkLimits& limits)
+	{
+		if (limits.timeout.count() == 0 && !limits.cancel_token)
+		{
+			return stream.wait();
+		}
+
+		// the lines read before the expiry stay with the callback: docker reported those containers done
+		auto deadline = limits.timeout.count() > 0 ? Metrics::now() + limits.timeout : Metrics::Clock::time_point::max();
+		auto slice = limits.cancel_token ? std::chrono::milliseconds(10) : limits.timeout;
+		auto waited = std::async(std::launch::async, [&stream]() { return stream.wait(); });
+		while (waited.wait_for(slice) == std::future_status::timeout)
+		{
+			if (limits.cancel_token && limits.cancel_token->cancelled())
+			{
+				stream.cancel();
+				waited.wait();
+				return { Shell::CANCELLED, "Cancelled" };
+			}
+			if (Metrics::now() >= deadline)
+			{
+				stream.cancel();
+				waited.wait();
+				return { Shell::TIMEOUT, "Timed out after " + std::to_string(limits.timeout.count()) + " ms" };
+			}
+		}
+		return waited.get();
+	}
+
+	/**
+		@brief  Runs one docker invocation for the given containers and fills their outputs.
+		        docker prints the name of each container done on stdout and one error line per failure on stderr.
+	**/
+	void execute_chunk(BulkAction action, const std::vector<std::string>& containers, size_t begin, size_t end, const BulkLimits& limits, BulkOutput& outputs)
+	{
+		Shell::Argv args = base_argv(action);
+		args.insert(args.end(), containers.begin() + begin, containers.begin() + end);
+
+		if (limits.cancel_token && limits.cancel_token->cancelled())
+		{
+			for (size_t i = begin; i < end; ++i) outputs[i].second = { Shell::CANCELLED, "Cancelled" };
+			return;
+		}
+
+		std::unordered_map<std::string, bool> done;
+		std::vector<std::string> errors;
+		size_t bytes = 0;
+
+		auto collect = [&](Shell::Channel channel, std::string_view line) {
+			bytes += line.size() + 1;
+			if (channel == Shell::STDOUT)
+			{
+				done[std::string(line)] = true;
+			}
+			else if (!line.empty())
+			{
+				errors.emplace_back(line);
+			}
+			return true;
+		};
+
+		auto started = Metrics::now();
+		Shell::Stream stream;
+		if (get_backend() == Backend::SPAWN)
+		{
+			stream = Shell::stream(args, collect);
+		}
+		else
+		{
+			std::string command;
+			for (auto& arg : args) command += (command.empty() ? "" : " ") + arg;
+			stream = Shell::stream(command, collect);
+		}
+		Shell::Output ret = wait_limited(stream, limits);
+		Metrics::record(Metrics::key("docker_command", "command", args[1]), Metrics::now() - started, ret.exitCode != Shell::SUCCESS, bytes);
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			const std::string& container = containers[i];
+			if (done.count(container))
+			{
+				outputs[i].second = { Shell::SUCCESS, container };
+				continue;
+			}
+
+			auto error = std::find_if(errors.begin(), errors.end(), [&container](const std::string& e) { return mentions(e, container); });
+			if (error != errors.end())
+			{
+				outputs[i].second = { Shell::FAIL, *error };
+			}
+			else if (ret.exitCode == Shell::TIMEOUT || ret.exitCode == Shell::CANCELLED)
+			{
+				outputs[i].second = ret;
+			}
+			else if (done.empty() && !errors.empty())
+			{
+				outputs[i].second = { Shell::FAIL, errors.front() }; // e.g. docker could not run at all
+			}
+			else if (done.empty() && ret.exitCode != Shell::SUCCESS)
+			{
+				outputs[i].second = ret;
+			}
+			else
+			{
+				outputs[i].second = { Shell::FAIL, "No result from docker for " + container };
+			}
+		}
+	}
+
+	/**
+		@brief  Runs the jobs on at most parallelism threads
+	**/
+	void run_parallel(size_t jobs, size_t parallelism, const std::function<void(size_t)>& job)
+	{
+		std::atomic<size_t> next{ 0 };
+		auto worker = [&]() {
+			for (size_t j = next++; j < jobs; j = next++)
+			{
+				job(j);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		size_t count = std::min(std::max<size_t>(parallelism, 1), jobs);
+		for (size_t t = 1; t < count; ++t)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+	}
+}
+
+
+BulkOutput docker::CLI::bulk(BulkAction action, const std::vector<std::string>& containers, size_t parallelism, const BulkLimits& limits)
+{
+	BulkOutput outputs;
+	outputs.reserve(containers.size());
+	for (auto& container : containers)
+	{
+		outputs.emplace_back(container, Shell::Output{ Shell::FAIL, "" });
+	}
+
+	if (get_backend() == Backend::ENGINE_API)
+	{
+		run_parallel(containers.size(), parallelism, [&](size_t i) {
+			outputs[i].second = execute_one(action, containers[i], limits);
+		});
+		return outputs;
+	}
+
+	// split the containers in invocations that fit the command line
+	std::vector<std::pair<size_t, size_t>> chunks;
+	size_t budget = argument_budget();
+	size_t begin = 0;
+	size_t used = 0;
+	for (size_t i = 0; i < containers.size(); ++i)
+	{
+		size_t length = containers[i].size() + 1;
+		if (i > begin && used + length > budget)
+		{
+			chunks.emplace_back(begin, i);
+			begin = i;
+			used = 0;
+		}
+		used += length;
+	}
+	if (begin < containers.size())
+	{
+		chunks.emplace_back(begin, containers.size());
+	}
+
+	run_parallel(chunks.size(), parallelism, [&](size_t c) {
+		execute_chunk(action, containers, chunks[c].first, chunks[c].second, limits, outputs);
+	});
+
+	return outputs;
+}
@@ -1,23 +1,219 @@
 #include "Docker.h"
+#include "EngineClient.hpp"
+#include "Json.hpp"
+#include "Reference.hpp"
+
+#include <atomic>
+#include <ctime>
+#include <cstdio>
 
 using namespace docker;
 using namespace CLI;
 
 
+namespace
+{
+	std::atomic<Backend> g_backend{ Backend::SHELL };
+
+	/*
+	* Helpers for the Engine API backend
+	*/
+
+	/**
+		@brief  Converts an engine response in the output that the docker CLI would give
+		@param  response - The engine response
+		@param  output   - The text printed on success
+	**/
+	Shell::Output api_output(const engine::Response& response, std::string output)
+	{
+		Shell::Output o;
+		if (response.ok())
+		{
+			o.exitCode = Shell::SUCCESS;
+			o.result = std::move(output);
+		}
+		else
+		{
+			std::string message = json::to_string(json::find(response.body, { "message" }));
+			o.exitCode = Shell::FAIL;
+			o.result = "Error response from daemon: " + (message.empty() ? response.body : message);
+		}
+		return o;
+	}
+
+	Shell::Output api_error(const std::exception& ex)
+	{
+		Shell::Output o;
+		o.exitCode = Shell::FAIL;
+		o.result = ex.what();
+		return o;
+	}
+
+	/**
+		@brief  Sends a POST with no body to /containers/{name}/{action} and returns the container name, as the CLI does
+	**/
+	Shell::Output api_container_action(const std::string& container, const char* action)
+	{
+		try
+		{
+			auto response = engine::Client::instance().request("POST", "/containers/" + engine::url_encode(container) + "/" + action);
+			return api_output(response, container);
+		}
+		catch (const std::exception& ex)
+		{
+			return api_error(ex);
+		}
+	}
+
+	std::string human_size(double bytes)
+	{
+		// docker uses decimal units with 3 significant digits
+		const char* units[] = { "B", "kB", "MB", "GB", "TB", "PB" };
+		int unit = 0;
+		while (bytes >= 1000.0 && unit < 5)
+		{
+			bytes /= 1000.0;
+			++unit;
+		}
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.3g%s", bytes, units[unit]);
+		return buffer;
+	}
+
+	std::string human_elapsed(long long created)
+	{
+		long long seconds = static_cast<long long>(std::time(nullptr)) - created;
+		struct { long long length; const char* name; } steps[] = {
+			{ 365LL * 24 * 3600, "year" }, { 30LL * 24 * 3600, "month" }, { 7LL * 24 * 3600, "week" },
+			{ 24 * 3600, "day" }, { 3600, "hour" }, { 60, "minute" }, { 1, "second" },
+		};
+		for (auto& step : steps)
+		{
+			long long n = seconds / step.length;
+			if (n > 0)
+			{
+				return std::to_string(n) + " " + step.name + (n > 1 ? "s" : "") + " ago";
+			}
+		}
+		return "Less than a second ago";
+	}
+
+	/**
+		@brief  The lines docker images --no-trunc --digests --format '{{json .}}' prints for an image of the Engine API
+	**/
+	std::string image_json_lines(std::string_view image)
+	{
+		long long created = std::strtoll(std::string(json::find(image, { "Created" })).c_str(), nullptr, 10);
+		std::time_t created_time = static_cast<std::time_t>(created);
+		char created_at[64] = "";
+		if (std::tm* tm = std::gmtime(&created_time))
+		{
+			std::strftime(created_at, sizeof(created_at), "%Y-%m-%d %H:%M:%S +0000 UTC", tm);
+		}
+		std::string size = human_size(std::strtod(std::string(json::find(image, { "Size" })).c_str(), nullptr));
+		std::string id = json::to_string(json::find(image, { "Id" }));
+
+		std::vector<std::string> digests;
+		for (auto& raw : json::elements(json::find(image, { "RepoDigests" }))) digests.push_back(json::to_string(raw));
+
+		auto line = [&](const std::string& repository, const std::string& tag) {
+			std::string digest = "<none>";
+			for (auto& d : digests)
+			{
+				if (d.size() > repository.size() && d.compare(0, repository.size(), repository) == 0 && d[repository.size()] == '@')
+				{
+					digest = d.substr(repository.size() + 1);
+				}
+			}
+			return "{\"Containers\":\"N/A\",\"CreatedAt\":" + json::quote(created_at) + ",\"CreatedSince\":" + json::quote(human_elapsed(created))
+				+ ",\"Digest\":" + json::quote(digest) + ",\"ID\":" + json::quote(id) + ",\"Repository\":" + json::quote(repository)
+				+ ",\"SharedSize\":\"N/A\",\"Size\":" + json::quote(size) + ",\"Tag\":" + json::quote(tag)
+				+ ",\"UniqueSize\":\"N/A\",\"VirtualSize\":" + json::quote(size) + "}\n";
+		};
+
+		std::string lines;
+		auto tags = json::elements(json::find(image, { "RepoTags" }));
+		for (auto& raw_tag : tags)
+		{
+			std::string tag = json::to_string(raw_tag);
+			auto colon = tag.rfind(':');
+			lines += colon == std::string::npos ? line(tag, "<none>") : line(tag.substr(0, colon), tag.substr(colon + 1));
+		}
+		if (tags.empty())
+		{
+			// untagged: a line per repository digest, or a single <none> line
+			for (auto& d : digests)
+			{
+				lines += line(d.substr(0, d.find('@')), "<none>");
+			}
+			if (digests.empty()) lines += line("<none>", "<none>");
+		}
+		return lines;
+	}
+}
+
+
+void docker::set_backend(Backend backend, std::optional<std::string> socket_path)
+{
+	if (socket_path)
+	{
+		engine::Client::instance().set_socket_path(std::move(*socket_path));
+	}
+	g_backend = backend;
+}
+
+Backend docker::get_backend()
+{
+	return g_backend;
+}
+
+
 Shell::Output docker::CLI::destroy_all_containers()
 {
-	Shell s{};
-	auto res = s.execute("docker ps -a --format {{.ID}}");
-	if (res.exitCode != Shell::SUCCESS)
+	std::vector<std::string> containers_IDs;
+
+	if (get_backend() == Backend::ENGINE_API)
 	{
-		return res;
+		engine::Response list;
+		try
+		{
+			list = engine::Client::instance().request("GET", "/containers/json?all=1");
+		}
+		catch (const std::exception& ex)
+		{
+			return api_error(ex);
+		}
+
+		Shell::Output res = api_output(list, "");
+		if (res.exitCode != Shell::SUCCESS)
+		{
+			return res;
+		}
+
+		for (auto& cnt : json::elements(list.body))
+		{
+			containers_IDs.emplace_back(json::to_string(json::find(cnt, { "Id" })));
+		}
+	}
+	else
+	{
+		auto res = I_Command("docker ps -a --format {{.ID}}").execute();
+		if (res.exitCode != Shell::SUCCESS)
+		{
+			return res;
+		}
+
+		utils::split_string(res.result, '\n', [&containers_IDs](std::string s) { if (!s.empty()) containers_IDs.emplace_back(s); });
 	}
 
-	std::list<std::string> containers_IDs;
-	utils::split_string(res.result, '\n', [&containers_IDs](std::string s) {containers_IDs.emplace_back(s); });
-	for (auto& cnt : containers_IDs)
+	Shell::Output res{ Shell::SUCCESS, "" };
+	for (auto& removed : bulk_remove(containers_IDs, true))
 	{
-		res = s.execute("docker rm -f " + cnt);
+		if (removed.second.exitCode != Shell::SUCCESS)
+		{
+			return removed.second;
+		}
+		res = removed.second;
 	}
 	
 	return res;
@@ -39,9 +235,179 @@ std::string I_Command::str()
 	return _command;
 }
 
+Shell::Argv I_Command::argv()
+{
+	Shell::Argv args;
+	utils::split_string(_command, ' ', [&args](std::string s) { if (!s.empty()) args.emplace_back(s); });
+	return args;
+}
+
 Shell::Output I_Command::execute()
 {
-	return _p_shell->execute(_command);
+	auto begin = Metrics::now();
+	_p_shell->set_timeout(_timeout);
+	if (_cancel_token)
+	{
+		_p_shell->set_cancel_token(*_cancel_token);
+	}
+	else
+	{
+		_p_shell->clear_cancel_token();
+	}
+
+	Shell::Output result;
+	switch (get_backend())
+	{
+	case Backend::ENGINE_API:
+		result = execute_api_limited(begin);
+		break;
+	case Backend::SPAWN:
+		result = _p_shell->execute(argv());
+		break;
+	case Backend::COPROCESS:
+		result = _p_shell->execute_coprocess(str());
+		break;
+	default:
+		result = _p_shell->execute(str());
+		break;
+	}
+	Metrics::record(metrics_key(), Metrics::now() - begin, result.exitCode != Shell::SUCCESS, result.result.size());
+	return result;
+}
+
+Shell::Output I_Command::execute_api_limited(Metrics::Clock::time_point begin)
+{
+	if (_cancel_token && _cancel_token->cancelled())
+	{
+		return { Shell::CANCELLED, "Cancelled" };
+	}
+	if (_timeout.count() == 0 && !_cancel_token)
+	{
+		return execute_api();
+	}
+
+	auto deadline = _timeout.count() > 0 ? begin + _timeout : Metrics::Clock::time_point::max();
+	std::function<bool()> cancelled;
+	if (_cancel_token) cancelled = [token = *_cancel_token]() { return token.cancelled(); };
+
+	engine::Limits limits(deadline, std::move(cancelled));
+	Shell::Output result = execute_api();
+	if (result.exitCode == Shell::FAIL && Metrics::now() >= deadline)
+	{
+		return { Shell::TIMEOUT, "Timed out after " + std::to_string(_timeout.count()) + " ms" };
+	}
+	if (result.exitCode == Shell::FAIL && _cancel_token && _cancel_token->cancelled())
+	{
+		return { Shell::CANCELLED, "Cancelled" };
+	}
+	return result;
+}
+
+Shell::Stream I_Command::stream(Shell::StreamCallback callback, Shell::Framing framing)
+{
+	if (get_backend() == Backend::SPAWN)
+	{
+		return Shell::stream(argv(), std::move(callback), framing);
+	}
+	return Shell::stream(str(), std::move(callback), framing);
+}
+
+std::future<Shell::Output> I_Command::execute_async()
+{
+	if (get_backend() == Backend::ENGINE_API)
+	{
+		auto task = std::make_shared<std::packaged_task<Shell::Output()>>(api_task());
+		auto future = task->get_future();
+		engine::Workers::instance().post([task]() { (*task)(); });
+		return future;
+	}
+
+	auto promise = std::make_shared<std::promise<Shell::Output>>();
+	auto future = promise->get_future();
+	execute_async([promise](Shell::Output output) { promise->set_value(std::move(output)); });
+	return future;
+}
+
+void I_Command::execute_async(Shell::Completion on_complete)
+{
+	if (get_backend() == Backend::ENGINE_API)
+	{
+		engine::Workers::instance().post([task = api_task(), on_complete = std::move(on_complete)]() { on_complete(task()); });
+		return;
+	}
+
+	Shell::Completion recorded = [on_complete = std::move(on_complete), key = metrics_key(), begin = Metrics::now()](Shell::Output output) {
+		Metrics::record(key, Metrics::now() - begin, output.exitCode != Shell::SUCCESS, output.result.size());
+		on_complete(std::move(output));
+	};
+
+	switch (get_backend())
+	{
+	case Backend::SPAWN:
+		Shell::execute_async(argv(), std::move(recorded));
+		break;
+	default:
+		Shell::execute_async(str(), std::move(recorded));
+		break;
+	}
+}
+
+I_Command& I_Command::set_timeout(std::chrono::milliseconds timeout)
+{
+	_timeout = timeout.count() > 0 ? timeout : std::chrono::milliseconds(0);
+	return *this;
+}
+
+I_Command& I_Command::set_cancel_token(Shell::CancelToken token)
+{
+	_cancel_token = std::move(token);
+	return *this;
+}
+
+std::function<Shell::Output()> I_Command::api_task()
+{
+	// the caller's object may be gone before the request ends
+	std::shared_ptr<I_Command> command = clone();
+	command->_p_shell = std::make_shared<Shell>();
+
+	return [command, key = metrics_key(), begin = Metrics::now()]() {
+		Shell::Output output = command->execute_api_limited(begin);
+		Metrics::record(key, Metrics::now() - begin, output.exitCode != Shell::SUCCESS, output.result.size());
+		return output;
+	};
+}
+
+void I_Command::limit(I_Command& other) const
+{
+	other._timeout = _timeout;
+	other._cancel_token = _cancel_token;
+}
+
+Shell::Output I_Command::execute_api()
+{
+	return _p_shell->execute(str());
+}
+
+Metrics::Key I_Command::metrics_key()
+{
+	if (!_metrics_key)
+	{
+		// the subcommand follows "docker", e.g. create, inspect, container prune
+		std::string_view words(_command);
+		std::string_view subcommand;
+		if (words.compare(0, 7, "docker ") == 0)
+		{
+			words.remove_prefix(7);
+			size_t end = words.find(' ');
+			if (words.compare(0, end, "container") == 0 && end != std::string_view::npos)
+			{
+				end = words.find(' ', end + 1);
+			}
+			subcommand = words.substr(0, end);
+		}
+		_metrics_key = Metrics::key("docker_command", "command", subcommand.empty() ? "other" : subcommand);
+	}
+	return *_metrics_key;
 }
 
 
@@ -55,116 +421,297 @@ Create::Create(std::string image_name)
 Create::~Create()
 {}
 
-Shell::Output Create::execute()
+std::string Create::str()
 {
-	std::string exec = _command;
-	exec += " --name=" + _container_name;
-	exec += " --hostname=" + _container_name;
-	exec += " " + _image_name_or_ID + " " + _entrypoint;
-	return _p_shell->execute(exec);
+	if (!_frozen) freeze();
+
+	std::string exec;
+	exec.reserve(_command.size() + _frozen_str.size() + 2 * _container_name.size() + _image_name_or_ID.size() + _entrypoint.size() + 24);
+	exec.append(_command).append(_frozen_str);
+	exec.append(" --name=").append(_container_name);
+	exec.append(" --hostname=").append(_container_name);
+	exec.append(" ").append(_image_name_or_ID).append(" ").append(_entrypoint);
+	return exec;
 }
 
-std::string Create::str()
+Shell::Argv Create::argv()
 {
-	std::string exec = _command;
-	exec += " --name=" + _container_name;
-	exec += " --hostname=" + _container_name;
-	exec += " " + _image_name_or_ID + " " + _entrypoint;
-	return exec;
+	return build_argv("create", {});
+}
+
+void Create::freeze()
+{
+	_frozen_args.clear();
+	auto& args = _frozen_args;
+
+	if (_options.remove_at_exit) args.emplace_back("--rm");
+	if (_options.tty) args.emplace_back("-t");
+	if (!_options.workdir.empty())
+	{
+		args.emplace_back("-w");
+		args.emplace_back(_options.workdir);
+	}
+	for (auto& [hostname, hostip] : _options.dns_entries)
+	{
+		args.emplace_back("--add-host=" + hostname + ":" + hostip);
+	}
+	for (auto& port : _options.ports)
+	{
+		args.emplace_back("-p");
+		args.emplace_back(std::to_string(port.host_port) + ":" + std::to_string(port.container_port) + (port.protocol == UDP ? "/udp" : "/tcp"));
+	}
+	size_t first_env = args.size();
+	for (auto& [name, value] : _options.env)
+	{
+		args.emplace_back("-e");
+		args.emplace_back(name + "=" + value);
+	}
+	size_t first_device = args.size();
+	for (auto& device : _options.devices)
+	{
+		args.emplace_back("--device=" + device);
+	}
+	size_t first_bind = args.size();
+	for (auto& bind : _options.binds)
+	{
+		args.emplace_back("--volume=" + bind);
+	}
+	size_t first_gpu = args.size();
+	if (_options.nvidia_gpus)
+	{
+		args.insert(args.end(), { "--gpus", "all", "--runtime", "nvidia", "-e", "NVIDIA_DRIVER_CAPABILITIES=all" });
+	}
+	if (!_options.network.empty())
+	{
+		args.emplace_back("--network");
+		args.emplace_back(_options.network);
+	}
+
+	// the shell form quotes env values and volumes, so that the shell still expands variables in them
+	size_t size = 0;
+	for (auto& arg : args) size += arg.size() + 3;
+	_frozen_str.clear();
+	_frozen_str.reserve(size);
+	for (size_t i = 0; i < args.size(); ++i)
+	{
+		const std::string& arg = args[i];
+		_frozen_str += ' ';
+		bool env_value = (i >= first_env && i < first_device && (i - first_env) % 2 == 1) || (i >= first_gpu && arg.rfind("NVIDIA_", 0) == 0);
+		bool volume = i >= first_bind && i < first_gpu;
+		size_t eq = arg.find('=');
+		if ((env_value || volume) && eq != std::string::npos)
+		{
+			_frozen_str.append(arg, 0, eq + 1).append("\"").append(arg, eq + 1, std::string::npos).append("\"");
+		}
+		else
+		{
+			_frozen_str += arg;
+		}
+	}
+
+	_frozen = true;
+}
+
+Shell::Argv Create::build_argv(const char* subcommand, std::initializer_list<const char*> flags)
+{
+	if (!_frozen) freeze();
+
+	Shell::Argv args;
+	args.reserve(2 + flags.size() + _frozen_args.size() + 3 + 4);
+	args.emplace_back("docker");
+	args.emplace_back(subcommand);
+	args.insert(args.end(), flags.begin(), flags.end());
+	args.insert(args.end(), _frozen_args.begin(), _frozen_args.end());
+
+	args.emplace_back("--name=" + _container_name);
+	args.emplace_back("--hostname=" + _container_name);
+	args.emplace_back(_image_name_or_ID);
+	utils::split_string(_entrypoint, ' ', [&args](std::string s) { if (!s.empty()) args.emplace_back(s); });
+
+	return args;
+}
+
+Shell::Output Create::execute_api()
+{
+	std::string id;
+	return create_api(id);
+}
+
+Shell::Output Create::create_api(std::string& id)
+{
+	// Translate the options into the container configuration of the Engine API
+	std::string body = "{\"Image\":" + json::quote(_image_name_or_ID);
+
+	if (!_container_name.empty())
+	{
+		body += ",\"Hostname\":" + json::quote(_container_name);
+	}
+	if (_options.tty)
+	{
+		body += ",\"Tty\":true";
+	}
+	if (!_options.workdir.empty())
+	{
+		body += ",\"WorkingDir\":" + json::quote(_options.workdir);
+	}
+
+	std::vector<std::string> env;
+	for (auto& [name, value] : _options.env) env.emplace_back(name + "=" + value);
+	if (_options.nvidia_gpus) env.emplace_back("NVIDIA_DRIVER_CAPABILITIES=all");
+	if (!env.empty())
+	{
+		body += ",\"Env\":[";
+		for (size_t i = 0; i < env.size(); ++i) body += (i ? "," : "") + json::quote(env[i]);
+		body += "]";
+	}
+
+	std::vector<std::string> cmd;
+	utils::split_string(_entrypoint, ' ', [&cmd](std::string s) { if (!s.empty()) cmd.emplace_back(s); });
+	if (!cmd.empty())
+	{
+		body += ",\"Cmd\":[";
+		for (size_t i = 0; i < cmd.size(); ++i) body += (i ? "," : "") + json::quote(cmd[i]);
+		body += "]";
+	}
+
+	std::string exposed;
+	std::string bindings;
+	for (auto& port : _options.ports)
+	{
+		std::string key = json::quote(std::to_string(port.container_port) + (port.protocol == UDP ? "/udp" : "/tcp"));
+		exposed += (exposed.empty() ? "" : ",") + key + ":{}";
+		bindings += (bindings.empty() ? "" : ",") + key + ":[{\"HostPort\":" + json::quote(std::to_string(port.host_port)) + "}]";
+	}
+	if (!exposed.empty())
+	{
+		body += ",\"ExposedPorts\":{" + exposed + "}";
+	}
+
+	body += ",\"HostConfig\":{\"AutoRemove\":" + std::string(_options.remove_at_exit ? "true" : "false");
+	if (!bindings.empty())
+	{
+		body += ",\"PortBindings\":{" + bindings + "}";
+	}
+	if (!_options.dns_entries.empty())
+	{
+		body += ",\"ExtraHosts\":[";
+		for (size_t i = 0; i < _options.dns_entries.size(); ++i)
+		{
+			body += (i ? "," : "") + json::quote(_options.dns_entries[i].first + ":" + _options.dns_entries[i].second);
+		}
+		body += "]";
+	}
+	if (!_options.devices.empty())
+	{
+		body += ",\"Devices\":[";
+		for (size_t i = 0; i < _options.devices.size(); ++i)
+		{
+			body += (i ? "," : "") + std::string("{\"PathOnHost\":") + json::quote(_options.devices[i])
+				+ ",\"PathInContainer\":" + json::quote(_options.devices[i]) + ",\"CgroupPermissions\":\"rwm\"}";
+		}
+		body += "]";
+	}
+	if (!_options.binds.empty())
+	{
+		body += ",\"Binds\":[";
+		for (size_t i = 0; i < _options.binds.size(); ++i) body += (i ? "," : "") + json::quote(_options.binds[i]);
+		body += "]";
+	}
+	if (!_options.network.empty())
+	{
+		body += ",\"NetworkMode\":" + json::quote(_options.network);
+	}
+	if (_options.nvidia_gpus)
+	{
+		body += ",\"Runtime\":\"nvidia\",\"DeviceRequests\":[{\"Driver\":\"\",\"Count\":-1,\"Capabilities\":[[\"gpu\"]]}]";
+	}
+	body += "}}";
+
+	std::string target = "/containers/create";
+	if (!_container_name.empty())
+	{
+		target += "?name=" + engine::url_encode(_container_name);
+	}
+
+	try
+	{
+		auto response = engine::Client::instance().request("POST", target, body);
+		id = json::to_string(json::find(response.body, { "Id" }));
+		return api_output(response, id);
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
 }
 
 Create& Create::remove_at_exit()
 {
-	_command += " -rm";
+	_options.remove_at_exit = true;
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::add_tty()
 {
-	_command += " -t";
+	_options.tty = true;
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::workdir(std::string dir)
 {
-	_command += " -w " + dir;
+	_options.workdir = dir;
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::add_dns_entry(std::string hostname, std::string hostip)
 {
-	_command += " --add-host=" + hostname + ":" + hostip;
+	_options.dns_entries.emplace_back(hostname, hostip);
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::port_map(int host_port, int container_port, NetworkProtocol protocol)
 {
-	std::string prot;
-	switch (protocol)
-	{
-	case docker::CLI::Create::UDP:
-		prot = "ucp";
-		break;
-	case docker::CLI::Create::TCP:
-		prot = "tcp";
-		break;
-	default:
-		prot = "tcp";
-		break;
-	}
-    _command += " -p " + std::to_string(host_port);
-    _command += ":" + std::to_string(container_port);
-	_command += "/" + prot;
+	_options.ports.push_back({ host_port, container_port, protocol });
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::set_env(std::string env_name, std::string env_value)
 {
-	_command += " -e " + env_name + "=\"" + env_value + "\"";
+	_options.env.emplace_back(env_name, env_value);
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::add_external_device(std::string device_path)
 {
-	_command += " --device=" + device_path;
+	_options.devices.emplace_back(device_path);
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::volume_bind_mount(std::string host_path, std::string container_path, BindMode mode)
 {
-	switch (mode)
-	{
-	case docker::CLI::Create::RO:
-		_command += " --volume=\"" + host_path + ":" + container_path + ":ro" + "\"";
-		break;
-	case docker::CLI::Create::RW:
-		_command += " --volume=\"" + host_path + ":" + container_path + ":rw" + "\"";
-		break;
-	default:
-		_command += " --volume=\"" + host_path + ":" + container_path + ":rw" + "\"";
-		break;
-	}
+	_options.binds.emplace_back(host_path + ":" + container_path + (mode == RO ? ":ro" : ":rw"));
+	_frozen = false;
 	return *this;
 }
 
 Create& docker::CLI::Create::add_volume(std::string volume_name, std::string container_path, bool read_only)
 {
-	if (read_only)
-	{
-		_command += " --volume=\"" + volume_name + ":" + container_path + ":ro" + "\"";
-	}
-	else
-	{
-		_command += " --volume=\"" + volume_name + ":" + container_path + "\"";
-	}
+	_options.binds.emplace_back(volume_name + ":" + container_path + (read_only ? ":ro" : ""));
+	_frozen = false;
 	return *this;
 }
 
 Create& Create::add_nvidia_gpu_support()
 {
-	_command += " --gpus all";
-	_command += " --runtime nvidia";
-	_command += " -e NVIDIA_DRIVER_CAPABILITIES=\"all\"";
+	_options.nvidia_gpus = true;
+	_frozen = false;
 	return *this;
 }
 
@@ -194,7 +741,9 @@ Create& docker::CLI::Create::network_driver(NetworkDriver network_driver)
 	default:
 		break;
 	}
-    _command += " --network " + driver;
+	_network_driver = network_driver;
+	_options.network = driver;
+	_frozen = false;
 	return *this;
 }
 
@@ -215,9 +764,42 @@ Run::~Run()
 Run& Run::detached()
 {
 	_command += " -d";
+	_detached = true;
 	return *this;
 }
 
+Shell::Argv Run::argv()
+{
+	if (_detached)
+	{
+		return build_argv("run", { "-d" });
+	}
+	return build_argv("run", {});
+}
+
+Shell::Output Run::execute_api()
+{
+	// Attached runs stream the container output: leave them to the docker CLI
+	if (!_detached)
+	{
+		return I_Command::execute_api();
+	}
+
+	std::string id;
+	Shell::Output ret = create_api(id);
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		return ret;
+	}
+
+	ret = api_container_action(id, "start");
+	if (ret.exitCode == Shell::SUCCESS)
+	{
+		ret.result = id;
+	}
+	return ret;
+}
+
 
 /*****************************************
 * DOCKER STOP COMMAND
@@ -229,10 +811,19 @@ Stop::Stop(std::string container_name_or_ID)
 Stop::~Stop()
 {}
 
-Shell::Output Stop::execute()
+std::string Stop::str()
 {
-	std::string exec = _command + " " + _container;
-	return _p_shell->execute(exec);
+	return _command + " " + _container;
+}
+
+Shell::Argv Stop::argv()
+{
+	return { "docker", "stop", _container };
+}
+
+Shell::Output Stop::execute_api()
+{
+	return api_container_action(_container, "stop");
 }
 
 Stop& Stop::change_contianer_to_stop(std::string container_name_or_ID)
@@ -252,10 +843,19 @@ Kill::Kill(std::string container_name_or_ID)
 Kill::~Kill()
 {}
 
-Shell::Output Kill::execute()
+std::string Kill::str()
+{
+	return _command + " " + _container;
+}
+
+Shell::Argv Kill::argv()
+{
+	return { "docker", "kill", _container };
+}
+
+Shell::Output Kill::execute_api()
 {
-	std::string exec = _command + " " + _container;
-	return _p_shell->execute(exec);
+	return api_container_action(_container, "kill");
 }
 
 Kill& Kill::change_contianer_to_kill(std::string container_name_or_ID)
@@ -274,10 +874,19 @@ Start::Start(std::string container_name_or_ID)
 Start::~Start()
 {}
 
-Shell::Output Start::execute()
+std::string Start::str()
+{
+	return _command + " " + _container;
+}
+
+Shell::Argv Start::argv()
+{
+	return { "docker", "start", _container };
+}
+
+Shell::Output Start::execute_api()
 {
-	std::string exec = _command + " " + _container;
-	return _p_shell->execute(exec);
+	return api_container_action(_container, "start");
 }
 
 Start& Start::change_contianer_to_start(std::string container_name_or_ID)
@@ -287,45 +896,421 @@ Start& Start::change_contianer_to_start(std::string container_name_or_ID)
 }
 
 /*****************************************
-* DOCKER REMOVE COMMAND
+* DOCKER PAUSE COMMAND
 */
-Remove::Remove(std::string container_name_or_ID)
-	: I_Command("docker rm"), _container(container_name_or_ID)
+Pause::Pause(std::string container_name_or_ID)
+	: I_Command("docker pause"), _container(container_name_or_ID)
 {}
 
-Remove::~Remove()
+Pause::~Pause()
 {}
 
-Remove& Remove::force()
+std::string Pause::str()
 {
-	_command += " -f";
-	return *this;
+	return _command + " " + _container;
 }
 
-Remove& docker::CLI::Remove::change_contianer_to_remove(std::string container_name_or_ID)
+Shell::Argv Pause::argv()
 {
-	_command = container_name_or_ID;
-	return *this;
+	return { "docker", "pause", _container };
 }
 
-Shell::Output Remove::execute()
+Shell::Output Pause::execute_api()
 {
-	std::string exec = _command + " " + _container;
-	return _p_shell->execute(exec);
+	return api_container_action(_container, "pause");
 }
 
 
 /*****************************************
-* DOCKER PRUNE COMMAND
+* DOCKER UNPAUSE COMMAND
 */
-Prune::Prune()
-	: I_Command("docker container prune -f")
+Unpause::Unpause(std::string container_name_or_ID)
+	: I_Command("docker unpause"), _container(container_name_or_ID)
 {}
 
-Prune::~Prune()
+Unpause::~Unpause()
 {}
 
-
+std::string Unpause::str()
+{
+	return _command + " " + _container;
+}
+
+Shell::Argv Unpause::argv()
+{
+	return { "docker", "unpause", _container };
+}
+
+Shell::Output Unpause::execute_api()
+{
+	return api_container_action(_container, "unpause");
+}
+
+
+/*****************************************
+* DOCKER REMOVE COMMAND
+*/
+Remove::Remove(std::string container_name_or_ID)
+	: I_Command("docker rm"), _container(container_name_or_ID)
+{}
+
+Remove::~Remove()
+{}
+
+Remove& Remove::force()
+{
+	_command += " -f";
+	_force = true;
+	return *this;
+}
+
+Remove& docker::CLI::Remove::change_contianer_to_remove(std::string container_name_or_ID)
+{
+	_container = container_name_or_ID;
+	return *this;
+}
+
+std::string Remove::str()
+{
+	return _command + " " + _container;
+}
+
+Shell::Argv Remove::argv()
+{
+	if (_force)
+	{
+		return { "docker", "rm", "-f", _container };
+	}
+	return { "docker", "rm", _container };
+}
+
+Shell::Output Remove::execute_api()
+{
+	try
+	{
+		std::string target = "/containers/" + engine::url_encode(_container);
+		if (_force)
+		{
+			target += "?force=1";
+		}
+		auto response = engine::Client::instance().request("DELETE", target);
+		return api_output(response, _container);
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
+}
+
+
+/*****************************************
+* DOCKER PRUNE COMMAND
+*/
+Prune::Prune()
+	: I_Command("docker container prune -f")
+{}
+
+Prune::~Prune()
+{}
+
+Shell::Output Prune::execute_api()
+{
+	try
+	{
+		auto response = engine::Client::instance().request("POST", "/containers/prune");
+
+		std::string output = "Deleted Containers:\n";
+		for (auto& id : json::elements(json::find(response.body, { "ContainersDeleted" })))
+		{
+			output += json::to_string(id) + "\n";
+		}
+		output += "\nTotal reclaimed space: " + human_size(std::strtod(std::string(json::find(response.body, { "SpaceReclaimed" })).c_str(), nullptr));
+
+		return api_output(response, output);
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
+}
+
+
+/***********************************
+* DOCKER EXEC
+*/
+Exec::Exec(std::string container_name_or_ID, std::string command)
+	: I_Command("docker exec"), _container(container_name_or_ID), _shell_command(command)
+{}
+
+Exec::~Exec()
+{}
+
+Exec& Exec::user(std::string user)
+{
+	_user = user;
+	return *this;
+}
+
+Exec& Exec::workdir(std::string directory)
+{
+	_workdir = directory;
+	return *this;
+}
+
+std::string Exec::str()
+{
+	std::string exec = _command;
+	if (!_user.empty()) exec.append(" --user ").append(_user);
+	if (!_workdir.empty()) exec.append(" --workdir '").append(_workdir).append("'");
+	exec.append(" ").append(_container).append(" sh -c '");
+	for (char ch : _shell_command)
+	{
+		if (ch == '\'') exec.append("'\\''");
+		else exec.push_back(ch);
+	}
+	exec.append("'");
+	return exec;
+}
+
+Shell::Argv Exec::argv()
+{
+	Shell::Argv args{ "docker", "exec" };
+	if (!_user.empty()) args.insert(args.end(), { "--user", _user });
+	if (!_workdir.empty()) args.insert(args.end(), { "--workdir", _workdir });
+	args.insert(args.end(), { _container, "sh", "-c", _shell_command });
+	return args;
+}
+
+
+/***********************************
+* DOCKER LOGS
+*/
+Logs::Logs(std::string container_name_or_ID)
+	: I_Command("docker logs"), _container(container_name_or_ID)
+{}
+
+Logs::~Logs()
+{}
+
+void Logs::reset_command_options()
+{
+	_command = "docker logs";
+	_follow = false;
+	_timestamps = false;
+	_since.clear();
+	_tail.clear();
+}
+
+Logs& Logs::follow()
+{
+	_command += " -f";
+	_follow = true;
+	return *this;
+}
+
+Logs& Logs::timestamps()
+{
+	_command += " --timestamps";
+	_timestamps = true;
+	return *this;
+}
+
+Logs& Logs::since(std::string time)
+{
+	_command += " --since '" + time + "'";
+	_since = time;
+	return *this;
+}
+
+Logs& Logs::tail(std::string lines)
+{
+	_command += " --tail '" + lines + "'";
+	_tail = lines;
+	return *this;
+}
+
+std::string Logs::str()
+{
+	return _command + " " + _container;
+}
+
+Shell::Argv Logs::argv()
+{
+	Shell::Argv args{ "docker", "logs" };
+	if (_follow) args.push_back("-f");
+	if (_timestamps) args.push_back("--timestamps");
+	if (!_since.empty()) args.insert(args.end(), { "--since", _since });
+	if (!_tail.empty()) args.insert(args.end(), { "--tail", _tail });
+	args.push_back(_container);
+	return args;
+}
+
+/***********************************
+* DOCKER PULL
+*/
+Pull::Pull(std::string reference)
+	: I_Command("docker pull"), _reference(reference)
+{}
+
+Pull::~Pull()
+{}
+
+void Pull::reset_command_options()
+{
+	_command = "docker pull";
+	_platform.clear();
+}
+
+Pull& Pull::platform(std::string platform)
+{
+	_command += " --platform '" + platform + "'";
+	_platform = platform;
+	return *this;
+}
+
+std::string Pull::str()
+{
+	return _command + " " + _reference;
+}
+
+Shell::Argv Pull::argv()
+{
+	Shell::Argv args{ "docker", "pull" };
+	if (!_platform.empty()) args.insert(args.end(), { "--platform", _platform });
+	args.push_back(_reference);
+	return args;
+}
+
+Shell::Output Pull::execute_api()
+{
+	// without a tag the API pulls all the tags of the repository
+	std::string target = "/images/create?fromImage=" + engine::url_encode(_reference);
+	if (!has_tag_or_digest(_reference))
+	{
+		target += "&tag=latest";
+	}
+	if (!_platform.empty())
+	{
+		target += "&platform=" + engine::url_encode(_platform);
+	}
+
+	engine::Response response;
+	try
+	{
+		response = engine::Client::instance().request("POST", target);
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
+
+	if (!response.ok())
+	{
+		return api_output(response, "");
+	}
+
+	// a JSON message per step: the failures come as messages too, with a 200 status
+	std::string output;
+	std::string_view body = response.body;
+	while (!body.empty())
+	{
+		size_t end = body.find('\n');
+		std::string_view message = body.substr(0, end);
+		body = end == std::string_view::npos ? std::string_view() : body.substr(end + 1);
+
+		std::string error = json::to_string(json::find(message, { "error" }));
+		if (!error.empty())
+		{
+			return { Shell::FAIL, error };
+		}
+		std::string status = json::to_string(json::find(message, { "status" }));
+		std::string id = json::to_string(json::find(message, { "id" }));
+		if (!status.empty())
+		{
+			output += (id.empty() ? "" : id + ": ") + status + "\n";
+		}
+	}
+	output += _reference;
+	return api_output(response, output);
+}
+
+/***********************************
+* DOCKER STATS
+*/
+Stats::Stats()
+	: I_Command("docker stats --no-stream --no-trunc --format '{{json .}}'")
+{}
+
+Stats::Stats(std::vector<std::string> containers)
+	: I_Command("docker stats --no-stream --no-trunc --format '{{json .}}'"), _containers(std::move(containers))
+{
+	for (auto& container : _containers) _command.append(" ").append(container);
+}
+
+Stats::~Stats()
+{}
+
+Shell::Argv Stats::argv()
+{
+	Shell::Argv args{ "docker", "stats", "--no-stream", "--no-trunc", "--format", "{{json .}}" };
+	args.insert(args.end(), _containers.begin(), _containers.end());
+	return args;
+}
+
+uint64_t StatsInfo::parse_size(std::string_view text)
+{
+	std::string number(text);
+	char* end = nullptr;
+	double value = std::strtod(number.c_str(), &end);
+	if (end == number.c_str() || value < 0)
+	{
+		return 0; // "--" when the value is not available
+	}
+
+	std::string_view unit = std::string_view(number).substr(end - number.c_str());
+	struct Unit { const char* name; double factor; };
+	static const Unit units[] = {
+		{ "B", 1.0 },
+		{ "kB", 1e3 }, { "KB", 1e3 }, { "MB", 1e6 }, { "GB", 1e9 }, { "TB", 1e12 }, { "PB", 1e15 },
+		{ "KiB", 1024.0 }, { "MiB", 1048576.0 }, { "GiB", 1073741824.0 }, { "TiB", 1099511627776.0 }, { "PiB", 1125899906842624.0 },
+	};
+	for (const Unit& u : units)
+	{
+		if (unit == u.name)
+		{
+			return static_cast<uint64_t>(value * u.factor + 0.5);
+		}
+	}
+	return static_cast<uint64_t>(value + 0.5);
+}
+
+bool StatsInfo::parse(std::string_view line)
+{
+	// "used / limit" pairs
+	auto split = [](std::string_view pair, uint64_t& first, uint64_t& second) {
+		size_t slash = pair.find(" / ");
+		first = parse_size(pair.substr(0, slash));
+		second = slash == std::string_view::npos ? 0 : parse_size(pair.substr(slash + 3));
+	};
+	auto percent = [](std::string_view text) {
+		return std::strtod(std::string(text).c_str(), nullptr);
+	};
+
+	return json::for_each_member(line, [&](std::string_view key, std::string_view value) {
+		std::string text = json::to_string(value);
+		if (key == "ID")			id = text;
+		else if (key == "Name")		name = text;
+		else if (key == "CPUPerc")	cpu_percent = percent(text);
+		else if (key == "MemPerc")	memory_percent = percent(text);
+		else if (key == "MemUsage")	split(text, memory_usage, memory_limit);
+		else if (key == "NetIO")	split(text, net_rx, net_tx);
+		else if (key == "BlockIO")	split(text, block_read, block_write);
+		else if (key == "PIDs")		pids = parse_size(text);
+		return true;
+	});
+}
+
+
 /***********************************
 * DOCKER IMAGES
 */
@@ -339,6 +1324,8 @@ Images::~Images()
 void Images::reset_command_options()
 {
 	_command = "docker images";
+	_references.clear();
+	_extract.reset();
 }
 
 Images& Images::filter(Images::Filter filter, std::string filter_value)
@@ -353,6 +1340,7 @@ Images& Images::filter(Images::Filter filter, std::string filter_value)
 	//	break;
 	case Images::REFERENCE:
 		_command += " --filter \"reference=" + filter_value + "\"";
+		_references.emplace_back(filter_value);
 		break;
     }
 
@@ -372,10 +1360,285 @@ Images& Images::extract(Extract ext)
 	case Images::TAG:
 		_command += " --format {{.Tag}}";
 		break;
+	case Images::JSON:
+		_command += " --no-trunc --digests --format '{{json .}}'";
+		break;
     }
+	_extract = ext;
 	return *this;
 }
 
+Shell::Argv Images::argv()
+{
+	Shell::Argv args{ "docker", "images" };
+	for (auto& reference : _references)
+	{
+		args.emplace_back("--filter");
+		args.emplace_back("reference=" + reference);
+	}
+	if (_extract == JSON)
+	{
+		args.insert(args.end(), { "--no-trunc", "--digests", "--format", "{{json .}}" });
+	}
+	else if (_extract)
+	{
+		args.emplace_back("--format");
+		args.emplace_back(*_extract == ID ? "{{.ID}}" : (*_extract == NAME ? "{{.Repository}}" : "{{.Tag}}"));
+	}
+	return args;
+}
+
+Shell::Output Images::execute_api()
+{
+	std::string target = "/images/json";
+	if (!_references.empty())
+	{
+		std::string filters = "{\"reference\":[";
+		for (size_t i = 0; i < _references.size(); ++i) filters += (i ? "," : "") + json::quote(_references[i]);
+		filters += "]}";
+		target += "?filters=" + engine::url_encode(filters);
+	}
+
+	engine::Response response;
+	try
+	{
+		response = engine::Client::instance().request("GET", target);
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
+
+	if (!response.ok())
+	{
+		return api_output(response, "");
+	}
+
+	// One row for each repository:tag of each image, as the CLI does
+	std::vector<std::array<std::string, 5>> rows;
+	std::string lines;
+	for (auto& image : json::elements(response.body))
+	{
+		if (_extract == JSON)
+		{
+			lines += image_json_lines(image);
+			continue;
+		}
+
+		std::string id = json::to_string(json::find(image, { "Id" }));
+		if (id.compare(0, 7, "sha256:") == 0) id.erase(0, 7);
+		id.resize(std::min<size_t>(id.size(), 12));
+
+		std::string created = human_elapsed(std::strtoll(std::string(json::find(image, { "Created" })).c_str(), nullptr, 10));
+		std::string size = human_size(std::strtod(std::string(json::find(image, { "Size" })).c_str(), nullptr));
+
+		auto tags = json::elements(json::find(image, { "RepoTags" }));
+		if (tags.empty())
+		{
+			rows.push_back({ "<none>", "<none>", id, created, size });
+		}
+		for (auto& raw_tag : tags)
+		{
+			std::string tag = json::to_string(raw_tag);
+			auto colon = tag.rfind(':');
+			std::string repository = colon == std::string::npos ? tag : tag.substr(0, colon);
+			std::string version = colon == std::string::npos ? "<none>" : tag.substr(colon + 1);
+			rows.push_back({ repository, version, id, created, size });
+		}
+	}
+
+	std::string output;
+	if (_extract == JSON)
+	{
+		if (!lines.empty()) lines.pop_back();
+		return api_output(response, lines);
+	}
+	if (_extract)
+	{
+		size_t column = *_extract == ID ? 2 : (*_extract == NAME ? 0 : 1);
+		for (auto& row : rows)
+		{
+			output += (output.empty() ? "" : "\n") + row[column];
+		}
+		return api_output(response, output);
+	}
+
+	rows.insert(rows.begin(), { "REPOSITORY", "TAG", "IMAGE ID", "CREATED", "SIZE" });
+	std::array<size_t, 5> widths{};
+	for (auto& row : rows)
+	{
+		for (size_t c = 0; c < row.size(); ++c) widths[c] = std::max(widths[c], row[c].size());
+	}
+	for (size_t r = 0; r < rows.size(); ++r)
+	{
+		if (r) output += "\n";
+		for (size_t c = 0; c < rows[r].size(); ++c)
+		{
+			output += rows[r][c];
+			if (c + 1 < rows[r].size()) output += std::string(widths[c] - rows[r][c].size() + 3, ' ');
+		}
+	}
+	return api_output(response, output);
+}
+
+
+/***********************************
+* TYPED INSPECT
+*/
+bool InspectInfo::locate(std::string_view inspect_output, Raw& raw)
+{
+	// docker inspect prints an array, even for a single container
+	std::string_view doc = inspect_output;
+	size_t first = doc.find_first_not_of(" \t\r\n");
+	if (first != std::string_view::npos && doc[first] == '[')
+	{
+		size_t pos = first + 1;
+		size_t begin = doc.find_first_not_of(" \t\r\n", pos);
+		if (begin == std::string_view::npos || !json::skip_value(doc, pos))
+		{
+			return false;
+		}
+		doc = doc.substr(begin, pos - begin);
+	}
+
+	bool ok = json::for_each_member(doc, [&raw](std::string_view key, std::string_view value) {
+		if (key == "Id")					raw.id = value;
+		else if (key == "Name")				raw.name = value;
+		else if (key == "Image")			raw.image_id = value;
+		else if (key == "RestartCount")		raw.restart_count = value;
+		else if (key == "Mounts")			raw.mounts = value;
+		else if (key == "Config")			raw.image = json::find(value, { "Image" });
+		else if (key == "NetworkSettings")	raw.networks = json::find(value, { "Networks" });
+		else if (key == "State")
+		{
+			json::for_each_member(value, [&raw](std::string_view k, std::string_view v) {
+				if (k == "Status")				raw.status = v;
+				else if (k == "ExitCode")		raw.exit_code = v;
+				else if (k == "Pid")			raw.pid = v;
+				else if (k == "StartedAt")		raw.started_at = v;
+				else if (k == "FinishedAt")		raw.finished_at = v;
+				else if (k == "Health")			raw.health = json::find(v, { "Status" });
+				return true;
+			});
+		}
+		return true;
+	});
+
+	return ok && !raw.id.empty();
+}
+
+std::string InspectInfo::text(std::string_view raw)
+{
+	return json::to_string(raw);
+}
+
+long long InspectInfo::integer(std::string_view raw)
+{
+	return json::to_integer(raw);
+}
+
+void InspectInfo::parse_mounts(std::string_view raw)
+{
+	mounts.clear();
+	for (auto& element : json::elements(raw))
+	{
+		Mount m;
+		json::for_each_member(element, [&m](std::string_view key, std::string_view value) {
+			if (key == "Type")				m.type = json::to_string(value);
+			else if (key == "Name")			m.name = json::to_string(value);
+			else if (key == "Source")		m.source = json::to_string(value);
+			else if (key == "Destination")	m.destination = json::to_string(value);
+			else if (key == "RW")			m.read_only = value == "false";
+			return true;
+		});
+		mounts.push_back(std::move(m));
+	}
+}
+
+void InspectInfo::parse_networks(std::string_view raw)
+{
+	networks.clear();
+	json::for_each_member(raw, [this](std::string_view key, std::string_view value) {
+		Network n;
+		n.name = std::string(key);
+		json::for_each_member(value, [&n](std::string_view k, std::string_view v) {
+			if (k == "IPAddress")			n.ip_address = json::to_string(v);
+			else if (k == "Gateway")		n.gateway = json::to_string(v);
+			else if (k == "MacAddress")		n.mac_address = json::to_string(v);
+			return true;
+		});
+		networks.push_back(std::move(n));
+		return true;
+	});
+}
+
+
+/***********************************
+* DOCKER PS
+*/
+Ps::Ps()
+	: I_Command("docker ps -a --no-trunc --format '{{json .}}'")
+{}
+
+Ps::~Ps()
+{}
+
+Shell::Argv Ps::argv()
+{
+	return { "docker", "ps", "-a", "--no-trunc", "--format", "{{json .}}" };
+}
+
+Shell::Output Ps::execute_api()
+{
+	engine::Response response;
+	try
+	{
+		response = engine::Client::instance().request("GET", "/containers/json?all=1");
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
+
+	// same fields as the CLI json format
+	std::string output;
+	for (auto& cnt : json::elements(response.body))
+	{
+		std::string names;
+		for (auto& name : json::elements(json::find(cnt, { "Names" })))
+		{
+			std::string n = json::to_string(name);
+			names += (names.empty() ? "" : ",") + (n.size() > 0 && n[0] == '/' ? n.substr(1) : n);
+		}
+
+		output += "{\"Command\":" + json::quote(json::to_string(json::find(cnt, { "Command" })))
+			+ ",\"ID\":" + json::quote(json::to_string(json::find(cnt, { "Id" })))
+			+ ",\"Image\":" + json::quote(json::to_string(json::find(cnt, { "Image" })))
+			+ ",\"Names\":" + json::quote(names)
+			+ ",\"State\":" + json::quote(json::to_string(json::find(cnt, { "State" })))
+			+ ",\"Status\":" + json::quote(json::to_string(json::find(cnt, { "Status" }))) + "}\n";
+	}
+	if (!output.empty()) output.pop_back();
+
+	return api_output(response, output);
+}
+
+
+/***********************************
+* DOCKER EVENTS
+*/
+Events::Events(std::string type)
+	: I_Command("docker events --format '{{json .}}' --filter type=" + type), _type(type)
+{}
+
+Events::~Events()
+{}
+
+Shell::Argv Events::argv()
+{
+	return { "docker", "events", "--format", "{{json .}}", "--filter", "type=" + _type };
+}
+
 
 /***********************************
 * DOCKER INSPECT CONTAINER
@@ -390,6 +1653,7 @@ Inspect::~Inspect()
 void Inspect::reset_command_options()
 {
 	_command = "docker inspect " + _container;
+	_extract.reset();
 }
 
 Inspect& Inspect::extract(Extract ext)
@@ -406,7 +1670,66 @@ Inspect& Inspect::extract(Extract ext)
 		_command += " --format {{.Id}}";
 		break;
 	}
+	_extract = ext;
 
 	return *this;
 }
 
+Shell::Argv Inspect::argv()
+{
+	Shell::Argv args{ "docker", "inspect", _container };
+	if (_extract)
+	{
+		args.emplace_back("--format");
+		switch (*_extract)
+		{
+		case docker::CLI::Inspect::STATUS:
+			args.emplace_back("{{.State.Status}}");
+			break;
+		case docker::CLI::Inspect::IMAGE_ID:
+			args.emplace_back("{{.Config.Image}}");
+			break;
+		case docker::CLI::Inspect::ID:
+			args.emplace_back("{{.Id}}");
+			break;
+		}
+	}
+	return args;
+}
+
+Shell::Output Inspect::execute_api()
+{
+	engine::Response response;
+	try
+	{
+		response = engine::Client::instance().request("GET", "/containers/" + engine::url_encode(_container) + "/json");
+	}
+	catch (const std::exception& ex)
+	{
+		return api_error(ex);
+	}
+
+	if (!_extract)
+	{
+		std::string_view body = response.body;
+		while (!body.empty() && (body.back() == '\n' || body.back() == '\r')) body.remove_suffix(1);
+		return api_output(response, "[" + std::string(body) + "]");
+	}
+
+	std::string_view value;
+	switch (*_extract)
+	{
+	case docker::CLI::Inspect::STATUS:
+		value = json::find(response.body, { "State", "Status" });
+		break;
+	case docker::CLI::Inspect::IMAGE_ID:
+		value = json::find(response.body, { "Config", "Image" });
+		break;
+	case docker::CLI::Inspect::ID:
+		value = json::find(response.body, { "Id" });
+		break;
+	}
+
+	return api_output(response, json::to_string(value));
+}
+
@@ -0,0 +1,376 @@
+#include "Docker.h"
+
+#include <cstring>
+
+#ifdef UNIX
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif // __linux__
+#endif // UNIX
+
+using namespace docker;
+
+
+namespace
+{
+	const char* FILE_NAMES[] = { "cpu.stat", "memory.current", "memory.stat", "io.stat" };
+
+	// big enough for the memory.stat of recent kernels
+	const size_t READ_BUFFER_SIZE = 16 * 1024;
+
+	struct Counter
+	{
+		std::string_view		key;
+		uint64_t CgroupReader::Usage::* field;
+	};
+
+	const Counter CPU_COUNTERS[] = {
+		{ "usage_usec", &CgroupReader::Usage::cpu_usage_usec },
+		{ "user_usec", &CgroupReader::Usage::cpu_user_usec },
+		{ "system_usec", &CgroupReader::Usage::cpu_system_usec },
+		{ "nr_periods", &CgroupReader::Usage::cpu_nr_periods },
+		{ "nr_throttled", &CgroupReader::Usage::cpu_nr_throttled },
+		{ "throttled_usec", &CgroupReader::Usage::cpu_throttled_usec },
+	};
+
+	const Counter MEMORY_COUNTERS[] = {
+		{ "anon", &CgroupReader::Usage::memory_anon },
+		{ "file", &CgroupReader::Usage::memory_file },
+		{ "kernel", &CgroupReader::Usage::memory_kernel },
+		{ "sock", &CgroupReader::Usage::memory_sock },
+		{ "shmem", &CgroupReader::Usage::memory_shmem },
+		{ "pgfault", &CgroupReader::Usage::memory_pgfault },
+		{ "pgmajfault", &CgroupReader::Usage::memory_pgmajfault },
+	};
+
+	const Counter IO_COUNTERS[] = {
+		{ "rbytes", &CgroupReader::Usage::io_read_bytes },
+		{ "wbytes", &CgroupReader::Usage::io_write_bytes },
+		{ "rios", &CgroupReader::Usage::io_read_ops },
+		{ "wios", &CgroupReader::Usage::io_write_ops },
+	};
+
+	uint64_t to_number(std::string_view text)
+	{
+		uint64_t value = 0;
+		for (char ch : text)
+		{
+			if (ch < '0' || ch > '9') break;
+			value = value * 10 + static_cast<uint64_t>(ch - '0');
+		}
+		return value;
+	}
+
+	/**
+		@brief  Parses "key value" lines (cpu.stat, memory.stat)
+	**/
+	template<size_t N>
+	void parse_flat(std::string_view text, const Counter (&counters)[N], CgroupReader::Usage& usage)
+	{
+		while (!text.empty())
+		{
+			size_t end = text.find('\n');
+			std::string_view line = text.substr(0, end);
+			text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+
+			size_t space = line.find(' ');
+			if (space == std::string_view::npos) continue;
+			std::string_view key = line.substr(0, space);
+			for (const Counter& c : counters)
+			{
+				if (c.key == key)
+				{
+					usage.*c.field = to_number(line.substr(space + 1));
+					break;
+				}
+			}
+		}
+	}
+
+	/**
+		@brief  Parses the "major:minor key=value..." lines of io.stat, summing the devices
+	**/
+	void parse_io(std::string_view text, CgroupReader::Usage& usage)
+	{
+		size_t pos = 0;
+		while (pos < text.size())
+		{
+			size_t end = text.find_first_of(" \n", pos);
+			if (end == std::string_view::npos) end = text.size();
+			std::string_view token = text.substr(pos, end - pos);
+			pos = end + 1;
+
+			size_t equal = token.find('=');
+			if (equal == std::string_view::npos) continue; // the device
+			std::string_view key = token.substr(0, equal);
+			for (const Counter& c : IO_COUNTERS)
+			{
+				if (c.key == key)
+				{
+					usage.*c.field += to_number(token.substr(equal + 1));
+					break;
+				}
+			}
+		}
+	}
+
+#ifdef UNIX
+	bool is_directory(const std::string& path)
+	{
+		struct stat st;
+		return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+	}
+
+	/**
+		@brief  Check if the file is on a cgroup v2 file system, where the files of a removed cgroup fail to read
+	**/
+	bool is_cgroupfs(int fd)
+	{
+#ifdef __linux__
+		struct statfs st;
+		return ::fstatfs(fd, &st) == 0 && st.f_type == CGROUP2_SUPER_MAGIC;
+#else
+		(void)fd;
+		return false;
+#endif // __linux__
+	}
+
+	/**
+		@brief  Check if the file has been deleted, for the file systems where it stays readable
+	**/
+	bool is_unlinked(int fd)
+	{
+		struct stat st;
+		return ::fstat(fd, &st) != 0 || st.st_nlink == 0;
+	}
+
+	/**
+		@brief  Reads a whole (small) file from its start
+		@retval  - The number of bytes read, -1 on error
+	**/
+	ssize_t read_file(int fd, char* buffer, size_t size)
+	{
+		size_t total = 0;
+		while (total < size)
+		{
+			ssize_t n = ::pread(fd, buffer + total, size - total, static_cast<off_t>(total));
+			if (n < 0)
+			{
+				if (errno == EINTR) continue;
+				return -1;
+			}
+			if (n == 0) break;
+			total += static_cast<size_t>(n);
+		}
+		return static_cast<ssize_t>(total);
+	}
+#endif // UNIX
+}
+
+
+CgroupReader::CgroupReader(std::string cgroup_root, std::string proc_root)
+	: _cgroup_root(std::move(cgroup_root)), _proc_root(std::move(proc_root))
+{}
+
+CgroupReader::~CgroupReader()
+{
+	for (auto& entry : _entries) close(entry);
+}
+
+void CgroupReader::close(Entry& entry)
+{
+#ifdef UNIX
+	for (int& fd : entry.fds)
+	{
+		if (fd >= 0) ::close(fd);
+		fd = -1;
+	}
+#endif // UNIX
+	entry.path.clear();
+}
+
+std::string CgroupReader::resolve(std::string_view id, int pid) const
+{
+#ifdef UNIX
+	if (pid > 0)
+	{
+		// cgroup v2 has a single line: 0::/path
+		int fd = ::open((_proc_root + "/" + std::to_string(pid) + "/cgroup").c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd >= 0)
+		{
+			char buffer[4096];
+			ssize_t n = read_file(fd, buffer, sizeof(buffer));
+			::close(fd);
+
+			std::string_view text(buffer, n > 0 ? static_cast<size_t>(n) : 0);
+			while (!text.empty())
+			{
+				size_t end = text.find('\n');
+				std::string_view line = text.substr(0, end);
+				text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+
+				if (line.substr(0, 3) == "0::" && line.size() > 4)
+				{
+					std::string path(line.substr(4));
+					if (is_directory(_cgroup_root + "/" + path)) return path;
+				}
+			}
+		}
+	}
+
+	if (!id.empty())
+	{
+		// the layouts of the systemd and the cgroupfs cgroup drivers
+		std::string candidates[] = {
+			"system.slice/docker-" + std::string(id) + ".scope",
+			"docker/" + std::string(id),
+		};
+		for (auto& path : candidates)
+		{
+			if (is_directory(_cgroup_root + "/" + path)) return path;
+		}
+	}
+#endif // UNIX
+	return {};
+}
+
+CgroupReader::Handle CgroupReader::add(Container& container)
+{
+	CLI::InspectInfo info;
+	Shell::Output ret = container.limited(CLI::Inspect(container._runtime_infos.name))
+		.execute_typed<CLI::InspectInfo::STATE | CLI::InspectInfo::PID>(info);
+	if (ret.exitCode != Shell::SUCCESS || info.pid <= 0)
+	{
+		return INVALID; // not running
+	}
+	return add(info.id, info.pid);
+}
+
+CgroupReader::Handle CgroupReader::add(std::string_view id, int pid)
+{
+#ifdef UNIX
+	std::string path = resolve(id, pid);
+	if (path.empty())
+	{
+		return INVALID;
+	}
+
+	Entry entry;
+	entry.path = path;
+	std::string directory = _cgroup_root + "/" + path + "/";
+	bool any = false;
+	for (int f = 0; f < FILES; ++f)
+	{
+		// a file is missing when its controller is not enabled for the cgroup
+		entry.fds[f] = ::open((directory + FILE_NAMES[f]).c_str(), O_RDONLY | O_CLOEXEC);
+		any = any || entry.fds[f] >= 0;
+	}
+	if (!any)
+	{
+		return INVALID;
+	}
+	for (int fd : entry.fds)
+	{
+		if (fd >= 0)
+		{
+			entry.cgroupfs = is_cgroupfs(fd);
+			break;
+		}
+	}
+
+	Handle handle;
+	if (!_free.empty())
+	{
+		handle = _free.back();
+		_free.pop_back();
+		_entries[handle] = std::move(entry);
+	}
+	else
+	{
+		handle = static_cast<Handle>(_entries.size());
+		_entries.push_back(std::move(entry));
+	}
+	++_size;
+	return handle;
+#else
+	return INVALID;
+#endif // UNIX
+}
+
+void CgroupReader::remove(Handle handle)
+{
+	if (handle >= _entries.size() || _entries[handle].path.empty())
+	{
+		return;
+	}
+	close(_entries[handle]);
+	_free.push_back(handle);
+	--_size;
+}
+
+std::string_view CgroupReader::path(Handle handle) const
+{
+	return handle < _entries.size() ? std::string_view(_entries[handle].path) : std::string_view();
+}
+
+bool CgroupReader::read(Handle handle, Usage& usage) const
+{
+	usage = Usage();
+#ifdef UNIX
+	if (handle >= _entries.size() || _entries[handle].path.empty())
+	{
+		return false;
+	}
+
+	char buffer[READ_BUFFER_SIZE];
+	const Entry& entry = _entries[handle];
+	for (int f = 0; f < FILES; ++f)
+	{
+		if (entry.fds[f] < 0) continue;
+
+		if (!entry.cgroupfs && is_unlinked(entry.fds[f]))
+		{
+			return false;
+		}
+
+		// the files of a removed cgroup fail with ENODEV
+		ssize_t n = read_file(entry.fds[f], buffer, sizeof(buffer));
+		if (n < 0)
+		{
+			return false;
+		}
+		std::string_view text(buffer, static_cast<size_t>(n));
+
+		switch (f)
+		{
+		case CPU_STAT:			parse_flat(text, CPU_COUNTERS, usage); break;
+		case MEMORY_CURRENT:	usage.memory_current = to_number(text); break;
+		case MEMORY_STAT:		parse_flat(text, MEMORY_COUNTERS, usage); break;
+		case IO_STAT:			parse_io(text, usage); break;
+		}
+	}
+	return true;
+#else
+	return false;
+#endif // UNIX
+}
+
+size_t CgroupReader::read_all(const std::function<void(Handle, const Usage&)>& f) const
+{
+	size_t count = 0;
+	Usage usage;
+	for (Handle h = 0; h < _entries.size(); ++h)
+	{
+		if (!_entries[h].path.empty() && read(h, usage))
+		{
+			f(h, usage);
+			++count;
+		}
+	}
+	return count;
+}
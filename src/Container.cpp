@@ -1,44 +1,115 @@
 #include "Docker.h"
 #include "Shell.h"
+#include "ExecSessions.hpp"
 
 using namespace docker;
 
 
+const std::array<std::string, 7> Container::_status_names{ "created", "restarting", "running", "removing", "paused", "exited", "dead" };
+
+
 Container::Container(CLI::Create create_command)
-    :	_create_command(create_command),
-    _status_names{"created", "restarting", "running", "removing", "paused", "exited", "dead" }
+    :	_create_command(create_command)
 {
 	_runtime_infos.image_name_or_id = _create_command.get_image_identifier();
 	_runtime_infos.entrypoint = _create_command.get_entrypoint();
 	_runtime_infos.name = _create_command.get_container_unique_name();
 	_runtime_infos.current_status = "unknown";
+	_exec_sessions = std::make_unique<ExecSessions>(_runtime_infos.name);
 
 	_notify_status_changed = []() {};
 }
 
 Container::Container(CLI::Create create_command, std::string container_unique_name)
-	: _create_command(create_command),
-	_status_names{ "created", "restarting", "running", "removing", "paused", "exited", "dead" }
+	: _create_command(create_command)
 {
 	_runtime_infos.image_name_or_id = _create_command.get_image_identifier();
 	_runtime_infos.entrypoint = _create_command.get_entrypoint();
 	_runtime_infos.name = container_unique_name;
 	_create_command.set_container_unique_name(container_unique_name);
 	_runtime_infos.current_status = "unknown";
+	_exec_sessions = std::make_unique<ExecSessions>(_runtime_infos.name);
 	
 	_notify_status_changed = []() {};
 }
 
 Container::~Container()
-{}
+{
+	if (_watched)
+	{
+		EventWatcher::instance().unwatch(*this);
+	}
+}
+
+Container::Container(Container&& other)
+	: _create_command(std::move(other._create_command))
+{
+	move_from(other);
+}
+
+Container& Container::operator=(Container&& other)
+{
+	if (this != &other)
+	{
+		if (_watched)
+		{
+			EventWatcher::instance().unwatch(*this);
+		}
+		_create_command = std::move(other._create_command);
+		move_from(other);
+	}
+	return *this;
+}
+
+void Container::move_from(Container& other)
+{
+	// the watcher must not update other while it is moved: it re-points its registration with the state
+	if (other._watched)
+	{
+		EventWatcher::instance().rebind(other, *this);
+	}
+	else
+	{
+		move_state_from(other);
+	}
+
+	_cache_policy = other._cache_policy;
+	_cache_ttl = other._cache_ttl;
+	_timeout = other._timeout;
+	_cancel_token = std::move(other._cancel_token);
+	_exec_sessions = std::move(other._exec_sessions);
+	// the moved-from container stays usable: its sessions no longer name a container
+	other._exec_sessions = std::make_unique<ExecSessions>(std::string());
+}
+
+void Container::move_state_from(Container& other)
+{
+	std::scoped_lock lock(_state_mutex, other._state_mutex);
+
+	_runtime_infos = std::move(other._runtime_infos);
+	_current_status = other._current_status;
+	_notify_status_changed = std::move(other._notify_status_changed);
+	_notify_and_send_status_changed = std::move(other._notify_and_send_status_changed);
+	_notify_status_changed_with_this = std::move(other._notify_status_changed_with_this);
+	_refreshed_at = other._refreshed_at;
+	_stale = other._stale;
+}
 
 bool Container::operator==(const Container& other) const
 {
+	if (this == &other)
+	{
+		return true;
+	}
+
+	std::scoped_lock lock(_state_mutex, other._state_mutex);
 	return (this->_runtime_infos.name == other._runtime_infos.name) || (this->_runtime_infos.ID == other._runtime_infos.ID);
 }
 
 std::ostream& Container::operator<<(std::ostream& stream)
 {
+	std::lock_guard<std::mutex> lock(_state_mutex);
+
 	stream << "Container Infos:\n";
 	stream << "{\n";
 	stream << "\tName: " << _runtime_infos.name << "\n";
@@ -57,6 +128,7 @@ void Container::set_status_callback(std::function<void()> function)
     {
         std::cerr << "docker::Container::set_status_callback: function is empty" << std::endl;
     }
+	std::lock_guard<std::mutex> lock(_state_mutex);
 	 _notify_status_changed = function;
     _notify_and_send_status_changed = nullptr;
 	 _notify_status_changed_with_this = nullptr;
@@ -68,6 +140,7 @@ void Container::set_status_callback(std::function<void(Status)> function)
 	{
 		std::cerr << "docker::Container::set_status_callback: function is empty" << std::endl;
 	}
+	std::lock_guard<std::mutex> lock(_state_mutex);
 	_notify_status_changed = nullptr;
 	_notify_and_send_status_changed = function;
 	_notify_status_changed_with_this = nullptr;
@@ -79,13 +152,82 @@ void Container::set_status_callback(std::function<void(Container*)> function)
 	{
 		std::cerr << "docker::Container::set_status_callback: function is empty" << std::endl;
 	}
+	std::lock_guard<std::mutex> lock(_state_mutex);
 	_notify_status_changed = nullptr;
 	_notify_and_send_status_changed = nullptr;
 	_notify_status_changed_with_this = function;
 }
 
+void Container::set_cache_policy(CachePolicy policy, std::chrono::milliseconds ttl)
+{
+	_cache_policy = policy;
+	_cache_ttl = ttl;
+}
+
+void Container::invalidate()
+{
+	std::lock_guard<std::mutex> lock(_state_mutex);
+	_stale = true;
+}
+
+void Container::set_timeout(std::chrono::milliseconds timeout)
+{
+	_timeout = timeout;
+}
+
+void Container::set_cancel_token(Shell::CancelToken token)
+{
+	_cancel_token = std::move(token);
+}
+
+Container::Status Container::get_status()
+{
+	refresh_if_stale();
+	return current_status();
+}
+
+Container::RuntimeInfos Container::get_runtime_infos()
+{
+	refresh_if_stale();
+	std::lock_guard<std::mutex> lock(_state_mutex);
+	return _runtime_infos;
+}
+
+void Container::refresh_if_stale()
+{
+	if (_watched)
+	{
+		EventWatcher::instance().recover();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_state_mutex);
+		switch (_cache_policy)
+		{
+		case CachePolicy::EAGER:
+			// kept up to date by the lifecycle operations, or by the events stream unless events were missed
+			if (!_watched || !_stale) return;
+			break;
+		case CachePolicy::LAZY:
+			if (!_stale) return;
+			break;
+		case CachePolicy::TTL:
+			if (!_stale && std::chrono::steady_clock::now() - _refreshed_at < _cache_ttl) return;
+			break;
+		}
+	}
+
+	update_status();
+}
+
 Shell::Output Container::update_runtime_infos()
 {
+	if (_cache_policy != CachePolicy::EAGER)
+	{
+		invalidate(); // refreshed when needed
+		return { Shell::SUCCESS, "" };
+	}
+
 	Shell::Output status_ret = update_status(); // --> triggers update_status callback
 
 	return status_ret;
@@ -93,7 +235,7 @@ Shell::Output Container::update_runtime_infos()
 
 Shell::Output Container::exec_create()
 {
-	Shell::Output ret = _create_command.execute();
+	Shell::Output ret = limited(_create_command).execute();
 
 	update_runtime_infos();
 
@@ -102,7 +244,7 @@ Shell::Output Container::exec_create()
 
 Shell::Output Container::exec_start()
 {
-	Shell::Output ret = CLI::Start(_runtime_infos.name).execute();
+	Shell::Output ret = limited(CLI::Start(_runtime_infos.name)).execute();
 
 	update_runtime_infos();
 
@@ -111,7 +253,7 @@ Shell::Output Container::exec_start()
 
 Shell::Output Container::exec_stop()
 {
-	Shell::Output	ret = CLI::Stop(_runtime_infos.name).execute();
+	Shell::Output	ret = limited(CLI::Stop(_runtime_infos.name)).execute();
 	
 	update_runtime_infos();
 
@@ -120,27 +262,59 @@ Shell::Output Container::exec_stop()
 
 Shell::Output Container::exec_remove()
 {
-	Shell::Output	ret = CLI::Remove(_runtime_infos.name).execute();
+	Shell::Output	ret = limited(CLI::Remove(_runtime_infos.name)).execute();
 
 	if (ret.exitCode != Shell::SUCCESS)
 	{
+		std::lock_guard<std::mutex> lock(_state_mutex);
 		_runtime_infos.current_status = "unknown";
 		_current_status = Status::UNKNOWN;
+		_stale = true;
 		return ret;
 	}
 
-	_runtime_infos.ID = "";
-	_runtime_infos.current_status = "removed";
-	_current_status = Status::REMOVED;
+	_exec_sessions->close();
 
-    _notify_status_changed();
+	std::function<void()> notify_status_changed;
+	{
+		std::lock_guard<std::mutex> lock(_state_mutex);
+		_runtime_infos.ID = "";
+		_runtime_infos.current_status = "removed";
+		_current_status = Status::REMOVED;
+		_stale = false;
+		_refreshed_at = std::chrono::steady_clock::now();
+		notify_status_changed = _notify_status_changed;
+	}
+
+	if (notify_status_changed)
+	{
+		notify_status_changed();
+	}
 
 	return ret;
 }
 
 Shell::Output Container::exec_kill()
 {
-	Shell::Output	ret = CLI::Kill(_runtime_infos.name).execute();
+	Shell::Output	ret = limited(CLI::Kill(_runtime_infos.name)).execute();
+
+	update_runtime_infos();
+
+	return ret;
+}
+
+Shell::Output Container::exec_pause()
+{
+	Shell::Output	ret = limited(CLI::Pause(_runtime_infos.name)).execute();
+
+	update_runtime_infos();
+
+	return ret;
+}
+
+Shell::Output Container::exec_unpause()
+{
+	Shell::Output	ret = limited(CLI::Unpause(_runtime_infos.name)).execute();
 
 	update_runtime_infos();
 
@@ -149,75 +323,165 @@ Shell::Output Container::exec_kill()
 
 Shell::Output docker::Container::exec_destroy()
 {
-	Shell::Output	ret = CLI::Remove(_runtime_infos.name).force().execute();
+	Shell::Output	ret = limited(CLI::Remove(_runtime_infos.name)).force().execute();
 	
 	if (ret.exitCode != Shell::SUCCESS)
 	{
+		std::lock_guard<std::mutex> lock(_state_mutex);
 		_runtime_infos.current_status = "unknown";
 		_current_status = Status::UNKNOWN;
+		_stale = true;
 		return ret;
 	}
 
-	_runtime_infos.ID = "";
-	_runtime_infos.current_status = "destroyed";
-	_current_status = Status::REMOVED;
+	_exec_sessions->close();
 
-    _notify_status_changed();
+	std::function<void()> notify_status_changed;
+	{
+		std::lock_guard<std::mutex> lock(_state_mutex);
+		_runtime_infos.ID = "";
+		_runtime_infos.current_status = "destroyed";
+		_current_status = Status::REMOVED;
+		_stale = false;
+		_refreshed_at = std::chrono::steady_clock::now();
+		notify_status_changed = _notify_status_changed;
+	}
+
+	if (notify_status_changed)
+	{
+		notify_status_changed();
+	}
 
 	return ret;
 }
 
-Shell::Output Container::update_status()
+Shell::Output Container::exec(const std::string& command)
 {
-	Status stat = Status::UNKNOWN;
+	return _exec_sessions->execute(command, _timeout, _cancel_token);
+}
 
-	Shell::Output	ret = CLI::Inspect(_runtime_infos.name).extract(CLI::Inspect::STATUS).execute();
+void Container::set_exec_sessions(size_t max, std::string shell)
+{
+	_exec_sessions->configure(max, std::move(shell));
+}
 
-	if (ret.exitCode != Shell::SUCCESS)
-	{
-		stat = Status::UNKNOWN;
-		_runtime_infos.current_status = "unknown";
-		return ret;
-    }
+void Container::close_exec_sessions()
+{
+	_exec_sessions->close();
+}
 
-    auto it = std::find(_status_names.begin(), _status_names.end(), ret.result);
+LogFollower Container::follow_logs(LogSink sink, LogOptions options)
+{
+	return LogFollower(_runtime_infos.name, std::move(sink), std::move(options));
+}
+
+Shell::Output Container::update_status()
+{
+	CLI::InspectInfo info;
+	Shell::Output	ret = limited(CLI::Inspect(_runtime_infos.name)).execute_typed<CLI::InspectInfo::STATE>(info);
 
-    if (it == _status_names.end())
+	if (ret.exitCode != Shell::SUCCESS)
 	{
-		stat = Status::UNKNOWN;
+		std::lock_guard<std::mutex> lock(_state_mutex);
 		_runtime_infos.current_status = "unknown";
+		_stale = false; // do not retry on every get_status
+		_refreshed_at = std::chrono::steady_clock::now();
 		return ret;
-	}
-
-	_runtime_infos.current_status = (*it);
+    }
 
-    long dist = std::distance(_status_names.begin(), it);
+	// the same inspect gives the ID
+	set_id(info.id);
+	apply_status(info.status);
 
-	stat = static_cast<Status>(dist);
+	ret.result = info.status;
+	return ret;
+}
 
-	if (_current_status != stat)
+void Container::apply_status(Status stat)
+{
+	std::function<void()> notify_status_changed;
+	std::function<void(Status)> notify_and_send_status_changed;
+	std::function<void(Container*)> notify_status_changed_with_this;
 	{
-		_current_status = stat;
-		if (_notify_status_changed)
+		std::lock_guard<std::mutex> lock(_state_mutex);
+		_stale = false;
+		_refreshed_at = std::chrono::steady_clock::now();
+
+		if (stat == Status::REMOVED)
+		{
+			_runtime_infos.current_status = "removed";
+		}
+		else if (stat == Status::UNKNOWN)
 		{
-			_notify_status_changed(); // trigger callback
+			_runtime_infos.current_status = "unknown";
 		}
-		if (_notify_and_send_status_changed)
+		else
 		{
-			_notify_and_send_status_changed(stat); // trigger callback
+			_runtime_infos.current_status = _status_names[static_cast<size_t>(stat)];
 		}
-		if (_notify_status_changed_with_this)
+
+		if (_current_status == stat)
 		{
-			_notify_status_changed_with_this(this); // trigger callback
+			return;
 		}
+		_current_status = stat;
+
+		// called unlocked: a callback may use the object
+		notify_status_changed = _notify_status_changed;
+		notify_and_send_status_changed = _notify_and_send_status_changed;
+		notify_status_changed_with_this = _notify_status_changed_with_this;
 	}
 
-	return ret;
+	if (notify_status_changed)
+	{
+		notify_status_changed(); // trigger callback
+	}
+	if (notify_and_send_status_changed)
+	{
+		notify_and_send_status_changed(stat); // trigger callback
+	}
+	if (notify_status_changed_with_this)
+	{
+		notify_status_changed_with_this(this); // trigger callback
+	}
+}
+
+bool Container::apply_status(const std::string& status_name)
+{
+	auto it = std::find(_status_names.begin(), _status_names.end(), status_name);
+
+	if (it == _status_names.end())
+	{
+		std::lock_guard<std::mutex> lock(_state_mutex);
+		_runtime_infos.current_status = "unknown";
+		return false;
+	}
+
+	apply_status(static_cast<Status>(std::distance(_status_names.begin(), it)));
+	return true;
+}
+
+std::string Container::id() const
+{
+	std::lock_guard<std::mutex> lock(_state_mutex);
+	return _runtime_infos.ID;
+}
+
+void Container::set_id(std::string id)
+{
+	std::lock_guard<std::mutex> lock(_state_mutex);
+	_runtime_infos.ID = std::move(id);
+}
+
+Container::Status Container::current_status() const
+{
+	std::lock_guard<std::mutex> lock(_state_mutex);
+	return _current_status;
 }
 
 Shell::Output Container::inspect_ID()
 {
-	Shell::Output	ret = CLI::Inspect(_runtime_infos.name).extract(CLI::Inspect::ID).execute();
+	Shell::Output	ret = limited(CLI::Inspect(_runtime_infos.name)).extract(CLI::Inspect::ID).execute();
 	std::string id;
 
 	if (ret.exitCode != Shell::SUCCESS)
@@ -228,6 +492,7 @@ Shell::Output Container::inspect_ID()
 
 	id = ret.result;
 
+	std::lock_guard<std::mutex> lock(_state_mutex);
 	if (_runtime_infos.ID != id)
 	{
 		_runtime_infos.ID = id;
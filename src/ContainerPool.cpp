@@ -0,0 +1,245 @@
+#include "Docker.h"
+#include "ExecSessions.hpp"
+
+#ifdef UNIX
+#include <unistd.h>
+#else
+#include <process.h>
+#endif // UNIX
+
+using namespace docker;
+
+
+namespace
+{
+	/**
+		@brief  The prefix of the names of a new pool: the names of two pools (of this process or not) never collide
+	**/
+	std::string unique_prefix(const std::string& name_prefix)
+	{
+		static std::atomic<uint64_t> pools{ 0 };
+#ifdef UNIX
+		long pid = static_cast<long>(::getpid());
+#else
+		long pid = static_cast<long>(::_getpid());
+#endif // UNIX
+		return name_prefix + "_" + std::to_string(pid) + "_" + std::to_string(++pools);
+	}
+}
+
+
+ContainerPool::ContainerPool(CLI::Create create_template, size_t size, Warmth warmth, std::string name_prefix)
+	: _template(create_template), _warmth(warmth), _prefix(unique_prefix(name_prefix)), _size(size)
+{
+	_refiller = std::thread([this]() { refill_loop(); });
+}
+
+ContainerPool::~ContainerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	_refiller.join();
+
+	// whatever is left goes with a single bulk remove
+	std::vector<std::string> names;
+	for (auto& c : _ready) names.push_back(c->_runtime_infos.name);
+	for (auto& c : _to_destroy) names.push_back(c->_runtime_infos.name);
+	if (!names.empty())
+	{
+		for (auto& removed : CLI::bulk_remove(names, true))
+		{
+			if (removed.second.exitCode != Shell::SUCCESS)
+			{
+				std::cerr << "docker::ContainerPool::~ContainerPool: " << removed.first << " not removed: " << removed.second.result << std::endl;
+			}
+		}
+	}
+}
+
+std::unique_ptr<Container> ContainerPool::acquire()
+{
+	std::unique_ptr<Container> container;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_ready.empty())
+		{
+			container = std::move(_ready.front());
+			_ready.pop_front();
+			++_stats.hits;
+		}
+		else
+		{
+			++_stats.misses;
+		}
+	}
+	_cv.notify_all(); // refill
+
+	if (!container)
+	{
+		return make_container(false);
+	}
+
+	if (_warmth == Warmth::PAUSED && container->exec_unpause().exitCode != Shell::SUCCESS)
+	{
+		release(std::move(container), Release::DESTROY);
+		return make_container(false);
+	}
+	return container;
+}
+
+void ContainerPool::release(std::unique_ptr<Container> container, Release mode)
+{
+	if (!container)
+	{
+		return;
+	}
+
+	reset(*container);
+
+	if (mode == Release::RECYCLE)
+	{
+		bool ready = _warmth == Warmth::PAUSED
+			? container->exec_pause().exitCode == Shell::SUCCESS
+			: container->get_status() == Container::Status::CREATED; // never started
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (ready && _ready.size() < _size)
+		{
+			_ready.push_back(std::move(container));
+			++_stats.recycled;
+			return;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_to_destroy.push_back(std::move(container));
+	}
+	_cv.notify_all();
+}
+
+void ContainerPool::resize(size_t size)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_size = size;
+		while (_ready.size() > _size)
+		{
+			_to_destroy.push_back(std::move(_ready.back()));
+			_ready.pop_back();
+		}
+	}
+	_cv.notify_all();
+}
+
+ContainerPool::Stats ContainerPool::stats()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Stats stats = _stats;
+	stats.available = _ready.size();
+	return stats;
+}
+
+std::unique_ptr<Container> ContainerPool::make_container(bool park)
+{
+	auto container = std::make_unique<Container>(_template, _prefix + "_" + std::to_string(++_sequence));
+	container->set_cache_policy(Container::CachePolicy::LAZY);
+
+	bool ok = container->exec_create().exitCode == Shell::SUCCESS;
+	if (ok && _warmth == Warmth::PAUSED)
+	{
+		ok = container->exec_start().exitCode == Shell::SUCCESS
+			&& (!park || container->exec_pause().exitCode == Shell::SUCCESS);
+	}
+
+	if (!ok)
+	{
+		container->exec_destroy();
+		return nullptr;
+	}
+	return container;
+}
+
+void ContainerPool::reset(Container& container)
+{
+	if (container._watched)
+	{
+		EventWatcher::instance().unwatch(container);
+	}
+
+	// the sessions run in the container: a new user must not inherit them, nor their configuration
+	container._exec_sessions->close();
+	container._exec_sessions = std::make_unique<ExecSessions>(container._runtime_infos.name);
+
+	container.set_cache_policy(Container::CachePolicy::LAZY);
+	container.set_timeout(std::chrono::milliseconds(0));
+	container._cancel_token.reset();
+
+	std::lock_guard<std::mutex> lock(container._state_mutex);
+	container._notify_status_changed = nullptr;
+	container._notify_and_send_status_changed = nullptr;
+	container._notify_status_changed_with_this = nullptr;
+}
+
+void ContainerPool::refill_loop()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		_cv.wait(lock, [this]() { return _stop || !_to_destroy.empty() || _ready.size() + _creating < _size; });
+		if (_stop)
+		{
+			return;
+		}
+
+		if (!_to_destroy.empty())
+		{
+			auto container = std::move(_to_destroy.back());
+			_to_destroy.pop_back();
+
+			lock.unlock();
+			container->exec_destroy();
+			container.reset();
+			lock.lock();
+
+			++_stats.destroyed;
+			continue;
+		}
+
+		++_creating;
+		lock.unlock();
+
+		auto begin = std::chrono::steady_clock::now();
+		auto container = make_container(true);
+		double latency = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+		lock.lock();
+		--_creating;
+
+		if (!container)
+		{
+			++_stats.failed;
+			// do not hammer docker when the template cannot be created (e.g. missing image)
+			_cv.wait_for(lock, std::chrono::seconds(1), [this]() { return _stop; });
+			continue;
+		}
+
+		++_stats.created;
+		if (_ready.size() < _size)
+		{
+			_ready.push_back(std::move(container));
+		}
+		else
+		{
+			_to_destroy.push_back(std::move(container)); // shrunk meanwhile
+		}
+		_latency_total += latency;
+		_stats.refill_latency_last = latency;
+		_stats.refill_latency_mean = _latency_total / _stats.created;
+		_stats.refill_latency_max = std::max(_stats.refill_latency_max, latency);
+	}
+}
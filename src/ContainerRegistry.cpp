@@ -0,0 +1,98 @@
+#include "Docker.h"
+#include "Json.hpp"
+
+using namespace docker;
+
+
+ContainerRegistry::ContainerRegistry()
+{}
+
+ContainerRegistry::~ContainerRegistry()
+{}
+
+Container& ContainerRegistry::add(CLI::Create create_command, std::string container_unique_name)
+{
+	auto& container = _containers[container_unique_name];
+	if (!container)
+	{
+		container = std::make_unique<Container>(create_command, container_unique_name);
+	}
+	return *container;
+}
+
+Container* ContainerRegistry::find(const std::string& name_or_id)
+{
+	auto it = _containers.find(name_or_id);
+	if (it != _containers.end())
+	{
+		return it->second.get();
+	}
+
+	for (auto& c : _containers)
+	{
+		std::string id = c.second->id();
+		if (!id.empty() && id == name_or_id)
+		{
+			return c.second.get();
+		}
+	}
+	return nullptr;
+}
+
+bool ContainerRegistry::remove(const std::string& name)
+{
+	return _containers.erase(name) > 0;
+}
+
+void ContainerRegistry::for_each(std::function<void(Container&)> f)
+{
+	for (auto& c : _containers)
+	{
+		f(*c.second);
+	}
+}
+
+Shell::Output ContainerRegistry::refresh()
+{
+	Shell::Output ret = CLI::Ps().execute();
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		return ret;
+	}
+
+	std::unordered_map<Container*, bool> listed;
+	listed.reserve(_containers.size());
+
+	std::string_view lines = ret.result;
+	while (!lines.empty())
+	{
+		size_t end = lines.find('\n');
+		std::string_view line = lines.substr(0, end);
+		lines = end == std::string_view::npos ? std::string_view() : lines.substr(end + 1);
+
+		// a container has more names when linked: the first one is its own
+		std::string names = json::to_string(json::find(line, { "Names" }));
+		auto it = _containers.find(names.substr(0, names.find(',')));
+		if (it == _containers.end())
+		{
+			continue; // not in the registry
+		}
+
+		Container& container = *it->second;
+		container.set_id(json::to_string(json::find(line, { "ID" })));
+		container.apply_status(json::to_string(json::find(line, { "State" })));
+		listed[&container] = true;
+	}
+
+	for (auto& c : _containers)
+	{
+		Container& container = *c.second;
+		if (listed.count(&container) == 0 && container.current_status() != Container::Status::UNKNOWN)
+		{
+			container.set_id("");
+			container.apply_status(Container::Status::REMOVED);
+		}
+	}
+
+	return ret;
+}
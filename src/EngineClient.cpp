@@ -0,0 +1,522 @@
+#include "EngineClient.hpp"
+
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+#ifdef UNIX
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#endif // UNIX
+
+using namespace docker;
+using namespace engine;
+
+
+namespace
+{
+	thread_local const Limits* t_limits = nullptr;
+
+	std::string to_lower(std::string s)
+	{
+		std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return s;
+	}
+
+#ifdef UNIX
+	/*
+	* Buffered reader over a connected socket
+	*/
+	class SocketReader
+	{
+		int			_fd;
+		std::string _buffer;
+		size_t		_pos = 0;
+
+		/**
+			@brief Waits for data within the limits of the calling thread, throws once they are exceeded
+		**/
+		void wait_readable(const Limits& limits)
+		{
+			while (true)
+			{
+				int timeout = limits.cancelled ? 100 : -1; // look at cancellation requests
+				if (limits.deadline != std::chrono::steady_clock::time_point::max())
+				{
+					auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(limits.deadline - std::chrono::steady_clock::now()).count();
+					if (remaining <= 0)
+					{
+						throw std::runtime_error("Timed out waiting for the Docker daemon");
+					}
+					timeout = timeout < 0 ? static_cast<int>(remaining) + 1 : std::min(timeout, static_cast<int>(remaining) + 1);
+				}
+				if (limits.cancelled && limits.cancelled())
+				{
+					throw std::runtime_error("Cancelled");
+				}
+
+				pollfd fd{ _fd, POLLIN, 0 };
+				int rc = ::poll(&fd, 1, timeout);
+				if (rc > 0 || (rc < 0 && errno != EINTR)) return;
+			}
+		}
+
+		bool fill()
+		{
+			if (_pos > 0 && _pos == _buffer.size())
+			{
+				_buffer.clear();
+				_pos = 0;
+			}
+
+			if (t_limits)
+			{
+				wait_readable(*t_limits);
+			}
+
+			char chunk[64 * 1024];
+			ssize_t bytes = 0;
+			do
+			{
+				bytes = ::recv(_fd, chunk, sizeof(chunk), 0);
+			} while (bytes < 0 && errno == EINTR);
+
+			if (bytes <= 0) return false;
+
+			_buffer.append(chunk, static_cast<size_t>(bytes));
+			received = true;
+			return true;
+		}
+
+	public:
+		bool received = false;
+
+		explicit SocketReader(int fd) : _fd(fd) {}
+
+		bool read_line(std::string& line)
+		{
+			size_t eol = 0;
+			while ((eol = _buffer.find("\r\n", _pos)) == std::string::npos)
+			{
+				if (!fill()) return false;
+			}
+			line.assign(_buffer, _pos, eol - _pos);
+			_pos = eol + 2;
+			return true;
+		}
+
+		bool read_exact(size_t size, std::string& out)
+		{
+			while (_buffer.size() - _pos < size)
+			{
+				if (!fill()) return false;
+			}
+			out.append(_buffer, _pos, size);
+			_pos += size;
+			return true;
+		}
+
+		void read_to_eof(std::string& out)
+		{
+			do
+			{
+				out.append(_buffer, _pos, std::string::npos);
+				_pos = _buffer.size();
+			} while (fill());
+		}
+	};
+
+	bool send_all(int fd, const char* data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t bytes = ::send(fd, data, size, MSG_NOSIGNAL);
+			if (bytes < 0)
+			{
+				if (errno == EINTR) continue;
+				return false;
+			}
+			data += bytes;
+			size -= static_cast<size_t>(bytes);
+		}
+		return true;
+	}
+#endif // UNIX
+}
+
+
+Limits::Limits(std::chrono::steady_clock::time_point deadline, std::function<bool()> cancelled)
+	: deadline(deadline), cancelled(std::move(cancelled)), _previous(t_limits)
+{
+	t_limits = this;
+}
+
+Limits::~Limits()
+{
+	t_limits = _previous;
+}
+
+const Limits* Limits::current()
+{
+	return t_limits;
+}
+
+Client& Client::instance()
+{
+	static Client client;
+	return client;
+}
+
+Client::~Client()
+{
+	close_idle();
+}
+
+Workers& Workers::instance()
+{
+	// the client is created first, so destroyed after the threads are joined
+	Client::instance();
+	static Workers workers;
+	return workers;
+}
+
+Workers::Workers()
+{
+	for (size_t i = 0; i < WORKERS; ++i)
+	{
+		_threads.emplace_back(&Workers::run, this);
+	}
+}
+
+Workers::~Workers()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+		_queue.clear();
+	}
+	_cv.notify_all();
+	for (auto& thread : _threads)
+	{
+		thread.join();
+	}
+}
+
+void Workers::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue.push_back(std::move(task));
+	}
+	_cv.notify_one();
+}
+
+void Workers::run()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_cv.wait(lock, [this]() { return _stop || !_queue.empty(); });
+			if (_stop)
+			{
+				return;
+			}
+			task = std::move(_queue.front());
+			_queue.pop_front();
+		}
+		task();
+	}
+}
+
+void Client::set_socket_path(std::string path)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (path == _socket_path) return;
+
+	_socket_path = std::move(path);
+#ifdef UNIX
+	for (int fd : _idle) ::close(fd);
+#endif // UNIX
+	_idle.clear();
+}
+
+void Client::close_idle()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+#ifdef UNIX
+	for (int fd : _idle) ::close(fd);
+#endif // UNIX
+	_idle.clear();
+}
+
+#ifdef UNIX
+
+int Client::acquire(bool& reused)
+{
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_idle.empty())
+		{
+			int fd = _idle.back();
+			_idle.pop_back();
+			reused = true;
+			return fd;
+		}
+		path = _socket_path;
+	}
+
+	reused = false;
+
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		throw std::runtime_error("Socket path too long: " + path);
+	}
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		throw std::runtime_error(std::strerror(errno));
+	}
+
+	if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+	{
+		int err = errno;
+		::close(fd);
+		throw std::runtime_error("Cannot connect to the Docker daemon at unix://" + path + ": " + std::strerror(err));
+	}
+
+	return fd;
+}
+
+void Client::release(int fd)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_idle.push_back(fd);
+}
+
+bool Client::transact(int fd, const std::string& request, bool is_head, Response& response, bool& keep_alive, bool& received)
+{
+	received = false;
+
+	if (!send_all(fd, request.data(), request.size()))
+	{
+		return false;
+	}
+
+	SocketReader reader(fd);
+	std::string line;
+
+	// Status line: HTTP/1.1 200 OK
+	if (!reader.read_line(line))
+	{
+		received = reader.received;
+		return false;
+	}
+	received = true;
+
+	auto sp = line.find(' ');
+	if (line.compare(0, 5, "HTTP/") != 0 || sp == std::string::npos)
+	{
+		throw std::runtime_error("Malformed response from the Docker daemon: " + line);
+	}
+	response.status = std::atoi(line.c_str() + sp + 1);
+	keep_alive = line.compare(0, 8, "HTTP/1.0") != 0;
+
+	// Headers
+	bool chunked = false;
+	bool has_length = false;
+	size_t content_length = 0;
+	while (true)
+	{
+		if (!reader.read_line(line))
+		{
+			throw std::runtime_error("Connection closed by the Docker daemon");
+		}
+		if (line.empty()) break;
+
+		auto colon = line.find(':');
+		if (colon == std::string::npos) continue;
+
+		std::string name = to_lower(line.substr(0, colon));
+		auto value_begin = line.find_first_not_of(' ', colon + 1);
+		std::string value = value_begin == std::string::npos ? std::string() : line.substr(value_begin);
+
+		if (name == "content-length")
+		{
+			has_length = true;
+			content_length = std::strtoull(value.c_str(), nullptr, 10);
+		}
+		else if (name == "transfer-encoding")
+		{
+			chunked = to_lower(value).find("chunked") != std::string::npos;
+		}
+		else if (name == "connection")
+		{
+			auto v = to_lower(value);
+			if (v == "close") keep_alive = false;
+			if (v == "keep-alive") keep_alive = true;
+		}
+	}
+
+	// Body
+	response.body.clear();
+	if (is_head || response.status == 204 || response.status == 304 || response.status / 100 == 1)
+	{
+		return true;
+	}
+
+	if (chunked)
+	{
+		while (true)
+		{
+			if (!reader.read_line(line))
+			{
+				throw std::runtime_error("Connection closed by the Docker daemon");
+			}
+			size_t chunk_size = std::strtoull(line.c_str(), nullptr, 16);
+			if (chunk_size == 0)
+			{
+				// skip the trailers up to the final empty line
+				while (reader.read_line(line) && !line.empty()) {}
+				break;
+			}
+			if (!reader.read_exact(chunk_size, response.body) || !reader.read_line(line))
+			{
+				throw std::runtime_error("Connection closed by the Docker daemon");
+			}
+		}
+	}
+	else if (has_length)
+	{
+		response.body.reserve(content_length);
+		if (!reader.read_exact(content_length, response.body))
+		{
+			throw std::runtime_error("Connection closed by the Docker daemon");
+		}
+	}
+	else
+	{
+		reader.read_to_eof(response.body);
+		keep_alive = false;
+	}
+
+	return true;
+}
+
+Response Client::request(std::string_view method, std::string_view target, std::string_view body)
+{
+	std::string request;
+	request.reserve(128 + target.size() + body.size());
+	request.append(method).append(" ").append(target).append(" HTTP/1.1\r\n");
+	request.append("Host: docker\r\n");
+	if (!body.empty())
+	{
+		request.append("Content-Type: application/json\r\n");
+	}
+	if (!body.empty() || method == "POST" || method == "PUT")
+	{
+		request.append("Content-Length: ").append(std::to_string(body.size())).append("\r\n");
+	}
+	request.append("\r\n");
+	request.append(body);
+
+	for (int attempt = 0; attempt < 2; ++attempt)
+	{
+		bool reused = false;
+		int fd = acquire(reused);
+
+		Response response;
+		bool keep_alive = false;
+		bool received = false;
+		bool done = false;
+		try
+		{
+			done = transact(fd, request, method == "HEAD", response, keep_alive, received);
+		}
+		catch (...)
+		{
+			::close(fd);
+			throw;
+		}
+
+		if (done)
+		{
+			if (keep_alive)
+			{
+				release(fd);
+			}
+			else
+			{
+				::close(fd);
+			}
+			return response;
+		}
+
+		::close(fd);
+
+		// A stale keep-alive connection is retried once on a new connection
+		if (!reused || received)
+		{
+			break;
+		}
+	}
+
+	throw std::runtime_error("Connection to the Docker daemon lost");
+}
+
+#else
+
+int Client::acquire(bool&)
+{
+	throw std::runtime_error("The Engine API backend is available only on unix systems");
+}
+
+void Client::release(int)
+{}
+
+bool Client::transact(int, const std::string&, bool, Response&, bool&, bool&)
+{
+	return false;
+}
+
+Response Client::request(std::string_view, std::string_view, std::string_view)
+{
+	throw std::runtime_error("The Engine API backend is available only on unix systems");
+}
+
+#endif // UNIX
+
+
+std::string engine::url_encode(std::string_view text)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	std::string out;
+	out.reserve(text.size());
+	for (unsigned char c : text)
+	{
+		if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~')
+		{
+			out += static_cast<char>(c);
+		}
+		else
+		{
+			out += '%';
+			out += hex[c >> 4];
+			out += hex[c & 0xF];
+		}
+	}
+	return out;
+}
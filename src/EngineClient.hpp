@@ -0,0 +1,136 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <thread>
+
+namespace docker
+{
+	namespace engine
+	{
+		/**
+			@struct Response
+			@brief  Status code and decoded body of an Engine API HTTP response
+		**/
+		struct Response
+		{
+			int         status = 0;
+			std::string body;
+
+			bool ok() const { return (status >= 200 && status < 300) || status == 304; }
+		};
+
+		/**
+			@class   Limits
+			@brief   Bounds the requests sent by the calling thread while the object lives. Once the deadline expires
+			         or the cancellation function returns true, the response is no longer waited for: its connection
+					 is closed and request() throws.
+		**/
+		class Limits
+		{
+		public:
+			Limits(std::chrono::steady_clock::time_point deadline, std::function<bool()> cancelled);
+			~Limits();
+			Limits(const Limits&) = delete;
+			Limits& operator=(const Limits&) = delete;
+
+			/**
+				@brief  The limits of the calling thread, nullptr if none
+			**/
+			static const Limits* current();
+
+			const std::chrono::steady_clock::time_point	deadline;
+			const std::function<bool()>					cancelled;	// may be empty
+
+		private:
+			const Limits* _previous;
+		};
+
+		/**
+			@class   Client
+			@brief   HTTP/1.1 client for the Docker Engine API listening on a unix socket.
+			@details ~ Connections are kept alive and reused by the following requests. A request
+			         failing on a reused connection before any response is received is retried once
+			         on a fresh connection, since the daemon may have closed the idle one.
+			         Errors are reported throwing std::runtime_error.
+		**/
+		class Client
+		{
+		public:
+			static Client& instance();
+
+			~Client();
+
+			/**
+				@brief Change the engine socket. Idle connections to the previous socket are closed.
+				@param path - Full path of the unix socket
+			**/
+			void set_socket_path(std::string path);
+
+			/**
+				@brief  Sends a request and waits for the complete response
+				@param  method - HTTP method (GET, POST, DELETE, ...)
+				@param  target - Request target: API path plus query string
+				@param  body   - JSON body, sent only if not empty
+				@retval        - The response
+			**/
+			Response request(std::string_view method, std::string_view target, std::string_view body = {});
+
+		private:
+			Client() = default;
+
+			int  acquire(bool& reused);
+			void release(int fd);
+			void close_idle();
+			bool transact(int fd, const std::string& request, bool is_head, Response& response, bool& keep_alive, bool& received);
+
+			std::mutex			_mutex;
+			std::string			_socket_path = "/var/run/docker.sock";
+			std::vector<int>	_idle;
+		};
+
+		/**
+			@class   Workers
+			@brief   The threads performing the requests of the asynchronous commands, WORKERS at most: the following
+			         requests are queued until a thread is free.
+			@details ~ The threads are joined at exit, before the Client they use is destroyed. The requests still queued
+			         then are dropped: their callbacks are not called and their futures get a broken promise.
+		**/
+		class Workers
+		{
+		public:
+			static const size_t WORKERS = 8;
+
+			static Workers& instance();
+
+			~Workers();
+
+			/**
+				@brief  Queues the task, run by the first free thread
+			**/
+			void post(std::function<void()> task);
+
+		private:
+			Workers();
+
+			void run();
+
+			std::mutex							_mutex;
+			std::condition_variable				_cv;
+			std::deque<std::function<void()>>	_queue;
+			std::vector<std::thread>			_threads;
+			bool								_stop = false;
+		};
+
+		/**
+			@brief  Percent-encodes a text to be used in a request target
+		**/
+		std::string url_encode(std::string_view text);
+	}
+}
@@ -0,0 +1,253 @@
+#include "Docker.h"
+#include "Json.hpp"
+
+using namespace docker;
+
+
+namespace
+{
+	/**
+		@brief  The status a container reaches with the given event action
+		@retval  - False if the action does not change the status (e.g. kill, exec_start, health_status)
+	**/
+	bool status_of_action(std::string_view action, Container::Status& status)
+	{
+		static const std::pair<std::string_view, Container::Status> actions[] = {
+			{ "create",		Container::Status::CREATED },
+			{ "start",		Container::Status::RUNNING },
+			{ "restart",	Container::Status::RUNNING },
+			{ "unpause",	Container::Status::RUNNING },
+			{ "pause",		Container::Status::PAUSED },
+			{ "die",		Container::Status::EXITED },
+			{ "stop",		Container::Status::EXITED },
+			{ "destroy",	Container::Status::REMOVED },
+		};
+
+		for (auto& a : actions)
+		{
+			if (a.first == action)
+			{
+				status = a.second;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// set on the events thread while a status callback runs
+	thread_local bool dispatching = false;
+}
+
+
+EventWatcher& EventWatcher::instance()
+{
+	static EventWatcher watcher;
+	return watcher;
+}
+
+EventWatcher::EventWatcher()
+{}
+
+EventWatcher::~EventWatcher()
+{
+	stop();
+}
+
+Shell::Output EventWatcher::watch(Container& container)
+{
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		if (!container._runtime_infos.name.empty())
+		{
+			_by_name[container._runtime_infos.name] = &container;
+		}
+		std::string id = container.id();
+		if (!id.empty())
+		{
+			_by_id[id] = &container;
+		}
+		container._watched = true;
+	}
+
+	return start();
+}
+
+void EventWatcher::unwatch(Container& container)
+{
+	std::unique_lock<std::recursive_mutex> lock(_mutex);
+
+	for (auto* map : { &_by_name, &_by_id })
+	{
+		for (auto it = map->begin(); it != map->end();)
+		{
+			it = it->second == &container ? map->erase(it) : std::next(it);
+		}
+	}
+	container._watched = false;
+	wait_dispatched(lock, container);
+}
+
+void EventWatcher::rebind(Container& from, Container& to)
+{
+	std::unique_lock<std::recursive_mutex> lock(_mutex);
+
+	wait_dispatched(lock, from);
+	to.move_state_from(from);
+	for (auto* map : { &_by_name, &_by_id })
+	{
+		for (auto& entry : *map)
+		{
+			if (entry.second == &from) entry.second = &to;
+		}
+	}
+	from._watched = false;
+	to._watched = true;
+}
+
+void EventWatcher::wait_dispatched(std::unique_lock<std::recursive_mutex>& lock, Container& container)
+{
+	// a callback of the container may run on the events thread; a callback unwatching its own container does not wait for itself
+	if (!dispatching)
+	{
+		_dispatched.wait(lock, [&]() { return _dispatching != &container; });
+	}
+}
+
+Shell::Output EventWatcher::start()
+{
+	std::lock_guard<std::mutex> lock(_stream_mutex);
+
+	return start_stream();
+}
+
+void EventWatcher::recover()
+{
+	// from a status callback the stream is running, and stop() may hold the lock while waiting for it
+	if (dispatching)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(_stream_mutex);
+
+	if (_started && !_stream.running())
+	{
+		start_stream();
+	}
+}
+
+Shell::Output EventWatcher::start_stream()
+{
+	if (_stream.running())
+	{
+		return { Shell::SUCCESS, "" };
+	}
+
+	Shell::Output ret{ Shell::SUCCESS, "" };
+	try
+	{
+		_stream = CLI::Events().stream([this](Shell::Channel channel, std::string_view line) {
+			if (channel == Shell::STDOUT)
+			{
+				on_event(line);
+			}
+			return true;
+		});
+	}
+	catch (const std::exception& ex)
+	{
+		ret = { Shell::FAIL, "Exception: " + std::string(ex.what()) };
+	}
+	_started = ret.exitCode == Shell::SUCCESS;
+
+	// events may have been missed while the stream was down: the watched containers refresh on their next get_status
+	std::lock_guard<std::recursive_mutex> lock(_mutex);
+	for (auto& entry : _by_name)
+	{
+		entry.second->invalidate();
+	}
+	for (auto& entry : _by_id)
+	{
+		entry.second->invalidate();
+	}
+	return ret;
+}
+
+void EventWatcher::stop()
+{
+	std::lock_guard<std::mutex> lock(_stream_mutex);
+
+	_started = false;
+	_stream.cancel();
+	_stream.wait();
+}
+
+bool EventWatcher::running()
+{
+	std::lock_guard<std::mutex> lock(_stream_mutex);
+
+	return _stream.running();
+}
+
+void EventWatcher::on_event(std::string_view line)
+{
+	Container::Status status;
+	if (json::find(line, { "Type" }) != "\"container\"" || !status_of_action(json::to_string(json::find(line, { "Action" })), status))
+	{
+		return;
+	}
+
+	std::string id = json::to_string(json::find(line, { "Actor", "ID" }));
+	std::string name = json::to_string(json::find(line, { "Actor", "Attributes", "name" }));
+
+	Container* container = nullptr;
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+
+		auto by_name = _by_name.find(name);
+		if (by_name != _by_name.end())
+		{
+			container = by_name->second;
+		}
+		else
+		{
+			auto by_id = _by_id.find(id);
+			if (by_id == _by_id.end())
+			{
+				return; // not watched
+			}
+			container = by_id->second;
+		}
+
+		// a newly created container gets its ID
+		if (status == Container::Status::CREATED && !id.empty())
+		{
+			std::string previous = container->id();
+			if (previous != id)
+			{
+				_by_id.erase(previous);
+				container->set_id(id);
+				_by_id[id] = container;
+			}
+		}
+		_dispatching = container;
+	}
+
+	// the callbacks run unlocked: unwatch and rebind wait for them instead
+	dispatching = true;
+	try
+	{
+		container->apply_status(status);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "docker::EventWatcher::on_event: status callback failed: " << ex.what() << std::endl;
+	}
+	dispatching = false;
+
+	{
+		std::lock_guard<std::recursive_mutex> lock(_mutex);
+		_dispatching = nullptr;
+	}
+	_dispatched.notify_all();
+}
@@ -0,0 +1,130 @@
+#include "ExecSessions.hpp"
+#include "Metrics.h"
+
+using namespace docker;
+
+
+ExecSessions::ExecSessions(std::string container)
+	: _container(std::move(container))
+{}
+
+ExecSessions::~ExecSessions()
+{
+	close();
+}
+
+void ExecSessions::configure(size_t max, std::string shell)
+{
+	std::vector<Slot> closing;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_max = max > 0 ? max : 1;
+		if (shell != _shell)
+		{
+			_shell = std::move(shell);
+			++_generation;
+		}
+
+		for (auto it = _idle.begin(); it != _idle.end();)
+		{
+			if (it->generation != _generation || _open > _max)
+			{
+				closing.push_back(std::move(*it));
+				it = _idle.erase(it);
+				--_open;
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+	_available.notify_all();
+	// the stale sessions are stopped by their destructors, out of the lock
+}
+
+Shell::Output ExecSessions::execute(const std::string& command, std::chrono::milliseconds timeout, const std::optional<Shell::CancelToken>& token)
+{
+	static const Metrics::Key key = Metrics::key("docker_command", "command", "exec session");
+	auto begin = Metrics::now();
+
+	Slot slot = acquire();
+	Shell::Session& session = *slot.session;
+
+	// a session idle for a while may hang (e.g. a frozen container): check it before use
+	if (begin - slot.used_at > HEALTH_CHECK_INTERVAL && session.running())
+	{
+		session.ping(HEALTH_CHECK_TIMEOUT);
+	}
+
+	session.set_timeout(timeout);
+	if (token)
+	{
+		session.set_cancel_token(*token);
+	}
+	else
+	{
+		session.clear_cancel_token();
+	}
+	Shell::Output result = session.execute(command);
+	session.clear_cancel_token();
+
+	release(std::move(slot));
+	Metrics::record(key, Metrics::now() - begin, result.exitCode != Shell::SUCCESS, result.result.size());
+	return result;
+}
+
+void ExecSessions::close()
+{
+	std::vector<Slot> closing;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_generation;
+		_open -= _idle.size();
+		closing.swap(_idle);
+	}
+	_available.notify_all();
+	// the sessions are stopped by their destructors, out of the lock
+}
+
+ExecSessions::Slot ExecSessions::acquire()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		if (!_idle.empty())
+		{
+			Slot slot = std::move(_idle.back());
+			_idle.pop_back();
+			return slot;
+		}
+		if (_open < _max)
+		{
+			++_open;
+			Slot slot;
+			slot.session = std::make_unique<Shell::Session>(Shell::Argv{ "docker", "exec", "-i", _container, _shell, "-s" });
+			slot.generation = _generation;
+			slot.used_at = Clock::now();
+			return slot;
+		}
+		_available.wait(lock);
+	}
+}
+
+void ExecSessions::release(Slot slot)
+{
+	slot.used_at = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (slot.generation != _generation || _open > _max)
+		{
+			--_open;
+		}
+		else
+		{
+			_idle.push_back(std::move(slot));
+		}
+	}
+	_available.notify_one();
+	// a closed session is stopped here by the destructor of the slot, out of the lock
+}
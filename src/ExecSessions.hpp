@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Shell.h"
+
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace docker
+{
+	/**
+		@class   ExecSessions
+		@brief   The exec sessions of a container: `docker exec -i <container> <shell> -s` processes kept open and
+		         reused by the commands run in the container (see Shell::Session).
+		@details ~ Sessions are opened on demand up to the maximum: a caller finding all of them busy waits for one.
+		         A session idle for longer than the health check interval is pinged before being handed out and
+				 stopped if it does not answer. Stopped or ended sessions are started again by their next command.
+	**/
+	class ExecSessions
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		static constexpr std::chrono::milliseconds HEALTH_CHECK_INTERVAL{ 5000 };
+		static constexpr std::chrono::milliseconds HEALTH_CHECK_TIMEOUT{ 1000 };
+
+		explicit ExecSessions(std::string container);
+		~ExecSessions();
+		ExecSessions(const ExecSessions&) = delete;
+		ExecSessions& operator=(const ExecSessions&) = delete;
+
+		/**
+			@brief Set the maximum number of sessions and the shell they run. Idle sessions beyond the maximum, or
+			       running another shell, are closed; busy ones once their command ends.
+		**/
+		void configure(size_t max, std::string shell);
+
+		/**
+			@brief  Runs a command in one of the sessions
+			@param  command - A POSIX shell command line
+			@param  timeout - Maximum duration of the command, zero for no limit
+			@param  token   - Cancels the command, if given
+			@retval         - Exit code of the command and its standard output (its standard error if it failed)
+		**/
+		Shell::Output execute(const std::string& command, std::chrono::milliseconds timeout, const std::optional<Shell::CancelToken>& token);
+
+		/**
+			@brief Closes the idle sessions. Busy ones are closed once their command ends.
+		**/
+		void close();
+
+	private:
+		struct Slot
+		{
+			std::unique_ptr<Shell::Session> session;
+			uint64_t generation = 0;
+			Clock::time_point used_at;
+		};
+
+		Slot acquire();
+		void release(Slot slot);
+
+		const std::string		_container;
+		std::mutex				_mutex;
+		std::condition_variable	_available;
+		std::vector<Slot>		_idle;
+		size_t					_open = 0;		// idle and busy sessions
+		size_t					_max = 2;
+		std::string				_shell = "sh";
+		uint64_t				_generation = 0;	// incremented by close(): the busy sessions of a previous generation are closed on release
+	};
+}
@@ -0,0 +1,350 @@
+#include "Docker.h"
+#include "Json.hpp"
+
+#include <cstring>
+
+using namespace docker;
+
+
+namespace
+{
+	const size_t BLOCK_SIZE = 64 * 1024;
+}
+
+
+Fleet::Fleet()
+{}
+
+Fleet::~Fleet()
+{}
+
+uint32_t Fleet::intern(std::string_view text)
+{
+	auto it = _interned.find(text);
+	if (it != _interned.end())
+	{
+		++_refs[it->second];
+		return it->second;
+	}
+
+	std::string_view stored = store(text);
+
+	uint32_t interned;
+	if (!_free_strings.empty())
+	{
+		interned = _free_strings.back();
+		_free_strings.pop_back();
+		_strings[interned] = stored;
+		_refs[interned] = 1;
+	}
+	else
+	{
+		interned = static_cast<uint32_t>(_strings.size());
+		_strings.push_back(stored);
+		_refs.push_back(1);
+	}
+	_interned.emplace(stored, interned);
+	return interned;
+}
+
+void Fleet::release(uint32_t interned)
+{
+	if (interned == NONE || --_refs[interned] > 0)
+	{
+		return;
+	}
+
+	_interned.erase(_strings[interned]);
+	_released_bytes += _strings[interned].size();
+	_strings[interned] = std::string_view();
+	_free_strings.push_back(interned);
+
+	if (_released_bytes >= BLOCK_SIZE && _released_bytes * 2 >= _stored_bytes)
+	{
+		compact();
+	}
+}
+
+std::string_view Fleet::store(std::string_view text)
+{
+	_stored_bytes += text.size();
+
+	if (text.size() > BLOCK_SIZE / 4)
+	{
+		// long strings get their own block
+		_long_blocks.emplace_back(new char[text.size()]);
+		_long_bytes += text.size();
+		std::memcpy(_long_blocks.back().get(), text.data(), text.size());
+		return std::string_view(_long_blocks.back().get(), text.size());
+	}
+
+	if (_blocks.empty() || _block_used + text.size() > BLOCK_SIZE)
+	{
+		_blocks.emplace_back(new char[BLOCK_SIZE]);
+		_block_used = 0;
+	}
+	char* dst = _blocks.back().get() + _block_used;
+	std::memcpy(dst, text.data(), text.size());
+	_block_used += text.size();
+	return std::string_view(dst, text.size());
+}
+
+void Fleet::compact()
+{
+	// the old blocks stay alive while the strings are copied; the interned ids do not change
+	std::vector<std::unique_ptr<char[]>> blocks, long_blocks;
+	blocks.swap(_blocks);
+	long_blocks.swap(_long_blocks);
+	_block_used = 0;
+	_long_bytes = 0;
+	_stored_bytes = 0;
+	_released_bytes = 0;
+	_interned.clear();
+
+	for (uint32_t interned = 0; interned < _strings.size(); ++interned)
+	{
+		if (_refs[interned] > 0)
+		{
+			_strings[interned] = store(_strings[interned]);
+			_interned.emplace(_strings[interned], interned);
+		}
+	}
+}
+
+std::string_view Fleet::text(uint32_t interned) const
+{
+	return interned == NONE ? std::string_view() : _strings[interned];
+}
+
+Fleet::Handle Fleet::add(std::string_view name, std::string_view image)
+{
+	uint32_t n = intern(name);
+	auto existing = _by_name.find(n);
+	if (existing != _by_name.end())
+	{
+		release(n);
+		return existing->second;
+	}
+
+	Handle h;
+	if (!_free.empty())
+	{
+		h = _free.back();
+		_free.pop_back();
+	}
+	else
+	{
+		h = static_cast<Handle>(_status.size());
+		_name.push_back(NONE);
+		_id.push_back(NONE);
+		_image.push_back(NONE);
+		_status.push_back(0);
+	}
+
+	_name[h] = n;
+	_id[h] = NONE;
+	_image[h] = image.empty() ? NONE : intern(image);
+	_status[h] = static_cast<int8_t>(Container::Status::UNKNOWN);
+	_by_name[n] = h;
+	++_size;
+	return h;
+}
+
+void Fleet::remove(Handle handle)
+{
+	if (handle >= _status.size() || _name[handle] == NONE)
+	{
+		return;
+	}
+
+	_by_name.erase(_name[handle]);
+	if (_id[handle] != NONE) _by_id.erase(_id[handle]);
+	release(_name[handle]);
+	release(_id[handle]);
+	release(_image[handle]);
+	_name[handle] = NONE;
+	_id[handle] = NONE;
+	_image[handle] = NONE;
+	_free.push_back(handle);
+	--_size;
+}
+
+Fleet::Handle Fleet::find(std::string_view name_or_id) const
+{
+	auto interned = _interned.find(name_or_id);
+	if (interned == _interned.end())
+	{
+		return INVALID;
+	}
+
+	auto by_name = _by_name.find(interned->second);
+	if (by_name != _by_name.end())
+	{
+		return by_name->second;
+	}
+	auto by_id = _by_id.find(interned->second);
+	return by_id != _by_id.end() ? by_id->second : INVALID;
+}
+
+std::string_view Fleet::name(Handle handle) const
+{
+	return handle < _name.size() ? text(_name[handle]) : std::string_view();
+}
+
+std::string_view Fleet::id(Handle handle) const
+{
+	return handle < _id.size() ? text(_id[handle]) : std::string_view();
+}
+
+std::string_view Fleet::image(Handle handle) const
+{
+	return handle < _image.size() ? text(_image[handle]) : std::string_view();
+}
+
+Container::Status Fleet::status(Handle handle) const
+{
+	return handle < _status.size() ? static_cast<Container::Status>(_status[handle]) : Container::Status::UNKNOWN;
+}
+
+size_t Fleet::count(Container::Status status) const
+{
+	int8_t s = static_cast<int8_t>(status);
+	size_t n = 0;
+	for (Handle h = 0; h < _status.size(); ++h)
+	{
+		n += (_status[h] == s && _name[h] != NONE);
+	}
+	return n;
+}
+
+std::vector<Fleet::Handle> Fleet::with_status(Container::Status status) const
+{
+	int8_t s = static_cast<int8_t>(status);
+	std::vector<Handle> handles;
+	for (Handle h = 0; h < _status.size(); ++h)
+	{
+		if (_status[h] == s && _name[h] != NONE) handles.push_back(h);
+	}
+	return handles;
+}
+
+void Fleet::set_status_callback(std::function<void(Handle, Container::Status)> function)
+{
+	_notify_status_changed = function;
+}
+
+void Fleet::set_status(Handle handle, Container::Status status)
+{
+	int8_t s = static_cast<int8_t>(status);
+	if (_status[handle] != s)
+	{
+		_status[handle] = s;
+		if (_notify_status_changed)
+		{
+			_notify_status_changed(handle, status); // trigger callback
+		}
+	}
+}
+
+Shell::Output Fleet::refresh()
+{
+	Shell::Output ret = CLI::Ps().execute();
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		return ret;
+	}
+
+	std::vector<bool> listed(_status.size(), false);
+
+	std::string_view lines = ret.result;
+	while (!lines.empty())
+	{
+		size_t end = lines.find('\n');
+		std::string_view line = lines.substr(0, end);
+		lines = end == std::string_view::npos ? std::string_view() : lines.substr(end + 1);
+
+		// a container has more names when linked: the first one is its own
+		std::string names = json::to_string(json::find(line, { "Names" }));
+		auto interned = _interned.find(std::string_view(names).substr(0, names.find(',')));
+		auto by_name = interned == _interned.end() ? _by_name.end() : _by_name.find(interned->second);
+		if (by_name == _by_name.end())
+		{
+			continue; // not tracked
+		}
+		Handle h = by_name->second;
+
+		uint32_t id = intern(json::to_string(json::find(line, { "ID" })));
+		if (_id[h] != id)
+		{
+			if (_id[h] != NONE) _by_id.erase(_id[h]);
+			release(_id[h]);
+			_id[h] = id;
+			_by_id[id] = h;
+		}
+		else
+		{
+			release(id); // already referenced by the container
+		}
+
+		std::string state = json::to_string(json::find(line, { "State" }));
+		auto it = std::find(Container::_status_names.begin(), Container::_status_names.end(), state);
+		set_status(h, it == Container::_status_names.end()
+			? Container::Status::UNKNOWN
+			: static_cast<Container::Status>(std::distance(Container::_status_names.begin(), it)));
+		listed[h] = true;
+	}
+
+	for (Handle h = 0; h < _status.size(); ++h)
+	{
+		if (!listed[h] && _name[h] != NONE && _status[h] != static_cast<int8_t>(Container::Status::UNKNOWN))
+		{
+			set_status(h, Container::Status::REMOVED);
+		}
+	}
+
+	return ret;
+}
+
+CLI::BulkOutput Fleet::apply(CLI::BulkAction action, const std::vector<Handle>& handles)
+{
+	std::vector<std::string> names;
+	std::vector<Handle> targets;
+	names.reserve(handles.size());
+	for (Handle h : handles)
+	{
+		if (h < _name.size() && _name[h] != NONE)
+		{
+			names.emplace_back(text(_name[h]));
+			targets.push_back(h);
+		}
+	}
+
+	Container::Status reached = Container::Status::UNKNOWN;
+	switch (action)
+	{
+	case CLI::BulkAction::START:		reached = Container::Status::RUNNING; break;
+	case CLI::BulkAction::STOP:			reached = Container::Status::EXITED; break;
+	case CLI::BulkAction::KILL:			reached = Container::Status::EXITED; break;
+	case CLI::BulkAction::REMOVE:		reached = Container::Status::REMOVED; break;
+	case CLI::BulkAction::FORCE_REMOVE:	reached = Container::Status::REMOVED; break;
+	}
+
+	CLI::BulkOutput outputs = CLI::bulk(action, names);
+	for (size_t i = 0; i < outputs.size(); ++i)
+	{
+		set_status(targets[i], outputs[i].second.exitCode == Shell::SUCCESS ? reached : Container::Status::UNKNOWN);
+	}
+	return outputs;
+}
+
+size_t Fleet::memory_usage() const
+{
+	size_t bytes = _blocks.size() * BLOCK_SIZE + _long_bytes;
+	bytes += (_blocks.capacity() + _long_blocks.capacity()) * sizeof(std::unique_ptr<char[]>);
+	bytes += _strings.capacity() * sizeof(std::string_view) + (_refs.capacity() + _free_strings.capacity()) * sizeof(uint32_t);
+	bytes += (_interned.size() + _by_name.size() + _by_id.size()) * (sizeof(void*) * 2 + sizeof(std::string_view) + sizeof(uint32_t) * 2);
+	bytes += (_interned.bucket_count() + _by_name.bucket_count() + _by_id.bucket_count()) * sizeof(void*);
+	bytes += (_name.capacity() + _id.capacity() + _image.capacity()) * sizeof(uint32_t) + _status.capacity() * sizeof(int8_t);
+	bytes += _free.capacity() * sizeof(Handle);
+	return bytes;
+}
@@ -0,0 +1,473 @@
+#include "Docker.h"
+#include "Json.hpp"
+#include "Reference.hpp"
+
+using namespace docker;
+
+
+namespace
+{
+	/**
+		@brief  The digest of a repository@digest reference
+	**/
+	std::string bare_digest(const std::string& digest)
+	{
+		return digest.substr(digest.find('@') + 1);
+	}
+
+	/**
+		@brief  Decodes the lines of docker images --format '{{json .}}', each one being a repository:tag of an image
+	**/
+	std::vector<ImageCatalog::Image> parse_rows(std::string_view output)
+	{
+		std::vector<ImageCatalog::Image> rows;
+		while (!output.empty())
+		{
+			size_t end = output.find('\n');
+			std::string_view line = output.substr(0, end);
+			output = end == std::string_view::npos ? std::string_view() : output.substr(end + 1);
+
+			ImageCatalog::Image row;
+			std::string repository, tag, digest, size;
+			bool parsed = json::for_each_member(line, [&](std::string_view key, std::string_view value) {
+				if (key == "ID")				row.id = json::to_string(value);
+				else if (key == "Repository")	repository = json::to_string(value);
+				else if (key == "Tag")			tag = json::to_string(value);
+				else if (key == "Digest")		digest = json::to_string(value);
+				else if (key == "Size")			size = json::to_string(value);
+				else if (key == "CreatedAt")	row.created_at = json::to_string(value);
+				return true;
+			});
+			if (!parsed || row.id.empty())
+			{
+				continue;
+			}
+
+			if (row.id.find(':') == std::string::npos)
+			{
+				row.id = "sha256:" + row.id;
+			}
+			if (!repository.empty() && repository != "<none>")
+			{
+				if (!tag.empty() && tag != "<none>") row.references.push_back(repository + ":" + tag);
+				if (!digest.empty() && digest != "<none>") row.digests.push_back(repository + "@" + digest);
+			}
+			row.size = CLI::StatsInfo::parse_size(size);
+			rows.push_back(std::move(row));
+		}
+		return rows;
+	}
+}
+
+
+ImageCatalog::ImageCatalog(std::chrono::milliseconds ttl)
+	: _ttl(ttl)
+{}
+
+ImageCatalog::~ImageCatalog()
+{
+	unwatch();
+}
+
+Shell::Output ImageCatalog::refresh()
+{
+	std::lock_guard<std::mutex> refresh_lock(_refresh_mutex);
+	return load_all();
+}
+
+void ImageCatalog::invalidate()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_stale = true;
+}
+
+std::optional<ImageCatalog::Image> ImageCatalog::find(std::string_view key)
+{
+	update();
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Image* image = lookup(key);
+	if (!image)
+	{
+		return std::nullopt;
+	}
+	return *image;
+}
+
+bool ImageCatalog::exists(std::string_view key)
+{
+	update();
+	std::lock_guard<std::mutex> lock(_mutex);
+	return lookup(key) != nullptr;
+}
+
+std::string ImageCatalog::id(std::string_view key)
+{
+	update();
+	std::lock_guard<std::mutex> lock(_mutex);
+	const Image* image = lookup(key);
+	return image ? image->id : std::string();
+}
+
+std::vector<ImageCatalog::Image> ImageCatalog::images()
+{
+	update();
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<Image> all;
+	all.reserve(_images.size());
+	for (auto& image : _images) all.push_back(image.second);
+	return all;
+}
+
+size_t ImageCatalog::size()
+{
+	update();
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _images.size();
+}
+
+Shell::Output ImageCatalog::watch()
+{
+	std::lock_guard<std::mutex> lock(_stream_mutex);
+
+	if (_watching && _stream.running())
+	{
+		return { Shell::SUCCESS, "" };
+	}
+
+	Shell::Output ret = start_stream();
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		return ret;
+	}
+	_watching = true;
+	invalidate(); // the images may have changed while not watching
+	return ret;
+}
+
+void ImageCatalog::unwatch()
+{
+	std::lock_guard<std::mutex> lock(_stream_mutex);
+
+	_watching = false;
+	_stream.cancel();
+	_stream.wait();
+}
+
+Shell::Output ImageCatalog::start_stream()
+{
+	try
+	{
+		_stream = CLI::Events("image").stream([this](Shell::Channel channel, std::string_view line) {
+			if (channel == Shell::STDOUT)
+			{
+				on_event(line);
+			}
+			return true;
+		});
+	}
+	catch (const std::exception& ex)
+	{
+		return { Shell::FAIL, "Exception: " + std::string(ex.what()) };
+	}
+
+	return { Shell::SUCCESS, "" };
+}
+
+void ImageCatalog::update()
+{
+	auto expired = [this]() {
+		return !_loaded || _stale || (_ttl.count() > 0 && std::chrono::steady_clock::now() - _loaded_at >= _ttl);
+	};
+
+	// up to date: no wait for the docker call another thread may be running
+	bool stream_down;
+	{
+		std::lock_guard<std::mutex> lock(_stream_mutex);
+		stream_down = _watching && !_stream.running();
+	}
+	if (!stream_down)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!expired() && _pending_references.empty() && _pending_deletes.empty())
+		{
+			return;
+		}
+	}
+
+	std::lock_guard<std::mutex> refresh_lock(_refresh_mutex);
+
+	{
+		std::lock_guard<std::mutex> lock(_stream_mutex);
+		if (_watching && !_stream.running())
+		{
+			// events may have been missed while the stream was down
+			_watching = start_stream().exitCode == Shell::SUCCESS;
+			invalidate();
+		}
+	}
+
+	bool full;
+	std::vector<std::string> references;
+	std::vector<std::string> deleted;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		full = expired();
+		if (!full)
+		{
+			references.swap(_pending_references);
+			deleted.swap(_pending_deletes);
+		}
+	}
+
+	if (full)
+	{
+		load_all();
+	}
+	else if (!references.empty() || !deleted.empty())
+	{
+		load_references(std::move(references), std::move(deleted));
+	}
+}
+
+Shell::Output ImageCatalog::load_all()
+{
+	{
+		// the events received from now on are applied after this load
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pending_references.clear();
+		_pending_deletes.clear();
+		_stale = false;
+	}
+
+	auto loaded_at = std::chrono::steady_clock::now();
+	Shell::Output ret = CLI::Images().extract(CLI::Images::JSON).execute();
+	std::vector<Image> rows;
+	if (ret.exitCode == Shell::SUCCESS)
+	{
+		rows = parse_rows(ret.result);
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		_stale = true;
+		return ret;
+	}
+
+	_images.clear();
+	_by_reference.clear();
+	_by_id.clear();
+	_by_digest.clear();
+	for (auto& row : rows) merge(row);
+	_loaded = true;
+	_loaded_at = loaded_at;
+	return ret;
+}
+
+Shell::Output ImageCatalog::load_references(std::vector<std::string> references, std::vector<std::string> deleted)
+{
+	std::sort(references.begin(), references.end());
+	references.erase(std::unique(references.begin(), references.end()), references.end());
+
+	Shell::Output ret{ Shell::SUCCESS, "" };
+	std::vector<Image> rows;
+	if (!references.empty())
+	{
+		// a single call for all the references
+		CLI::Images command;
+		for (auto& reference : references) command.filter(CLI::Images::REFERENCE, reference);
+		ret = command.extract(CLI::Images::JSON).execute();
+		if (ret.exitCode == Shell::SUCCESS)
+		{
+			rows = parse_rows(ret.result);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		_stale = true;
+		return ret;
+	}
+
+	// the references not listed anymore are gone, and the listed ones may have moved to another image
+	for (auto& reference : references) unlink_reference(reference);
+	for (auto& row : rows) merge(row);
+	for (auto& id : deleted) erase(id);
+	return ret;
+}
+
+void ImageCatalog::on_event(std::string_view line)
+{
+	if (json::find(line, { "Type" }) != "\"image\"")
+	{
+		return;
+	}
+
+	std::string action = json::to_string(json::find(line, { "Action" }));
+	std::string id = json::to_string(json::find(line, { "Actor", "ID" }));
+	std::string name = json::to_string(json::find(line, { "Actor", "Attributes", "name" }));
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (action == "delete")
+	{
+		_pending_deletes.push_back(id);
+	}
+	else if (action == "pull" || action == "tag")
+	{
+		// the pulled reference is the actor, the new tag is its name
+		std::string reference = normalize_reference(action == "pull" ? id : name);
+		if (reference.find('@') != std::string::npos)
+		{
+			_stale = true; // pulled by digest: the tags it got are unknown
+		}
+		else
+		{
+			_pending_references.push_back(std::move(reference));
+		}
+	}
+	else if (action == "untag")
+	{
+		// the removed tag is not reported: all the references of the image are checked
+		if (const Image* image = lookup(id))
+		{
+			for (auto& reference : image->references) _pending_references.push_back(normalize_reference(reference));
+		}
+	}
+	else if (action == "load" || action == "import")
+	{
+		_stale = true;
+	}
+}
+
+const ImageCatalog::Image* ImageCatalog::lookup(std::string_view key) const
+{
+	auto image = [this](const std::unordered_map<std::string, std::string>& index, const std::string& k) -> const Image* {
+		auto it = index.find(k);
+		if (it == index.end())
+		{
+			return nullptr;
+		}
+		auto found = _images.find(it->second);
+		return found == _images.end() ? nullptr : &found->second;
+	};
+
+	if (key.empty())
+	{
+		return nullptr;
+	}
+
+	std::string normalized = normalize_reference(key);
+	if (normalized.find('@') != std::string::npos)
+	{
+		return image(_by_digest, normalized);
+	}
+	if (const Image* found = image(_by_reference, normalized))
+	{
+		return found;
+	}
+
+	std::string raw(key);
+	if (const Image* found = image(_by_id, raw))
+	{
+		return found;
+	}
+	return image(_by_digest, raw);
+}
+
+void ImageCatalog::merge(const Image& row)
+{
+	auto it = _images.find(row.id);
+	if (it == _images.end())
+	{
+		it = _images.emplace(row.id, Image()).first;
+		it->second.id = row.id;
+
+		std::string bare = row.id.substr(row.id.find(':') + 1);
+		_by_id[row.id] = row.id;
+		_by_id[bare] = row.id;
+		_by_id[bare.substr(0, 12)] = row.id;
+	}
+
+	Image& image = it->second;
+	image.size = row.size;
+	image.created_at = row.created_at;
+
+	for (auto& reference : row.references)
+	{
+		std::string key = normalize_reference(reference);
+		auto linked = _by_reference.find(key);
+		if (linked != _by_reference.end())
+		{
+			if (linked->second == row.id)
+			{
+				continue;
+			}
+			unlink_reference(key); // the tag moved to this image
+		}
+		_by_reference.emplace(key, row.id);
+		image.references.push_back(reference);
+	}
+
+	for (auto& digest : row.digests)
+	{
+		_by_digest[normalize_reference(digest)] = row.id;
+		_by_digest[bare_digest(digest)] = row.id;
+		if (std::find(image.digests.begin(), image.digests.end(), digest) == image.digests.end())
+		{
+			image.digests.push_back(digest);
+		}
+	}
+}
+
+void ImageCatalog::unlink_reference(const std::string& reference)
+{
+	auto linked = _by_reference.find(reference);
+	if (linked == _by_reference.end())
+	{
+		return;
+	}
+
+	auto image = _images.find(linked->second);
+	if (image != _images.end())
+	{
+		auto& references = image->second.references;
+		references.erase(std::remove_if(references.begin(), references.end(),
+			[&reference](const std::string& r) { return normalize_reference(r) == reference; }), references.end());
+	}
+	_by_reference.erase(linked);
+}
+
+void ImageCatalog::erase(const std::string& key)
+{
+	auto found = _by_id.find(key);
+	if (found == _by_id.end())
+	{
+		return;
+	}
+	const std::string id = found->second;
+
+	// the entries of the indexes may have been taken by another image since
+	auto unlink = [&id](std::unordered_map<std::string, std::string>& index, const std::string& k) {
+		auto it = index.find(k);
+		if (it != index.end() && it->second == id) index.erase(it);
+	};
+
+	auto image = _images.find(id);
+	if (image != _images.end())
+	{
+		for (auto& reference : image->second.references) unlink(_by_reference, normalize_reference(reference));
+		for (auto& digest : image->second.digests)
+		{
+			unlink(_by_digest, normalize_reference(digest));
+			unlink(_by_digest, bare_digest(digest));
+		}
+		_images.erase(image);
+	}
+
+	std::string bare = id.substr(id.find(':') + 1);
+	unlink(_by_id, bare.substr(0, 12));
+	unlink(_by_id, bare);
+	unlink(_by_id, id);
+}
@@ -0,0 +1,239 @@
+#include "Docker.h"
+#include "Reference.hpp"
+
+#include <cctype>
+
+using namespace docker;
+
+
+namespace
+{
+	bool is_layer_id(std::string_view text)
+	{
+		if (text.size() != 12)
+		{
+			return false;
+		}
+		for (char ch : text)
+		{
+			if (!std::isxdigit(static_cast<unsigned char>(ch))) return false;
+		}
+		return true;
+	}
+
+	std::string_view trim(std::string_view text)
+	{
+		while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) text.remove_prefix(1);
+		while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.remove_suffix(1);
+		return text;
+	}
+
+	/**
+		@brief  Decodes a step printed by docker pull: "<layer>: <status>[ [==>  ] <current>/<total>]", or a step of the whole
+		        image such as "22.04: Pulling from library/ubuntu" or "Digest: sha256:..."
+		@retval  - False for the other lines, i.e. the full reference printed at the end
+	**/
+	bool parse_progress(std::string_view line, ImagePuller::Progress& progress)
+	{
+		size_t separator = line.find(": ");
+		if (separator == std::string_view::npos)
+		{
+			return false;
+		}
+
+		if (!is_layer_id(line.substr(0, separator)))
+		{
+			progress.status = std::string(line);
+			return true;
+		}
+		progress.layer = std::string(line.substr(0, separator));
+		std::string_view status = line.substr(separator + 2);
+
+		// the sizes are the last word, after the progress bar if any
+		size_t space = status.rfind(' ');
+		std::string_view sizes = space == std::string_view::npos ? std::string_view() : status.substr(space + 1);
+		size_t slash = sizes.find('/');
+		if (slash != std::string_view::npos)
+		{
+			progress.current = CLI::StatsInfo::parse_size(sizes.substr(0, slash));
+			progress.total = CLI::StatsInfo::parse_size(sizes.substr(slash + 1));
+			status = status.substr(0, std::min(space, status.find('[')));
+		}
+		progress.status = std::string(trim(status));
+		return true;
+	}
+}
+
+
+struct ImagePuller::Job
+{
+	std::string reference;
+	std::string key;
+	std::promise<Shell::Output> promise;
+	std::shared_future<Shell::Output> result;
+	Shell::Stream stream;	// set with the mutex held
+};
+
+
+ImagePuller::ImagePuller(size_t parallelism, ProgressCallback on_progress)
+	: _on_progress(std::move(on_progress))
+{
+	for (size_t i = 0; i < std::max<size_t>(parallelism, 1); ++i)
+	{
+		_pullers.emplace_back([this]() { pull_loop(); });
+	}
+}
+
+ImagePuller::~ImagePuller()
+{
+	std::deque<std::shared_ptr<Job>> queued;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+		queued.swap(_queue);
+		for (auto& pending : _pending) pending.second->stream.cancel();
+	}
+	_cv.notify_all();
+	for (auto& puller : _pullers)
+	{
+		puller.join();
+	}
+
+	for (auto& job : queued)
+	{
+		job->promise.set_value({ Shell::CANCELLED, "Pull cancelled" });
+	}
+}
+
+std::shared_future<Shell::Output> ImagePuller::pull(std::string reference)
+{
+	std::string key = normalize_reference(reference);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto pending = _pending.find(key);
+	if (pending != _pending.end())
+	{
+		return pending->second->result;
+	}
+
+	auto job = std::make_shared<Job>();
+	job->reference = std::move(reference);
+	job->key = key;
+	job->result = job->promise.get_future().share();
+	_pending.emplace(std::move(key), job);
+	_queue.push_back(job);
+	_cv.notify_one();
+	return job->result;
+}
+
+std::vector<Shell::Output> ImagePuller::pull_all(const std::vector<std::string>& references)
+{
+	std::vector<std::shared_future<Shell::Output>> results;
+	results.reserve(references.size());
+	for (auto& reference : references)
+	{
+		results.push_back(pull(reference));
+	}
+
+	std::vector<Shell::Output> outputs;
+	outputs.reserve(results.size());
+	for (auto& result : results)
+	{
+		outputs.push_back(result.get());
+	}
+	return outputs;
+}
+
+size_t ImagePuller::pending()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _pending.size();
+}
+
+void ImagePuller::pull_loop()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		_cv.wait(lock, [this]() { return _stop || !_queue.empty(); });
+		if (_stop)
+		{
+			return;
+		}
+
+		std::shared_ptr<Job> job = _queue.front();
+		_queue.pop_front();
+
+		lock.unlock();
+		Shell::Output ret = run(*job);
+		lock.lock();
+
+		// a pull of the same reference from now on starts again
+		_pending.erase(job->key);
+		job->promise.set_value(std::move(ret));
+	}
+}
+
+Shell::Output ImagePuller::run(Job& job)
+{
+	std::string reference;	// the full reference, printed last
+	std::string errors;
+
+	try
+	{
+		Shell::Stream stream = CLI::Pull(job.reference).stream([&](Shell::Channel channel, std::string_view line) {
+			if (channel == Shell::STDERR)
+			{
+				if (!line.empty()) errors += (errors.empty() ? "" : "\n") + std::string(line);
+				return true;
+			}
+
+			Progress progress;
+			if (parse_progress(line, progress))
+			{
+				progress.reference = job.reference;
+				report(progress);
+			}
+			else if (!line.empty())
+			{
+				reference = std::string(line);
+			}
+			return true;
+		});
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		job.stream = std::move(stream);
+		if (_stop)
+		{
+			job.stream.cancel(); // started after the destructor cancelled the running pulls
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		return { Shell::FAIL, "Exception: " + std::string(ex.what()) };
+	}
+
+	Shell::Output ret = job.stream.wait();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_stop)
+		{
+			return { Shell::CANCELLED, "Pull cancelled" };
+		}
+	}
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		return { ret.exitCode, errors.empty() ? ret.result : errors };
+	}
+	return { Shell::SUCCESS, reference };
+}
+
+void ImagePuller::report(const Progress& progress)
+{
+	if (_on_progress)
+	{
+		std::lock_guard<std::mutex> lock(_progress_mutex);
+		_on_progress(progress);
+	}
+}
@@ -0,0 +1,332 @@
+#include "Json.hpp"
+
+#include <charconv>
+#include <cstdint>
+
+using namespace docker;
+
+
+namespace
+{
+	void skip_ws(std::string_view doc, size_t& pos)
+	{
+		while (pos < doc.size() && (doc[pos] == ' ' || doc[pos] == '\n' || doc[pos] == '\r' || doc[pos] == '\t'))
+		{
+			++pos;
+		}
+	}
+
+	bool skip_string(std::string_view doc, size_t& pos)
+	{
+		// pos is on the opening quote
+		for (++pos; pos < doc.size(); ++pos)
+		{
+			if (doc[pos] == '\\')
+			{
+				++pos;
+			}
+			else if (doc[pos] == '"')
+			{
+				++pos;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool skip_container(std::string_view doc, size_t& pos)
+	{
+		// pos is on the opening bracket. Strings are skipped as a whole so that brackets inside them are ignored.
+		int depth = 0;
+		while (pos < doc.size())
+		{
+			char c = doc[pos];
+			if (c == '"')
+			{
+				if (!skip_string(doc, pos)) return false;
+				continue;
+			}
+			if (c == '{' || c == '[')
+			{
+				++depth;
+			}
+			else if (c == '}' || c == ']')
+			{
+				if (--depth == 0)
+				{
+					++pos;
+					return true;
+				}
+			}
+			++pos;
+		}
+		return false;
+	}
+
+	void append_utf8(std::string& out, uint32_t cp)
+	{
+		if (cp < 0x80)
+		{
+			out += static_cast<char>(cp);
+		}
+		else if (cp < 0x800)
+		{
+			out += static_cast<char>(0xC0 | (cp >> 6));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+		else if (cp < 0x10000)
+		{
+			out += static_cast<char>(0xE0 | (cp >> 12));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+		else
+		{
+			out += static_cast<char>(0xF0 | (cp >> 18));
+			out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+			out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+			out += static_cast<char>(0x80 | (cp & 0x3F));
+		}
+	}
+
+	uint32_t parse_hex4(std::string_view s, size_t pos)
+	{
+		uint32_t v = 0;
+		for (size_t i = pos; i < pos + 4 && i < s.size(); ++i)
+		{
+			char c = s[i];
+			v <<= 4;
+			if (c >= '0' && c <= '9') v |= c - '0';
+			else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+		}
+		return v;
+	}
+}
+
+
+bool json::skip_value(std::string_view doc, size_t& pos)
+{
+	skip_ws(doc, pos);
+	if (pos >= doc.size()) return false;
+
+	switch (doc[pos])
+	{
+	case '"':
+		return skip_string(doc, pos);
+	case '{':
+	case '[':
+		return skip_container(doc, pos);
+	default:
+		// number, true, false, null
+		while (pos < doc.size() && doc[pos] != ',' && doc[pos] != '}' && doc[pos] != ']'
+			&& doc[pos] != ' ' && doc[pos] != '\n' && doc[pos] != '\r' && doc[pos] != '\t')
+		{
+			++pos;
+		}
+		return true;
+	}
+}
+
+bool json::for_each_member(std::string_view object, const std::function<bool(std::string_view key, std::string_view value)>& f)
+{
+	size_t pos = 0;
+	skip_ws(object, pos);
+	if (pos >= object.size() || object[pos] != '{') return false;
+	++pos;
+
+	while (true)
+	{
+		skip_ws(object, pos);
+		if (pos >= object.size()) return false;
+		if (object[pos] == '}') return true;
+		if (object[pos] != '"') return false;
+
+		size_t key_begin = pos + 1;
+		if (!skip_string(object, pos)) return false;
+		std::string_view key = object.substr(key_begin, pos - key_begin - 1);
+
+		skip_ws(object, pos);
+		if (pos >= object.size() || object[pos] != ':') return false;
+		++pos;
+		skip_ws(object, pos);
+
+		size_t value_begin = pos;
+		if (!skip_value(object, pos)) return false;
+		if (!f(key, object.substr(value_begin, pos - value_begin))) return true;
+
+		skip_ws(object, pos);
+		if (pos < object.size() && object[pos] == ',') ++pos;
+	}
+}
+
+std::vector<std::pair<std::string_view, std::string_view>> json::members(std::string_view object)
+{
+	std::vector<std::pair<std::string_view, std::string_view>> result;
+
+	for_each_member(object, [&result](std::string_view key, std::string_view value) {
+		// keys are returned quoted
+		result.emplace_back(std::string_view(key.data() - 1, key.size() + 2), value);
+		return true;
+	});
+
+	return result;
+}
+
+std::vector<std::string_view> json::elements(std::string_view array)
+{
+	std::vector<std::string_view> result;
+
+	size_t pos = 0;
+	skip_ws(array, pos);
+	if (pos >= array.size() || array[pos] != '[') return result;
+	++pos;
+
+	while (true)
+	{
+		skip_ws(array, pos);
+		if (pos >= array.size() || array[pos] == ']') break;
+
+		size_t value_begin = pos;
+		if (!skip_value(array, pos)) break;
+		result.emplace_back(array.substr(value_begin, pos - value_begin));
+
+		skip_ws(array, pos);
+		if (pos < array.size() && array[pos] == ',') ++pos;
+	}
+
+	return result;
+}
+
+std::string_view json::find(std::string_view doc, std::initializer_list<std::string_view> path)
+{
+	std::string_view current = doc;
+
+	for (auto& key : path)
+	{
+		size_t pos = 0;
+		skip_ws(current, pos);
+		if (pos >= current.size() || current[pos] != '{') return {};
+		++pos;
+
+		bool found = false;
+		while (!found)
+		{
+			skip_ws(current, pos);
+			if (pos >= current.size() || current[pos] != '"') return {};
+
+			size_t key_begin = pos + 1;
+			if (!skip_string(current, pos)) return {};
+			std::string_view k = current.substr(key_begin, pos - key_begin - 1);
+
+			skip_ws(current, pos);
+			if (pos >= current.size() || current[pos] != ':') return {};
+			++pos;
+			skip_ws(current, pos);
+
+			size_t value_begin = pos;
+			if (!skip_value(current, pos)) return {};
+
+			if (k == key)
+			{
+				current = current.substr(value_begin, pos - value_begin);
+				found = true;
+			}
+			else
+			{
+				skip_ws(current, pos);
+				if (pos >= current.size() || current[pos] != ',') return {};
+				++pos;
+			}
+		}
+	}
+
+	return current;
+}
+
+long long json::to_integer(std::string_view raw)
+{
+	long long value = 0;
+	std::from_chars(raw.data(), raw.data() + raw.size(), value);
+	return value;
+}
+
+std::string json::to_string(std::string_view raw)
+{
+	if (raw.empty() || raw == "null") return {};
+	if (raw.front() != '"') return std::string(raw);
+
+	std::string out;
+	out.reserve(raw.size());
+
+	for (size_t i = 1; i + 1 < raw.size(); ++i)
+	{
+		char c = raw[i];
+		if (c != '\\')
+		{
+			out += c;
+			continue;
+		}
+
+		++i;
+		switch (raw[i])
+		{
+		case 'n': out += '\n'; break;
+		case 't': out += '\t'; break;
+		case 'r': out += '\r'; break;
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'u':
+		{
+			uint32_t cp = parse_hex4(raw, i + 1);
+			i += 4;
+			// surrogate pair
+			if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 < raw.size() && raw[i + 1] == '\\' && raw[i + 2] == 'u')
+			{
+				uint32_t low = parse_hex4(raw, i + 3);
+				cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+				i += 6;
+			}
+			append_utf8(out, cp);
+			break;
+		}
+		default: out += raw[i]; break; // \" \\ \/
+		}
+	}
+
+	return out;
+}
+
+std::string json::quote(std::string_view text)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	std::string out;
+	out.reserve(text.size() + 2);
+	out += '"';
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+			{
+				out += "\\u00";
+				out += hex[(c >> 4) & 0xF];
+				out += hex[c & 0xF];
+			}
+			else
+			{
+				out += c;
+			}
+			break;
+		}
+	}
+	out += '"';
+	return out;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <initializer_list>
+
+namespace docker
+{
+	/*
+	* Minimal JSON reader working directly on the raw text.
+	* Values are returned as views into the document, nothing is copied until a string is decoded.
+	*/
+	namespace json
+	{
+		/**
+			@brief  Finds the value at the given path of object keys
+			@param  doc  - A JSON document (or any JSON value)
+			@param  path - Keys to follow, from the outermost object
+			@retval      - The raw text of the value, empty if the path does not exist
+		**/
+		std::string_view find(std::string_view doc, std::initializer_list<std::string_view> path);
+
+		/**
+			@brief  Get the raw text of each element of an array
+			@param  array - The raw text of a JSON array
+			@retval       - The elements, empty if the value is not an array
+		**/
+		std::vector<std::string_view> elements(std::string_view array);
+
+		/**
+			@brief  Get the key and the raw value text of each member of an object
+			@param  object - The raw text of a JSON object
+			@retval        - The members (keys are still quoted), empty if the value is not an object
+		**/
+		std::vector<std::pair<std::string_view, std::string_view>> members(std::string_view object);
+
+		/**
+			@brief  Visits each member of an object in a single pass, without collecting them
+			@param  object - The raw text of a JSON object
+			@param  f      - Called with the key (unquoted) and the raw value text. Return false to stop
+			@retval        - False if the value is not an object or is malformed
+		**/
+		bool for_each_member(std::string_view object, const std::function<bool(std::string_view key, std::string_view value)>& f);
+
+		/**
+			@brief  Decodes a raw JSON integer
+			@param  raw - The raw text of the value
+			@retval     - The number, 0 if the value is not an integer
+		**/
+		long long to_integer(std::string_view raw);
+
+		/**
+			@brief  Decodes a raw JSON value into text. Strings are unescaped, other values are returned as they are, null becomes empty.
+			@param  raw - The raw text of the value
+			@retval     - The decoded text
+		**/
+		std::string to_string(std::string_view raw);
+
+		/**
+			@brief  Encodes a text as a quoted JSON string
+			@param  text - The text to encode
+			@retval      - The quoted and escaped string
+		**/
+		std::string quote(std::string_view text);
+
+		/**
+			@brief  Skips a whole value starting at pos (leading white spaces included)
+			@param  doc - The document
+			@param  pos - The position of the value, moved just after it
+			@retval     - False if the document is malformed
+		**/
+		bool skip_value(std::string_view doc, size_t& pos);
+	}
+}
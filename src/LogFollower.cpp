@@ -0,0 +1,554 @@
+#include "Docker.h"
+#include "LogSpill.hpp"
+
+#include <cstring>
+
+using namespace docker;
+
+
+namespace
+{
+	/*
+	* A read buffer: the producer appends to it and publishes the complete lines, the consumer delivers the published bytes
+	*/
+	struct Buffer
+	{
+		std::unique_ptr<char[]>	data;
+		size_t					size = 0;		// bytes written
+		size_t					published = 0;	// complete lines, visible to the consumer
+		size_t					delivered = 0;
+		bool					sealed = false;	// no more writes: recycled once delivered
+		Shell::Channel			channel = Shell::STDOUT;
+	};
+
+	// how often the consumer looks whether docker logs has ended
+	const std::chrono::milliseconds END_POLL_INTERVAL{ 50 };
+}
+
+
+struct LogFollower::State
+{
+	LogSink						sink;
+	LogOptions					options;
+
+	std::mutex					mutex;
+	std::condition_variable		cv;				// data to deliver (consumer), room to read (producer)
+	std::vector<std::unique_ptr<Buffer>> buffers;
+	std::vector<Buffer*>		free;
+	std::deque<Buffer*>			queue;			// buffers with data to deliver, oldest first
+	Buffer*						filling[2] = { nullptr, nullptr };
+
+	// once all the buffers are waiting for the sink, the output goes to the spill until the sink has caught up
+	std::unique_ptr<LogSpill>	spill;
+	bool						spilling = false;
+	std::string					partial[2];		// incomplete line of each channel while spilling
+
+	bool						ended = false;	// docker logs has ended and its last lines are published
+	bool						stopped = false;
+	std::atomic<bool>			done{ false };	// everything delivered, or stopped
+	Shell::Stream				stream;
+	std::thread					consumer;
+	Shell::Output				result{ Shell::SUCCESS, "" };
+	Stats						stats;
+
+	/**
+		@brief  Receives the output of docker logs, on the stream thread
+		@retval  - False to stop docker logs
+	**/
+	bool feed(Shell::Channel channel, std::string_view data);
+
+	/**
+		@brief  Delivers the lines to the sink until everything is delivered or the follower is stopped, on the consumer thread
+	**/
+	void deliver();
+
+private:
+	/**
+		@brief  Get an empty buffer for a channel, appended to the queue. Called with the mutex locked.
+		@retval  - nullptr if all the buffers are in use
+	**/
+	Buffer* take_buffer(Shell::Channel channel);
+
+	/**
+		@brief  Seals the buffers being filled, moving their incomplete lines to partial. Called with the mutex locked.
+	**/
+	void start_spilling();
+
+	/**
+		@brief  Writes the complete lines of the data to the spill, the incomplete last one to partial, removing them from data.
+		        Called with the mutex locked.
+		@retval  - False if stopped or the spill cannot be used
+	**/
+	bool spill_lines(std::unique_lock<std::mutex>& lock, Shell::Channel channel, std::string_view& data);
+
+	/**
+		@brief  Appends a record to the spill, waiting for room. Called with the mutex locked.
+		@retval  - False if stopped or the spill cannot be used
+	**/
+	bool spill_record(std::unique_lock<std::mutex>& lock, Shell::Channel channel, std::string_view first, std::string_view second);
+
+	/**
+		@brief  Publishes the incomplete last lines once docker logs has ended. Called with the mutex locked.
+	**/
+	void finish();
+
+	std::vector<LogLine>		_batch;			// reused by every delivery
+	std::string					_last;			// an incomplete last line being delivered
+};
+
+
+Buffer* LogFollower::State::take_buffer(Shell::Channel channel)
+{
+	Buffer* b = nullptr;
+	if (!free.empty())
+	{
+		b = free.back();
+		free.pop_back();
+	}
+	else if (buffers.size() < options.buffers)
+	{
+		buffers.push_back(std::make_unique<Buffer>());
+		b = buffers.back().get();
+		b->data.reset(new char[options.buffer_size]);
+	}
+	else
+	{
+		return nullptr;
+	}
+
+	b->size = b->published = b->delivered = 0;
+	b->sealed = false;
+	b->channel = channel;
+	queue.push_back(b);
+	filling[channel] = b;
+	return b;
+}
+
+void LogFollower::State::start_spilling()
+{
+	for (int ch = 0; ch < 2; ++ch)
+	{
+		Buffer* b = filling[ch];
+		if (!b) continue;
+		partial[ch].assign(b->data.get() + b->published, b->size - b->published);
+		b->size = b->published;
+		b->sealed = true;
+		filling[ch] = nullptr;
+	}
+	spilling = true;
+	cv.notify_all(); // sealed buffers may be recycled
+}
+
+bool LogFollower::State::spill_record(std::unique_lock<std::mutex>& lock, Shell::Channel channel, std::string_view first, std::string_view second)
+{
+	while (true)
+	{
+		if (stopped)
+		{
+			return false;
+		}
+		char* at = spill->reserve(first.size() + second.size());
+		if (at)
+		{
+			// the reserved room is not visible to the consumer until committed
+			lock.unlock();
+			std::memcpy(at, first.data(), first.size());
+			std::memcpy(at + first.size(), second.data(), second.size());
+			lock.lock();
+			spill->commit(channel);
+			stats.spilled_bytes += first.size() + second.size();
+			cv.notify_all();
+			return true;
+		}
+		if (spill->failed() && spill->empty())
+		{
+			return false; // no file can be created: back to the buffers
+		}
+		cv.wait(lock);
+	}
+}
+
+bool LogFollower::State::spill_lines(std::unique_lock<std::mutex>& lock, Shell::Channel channel, std::string_view& data)
+{
+	// pieces of at most a buffer, so that a record is never larger than two buffers and partial stays smaller than a buffer
+	while (!data.empty())
+	{
+		std::string_view piece = data.substr(0, options.buffer_size);
+		std::string& incomplete = partial[channel];
+		size_t eol = piece.rfind('\n');
+		if (eol == std::string_view::npos)
+		{
+			if (incomplete.size() + piece.size() >= options.buffer_size)
+			{
+				// a line longer than a buffer is delivered in pieces, as from the buffers
+				if (!spill_record(lock, channel, incomplete, piece)) return false;
+				incomplete.clear();
+			}
+			else
+			{
+				incomplete.append(piece.data(), piece.size());
+			}
+		}
+		else
+		{
+			if (!spill_record(lock, channel, incomplete, piece.substr(0, eol + 1))) return false;
+			incomplete.assign(piece.data() + eol + 1, piece.size() - eol - 1);
+		}
+		data.remove_prefix(piece.size());
+	}
+	return true;
+}
+
+bool LogFollower::State::feed(Shell::Channel channel, std::string_view data)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	stats.bytes += data.size();
+
+	while (!data.empty())
+	{
+		if (stopped)
+		{
+			return false;
+		}
+
+		if (spilling)
+		{
+			if (spill->empty() && queue.empty())
+			{
+				// the sink has caught up: back to the buffers, with the incomplete lines
+				spilling = false;
+				for (int ch = 0; ch < 2; ++ch)
+				{
+					if (partial[ch].empty()) continue;
+					Buffer* b = take_buffer(static_cast<Shell::Channel>(ch));
+					std::memcpy(b->data.get(), partial[ch].data(), partial[ch].size());
+					b->size = partial[ch].size();
+					partial[ch].clear();
+				}
+			}
+			else if (spill_lines(lock, channel, data))
+			{
+				return true;
+			}
+			else if (stopped)
+			{
+				return false;
+			}
+			else
+			{
+				// the spill cannot be used: wait for the sink instead
+				cv.wait(lock, [this]() { return stopped || queue.empty(); });
+				continue;
+			}
+		}
+
+		Buffer* b = filling[channel];
+		if (!b && !(b = take_buffer(channel)))
+		{
+			if (spill && !spill->failed())
+			{
+				start_spilling();
+			}
+			else
+			{
+				cv.wait(lock, [this]() { return stopped || !free.empty(); });
+			}
+			continue;
+		}
+
+		size_t n = std::min(options.buffer_size - b->size, data.size());
+		char* at = b->data.get() + b->size;
+		lock.unlock();
+		std::memcpy(at, data.data(), n); // beyond what is published: the consumer does not read it
+		lock.lock();
+		data.remove_prefix(n);
+		b->size += n;
+
+		// publish up to the last complete line: only the new bytes can hold it
+		for (size_t i = b->size; i > b->size - n; --i)
+		{
+			if (b->data[i - 1] == '\n')
+			{
+				b->published = i;
+				cv.notify_all();
+				break;
+			}
+		}
+
+		if (b->size == options.buffer_size)
+		{
+			// full: the incomplete line moves to the next buffer, a line longer than the buffer is delivered in pieces
+			if (b->published == 0) b->published = b->size;
+			size_t incomplete = b->size - b->published;
+			b->size = b->published;
+			b->sealed = true;
+			filling[channel] = nullptr;
+			cv.notify_all();
+
+			if (incomplete > 0)
+			{
+				std::string_view rest(b->data.get() + b->published, incomplete);
+				Buffer* next = take_buffer(channel);
+				if (!next && spill && !spill->failed())
+				{
+					start_spilling();
+					partial[channel].assign(rest.data(), rest.size());
+					continue;
+				}
+				while (!next && !stopped)
+				{
+					// the rest stays in the sealed buffer, which may be the one recycled
+					cv.wait(lock);
+					next = take_buffer(channel);
+				}
+				if (!next)
+				{
+					return false;
+				}
+				std::memmove(next->data.get(), rest.data(), rest.size());
+				next->size = rest.size();
+			}
+		}
+	}
+	return true;
+}
+
+void LogFollower::State::finish()
+{
+	for (int ch = 0; ch < 2; ++ch)
+	{
+		if (filling[ch])
+		{
+			filling[ch]->published = filling[ch]->size;
+			filling[ch]->sealed = true;
+			filling[ch] = nullptr;
+		}
+	}
+	ended = true; // the incomplete lines left by spilling are delivered last
+}
+
+void LogFollower::State::deliver()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopped)
+	{
+		// the oldest data of the buffers, then of the spill
+		Buffer* from = nullptr;
+		for (Buffer* b : queue)
+		{
+			if (b->delivered < b->published)
+			{
+				from = b;
+				break;
+			}
+		}
+
+		std::string_view data;
+		Shell::Channel channel = Shell::STDOUT;
+		bool from_spill = false;
+		size_t upto = 0;
+		if (from)
+		{
+			// more lines may be published while the sink runs
+			upto = from->published;
+			data = std::string_view(from->data.get() + from->delivered, upto - from->delivered);
+			channel = from->channel;
+		}
+		else if (spill && spill->front(channel, data))
+		{
+			from_spill = true;
+		}
+		else if (ended)
+		{
+			int ch = !partial[Shell::STDOUT].empty() ? Shell::STDOUT : !partial[Shell::STDERR].empty() ? Shell::STDERR : -1;
+			if (ch < 0)
+			{
+				break;
+			}
+			_last.swap(partial[ch]);
+			partial[ch].clear();
+			data = _last;
+			channel = static_cast<Shell::Channel>(ch);
+		}
+		else
+		{
+			if (!stream.running())
+			{
+				result = stream.wait();
+				finish();
+				continue;
+			}
+			cv.wait_for(lock, END_POLL_INTERVAL);
+			continue;
+		}
+
+		// frame the lines in place
+		lock.unlock();
+		_batch.clear();
+		while (!data.empty())
+		{
+			size_t eol = data.find('\n');
+			std::string_view line = data.substr(0, eol);
+			data = eol == std::string_view::npos ? std::string_view() : data.substr(eol + 1);
+			if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+			LogLine l{ {}, line, channel };
+			if (options.timestamps)
+			{
+				size_t space = line.find(' ');
+				l.timestamp = line.substr(0, space);
+				l.text = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+			}
+			_batch.push_back(l);
+		}
+
+		bool keep_going = true;
+		try
+		{
+			keep_going = sink(_batch);
+		}
+		catch (const std::exception& ex)
+		{
+			keep_going = false;
+			result = { Shell::FAIL, "Exception: " + std::string(ex.what()) };
+		}
+		lock.lock();
+
+		stats.lines += _batch.size();
+		++stats.batches;
+		if (from)
+		{
+			from->delivered = upto;
+			for (auto it = queue.begin(); it != queue.end();)
+			{
+				Buffer* b = *it;
+				if (b->sealed && b->delivered == b->size)
+				{
+					free.push_back(b);
+					it = queue.erase(it);
+				}
+				else
+				{
+					++it;
+				}
+			}
+		}
+		else if (from_spill)
+		{
+			spill->pop();
+		}
+		cv.notify_all();
+
+		if (!keep_going)
+		{
+			stopped = true;
+			stream.cancel();
+		}
+	}
+	done = true;
+	cv.notify_all();
+}
+
+
+LogFollower::LogFollower()
+{}
+
+LogFollower::LogFollower(std::string container_name_or_ID, LogSink sink, LogOptions options)
+	: _state(std::make_unique<State>())
+{
+	State* state = _state.get();
+	state->sink = std::move(sink);
+	state->options = std::move(options);
+	state->options.buffer_size = std::max<size_t>(state->options.buffer_size, 4096);
+	state->options.buffers = std::max<size_t>(state->options.buffers, 2);
+#ifdef UNIX
+	if (!state->options.spill_directory.empty())
+	{
+		// a record holds up to two buffers
+		size_t file_size = std::max(state->options.spill_file_size, 2 * state->options.buffer_size + 64);
+		state->spill = std::make_unique<LogSpill>(state->options.spill_directory, file_size, state->options.spill_files);
+	}
+#endif // UNIX
+
+	CLI::Logs logs(container_name_or_ID);
+	logs.follow();
+	if (state->options.timestamps) logs.timestamps();
+	if (!state->options.since.empty()) logs.since(state->options.since);
+	if (!state->options.tail.empty()) logs.tail(state->options.tail);
+
+	state->stream = logs.stream([state](Shell::Channel channel, std::string_view data) {
+		return state->feed(channel, data);
+	}, Shell::CHUNKS);
+	state->consumer = std::thread([state]() { state->deliver(); });
+}
+
+LogFollower::~LogFollower()
+{
+	stop();
+}
+
+LogFollower::LogFollower(LogFollower&&) noexcept = default;
+
+LogFollower& LogFollower::operator=(LogFollower&& other) noexcept
+{
+	if (this != &other)
+	{
+		stop();
+		_state = std::move(other._state);
+	}
+	return *this;
+}
+
+void LogFollower::stop()
+{
+	if (!_state)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(_state->mutex);
+		_state->stopped = true;
+	}
+	_state->cv.notify_all();
+	_state->stream.cancel();
+	if (_state->consumer.joinable())
+	{
+		_state->consumer.join();
+	}
+	Shell::Output output = _state->stream.wait(); // the producer has returned: the buffers can go
+	if (!_state->ended && _state->result.exitCode == Shell::SUCCESS && _state->result.result.empty())
+	{
+		_state->result = output;
+	}
+}
+
+bool LogFollower::running() const
+{
+	return _state && !_state->done;
+}
+
+Shell::Output LogFollower::wait()
+{
+	if (!_state)
+	{
+		return { Shell::FAIL, "No logs are being followed" };
+	}
+	if (_state->consumer.joinable())
+	{
+		_state->consumer.join();
+	}
+	std::lock_guard<std::mutex> lock(_state->mutex);
+	return _state->result;
+}
+
+LogFollower::Stats LogFollower::stats() const
+{
+	if (!_state)
+	{
+		return Stats();
+	}
+	std::lock_guard<std::mutex> lock(_state->mutex);
+	Stats s = _state->stats;
+	s.spill_files = _state->spill ? _state->spill->files() : 0;
+	return s;
+}
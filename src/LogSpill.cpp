@@ -0,0 +1,171 @@
+#include "LogSpill.hpp"
+
+#include <cstring>
+
+#ifdef UNIX
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#endif // UNIX
+
+using namespace docker;
+
+
+namespace
+{
+	// a record is its size and its channel, followed by the data padded to 8 bytes
+	const size_t HEADER_SIZE = 8;
+
+	size_t record_size(size_t data_size)
+	{
+		return HEADER_SIZE + ((data_size + 7) & ~size_t(7));
+	}
+}
+
+
+LogSpill::LogSpill(std::string directory, size_t file_size, size_t max_files)
+	: _directory(std::move(directory)), _file_size((file_size + 7) & ~size_t(7)), _max_files(max_files > 0 ? max_files : 1)
+{}
+
+LogSpill::~LogSpill()
+{
+	for (auto& file : _files) close(file);
+	close(_spare);
+}
+
+bool LogSpill::open(File& file)
+{
+#ifdef UNIX
+	std::string path = _directory + "/docker_logs_XXXXXX";
+	file.fd = ::mkstemp(&path[0]);
+	if (file.fd < 0)
+	{
+		return false;
+	}
+	::unlink(path.c_str());
+
+	if (::ftruncate(file.fd, static_cast<off_t>(_file_size)) != 0)
+	{
+		close(file);
+		return false;
+	}
+	void* data = ::mmap(nullptr, _file_size, PROT_READ | PROT_WRITE, MAP_SHARED, file.fd, 0);
+	if (data == MAP_FAILED)
+	{
+		close(file);
+		return false;
+	}
+	file.data = static_cast<char*>(data);
+	file.read = file.write = 0;
+	return true;
+#else
+	(void)file;
+	return false;
+#endif // UNIX
+}
+
+void LogSpill::close(File& file)
+{
+#ifdef UNIX
+	if (file.data) ::munmap(file.data, _file_size);
+	if (file.fd >= 0) ::close(file.fd);
+#endif // UNIX
+	file = File();
+}
+
+char* LogSpill::reserve(size_t size)
+{
+	size_t needed = record_size(size);
+	if (needed > _file_size)
+	{
+		return nullptr;
+	}
+
+	drop_consumed();
+	if (_files.size() == 1 && _files.front().read == _files.front().write)
+	{
+		_files.front().read = _files.front().write = 0; // all consumed: written again from its start
+	}
+
+	if (_files.empty() || _files.back().write + needed > _file_size)
+	{
+		if (_files.size() >= _max_files)
+		{
+			return nullptr;
+		}
+
+		File file;
+		if (_spare.data)
+		{
+			std::swap(file, _spare);
+			file.read = file.write = 0;
+		}
+		else if (!open(file))
+		{
+			_failed = true;
+			return nullptr;
+		}
+		_files.push_back(file);
+	}
+
+	_reserved = size;
+	return _files.back().data + _files.back().write + HEADER_SIZE;
+}
+
+void LogSpill::commit(Shell::Channel channel)
+{
+	File& file = _files.back();
+	uint32_t header[2] = { static_cast<uint32_t>(_reserved), static_cast<uint32_t>(channel) };
+	std::memcpy(file.data + file.write, header, sizeof(header));
+	file.write += record_size(_reserved);
+	_reserved = 0;
+}
+
+bool LogSpill::front(Shell::Channel& channel, std::string_view& data) const
+{
+	// the files before the first one with a record are consumed
+	for (const File& file : _files)
+	{
+		if (file.read == file.write) continue;
+
+		uint32_t header[2];
+		std::memcpy(header, file.data + file.read, sizeof(header));
+		channel = static_cast<Shell::Channel>(header[1]);
+		data = std::string_view(file.data + file.read + HEADER_SIZE, header[0]);
+		return true;
+	}
+	return false;
+}
+
+void LogSpill::pop()
+{
+	drop_consumed();
+	if (!_files.empty() && _files.front().read < _files.front().write)
+	{
+		File& file = _files.front();
+		uint32_t size;
+		std::memcpy(&size, file.data + file.read, sizeof(size));
+		file.read += record_size(size);
+	}
+	drop_consumed();
+}
+
+bool LogSpill::empty() const
+{
+	for (const File& file : _files)
+	{
+		if (file.read < file.write) return false;
+	}
+	return true;
+}
+
+void LogSpill::drop_consumed()
+{
+	// the last file is still written: it stays
+	while (_files.size() > 1 && _files.front().read == _files.front().write)
+	{
+		if (_spare.data) close(_files.front());
+		else std::swap(_spare, _files.front());
+		_files.pop_front();
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Shell.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+namespace docker
+{
+	/**
+		@class   LogSpill
+		@brief   FIFO of records (a channel and some log lines) kept in memory mapped files, for the lines a LogFollower
+		         cannot keep in memory while its sink is behind.
+		@details ~ Records are appended to the last file until it is full, then to a new one, up to the maximum number of
+				 files. A file is dropped once all its records have been consumed (one is kept to be reused). Files are
+				 deleted as soon as they are created: nothing is left on disk, whatever happens to the process.
+				 The page cache backs the records: under memory pressure they are written to disk instead of growing the heap.
+				 Not thread safe: a single producer reserves and commits, a single consumer reads front and pops, the
+				 calls being serialized by the caller. The memory of a reservation or of the front record can be used
+				 without holding the caller lock.
+	**/
+	class LogSpill
+	{
+	public:
+		/**
+			@param directory - Where to create the files
+			@param file_size - Size of a file, the largest record included
+			@param max_files - Files in use at most
+		**/
+		LogSpill(std::string directory, size_t file_size, size_t max_files);
+		~LogSpill();
+		LogSpill(const LogSpill&) = delete;
+		LogSpill& operator=(const LogSpill&) = delete;
+
+		/**
+			@brief  Reserves the room of a record at the end of the queue
+			@retval  - Where to copy the data of the record, nullptr if all the files are full or a file cannot be created
+		**/
+		char* reserve(size_t size);
+
+		/**
+			@brief Makes the reserved record visible to the consumer
+		**/
+		void commit(Shell::Channel channel);
+
+		/**
+			@brief  Get the oldest record
+			@retval  - False if there is none
+		**/
+		bool front(Shell::Channel& channel, std::string_view& data) const;
+
+		/**
+			@brief Drops the oldest record, and its file once all its records are consumed
+		**/
+		void pop();
+
+		/**
+			@brief  Check if all the records have been consumed
+		**/
+		bool empty() const;
+
+		/**
+			@brief  Number of files in use
+		**/
+		size_t files() const { return _files.size(); }
+
+		/**
+			@brief  Check if a file could not be created or mapped
+		**/
+		bool failed() const { return _failed; }
+
+	private:
+		struct File
+		{
+			int		fd = -1;
+			char*	data = nullptr;
+			size_t	read = 0;		// offset of the next record to consume
+			size_t	write = 0;		// end of the committed records
+		};
+
+		bool open(File& file);
+		void close(File& file);
+		void drop_consumed();
+
+		const std::string	_directory;
+		const size_t		_file_size;
+		const size_t		_max_files;
+		std::deque<File>	_files;
+		File				_spare;			// a consumed file, to be reused
+		size_t				_reserved = 0;	// size of the pending reservation
+		bool				_failed = false;
+	};
+}
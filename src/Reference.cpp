@@ -0,0 +1,36 @@
+#include "Reference.hpp"
+
+using namespace docker;
+
+
+bool docker::has_tag_or_digest(std::string_view reference)
+{
+	if (reference.find('@') != std::string_view::npos)
+	{
+		return true;
+	}
+
+	// the colon of a registry port is before the last slash
+	size_t slash = reference.rfind('/');
+	size_t colon = reference.rfind(':');
+	return colon != std::string_view::npos && (slash == std::string_view::npos || colon > slash);
+}
+
+std::string docker::normalize_reference(std::string_view reference)
+{
+	for (std::string_view prefix : { "docker.io/library/", "index.docker.io/library/", "docker.io/", "index.docker.io/" })
+	{
+		if (reference.substr(0, prefix.size()) == prefix)
+		{
+			reference.remove_prefix(prefix.size());
+			break;
+		}
+	}
+
+	std::string normalized(reference);
+	if (!has_tag_or_digest(normalized))
+	{
+		normalized += ":latest";
+	}
+	return normalized;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace docker
+{
+	/**
+		@brief  The familiar form of an image reference, as docker images prints it: without the default registry and namespace,
+		        with the latest tag if there is neither tag nor digest, e.g. docker.io/library/ubuntu becomes ubuntu:latest
+		@param  reference - The reference, repository[:tag][@digest]
+		@retval           - The normalized reference
+	**/
+	std::string normalize_reference(std::string_view reference);
+
+	/**
+		@brief  Check if an image reference has a tag or a digest
+	**/
+	bool has_tag_or_digest(std::string_view reference);
+}
@@ -0,0 +1,231 @@
+#include "Docker.h"
+#include "TimeSeries.hpp"
+
+#include <cmath>
+
+using namespace docker;
+
+
+namespace
+{
+	const size_t COLUMNS = 8; // one per metric, in the order of StatsSampler::Metric
+
+	int64_t now_ms()
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	bool is_rate(StatsSampler::Metric metric)
+	{
+		return metric == StatsSampler::Metric::NET_RX_RATE || metric == StatsSampler::Metric::NET_TX_RATE
+			|| metric == StatsSampler::Metric::BLOCK_READ_RATE || metric == StatsSampler::Metric::BLOCK_WRITE_RATE;
+	}
+}
+
+
+struct StatsSampler::Track
+{
+	series::SampleRing ring;
+	std::optional<CLI::StatsInfo> latest;
+
+	explicit Track(size_t bytes)
+		: ring(COLUMNS, bytes)
+	{}
+};
+
+
+StatsSampler::StatsSampler(size_t bytes_per_container)
+	: _bytes_per_container(bytes_per_container)
+{}
+
+StatsSampler::~StatsSampler()
+{
+	stop();
+}
+
+void StatsSampler::track(std::string name_or_id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_tracks.find(name_or_id) == _tracks.end())
+	{
+		_tracks.emplace(std::move(name_or_id), std::make_unique<Track>(_bytes_per_container));
+	}
+}
+
+void StatsSampler::untrack(const std::string& name_or_id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_tracks.erase(name_or_id);
+}
+
+Shell::Output StatsSampler::sample()
+{
+	// all the running containers at once: naming them would fail the whole call as soon as one is gone
+	int64_t time = now_ms();
+	Shell::Output ret = CLI::Stats().execute();
+	if (ret.exitCode != Shell::SUCCESS)
+	{
+		return ret;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::string_view lines = ret.result;
+	while (!lines.empty())
+	{
+		size_t end = lines.find('\n');
+		std::string_view line = lines.substr(0, end);
+		lines = end == std::string_view::npos ? std::string_view() : lines.substr(end + 1);
+
+		CLI::StatsInfo info;
+		if (!info.parse(line))
+		{
+			continue;
+		}
+		auto it = _tracks.find(info.name);
+		if (it == _tracks.end()) it = _tracks.find(info.id);
+		if (it == _tracks.end())
+		{
+			continue; // not tracked
+		}
+
+		const double values[COLUMNS] = {
+			info.cpu_percent,
+			static_cast<double>(info.memory_usage),
+			info.memory_percent,
+			static_cast<double>(info.net_rx),
+			static_cast<double>(info.net_tx),
+			static_cast<double>(info.block_read),
+			static_cast<double>(info.block_write),
+			static_cast<double>(info.pids),
+		};
+		it->second->ring.append(time, values);
+		it->second->latest = std::move(info);
+	}
+
+	return ret;
+}
+
+void StatsSampler::start(std::chrono::milliseconds interval)
+{
+	stop();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = false;
+	}
+	_sampler = std::thread([this, interval]() { sample_loop(interval); });
+}
+
+void StatsSampler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_cv.notify_all();
+	if (_sampler.joinable())
+	{
+		_sampler.join();
+	}
+}
+
+void StatsSampler::sample_loop(std::chrono::milliseconds interval)
+{
+	auto next = std::chrono::steady_clock::now();
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (_cv.wait_until(lock, next, [this]() { return _stop; }))
+			{
+				return;
+			}
+		}
+
+		// ticks stay on a regular grid, so that their timestamps compress to a bit each
+		next += interval;
+		sample();
+		auto now = std::chrono::steady_clock::now();
+		if (next < now)
+		{
+			next = now; // a sample took longer than the interval: skip the missed ticks
+		}
+	}
+}
+
+std::optional<CLI::StatsInfo> StatsSampler::latest(const std::string& name_or_id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _tracks.find(name_or_id);
+	if (it == _tracks.end())
+	{
+		return std::nullopt;
+	}
+	return it->second->latest;
+}
+
+StatsSampler::Usage StatsSampler::usage(const std::string& name_or_id, Metric metric, std::chrono::milliseconds window)
+{
+	const size_t column = static_cast<size_t>(metric);
+	const bool rate = is_rate(metric);
+	std::vector<double> values;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _tracks.find(name_or_id);
+		if (it == _tracks.end())
+		{
+			return Usage();
+		}
+
+		int64_t since = now_ms() - window.count();
+		int64_t last_time = 0;
+		double last_value = 0;
+		bool first = true;
+		it->second->ring.for_each(since, [&](int64_t time, const double* sample) {
+			double value = sample[column];
+			if (!rate)
+			{
+				values.push_back(value);
+			}
+			else if (!first && time > last_time && value >= last_value)
+			{
+				// the totals restart with the container: skip the interval of the restart
+				values.push_back((value - last_value) * 1000.0 / static_cast<double>(time - last_time));
+			}
+			first = false;
+			last_time = time;
+			last_value = value;
+		});
+	}
+
+	Usage u;
+	if (values.empty())
+	{
+		return u;
+	}
+
+	u.samples = values.size();
+	double total = 0;
+	for (double v : values) total += v;
+	u.mean = total / static_cast<double>(values.size());
+
+	// nearest rank percentiles
+	auto rank = [&values](double p) {
+		size_t k = static_cast<size_t>(std::ceil(p * static_cast<double>(values.size())));
+		return k == 0 ? 0 : k - 1;
+	};
+	std::sort(values.begin(), values.end());
+	u.min = values.front();
+	u.max = values.back();
+	u.p50 = values[rank(0.50)];
+	u.p99 = values[rank(0.99)];
+	return u;
+}
+
+size_t StatsSampler::memory()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	size_t bytes = 0;
+	for (auto& track : _tracks) bytes += track.second->ring.memory();
+	return bytes;
+}
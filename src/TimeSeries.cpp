@@ -0,0 +1,326 @@
+#include "TimeSeries.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace docker;
+using namespace series;
+
+
+namespace
+{
+	uint64_t to_bits(double value)
+	{
+		uint64_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	double from_bits(uint64_t bits)
+	{
+		double value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	uint64_t zigzag(int64_t v)
+	{
+		return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+	}
+
+	int64_t unzigzag(uint64_t v)
+	{
+		return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+	}
+
+	int leading_zeros(uint64_t v)
+	{
+		int n = 0;
+		for (uint64_t mask = uint64_t(1) << 63; mask && !(v & mask); mask >>= 1) ++n;
+		return n;
+	}
+
+	int trailing_zeros(uint64_t v)
+	{
+		int n = 0;
+		for (uint64_t mask = 1; mask && !(v & mask); mask <<= 1) ++n;
+		return n;
+	}
+
+	/*
+	* Appends bits, most significant first, to an array of words
+	*/
+	void write_bits(uint64_t* words, size_t& pos, uint64_t value, unsigned count)
+	{
+		if (count == 0) return;
+		if (count < 64) value &= (uint64_t(1) << count) - 1;
+
+		size_t word = pos / 64;
+		unsigned offset = pos % 64;
+		unsigned room = 64 - offset;
+		if (count <= room)
+		{
+			words[word] |= value << (room - count);
+		}
+		else
+		{
+			words[word] |= value >> (count - room);
+			words[word + 1] |= value << (64 - (count - room));
+		}
+		pos += count;
+	}
+
+	uint64_t read_bits(const uint64_t* words, size_t& pos, unsigned count)
+	{
+		if (count == 0) return 0;
+
+		size_t word = pos / 64;
+		unsigned offset = pos % 64;
+		unsigned room = 64 - offset;
+		uint64_t value;
+		if (count <= room)
+		{
+			value = words[word] >> (room - count);
+		}
+		else
+		{
+			value = (words[word] << (count - room)) | (words[word + 1] >> (64 - (count - room)));
+		}
+		pos += count;
+		return count < 64 ? value & ((uint64_t(1) << count) - 1) : value;
+	}
+
+	// delta of deltas classes: prefix bits, prefix length, payload length
+	struct TimeClass
+	{
+		uint64_t prefix;
+		unsigned prefix_bits;
+		unsigned payload_bits;
+	};
+	const TimeClass TIME_CLASSES[] = { { 0b10, 2, 7 }, { 0b110, 3, 12 }, { 0b1110, 4, 20 }, { 0b1111, 4, 64 } };
+
+	/*
+	* Decoder of the samples of a block
+	*/
+	struct Reader
+	{
+		const uint64_t* words;
+		size_t pos = 0;
+		size_t columns;
+		int64_t time = 0;
+		int64_t delta = 0;
+		std::vector<uint64_t> values;
+		std::vector<uint8_t> leading;
+		std::vector<uint8_t> trailing;
+
+		Reader(const uint64_t* words, size_t columns)
+			: words(words), columns(columns), values(columns), leading(columns), trailing(columns)
+		{}
+
+		void first()
+		{
+			time = static_cast<int64_t>(read_bits(words, pos, 64));
+			delta = 0;
+			for (size_t c = 0; c < columns; ++c)
+			{
+				values[c] = read_bits(words, pos, 64);
+				leading[c] = 64; // no window yet
+				trailing[c] = 0;
+			}
+		}
+
+		void next()
+		{
+			if (read_bits(words, pos, 1))
+			{
+				unsigned k = 0;
+				while (k < 3 && read_bits(words, pos, 1)) ++k;
+				delta += unzigzag(read_bits(words, pos, TIME_CLASSES[k].payload_bits));
+			}
+			time += delta;
+
+			for (size_t c = 0; c < columns; ++c)
+			{
+				if (!read_bits(words, pos, 1)) continue; // same value
+
+				if (read_bits(words, pos, 1))
+				{
+					leading[c] = static_cast<uint8_t>(read_bits(words, pos, 6));
+					unsigned meaningful = static_cast<unsigned>(read_bits(words, pos, 6)) + 1;
+					trailing[c] = static_cast<uint8_t>(64 - leading[c] - meaningful);
+				}
+				unsigned meaningful = 64 - leading[c] - trailing[c];
+				values[c] ^= read_bits(words, pos, meaningful) << trailing[c];
+			}
+		}
+	};
+}
+
+
+SampleRing::SampleRing(size_t columns, size_t bytes)
+	: _columns(columns), _last_values(columns), _leading(columns), _trailing(columns)
+{
+	size_t blocks = std::max<size_t>(2, (bytes + BLOCK_WORDS * sizeof(uint64_t) - 1) / (BLOCK_WORDS * sizeof(uint64_t)));
+	_words.assign(blocks * BLOCK_WORDS, 0);
+	_blocks.resize(blocks);
+
+	// the largest sample: a full timestamp and full values with their windows
+	_scratch.assign((4 + 64 + columns * (2 + 12 + 64)) / 64 + 2, 0);
+}
+
+void SampleRing::encode(int64_t time, const double* values, bool first)
+{
+	std::fill(_scratch.begin(), _scratch.end(), 0);
+	_scratch_bits = 0;
+	uint64_t* out = _scratch.data();
+
+	if (first)
+	{
+		write_bits(out, _scratch_bits, static_cast<uint64_t>(time), 64);
+		for (size_t c = 0; c < _columns; ++c)
+		{
+			write_bits(out, _scratch_bits, to_bits(values[c]), 64);
+		}
+		return;
+	}
+
+	int64_t delta = time - _last_time;
+	int64_t dod = delta - _last_delta;
+	if (dod == 0)
+	{
+		write_bits(out, _scratch_bits, 0, 1);
+	}
+	else
+	{
+		uint64_t z = zigzag(dod);
+		for (const TimeClass& k : TIME_CLASSES)
+		{
+			if (k.payload_bits == 64 || z < (uint64_t(1) << k.payload_bits))
+			{
+				write_bits(out, _scratch_bits, k.prefix, k.prefix_bits);
+				write_bits(out, _scratch_bits, z, k.payload_bits);
+				break;
+			}
+		}
+	}
+
+	for (size_t c = 0; c < _columns; ++c)
+	{
+		uint64_t x = to_bits(values[c]) ^ _last_values[c];
+		if (x == 0)
+		{
+			write_bits(out, _scratch_bits, 0, 1);
+			continue;
+		}
+
+		write_bits(out, _scratch_bits, 1, 1);
+		int lead = leading_zeros(x);
+		int trail = trailing_zeros(x);
+		if (_leading[c] < 64 && lead >= _leading[c] && trail >= _trailing[c])
+		{
+			// within the window of the previous value
+			write_bits(out, _scratch_bits, 0, 1);
+			write_bits(out, _scratch_bits, x >> _trailing[c], 64 - _leading[c] - _trailing[c]);
+		}
+		else
+		{
+			unsigned meaningful = 64 - lead - trail;
+			write_bits(out, _scratch_bits, 1, 1);
+			write_bits(out, _scratch_bits, static_cast<uint64_t>(lead), 6);
+			write_bits(out, _scratch_bits, meaningful - 1, 6);
+			write_bits(out, _scratch_bits, x >> trail, meaningful);
+			_leading[c] = static_cast<uint8_t>(lead);
+			_trailing[c] = static_cast<uint8_t>(trail);
+		}
+	}
+}
+
+void SampleRing::append(int64_t time, const double* values)
+{
+	const size_t block_bits = BLOCK_WORDS * 64;
+
+	bool first = _used == 0 || _blocks[_current].samples == 0;
+	if (!first)
+	{
+		// the window state is updated by encode: keep it to encode again in a new block
+		encode(time, values, false);
+		if (_blocks[_current].bits + _scratch_bits > block_bits)
+		{
+			// the block is full: the sample opens the next one, overwriting the oldest block once all are used
+			_current = (_current + 1) % _blocks.size();
+			_blocks[_current] = Block();
+			std::fill(_words.begin() + _current * BLOCK_WORDS, _words.begin() + (_current + 1) * BLOCK_WORDS, 0);
+			first = true;
+		}
+	}
+	if (first)
+	{
+		if (_used == 0) _used = 1;
+		else if (_used < _blocks.size() && _blocks[_current].samples == 0 && _current >= _used) _used = _current + 1;
+		encode(time, values, true);
+		for (size_t c = 0; c < _columns; ++c)
+		{
+			_leading[c] = 64;
+			_trailing[c] = 0;
+		}
+		_last_delta = 0;
+		_blocks[_current].first_time = time;
+	}
+	else
+	{
+		_last_delta = time - _last_time;
+	}
+
+	// copy the encoded sample at the end of the block
+	Block& block = _blocks[_current];
+	uint64_t* words = _words.data() + _current * BLOCK_WORDS;
+	size_t read = 0;
+	while (read < _scratch_bits)
+	{
+		unsigned count = static_cast<unsigned>(std::min<size_t>(64, _scratch_bits - read));
+		write_bits(words, block.bits, read_bits(_scratch.data(), read, count), count);
+	}
+	++block.samples;
+	block.last_time = time;
+
+	_last_time = time;
+	for (size_t c = 0; c < _columns; ++c)
+	{
+		_last_values[c] = to_bits(values[c]);
+	}
+}
+
+void SampleRing::for_each(int64_t since, const std::function<void(int64_t time, const double* values)>& f) const
+{
+	std::vector<double> values(_columns);
+
+	// oldest block first: the one after the current block once the ring has wrapped
+	size_t first_block = _used < _blocks.size() ? 0 : (_current + 1) % _blocks.size();
+	for (size_t i = 0; i < _used; ++i)
+	{
+		size_t b = (first_block + i) % _blocks.size();
+		const Block& block = _blocks[b];
+		if (block.samples == 0 || block.last_time < since)
+		{
+			continue;
+		}
+
+		Reader reader(_words.data() + b * BLOCK_WORDS, _columns);
+		for (size_t s = 0; s < block.samples; ++s)
+		{
+			if (s == 0) reader.first();
+			else reader.next();
+
+			if (reader.time < since) continue;
+			for (size_t c = 0; c < _columns; ++c) values[c] = from_bits(reader.values[c]);
+			f(reader.time, values.data());
+		}
+	}
+}
+
+size_t SampleRing::size() const
+{
+	size_t samples = 0;
+	for (size_t i = 0; i < _used; ++i) samples += _blocks[i].samples;
+	return samples;
+}
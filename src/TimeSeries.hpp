@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace docker
+{
+	/*
+	* Compressed time series of fixed memory, as in Gorilla (Pelkonen et al., VLDB 2015)
+	*/
+	namespace series
+	{
+		/**
+			@class   SampleRing
+			@brief   Samples of a few columns sharing their timestamps, compressed in a ring of blocks of fixed size.
+			@details ~ Timestamps are stored as the difference of their consecutive deltas and values as the XOR with the
+			         previous value of their column, so that regular ticks and slowly changing values take a few bits.
+					 The first sample of a block is stored in full, so that every block decodes on its own: once all
+					 the blocks are full the oldest one is overwritten. The memory used never changes.
+		**/
+		class SampleRing
+		{
+		public:
+			static const size_t BLOCK_WORDS = 64; // 512 bytes per block
+
+			/**
+				@param columns - Number of values of a sample
+				@param bytes   - Memory given to the samples, rounded up to whole blocks (at least two)
+			**/
+			SampleRing(size_t columns, size_t bytes);
+
+			/**
+				@brief Appends a sample. Timestamps must not decrease.
+				@param time   - The timestamp, e.g. in milliseconds
+				@param values - One value per column
+			**/
+			void append(int64_t time, const double* values);
+
+			/**
+				@brief Decodes the samples taken at or after a time, oldest first
+				@param since - The oldest timestamp of interest
+				@param f     - Called with the timestamp and the values of every sample
+			**/
+			void for_each(int64_t since, const std::function<void(int64_t time, const double* values)>& f) const;
+
+			/**
+				@brief  Number of samples kept
+			**/
+			size_t size() const;
+
+			/**
+				@brief  Memory used by the compressed samples, in bytes
+			**/
+			size_t memory() const { return _words.size() * sizeof(uint64_t); }
+
+			size_t columns() const { return _columns; }
+
+		private:
+			struct Block
+			{
+				size_t	bits = 0;
+				size_t	samples = 0;
+				int64_t	first_time = 0;
+				int64_t	last_time = 0;
+			};
+
+			/**
+				@brief Encodes a sample after the previous one of the block (or in full for the first one) into _scratch
+			**/
+			void encode(int64_t time, const double* values, bool first);
+
+			size_t				_columns;
+			std::vector<uint64_t> _words;	// the blocks, one after the other
+			std::vector<Block>	_blocks;
+			size_t				_current = 0;
+			size_t				_used = 0;	// blocks holding samples
+
+			// encoder state of the current block
+			int64_t				_last_time = 0;
+			int64_t				_last_delta = 0;
+			std::vector<uint64_t> _last_values;
+			std::vector<uint8_t> _leading;
+			std::vector<uint8_t> _trailing;
+			std::vector<uint64_t> _scratch;
+			size_t				_scratch_bits = 0;
+		};
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <iostream>
+
+/*
+* Minimal assertions for the test executables: a failed check is reported and counted, the test goes on.
+* main() returns check::result().
+*/
+namespace check
+{
+	inline int failures = 0;
+
+	inline int result()
+	{
+		if (failures > 0)
+		{
+			std::cerr << failures << " failed checks" << std::endl;
+		}
+		return failures == 0 ? 0 : 1;
+	}
+}
+
+#define CHECK(condition)																			\
+	do																								\
+	{																								\
+		if (!(condition))																			\
+		{																							\
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #condition << std::endl;	\
+			++check::failures;																		\
+		}																							\
+	} while (0)
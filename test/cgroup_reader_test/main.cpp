@@ -0,0 +1,191 @@
+/*
+* Tests of CgroupReader against a synthetic cgroup v2 tree, built in a temporary directory with the proc root next to it:
+*   - every counter of cpu.stat, memory.current, memory.stat and io.stat (summed over two devices)
+*   - the resolution from <proc>/<pid>/cgroup, its 0:: line among the cgroup v1 ones
+*   - the fallbacks on the layouts of the systemd and cgroupfs drivers
+*   - a controller that is not enabled (its files are missing)
+*   - the reads failing once the cgroup directory is removed
+*/
+#include "Docker.h"
+#include "Check.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace docker;
+
+
+namespace
+{
+	const std::string ID_SYSTEMD = "1111111111111111111111111111111111111111111111111111111111111111";
+	const std::string ID_CGROUPFS = "2222222222222222222222222222222222222222222222222222222222222222";
+	const std::string ID_PID = "3333333333333333333333333333333333333333333333333333333333333333";
+	const std::string ID_PARTIAL = "4444444444444444444444444444444444444444444444444444444444444444";
+	const int PID = 4242;
+
+	void make_directories(const std::string& path)
+	{
+		for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1))
+		{
+			::mkdir(path.substr(0, slash).c_str(), 0755);
+			if (slash == std::string::npos) break;
+		}
+	}
+
+	void remove_tree(const std::string& path)
+	{
+		::nftw(path.c_str(), [](const char* file, const struct stat*, int, struct FTW*) { return ::remove(file); }, 16, FTW_DEPTH | FTW_PHYS);
+	}
+
+	void write_file(const std::string& path, const std::string& content)
+	{
+		std::ofstream(path) << content;
+	}
+
+	/**
+		@brief  Writes the four files of a cgroup, the counters derived from base
+	**/
+	void make_cgroup(const std::string& directory, uint64_t base)
+	{
+		make_directories(directory);
+		auto n = [base](uint64_t offset) { return std::to_string(base + offset); };
+
+		write_file(directory + "/cpu.stat",
+			"usage_usec " + n(1) + "\nuser_usec " + n(2) + "\nsystem_usec " + n(3) + "\ncore_sched.force_idle_usec 0\n"
+			"nr_periods " + n(4) + "\nnr_throttled " + n(5) + "\nthrottled_usec " + n(6) + "\nnr_bursts 0\nburst_usec 0\n");
+		write_file(directory + "/memory.current", n(7) + "\n");
+		write_file(directory + "/memory.stat",
+			"anon " + n(8) + "\nfile " + n(9) + "\nkernel " + n(10) + "\nkernel_stack 16384\nsock " + n(11) + "\nshmem " + n(12) + "\n"
+			"file_mapped 0\npgfault " + n(13) + "\npgmajfault " + n(14) + "\n");
+		write_file(directory + "/io.stat",
+			"8:0 rbytes=" + n(100) + " wbytes=" + n(200) + " rios=" + n(300) + " wios=" + n(400) + " dbytes=0 dios=0\n"
+			"8:16 rbytes=" + n(1000) + " wbytes=" + n(2000) + " rios=" + n(3000) + " wios=" + n(4000) + " dbytes=0 dios=0\n");
+	}
+
+	void check_usage(const CgroupReader::Usage& usage, uint64_t base)
+	{
+		CHECK(usage.cpu_usage_usec == base + 1);
+		CHECK(usage.cpu_user_usec == base + 2);
+		CHECK(usage.cpu_system_usec == base + 3);
+		CHECK(usage.cpu_nr_periods == base + 4);
+		CHECK(usage.cpu_nr_throttled == base + 5);
+		CHECK(usage.cpu_throttled_usec == base + 6);
+		CHECK(usage.memory_current == base + 7);
+		CHECK(usage.memory_anon == base + 8);
+		CHECK(usage.memory_file == base + 9);
+		CHECK(usage.memory_kernel == base + 10);
+		CHECK(usage.memory_sock == base + 11);
+		CHECK(usage.memory_shmem == base + 12);
+		CHECK(usage.memory_pgfault == base + 13);
+		CHECK(usage.memory_pgmajfault == base + 14);
+		CHECK(usage.io_read_bytes == 2 * base + 1100);
+		CHECK(usage.io_write_bytes == 2 * base + 2200);
+		CHECK(usage.io_read_ops == 2 * base + 3300);
+		CHECK(usage.io_write_ops == 2 * base + 4400);
+	}
+}
+
+
+int main()
+{
+	char temp[] = "/tmp/cgroup_reader_test_XXXXXX";
+	if (::mkdtemp(temp) == nullptr)
+	{
+		std::perror("mkdtemp");
+		return 1;
+	}
+	const std::string root = temp;
+	const std::string cgroup_root = root + "/cgroup";
+	const std::string proc_root = root + "/proc";
+
+	make_cgroup(cgroup_root + "/system.slice/docker-" + ID_SYSTEMD + ".scope", 1000);
+	make_cgroup(cgroup_root + "/docker/" + ID_CGROUPFS, 2000);
+	make_cgroup(cgroup_root + "/custom/nested/" + ID_PID, 3000);
+
+	// the memory and io controllers are not enabled
+	make_directories(cgroup_root + "/docker/" + ID_PARTIAL);
+	write_file(cgroup_root + "/docker/" + ID_PARTIAL + "/cpu.stat", "usage_usec 42\nuser_usec 40\nsystem_usec 2\n");
+	make_directories(cgroup_root + "/docker/empty");
+
+	// a hybrid host: the cgroup v1 lines come first
+	make_directories(proc_root + "/" + std::to_string(PID));
+	write_file(proc_root + "/" + std::to_string(PID) + "/cgroup",
+		"12:memory:/docker/" + ID_PID + "\n3:cpu,cpuacct:/docker/" + ID_PID + "\n1:name=systemd:/\n0::/custom/nested/" + ID_PID + "\n");
+	make_directories(proc_root + "/1");
+	write_file(proc_root + "/1/cgroup", "0::/gone\n");
+
+	CgroupReader reader(cgroup_root, proc_root);
+	CgroupReader::Usage usage;
+
+	// resolution
+	CHECK(reader.resolve(ID_SYSTEMD) == "system.slice/docker-" + ID_SYSTEMD + ".scope");
+	CHECK(reader.resolve(ID_CGROUPFS) == "docker/" + ID_CGROUPFS);
+	CHECK(reader.resolve("", PID) == "custom/nested/" + ID_PID);
+	CHECK(reader.resolve(ID_PID, PID) == "custom/nested/" + ID_PID);
+	CHECK(reader.resolve(ID_CGROUPFS, 1) == "docker/" + ID_CGROUPFS);	// 0:: path missing: the id fallback
+	CHECK(reader.resolve(ID_CGROUPFS, 999) == "docker/" + ID_CGROUPFS);	// no such process
+	CHECK(reader.resolve("unknown").empty());
+	CHECK(reader.resolve("", 1).empty());
+
+	// counters
+	CgroupReader::Handle systemd = reader.add(ID_SYSTEMD);
+	CgroupReader::Handle cgroupfs = reader.add(ID_CGROUPFS);
+	CgroupReader::Handle by_pid = reader.add(ID_PID, PID);
+	CHECK(systemd != CgroupReader::INVALID);
+	CHECK(cgroupfs != CgroupReader::INVALID);
+	CHECK(by_pid != CgroupReader::INVALID);
+	CHECK(reader.size() == 3);
+	CHECK(reader.path(by_pid) == "custom/nested/" + ID_PID);
+
+	CHECK(reader.read(systemd, usage));
+	check_usage(usage, 1000);
+	CHECK(reader.read(cgroupfs, usage));
+	check_usage(usage, 2000);
+	CHECK(reader.read(by_pid, usage));
+	check_usage(usage, 3000);
+
+	// the files are read again from their start
+	write_file(cgroup_root + "/docker/" + ID_CGROUPFS + "/memory.current", "7\n");
+	CHECK(reader.read(cgroupfs, usage));
+	CHECK(usage.memory_current == 7);
+
+	// missing controllers
+	CgroupReader::Handle partial = reader.add(ID_PARTIAL);
+	CHECK(partial != CgroupReader::INVALID);
+	CHECK(reader.read(partial, usage));
+	CHECK(usage.cpu_usage_usec == 42);
+	CHECK(usage.cpu_user_usec == 40);
+	CHECK(usage.cpu_system_usec == 2);
+	CHECK(usage.memory_current == 0);
+	CHECK(usage.memory_anon == 0);
+	CHECK(usage.io_read_bytes == 0);
+	CHECK(reader.add("empty") == CgroupReader::INVALID);
+	CHECK(reader.add("unknown") == CgroupReader::INVALID);
+
+	size_t visited = 0;
+	CHECK(reader.read_all([&](CgroupReader::Handle, const CgroupReader::Usage&) { ++visited; }) == 4);
+	CHECK(visited == 4);
+
+	// the container is removed with its cgroup
+	remove_tree(cgroup_root + "/docker/" + ID_CGROUPFS);
+	CHECK(!reader.read(cgroupfs, usage));
+	CHECK(usage.cpu_usage_usec == 0);
+	CHECK(reader.read_all([](CgroupReader::Handle, const CgroupReader::Usage&) {}) == 3);
+
+	// handles
+	reader.remove(cgroupfs);
+	CHECK(reader.size() == 3);
+	CHECK(!reader.read(cgroupfs, usage));
+	CHECK(reader.path(cgroupfs).empty());
+	CHECK(reader.add(ID_SYSTEMD) == cgroupfs);	// reused
+	CHECK(!reader.read(CgroupReader::INVALID, usage));
+
+	remove_tree(root);
+	return check::result();
+}
@@ -0,0 +1,301 @@
+/*
+* Tests of the Engine API backend against a mock daemon listening on a unix socket.
+* The commands go through the public API (docker::set_backend, CLI::Inspect), which covers the HTTP/1.1 client:
+*   - bodies delimited by Content-Length and chunked bodies
+*   - keep-alive connections reused by the following requests
+*   - the single retry of a request sent on a pooled connection the daemon has closed
+*   - the timeout and the cancellation of a request waiting for its response
+*   - the error responses (non 2xx status codes)
+*   - the asynchronous executions, run on a worker within the same limits
+*   - a retargeted Remove: its shell command, argument vector and request name the same container
+*
+* The mock answers the requests on /containers/<name>[/json] according to the name:
+*   length   - Content-Length body
+*   chunked  - chunked body, in several chunks with a trailer
+*   missing  - 404 with a JSON message
+*   drop     - answers, then closes the connection without telling (Connection header absent)
+*   slow     - answers after SLOW_MS
+*/
+#include "Docker.h"
+#include "Check.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace docker;
+
+
+namespace
+{
+	const int SLOW_MS = 1000;
+
+	class MockDaemon
+	{
+	public:
+		explicit MockDaemon(std::string path)
+			: _path(std::move(path))
+		{
+			::unlink(_path.c_str());
+			_listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			sockaddr_un address{};
+			address.sun_family = AF_UNIX;
+			std::strncpy(address.sun_path, _path.c_str(), sizeof(address.sun_path) - 1);
+			if (::bind(_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(_listener, 16) != 0)
+			{
+				std::perror("mock daemon");
+			}
+			_acceptor = std::thread([this]() { accept_loop(); });
+		}
+
+		~MockDaemon()
+		{
+			_stop = true;
+			_acceptor.join();
+			for (auto& t : _connections) t.join();
+			::close(_listener);
+			::unlink(_path.c_str());
+		}
+
+		int connections() const { return _accepted; }
+		int requests() const { return _requests; }
+
+		/**
+			@brief  Method and target of the last request, e.g. "DELETE /containers/name?force=1"
+		**/
+		std::string last_request()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _last_request;
+		}
+
+	private:
+		void accept_loop()
+		{
+			while (!_stop)
+			{
+				pollfd fd{ _listener, POLLIN, 0 };
+				if (::poll(&fd, 1, 20) <= 0) continue;
+
+				int client = ::accept4(_listener, nullptr, nullptr, SOCK_CLOEXEC);
+				if (client < 0) continue;
+				++_accepted;
+				std::lock_guard<std::mutex> lock(_mutex);
+				_connections.emplace_back([this, client]() { serve(client); });
+			}
+		}
+
+		/**
+			@brief  Reads a request head (the requests of the tests have no body)
+			@retval  - False once the client closed the connection
+		**/
+		bool read_request(int fd, std::string& buffer, std::string& target)
+		{
+			size_t end;
+			while ((end = buffer.find("\r\n\r\n")) == std::string::npos)
+			{
+				pollfd p{ fd, POLLIN, 0 };
+				if (::poll(&p, 1, 20) == 0)
+				{
+					if (_stop) return false;
+					continue;
+				}
+				char chunk[4096];
+				ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+				if (n <= 0) return false;
+				buffer.append(chunk, static_cast<size_t>(n));
+			}
+			size_t first = buffer.find(' ');
+			target = buffer.substr(first + 1, buffer.find(' ', first + 1) - first - 1);
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_last_request = buffer.substr(0, first) + " " + target;
+			}
+			buffer.erase(0, end + 4);
+			return true;
+		}
+
+		void send_text(int fd, const std::string& text)
+		{
+			::send(fd, text.data(), text.size(), MSG_NOSIGNAL);
+		}
+
+		void serve(int fd)
+		{
+			std::string buffer;
+			std::string target;
+			while (read_request(fd, buffer, target))
+			{
+				++_requests;
+				std::string name = target.substr(std::strlen("/containers/"));
+				name = name.substr(0, name.find_first_of("/?"));
+
+				if (name == "chunked")
+				{
+					// split in the middle of a member, with chunk extensions and a trailer
+					send_text(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n"
+						"5\r\n{\"Id\"\r\n"
+						"b;ext=1\r\n:\"chunked\",\r\n"
+						"13\r\n\"Name\":\"/chunked\"}\n\r\n"
+						"0\r\nX-Trailer: yes\r\n\r\n");
+				}
+				else if (name == "missing")
+				{
+					std::string body = "{\"message\":\"No such container: missing\"}";
+					send_text(fd, "HTTP/1.1 404 Not Found\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+				}
+				else
+				{
+					if (name == "slow")
+					{
+						for (int waited = 0; waited < SLOW_MS && !_stop; waited += 10)
+						{
+							std::this_thread::sleep_for(std::chrono::milliseconds(10));
+						}
+					}
+					std::string body = "{\"Id\":\"" + name + "\",\"Name\":\"/" + name + "\"}\n";
+					send_text(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+					if (name == "drop")
+					{
+						break; // as a daemon closing an idle connection
+					}
+				}
+			}
+			::close(fd);
+		}
+
+		std::string _path;
+		int _listener = -1;
+		std::atomic<bool> _stop{ false };
+		std::atomic<int> _accepted{ 0 };
+		std::atomic<int> _requests{ 0 };
+		std::mutex _mutex;
+		std::string _last_request;
+		std::vector<std::thread> _connections;
+		std::thread _acceptor;
+	};
+
+	std::string inspect(const std::string& name)
+	{
+		return CLI::Inspect(name).execute().result;
+	}
+}
+
+
+int main()
+{
+	MockDaemon daemon("/tmp/engine_client_test_" + std::to_string(::getpid()) + ".sock");
+	set_backend(Backend::ENGINE_API, "/tmp/engine_client_test_" + std::to_string(::getpid()) + ".sock");
+
+	// bodies
+	CHECK(inspect("length") == "[{\"Id\":\"length\",\"Name\":\"/length\"}]");
+	CHECK(inspect("chunked") == "[{\"Id\":\"chunked\",\"Name\":\"/chunked\"}]");
+
+	// keep-alive: the same connection for all the requests
+	for (int i = 0; i < 5; ++i)
+	{
+		CHECK(CLI::Inspect("length").execute().exitCode == Shell::SUCCESS);
+	}
+	CHECK(daemon.connections() == 1);
+	CHECK(daemon.requests() == 7);
+
+	// the set_backend without path keeps the socket
+	set_backend(Backend::SPAWN);
+	set_backend(Backend::ENGINE_API);
+	CHECK(inspect("length") == "[{\"Id\":\"length\",\"Name\":\"/length\"}]");
+
+	// error status
+	Shell::Output missing = CLI::Inspect("missing").execute();
+	CHECK(missing.exitCode == Shell::FAIL);
+	CHECK(missing.result == "Error response from daemon: No such container: missing");
+	CHECK(daemon.connections() == 1);
+
+	// stale pooled connection: retried once on a new one
+	CHECK(inspect("drop") == "[{\"Id\":\"drop\",\"Name\":\"/drop\"}]");
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	int requests = daemon.requests();
+	CHECK(inspect("length") == "[{\"Id\":\"length\",\"Name\":\"/length\"}]");
+	CHECK(daemon.connections() == 2);
+	CHECK(daemon.requests() == requests + 1);
+
+	// timeout
+	auto begin = std::chrono::steady_clock::now();
+	CLI::Inspect timed("slow");
+	timed.set_timeout(std::chrono::milliseconds(200));
+	Shell::Output timed_out = timed.execute();
+	auto elapsed = std::chrono::steady_clock::now() - begin;
+	CHECK(timed_out.exitCode == Shell::TIMEOUT);
+	CHECK(elapsed < std::chrono::milliseconds(SLOW_MS / 2));
+
+	// cancellation, from another thread
+	Shell::CancelToken token;
+	std::thread canceller([token]() mutable {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		token.cancel();
+	});
+	begin = std::chrono::steady_clock::now();
+	CLI::Inspect cancelled("slow");
+	cancelled.set_cancel_token(token);
+	Shell::Output cancelled_out = cancelled.execute();
+	elapsed = std::chrono::steady_clock::now() - begin;
+	canceller.join();
+	CHECK(cancelled_out.exitCode == Shell::CANCELLED);
+	CHECK(elapsed < std::chrono::milliseconds(SLOW_MS / 2));
+
+	// the connections given up are not reused
+	CHECK(inspect("length") == "[{\"Id\":\"length\",\"Name\":\"/length\"}]");
+
+	// asynchronous: returns at once, the command object can be gone before the request ends
+	begin = std::chrono::steady_clock::now();
+	std::future<Shell::Output> slow = CLI::Inspect("slow").execute_async();
+	std::future<Shell::Output> timed_async = CLI::Inspect("slow").set_timeout(std::chrono::milliseconds(200)).execute_async();
+	Shell::CancelToken async_token;
+	std::future<Shell::Output> cancelled_async = CLI::Inspect("slow").set_cancel_token(async_token).execute_async();
+	std::promise<Shell::Output> completed;
+	CLI::Inspect("chunked").execute_async([&completed](Shell::Output output) { completed.set_value(std::move(output)); });
+	CHECK(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(100));
+
+	async_token.cancel();
+	CHECK(cancelled_async.get().exitCode == Shell::CANCELLED);
+	CHECK(timed_async.get().exitCode == Shell::TIMEOUT);
+	CHECK(completed.get_future().get().result == "[{\"Id\":\"chunked\",\"Name\":\"/chunked\"}]");
+	CHECK(std::chrono::steady_clock::now() - begin < std::chrono::milliseconds(SLOW_MS / 2));
+	CHECK(slow.get().result == "[{\"Id\":\"slow\",\"Name\":\"/slow\"}]");
+
+	// more requests than worker threads: queued, all of them answered
+	std::vector<std::future<Shell::Output>> queued;
+	for (int i = 0; i < 40; ++i)
+	{
+		queued.push_back(CLI::Inspect("length").execute_async());
+	}
+	size_t answered = 0;
+	for (auto& f : queued)
+	{
+		answered += f.get().exitCode == Shell::SUCCESS;
+	}
+	CHECK(answered == queued.size());
+
+	// retargeted remove: the same container for every backend
+	CLI::Remove remove("old");
+	remove.change_contianer_to_remove("length").force();
+	CHECK(remove.str() == "docker rm -f length");
+	CHECK(remove.argv() == Shell::Argv({ "docker", "rm", "-f", "length" }));
+	CHECK(remove.execute().exitCode == Shell::SUCCESS);
+	CHECK(daemon.last_request() == "DELETE /containers/length?force=1");
+
+	// no daemon
+	set_backend(Backend::ENGINE_API, "/tmp/engine_client_test_none.sock");
+	CHECK(CLI::Inspect("length").execute().exitCode == Shell::FAIL);
+
+	return check::result();
+}
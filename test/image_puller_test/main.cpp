@@ -0,0 +1,179 @@
+/*
+* Tests of ImagePuller against the stub docker of the benchmarks, which prints the steps of a pull of three layers:
+*   - the references of one image, in any form, share a single docker pull
+*   - no more pulls run at once than the parallelism
+*   - the progress of the layers and of the whole image, with the sizes docker reports
+*   - the error of a reference that does not exist (the stub fails the references starting with missing)
+*   - the destructor cancelling the queued pulls
+*/
+#include "Docker.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef STUB_DOCKER_DIR
+	#define STUB_DOCKER_DIR "."
+#endif
+
+using namespace docker;
+
+
+namespace
+{
+	const int PULL_MS = 300;
+
+	/**
+		@brief  Records the progress reported by a puller
+	**/
+	struct Recorder
+	{
+		std::mutex mutex;
+		std::vector<ImagePuller::Progress> steps;
+		std::set<std::string> in_flight;	// from Pulling from to Status: Downloaded
+		size_t max_in_flight = 0;
+
+		ImagePuller::ProgressCallback callback()
+		{
+			return [this](const ImagePuller::Progress& progress) {
+				std::lock_guard<std::mutex> lock(mutex);
+				steps.push_back(progress);
+				if (progress.status.find(": Pulling from ") != std::string::npos)
+				{
+					in_flight.insert(progress.reference);
+					max_in_flight = std::max(max_in_flight, in_flight.size());
+				}
+				else if (progress.status.compare(0, 7, "Status:") == 0)
+				{
+					in_flight.erase(progress.reference);
+				}
+			};
+		}
+
+		size_t count(const std::string& status)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			return std::count_if(steps.begin(), steps.end(), [&](const ImagePuller::Progress& p) { return p.status.find(status) != std::string::npos; });
+		}
+	};
+
+	std::chrono::milliseconds since(std::chrono::steady_clock::time_point begin)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+	}
+}
+
+
+int main()
+{
+	const char* path = std::getenv("PATH");
+	::setenv("PATH", (std::string(STUB_DOCKER_DIR) + ":" + (path ? path : "")).c_str(), 1);
+	::setenv("DOCKER_STUB_PULL_MS", std::to_string(PULL_MS).c_str(), 1);
+
+	// duplicate references: one pull, one result
+	{
+		Recorder recorder;
+		ImagePuller puller(4, recorder.callback());
+		auto first = puller.pull("ubuntu:22.04");
+		auto second = puller.pull("ubuntu:22.04");
+		auto qualified = puller.pull("docker.io/library/ubuntu:22.04");
+		CHECK(puller.pending() == 1);
+
+		CHECK(first.get().exitCode == Shell::SUCCESS);
+		CHECK(first.get().result == "docker.io/library/ubuntu:22.04");
+		CHECK(second.get().result == first.get().result);
+		CHECK(qualified.get().result == first.get().result);
+		CHECK(recorder.count("Pulling from") == 1);
+		CHECK(puller.pending() == 0);
+
+		// done: pulled again
+		CHECK(puller.pull("ubuntu:22.04").get().exitCode == Shell::SUCCESS);
+		CHECK(recorder.count("Pulling from") == 2);
+	}
+
+	// progress
+	{
+		Recorder recorder;
+		ImagePuller puller(1, recorder.callback());
+		CHECK(puller.pull("alpine:3.19").get().exitCode == Shell::SUCCESS);
+
+		std::set<std::string> layers;
+		bool sizes = false;
+		for (auto& step : recorder.steps)
+		{
+			CHECK(step.reference == "alpine:3.19");
+			if (step.layer.empty()) continue;
+
+			CHECK(step.layer.size() == 12);
+			layers.insert(step.layer);
+			if (step.status == "Downloading")
+			{
+				CHECK(step.current == CLI::StatsInfo::parse_size("14.7MB"));
+				CHECK(step.total == CLI::StatsInfo::parse_size("29.5MB"));
+				sizes = true;
+			}
+			else
+			{
+				CHECK(step.current == 0 && step.total == 0);
+			}
+		}
+		CHECK(layers.size() == 3);
+		CHECK(sizes);
+		CHECK(recorder.count("Pulling fs layer") == 3);
+		CHECK(recorder.count("Pull complete") == 3);
+		CHECK(recorder.count("3.19: Pulling from library/alpine") == 1);
+		CHECK(recorder.count("Digest: sha256:") == 1);
+	}
+
+	// parallelism
+	{
+		Recorder recorder;
+		ImagePuller puller(2, recorder.callback());
+		auto begin = std::chrono::steady_clock::now();
+		auto outputs = puller.pull_all({ "a:1", "b:1", "c:1", "d:1", "e:1", "f:1" });
+		auto elapsed = since(begin);
+
+		CHECK(outputs.size() == 6);
+		CHECK(std::all_of(outputs.begin(), outputs.end(), [](const Shell::Output& out) { return out.exitCode == Shell::SUCCESS; }));
+		CHECK(outputs[2].result == "docker.io/library/c:1");
+		CHECK(recorder.max_in_flight == 2);
+		CHECK(elapsed >= std::chrono::milliseconds(3 * PULL_MS - 50));
+		CHECK(elapsed < std::chrono::milliseconds(6 * PULL_MS));
+	}
+
+	// missing image
+	{
+		ImagePuller puller;
+		auto outputs = puller.pull_all({ "missing_image:1", "ubuntu:22.04" });
+		CHECK(outputs[0].exitCode != Shell::SUCCESS);
+		CHECK(outputs[0].result.find("pull access denied for missing_image:1") != std::string::npos);
+		CHECK(outputs[1].exitCode == Shell::SUCCESS);
+		CHECK(puller.pending() == 0);
+	}
+
+	// destruction: the running pull and the queued ones are cancelled
+	{
+		std::vector<std::shared_future<Shell::Output>> results;
+		auto begin = std::chrono::steady_clock::now();
+		{
+			ImagePuller puller(1);
+			for (const char* reference : { "g:1", "h:1", "i:1" })
+			{
+				results.push_back(puller.pull(reference));
+			}
+		}
+		CHECK(since(begin) < std::chrono::milliseconds(PULL_MS));
+		for (auto& result : results)
+		{
+			CHECK(result.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+			CHECK(result.get().exitCode == Shell::CANCELLED);
+		}
+	}
+
+	return check::result();
+}
@@ -0,0 +1,74 @@
+/*
+* Tests that Shell returns every byte of outputs far larger than a pipe buffer, stdout and stderr written at the
+* same time by two processes, through the system shell and through posix_spawn, synchronously and asynchronously,
+* and then through the fork server.
+*/
+#include "Shell.h"
+#include "Check.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+
+namespace
+{
+	bool filled(std::string_view text, size_t bytes, char ch)
+	{
+		return text.size() == bytes && std::all_of(text.begin(), text.end(), [ch](char c) { return c == ch; });
+	}
+
+	void check_drained(Shell& shell, size_t bytes)
+	{
+		std::string n = std::to_string(bytes);
+		std::string script = "head -c " + n + " /dev/zero | tr '\\000' e >&2 & head -c " + n + " /dev/zero | tr '\\000' o; wait";
+
+		Shell::View bash = shell.execute_view(script);
+		CHECK(bash.exitCode == Shell::SUCCESS);
+		CHECK(filled(bash.out, bytes, 'o'));
+		CHECK(filled(bash.err, bytes, 'e'));
+
+		Shell::View spawn = shell.execute_view(Shell::Argv{ "sh", "-c", script });
+		CHECK(spawn.exitCode == Shell::SUCCESS);
+		CHECK(filled(spawn.out, bytes, 'o'));
+		CHECK(filled(spawn.err, bytes, 'e'));
+
+		// the outputs copied out of the buffers
+		Shell::Output out = shell.execute(script);
+		CHECK(out.exitCode == Shell::SUCCESS);
+		CHECK(filled(out.result, bytes, 'o'));
+		out = shell.execute(Shell::Argv{ "sh", "-c", script });
+		CHECK(out.exitCode == Shell::SUCCESS);
+		CHECK(filled(out.result, bytes, 'o'));
+
+		// drained by the reactor thread
+		out = Shell::execute_async(script).get();
+		CHECK(out.exitCode == Shell::SUCCESS);
+		CHECK(filled(out.result, bytes, 'o'));
+		out = Shell::execute_async(Shell::Argv{ "sh", "-c", script + "; exit 3" }).get();
+		CHECK(out.exitCode == 3);
+		CHECK(filled(out.result, bytes, 'o'));
+	}
+}
+
+
+int main()
+{
+	const size_t sizes[] = { 1, 64 * 1024 + 1, 1024 * 1024, 8 * 1024 * 1024 + 7 };
+
+	Shell shell;
+	for (size_t bytes : sizes)
+	{
+		check_drained(shell, bytes);
+	}
+
+	// the children launched by the fork server
+	CHECK(Shell::start_fork_server());
+	for (size_t bytes : sizes)
+	{
+		check_drained(shell, bytes);
+	}
+	Shell::stop_fork_server();
+
+	return check::result();
+}
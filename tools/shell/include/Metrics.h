@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Shell.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+
+	@class   Metrics
+	@brief   Latency histograms, error and byte counters of the executed commands.
+	@details ~ The shell records the phases of every execution (shell_phase: pipes, launch, run, reap, cleanup) and
+	         its total (shell_execution: bash, spawn, stream, async, coprocess, session). The docker library records every command
+			 by subcommand (docker_command: create, start, inspect...).
+			 Each thread records in its own counters, without locks nor shared cache lines: a snapshot sums
+			 the counters of all the threads. Latencies are kept in buckets of powers of two microseconds.
+
+**/
+class SHELLAPI Metrics
+{
+public:
+	typedef uint32_t Key;
+	typedef std::chrono::steady_clock Clock;
+
+	static const Key INVALID = ~Key(0);
+	static const size_t MAX_KEYS = 256;
+	static const size_t BUCKETS = 24; // upper bounds 1us, 2us, 4us ... 2^22us (~4.2s), the last one is +Inf
+
+	/**
+		@struct Series
+		@brief  The counters of a key, summed over all the threads
+	**/
+	struct Series
+	{
+		std::string family;
+		std::string label_name;
+		std::string label_value;
+		uint64_t	count = 0;
+		uint64_t	sum_ns = 0;
+		uint64_t	errors = 0;
+		uint64_t	bytes = 0;
+		std::array<uint64_t, BUCKETS> buckets{}; // not cumulative
+
+		double mean_us() const { return count ? sum_ns / 1000.0 / count : 0; }
+
+		/**
+			@brief  Estimates a quantile of the latency
+			@param  q - The quantile, between 0 and 1
+			@retval   - The upper bound of the bucket holding the quantile, in microseconds
+		**/
+		double quantile_us(double q) const;
+	};
+
+	typedef std::vector<Series> Snapshot;
+
+	/**
+		@brief  Get the key identifying a series, registering it the first time. Meant to be called once and kept.
+		@param  family      - Name of the metric family, e.g. docker_command
+		@param  label_name  - Name of the label distinguishing the series of the family, e.g. command
+		@param  label_value - Value of the label, e.g. inspect
+		@retval             - The key, INVALID once MAX_KEYS series exist
+	**/
+	static Key key(std::string_view family, std::string_view label_name, std::string_view label_value);
+
+	/**
+		@brief Records an event in the counters of the calling thread
+		@param key     - The series
+		@param elapsed - Latency of the event
+		@param error   - Counts the event as failed
+		@param bytes   - Bytes read by the event
+	**/
+	static void record(Key key, Clock::duration elapsed, bool error = false, uint64_t bytes = 0);
+
+	static Clock::time_point now() { return Clock::now(); }
+
+	/**
+		@brief  Sums the counters of all the threads
+		@retval  - The series that recorded at least one event, in registration order
+	**/
+	static Snapshot snapshot();
+
+	/**
+		@brief  The snapshot in the Prometheus text exposition format: a histogram <family>_seconds and
+		        the counters <family>_errors_total and <family>_bytes_total per family.
+	**/
+	static std::string prometheus();
+
+	/**
+		@brief Zeroes all the counters. Events recorded at the same time may be lost.
+	**/
+	static void reset();
+
+	/**
+		@brief Enables or disables the recording (enabled by default)
+	**/
+	static void set_enabled(bool enabled);
+	static bool enabled();
+};
@@ -10,8 +10,13 @@
 	#define SHELLAPI
 #endif
 
+#include <chrono>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <memory>
+#include <functional>
+#include <future>
 #include <stdexcept>
 
 class SHELLAPI Shell
@@ -22,6 +27,8 @@ public:
 	{
 		SUCCESS = 0,
 		FAIL,
+		TIMEOUT = -2,	// the command did not end before its deadline: its process group has been killed
+		CANCELLED = -3,	// the command has been cancelled through its CancelToken
 	};
 
 	struct Output
@@ -32,7 +39,180 @@ public:
 		friend bool operator!=(Output o, Exit code) { return o.exitCode != code; }
 	};
 
+	/**
+	 * @struct  View
+	 * @brief   The outputs of the last execution of a Shell object, without copies: the views stay valid
+	 *          until the next execution (or the destruction) of the object. The final new line is trimmed.
+	 */
+	struct View
+	{
+		Exit				exitCode;
+		std::string_view	out;
+		std::string_view	err;
+
+		/**
+		 * @brief   The result as Output::result reports it: stdout, or stderr when stdout is empty
+		 */
+		std::string_view result() const { return out.empty() ? err : out; }
+	};
+
 	typedef std::string Input;
+	typedef std::vector<std::string> Argv;
+
+	enum Channel
+	{
+		STDOUT,
+		STDERR,
+	};
+
+	enum Framing
+	{
+		CHUNKS,	// data is delivered as it is read from the pipes
+		LINES,	// data is delivered one line at a time, without the line terminator
+	};
+
+	/**
+	 * @brief   Receives the output of a streamed command. The data is valid only during the call.
+	 *          Return false to cancel the command.
+	 */
+	typedef std::function<bool(Channel, std::string_view)> StreamCallback;
+
+	/**
+	 * @brief   Receives the result of an asynchronous execution
+	 */
+	typedef std::function<void(Output)> Completion;
+
+	/**
+	 * @class   CancelToken
+	 * @brief   Cancels the executions of the Shell objects (and of the commands) it is given to, from any thread.
+	 * @details Copies share the same state. Cancelling terminates the process group of the running executions,
+	 *          which end with the CANCELLED status, and makes the following ones end immediately with it.
+	 */
+	class SHELLAPI CancelToken
+	{
+	public:
+		CancelToken();
+
+		/**
+		 * @brief   Cancels the running and the future executions using the token. Returns immediately.
+		 */
+		void cancel();
+
+		/**
+		 * @brief   Check if the token has been cancelled
+		 */
+		bool cancelled() const;
+
+	private:
+		friend class Shell;
+		struct State;
+		std::shared_ptr<State> _state;
+	};
+
+	/**
+	 * @class   Stream
+	 * @brief   Handle to a command whose output is being streamed (see Shell::stream).
+	 * @details The callback runs on a worker thread owned by the handle. While the callback runs
+	 *          the output is not read, so a slow consumer makes the command wait (backpressure)
+	 *          and the memory used stays bounded. Destroying the handle cancels the command.
+	 */
+	class SHELLAPI Stream
+	{
+	public:
+		Stream();
+		~Stream();
+		Stream(Stream&&) noexcept;
+		Stream& operator=(Stream&&) noexcept;
+		Stream(const Stream&) = delete;
+		Stream& operator=(const Stream&) = delete;
+
+		/**
+		 * @brief   Terminates the command (and the processes it started). Returns immediately.
+		 */
+		void cancel();
+
+		/**
+		 * @brief   Check if the command is still running
+		 */
+		bool running() const;
+
+		/**
+		 * @brief   Waits for the command to end.
+		 * @return  The exit status. The result holds an error description if the command could not run.
+		 */
+		Output wait();
+
+	private:
+		friend class Shell;
+		struct State;
+		std::unique_ptr<State> _state;
+	};
+
+	/**
+	 * @class   Session
+	 * @brief   A long lived shell process executing the commands written to its stdin, one at a time, e.g. a shell
+	 *          inside a container opened with docker exec -i <container> sh.
+	 * @details Each command runs in a subshell with stdin from /dev/null: it cannot read the following commands nor
+	 *          change the state of the session (cd, variables, exit). Its end is framed on stdout and stderr with a
+	 *          marker holding a random token, followed by its exit status.
+	 *          The process is started by the first execution and started again by the next execution once it has
+	 *          ended, or has been stopped because a command failed to complete (timeout, cancellation, broken session).
+	 *          A session runs a command at a time: use it from one thread at a time. Not supported on windows.
+	 */
+	class SHELLAPI Session
+	{
+	public:
+		/**
+		 * @param   argv: a POSIX shell reading the commands on its stdin, followed by its arguments, e.g. { "sh", "-s" }.
+		 *          The program is searched in the PATH.
+		 */
+		explicit Session(Argv argv);
+		~Session();
+		Session(Session&&) noexcept;
+		Session& operator=(Session&&) noexcept;
+		Session(const Session&) = delete;
+		Session& operator=(const Session&) = delete;
+
+		/**
+		 * @brief   Executes a command in the session, starting the session process if it is not running
+		 * @param   command: the command to execute
+		 * @return  The result, as Shell::execute. TIMEOUT or CANCELLED if the limits set on the session expired.
+		 */
+		Output execute(const Input& command);
+
+		/**
+		 * @brief   Check that the running session process answers a no-op command within the timeout.
+		 *          A session that does not is stopped.
+		 * @return  False if the session is not running or did not answer
+		 */
+		bool ping(std::chrono::milliseconds timeout);
+
+		/**
+		 * @brief   Check if the session process has been started and has not ended
+		 */
+		bool running();
+
+		/**
+		 * @brief   Kills the session process. The next execution starts a new one.
+		 */
+		void stop();
+
+		/**
+		 * @brief   Bounds the duration of the following executions, see Shell::set_timeout
+		 */
+		void set_timeout(std::chrono::milliseconds timeout);
+
+		/**
+		 * @brief   Makes the following executions cancellable through the token, see Shell::set_cancel_token
+		 */
+		void set_cancel_token(CancelToken token);
+
+		void clear_cancel_token();
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> _impl;
+	};
 
 	Shell();
 	Shell(Input cmd);
@@ -58,6 +238,29 @@ public:
 	 */
 	Output execute(const Input commandS);
 
+	/**
+	 * @brief   As execute(const Input) but the outputs are left in the buffers of the object, which are reused from one
+	 *          execution to the next: in steady state an execution does not allocate memory for its outputs.
+	 * @param   command: the command to execute
+	 * @return  Views of stdout and stderr, valid until the next execution
+	 */
+	View execute_view(const Input& command);
+
+	/**
+	 * @brief   Executes the command previously set, see execute_view(const Input&)
+	 */
+	View execute_view();
+
+	/**
+	 * @brief   As execute(const Argv&) but the outputs are left in the buffers of the object, see execute_view(const Input&)
+	 */
+	View execute_view(const Argv& argv);
+
+	/**
+	 * @brief   Views of the outputs of the last execution, see execute_view(const Input&)
+	 */
+	View view() const noexcept;
+
 	/**
 		@brief  Immediatly executes a given command. Do not hold the command and the result.
 				No need to create instance of the class.
@@ -66,7 +269,117 @@ public:
 	**/
 	static Output prompt(const Input command);
 
-	void setCommand(const Input cmd) noexcept;
+	/**
+	 * @brief   Executes a program given as an argument vector, without going through the system shell.
+	 *          The program (argv[0]) is resolved through the PATH only the first time and then cached,
+	 *          and it is launched with posix_spawn, so the cost does not depend on the size of the calling process.
+	 *          Arguments are passed verbatim: no expansion, quoting or redirection is performed.
+	 * @param   argv: the program followed by its arguments
+	 * @return  The result of the command as a ShellOutput type.
+	 */
+	Output execute(const Argv& argv);
+
+	/**
+		@brief  Immediatly executes a given argument vector (see execute(const Argv&)). Do not hold the command and the result.
+		@param  argv - the program followed by its arguments
+		@retval      - the result
+	**/
+	static Output prompt(const Argv& argv);
+
+	/**
+	 * @brief   Executes a command in a long lived bash coprocess instead of starting a new bash: only a subshell
+	 *          of the small coprocess is forked, whatever the size of the calling process. The coprocesses are
+	 *          started on demand and shared by all the Shell objects; each one runs a command at a time.
+	 *          The command runs with stdin from /dev/null and cannot change the state of the coprocess (cd, variables, exit).
+	 *          Falls back to execute(const Input) where coprocesses are not supported.
+	 * @param   command: the command to execute
+	 * @return  The result of the command as a ShellOutput type.
+	 */
+	Output execute_coprocess(const Input command);
+
+	/**
+	 * @brief   Set the maximum number of coprocesses running commands at the same time (default 2). Extra callers wait.
+	 */
+	static void set_coprocesses(size_t max);
+
+	/**
+	 * @brief   Starts a small fork server process that launches the children of execute(), stream() and execute_async() on behalf
+	 *          of the calling process, so that their cost does not depend on the size of the calling process
+	 *          (page tables to copy, copy-on-write faults). Call it early, while the process is small and before
+	 *          other threads are started: the server is a fork of the calling process.
+	 *          The children get the environment the process had when the server was started.
+	 * @return  True if the server is running. Always false on windows.
+	 */
+	static bool start_fork_server();
+
+	/**
+	 * @brief   Ends the fork server: the next children are launched by the calling process again
+	 */
+	static void stop_fork_server();
+
+	/**
+	 * @brief   Executes a command through the system shell delivering its output to the callback as it is produced.
+	 *          Meant for long running commands (e.g. docker logs -f, docker events).
+	 * @param   command: the command to execute
+	 * @param   callback: receives the output, see StreamCallback
+	 * @param   framing: deliver raw chunks or whole lines
+	 * @return  The handle to wait for or cancel the command
+	 */
+	static Stream stream(const Input command, StreamCallback callback, Framing framing = LINES);
+
+	/**
+	 * @brief   As stream(const Input, ...) but the program is launched from its argument vector, see execute(const Argv&)
+	 */
+	static Stream stream(const Argv& argv, StreamCallback callback, Framing framing = LINES);
+
+	/**
+	 * @brief   Starts a command through the system shell and returns immediately.
+	 *          All the running asynchronous commands are followed by a single reactor thread (epoll), so any
+	 *          number of them can be in flight without a thread each.
+	 * @param   command: the command to execute
+	 * @return  The result, available once the command has ended
+	 */
+	static std::future<Output> execute_async(const Input command);
+
+	/**
+	 * @brief   As execute_async(const Input) but the program is launched from its argument vector, see execute(const Argv&)
+	 */
+	static std::future<Output> execute_async(const Argv& argv);
+
+	/**
+	 * @brief   Starts a command through the system shell and returns immediately. 
+	 * @param   command: the command to execute
+	 * @param   on_complete: called with the result once the command has ended. It runs on the reactor thread:
+	 *          keep it short and do not wait for other asynchronous commands inside it.
+	 */
+	static void execute_async(const Input command, Completion on_complete);
+
+	/**
+	 * @brief   As execute_async(const Input, Completion) but the program is launched from its argument vector, see execute(const Argv&)
+	 */
+	static void execute_async(const Argv& argv, Completion on_complete);
+
+	/**
+	 * @brief   Bounds the duration of the following executions of the object (execute, execute_view, execute_coprocess).
+	 *          When the deadline expires the process group of the command is killed and the execution ends with
+	 *          the TIMEOUT status. Not enforced on windows.
+	 * @param   timeout: the maximum duration, zero for no limit (default)
+	 */
+	void set_timeout(std::chrono::milliseconds timeout);
+
+	std::chrono::milliseconds get_timeout() const;
+
+	/**
+	 * @brief   Makes the following executions of the object cancellable through the token
+	 */
+	void set_cancel_token(CancelToken token);
+
+	/**
+	 * @brief   Detaches the cancellation token, if any
+	 */
+	void clear_cancel_token();
+
+	void setCommand(const Input& cmd) noexcept;
 
 	Input getCommand() const noexcept;
 
@@ -74,9 +387,17 @@ public:
 	std::string getResult() const noexcept;
 
 protected:
-	
+	/**
+	 * @brief   Copies the result of the last execution out of the implementation, whose buffers are kept for the next one
+	 */
+	Output collect_output();
+
+	/**
+	 * @brief   Starts the worker thread of a stream whose implementation has already been set up
+	 */
+	static void start_stream(Stream& stream, bool use_argv, StreamCallback callback, Framing framing);
+
 	Exit		_exit_status;
-	std::string _result;
 	Input 		_command;
 
 	struct ShellImpl;
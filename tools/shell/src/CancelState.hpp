@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Shell.h"
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+/*
+* Shared state of the copies of a CancelToken: the running executions listen to it
+*/
+struct Shell::CancelToken::State
+{
+	std::mutex	mutex;
+	bool		cancelled = false;
+	uint64_t	next = 0;
+	std::unordered_map<uint64_t, std::function<void()>> listeners;
+
+	/**
+		@brief Marks the token as cancelled and calls the listeners. Later calls do nothing.
+	**/
+	void cancel()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (cancelled) return;
+		cancelled = true;
+		for (auto& listener : listeners) listener.second();
+	}
+
+	bool is_cancelled()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return cancelled;
+	}
+
+	/**
+		@brief  Registers a function called once the token is cancelled
+		@retval  - The id to forget the listener, 0 if the token is already cancelled (the function is not registered)
+	**/
+	uint64_t listen(std::function<void()> on_cancel)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (cancelled) return 0;
+		listeners.emplace(++next, std::move(on_cancel));
+		return next;
+	}
+
+	/**
+		@brief Removes a listener. Once returned the listener is not running and will not be called.
+	**/
+	void forget(uint64_t id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		listeners.erase(id);
+	}
+};
@@ -0,0 +1,416 @@
+#pragma once
+
+#include "Shell.h"
+#include "UnixIO.hpp"
+
+#include <unistd.h>
+#include <spawn.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+extern char** environ;
+
+/**
+
+	@class   Coprocess
+	@brief   A long lived shell process executing the commands sent on its stdin, one at a time.
+	@details ~ Each command runs in a subshell of the coprocess, with stdin from /dev/null, so that it can
+	         neither read the protocol nor change the state of the coprocess. Its end is framed on both
+			 stdout and stderr with a marker holding a random token of the coprocess:
+			     ( eval 'command' ) </dev/null; printf '\n<token> %d\n' $?; printf '\n<token>\n' >&2
+			 Any POSIX shell reading its stdin can be a coprocess, e.g. bash -s or docker exec -i <container> sh.
+
+**/
+class Coprocess
+{
+public:
+	struct Result
+	{
+		int			exit_status = -1;
+		std::string out;
+		std::string err;
+		bool		delivered = false;	// the command has been written to the coprocess
+	};
+
+	Coprocess() = default;
+	~Coprocess()
+	{
+		stop();
+	}
+	Coprocess(const Coprocess&) = delete;
+	Coprocess& operator=(const Coprocess&) = delete;
+
+	/**
+		@brief  Launches the coprocess
+		@param  argv - The shell reading the commands on its stdin, followed by its arguments. Searched in the PATH.
+		@retval      - False if it cannot be launched
+	**/
+	bool start(const std::vector<std::string>& argv)
+	{
+		std::random_device random;
+		char token[33];
+		for (int i = 0; i < 32; ++i) token[i] = "0123456789abcdef"[random() & 0xF];
+		token[32] = '\0';
+		_token = std::string("__coprocess_") + token;
+		_out_marker = "\n" + _token + " ";
+		_err_marker = "\n" + _token + "\n";
+
+		unix_io::Pipes pipes;
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, pipes.in[unix_io::READ_END], STDIN_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, pipes.out[unix_io::WRITE_END], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, pipes.err[unix_io::WRITE_END], STDERR_FILENO);
+
+		// in its own process group: the signals sent to the group of the caller do not reach it
+		posix_spawnattr_t attributes;
+		posix_spawnattr_init(&attributes);
+		posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+		posix_spawnattr_setpgroup(&attributes, 0);
+
+		std::vector<char*> args;
+		args.reserve(argv.size() + 1);
+		for (auto& arg : argv) args.push_back(const_cast<char*>(arg.c_str()));
+		args.push_back(nullptr);
+		int rc = argv.empty() ? EINVAL : ::posix_spawnp(&_pid, args[0], &actions, &attributes, args.data(), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attributes);
+		if (rc != 0)
+		{
+			_pid = 0;
+			return false;
+		}
+
+		pipes.close_child_ends();
+		std::swap(_in, pipes.in[unix_io::WRITE_END]);
+		std::swap(_out, pipes.out[unix_io::READ_END]);
+		std::swap(_err, pipes.err[unix_io::READ_END]);
+		return true;
+	}
+
+	/**
+		@brief  Check if the coprocess has been started and has not ended. An ended coprocess is reaped.
+	**/
+	bool alive()
+	{
+		if (_pid <= 0)
+		{
+			return false;
+		}
+		pid_t rc = 0;
+		do
+		{
+			rc = ::waitpid(_pid, nullptr, WNOHANG);
+		} while (rc < 0 && errno == EINTR);
+		if (rc == 0)
+		{
+			return true;
+		}
+		_pid = 0;
+		return false;
+	}
+
+	/**
+		@brief Kills the coprocess group, closes its pipes and reaps it
+	**/
+	void stop()
+	{
+		unix_io::close_fd(_in);
+		unix_io::close_fd(_out);
+		unix_io::close_fd(_err);
+		if (_pid > 0)
+		{
+			::kill(-_pid, SIGKILL);
+			while (::waitpid(_pid, nullptr, 0) < 0 && errno == EINTR) {}
+			_pid = 0;
+		}
+	}
+
+	/**
+		@brief  Runs a command and reads its framed outputs
+		@retval  - False if the coprocess cannot be used anymore
+	**/
+	bool run(const std::string& command, Result& result, std::chrono::steady_clock::time_point deadline, const std::atomic<bool>* cancelled)
+	{
+		std::string& script = _script;
+		script.clear();
+		script.append("( eval '");
+		for (char ch : command)
+		{
+			if (ch == '\'') script.append("'\\''");
+			else script.push_back(ch);
+		}
+		script.append("' ) </dev/null; printf '\\n%s %d\\n' ").append(_token).append(" $?; printf '\\n%s\\n' ").append(_token).append(" >&2\n");
+
+		size_t written = 0;
+		result.delivered = false;
+		while (written < script.size())
+		{
+			if (!unix_io::write_some(_in, script, written))
+			{
+				result.err = "The shell session ended";
+				return false;
+			}
+		}
+		result.delivered = true;
+
+		const std::string& out_marker = _out_marker;
+		const std::string& err_marker = _err_marker;
+		bool out_done = false;
+		bool err_done = false;
+		size_t out_searched = 0;
+		size_t err_searched = 0;
+
+		while (!out_done || !err_done)
+		{
+			pollfd fds[2];
+			nfds_t count = 0;
+			if (!out_done) fds[count++] = { _out, POLLIN, 0 };
+			if (!err_done) fds[count++] = { _err, POLLIN, 0 };
+
+			int timeout = -1;
+			if (cancelled)
+			{
+				if (*cancelled)
+				{
+					result.exit_status = Shell::CANCELLED;
+					return false;
+				}
+				timeout = 100; // look at cancellation requests
+			}
+			if (deadline != std::chrono::steady_clock::time_point::max())
+			{
+				auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+				if (remaining <= 0)
+				{
+					result.exit_status = Shell::TIMEOUT;
+					return false;
+				}
+				timeout = timeout < 0 ? static_cast<int>(remaining) + 1 : std::min(timeout, static_cast<int>(remaining) + 1);
+			}
+
+			if (::poll(fds, count, timeout) < 0)
+			{
+				if (errno == EINTR) continue;
+				result.err = std::strerror(errno);
+				return false;
+			}
+
+			for (nfds_t k = 0; k < count; ++k)
+			{
+				if (fds[k].revents == 0) continue;
+
+				bool is_out = fds[k].fd == _out;
+				std::string& data = is_out ? result.out : result.err;
+				if (!unix_io::read_some(fds[k].fd, data))
+				{
+					// what the coprocess printed on stderr before ending tells why, e.g. the container is not running
+					if (is_out) drain(_err, result.err);
+					result.exit_status = -1;
+					result.err.insert(0, result.err.empty() ? "The shell session ended" : "The shell session ended: ");
+					return false;
+				}
+
+				if (is_out)
+				{
+					// the marker line is complete once the exit status is followed by its new line
+					size_t at = data.find(out_marker, out_searched);
+					if (at != std::string::npos && data.find('\n', at + out_marker.size()) != std::string::npos)
+					{
+						result.exit_status = std::atoi(data.c_str() + at + out_marker.size());
+						data.resize(at);
+						out_done = true;
+					}
+					else
+					{
+						out_searched = data.size() > out_marker.size() ? data.size() - out_marker.size() : 0;
+						if (at != std::string::npos) out_searched = at;
+					}
+				}
+				else
+				{
+					size_t at = data.find(err_marker, err_searched);
+					if (at != std::string::npos)
+					{
+						data.resize(at);
+						err_done = true;
+					}
+					else
+					{
+						err_searched = data.size() > err_marker.size() ? data.size() - err_marker.size() : 0;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	/**
+		@brief Reads what is left in an output of the ended coprocess, waiting for it at most a little while
+	**/
+	static void drain(int fd, std::string& data)
+	{
+		pollfd pfd{ fd, POLLIN, 0 };
+		while (::poll(&pfd, 1, 100) > 0 && unix_io::read_some(fd, data)) {}
+	}
+
+	pid_t		_pid = 0;
+	int			_in = -1;
+	int			_out = -1;
+	int			_err = -1;
+	std::string _token;
+	std::string _out_marker;
+	std::string _err_marker;
+	std::string _script;	// reused by every command
+};
+
+/**
+
+	@class   CoprocessPool
+	@brief   Long lived bash processes executing commands sent on their stdin, so that a command costs the
+	         fork of a small bash (and the exec of the program) instead of the fork and exec of a new bash
+			 from the calling process.
+	@details ~ A coprocess runs a single command at a time: concurrent callers use the other coprocesses
+			 (started on demand up to the maximum) or wait for one to be free.
+
+**/
+class CoprocessPool
+{
+public:
+	typedef Coprocess::Result Result;
+
+	static CoprocessPool& instance()
+	{
+		static CoprocessPool pool;
+		return pool;
+	}
+
+	~CoprocessPool()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (auto& c : _all) c->stop();
+	}
+
+	/**
+		@brief Set the maximum number of coprocesses. Running coprocesses beyond the maximum end once idle.
+	**/
+	void set_max(size_t max)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_max = max > 0 ? max : 1;
+		while (_all.size() > _max && !_idle.empty())
+		{
+			retire(_idle.back());
+			_idle.pop_back();
+		}
+		_available.notify_all();
+	}
+
+	/**
+		@brief Runs a command in a coprocess
+		@param command   - The command
+		@param result    - Receives the exit status and the outputs, appended to the (empty) output strings
+		@param deadline  - The command is killed with its coprocess at this time, the status is Shell::TIMEOUT
+		@param cancelled - If given and set while the command runs, the command is killed with its coprocess,
+		                   the status is Shell::CANCELLED
+	**/
+	void execute(const std::string& command, Result& result,
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+		const std::atomic<bool>* cancelled = nullptr)
+	{
+		result.exit_status = -1;
+		Coprocess* c = acquire();
+		if (!c)
+		{
+			result.err = "Cannot start the bash coprocess";
+			return;
+		}
+
+		if (!c->run(command, result, deadline, cancelled))
+		{
+			// the coprocess died, broke the protocol or runs an abandoned command: it is replaced by the next acquire
+			std::lock_guard<std::mutex> lock(_mutex);
+			retire(c);
+			_available.notify_one();
+			return;
+		}
+
+		release(c);
+	}
+
+private:
+	CoprocessPool() = default;
+
+	Coprocess* acquire()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (true)
+		{
+			if (!_idle.empty())
+			{
+				Coprocess* c = _idle.back();
+				_idle.pop_back();
+				return c;
+			}
+			if (_all.size() < _max)
+			{
+				auto c = std::make_unique<Coprocess>();
+				if (!c->start({ "/bin/bash", "--noprofile", "--norc", "-s" }))
+				{
+					return nullptr;
+				}
+				_all.push_back(std::move(c));
+				return _all.back().get();
+			}
+			_available.wait(lock);
+		}
+	}
+
+	void release(Coprocess* c)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_all.size() > _max)
+		{
+			retire(c);
+		}
+		else
+		{
+			_idle.push_back(c);
+		}
+		_available.notify_one();
+	}
+
+	/**
+		@brief Stops and forgets a coprocess. Called with the mutex locked.
+	**/
+	void retire(Coprocess* c)
+	{
+		for (auto it = _all.begin(); it != _all.end(); ++it)
+		{
+			if (it->get() == c)
+			{
+				c->stop();
+				_all.erase(it);
+				return;
+			}
+		}
+	}
+
+	std::mutex								_mutex;
+	std::condition_variable					_available;
+	std::vector<std::unique_ptr<Coprocess>> _all;
+	std::vector<Coprocess*>					_idle;
+	size_t									_max = 2;
+};
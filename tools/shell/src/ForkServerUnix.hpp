@@ -0,0 +1,455 @@
+#pragma once
+
+#include "UnixIO.hpp"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif // __linux__
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern char** environ;
+
+/**
+
+	@class   ForkServer
+	@brief   Small process forked from the calling process while it is still small, which launches the
+	         children on its behalf: the cost of a launch no longer depends on the size of the calling process.
+	@details ~ The caller creates the pipes of the child and sends their child ends over a unix socket (SCM_RIGHTS)
+	         together with the resolved program path and its argument vector. The server spawns the child in its
+			 own process group and answers on a socket dedicated to the request: first the pid, then the wait
+			 status once the child has ended. The caller drains the pipes itself, as for a local child.
+			 The children get the environment the calling process had when the server was started.
+
+**/
+class ForkServer
+{
+public:
+	static ForkServer& instance()
+	{
+		static ForkServer server;
+		return server;
+	}
+
+	~ForkServer()
+	{
+		stop();
+	}
+
+	/**
+		@brief  Forks the server, if not running yet
+		@retval  - True if the server is running
+	**/
+	bool start()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_control >= 0)
+		{
+			return true;
+		}
+
+		int sockets[2];
+		if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0)
+		{
+			return false;
+		}
+
+		pid_t pid = ::fork();
+		if (pid == 0) // SERVER
+		{
+			::close(sockets[0]);
+			serve(sockets[1]); // never returns
+		}
+
+		::close(sockets[1]);
+		if (pid < 0)
+		{
+			::close(sockets[0]);
+			return false;
+		}
+
+		_pid = pid;
+		_control = sockets[0];
+		return true;
+	}
+
+	/**
+		@brief Ends the server. The children already launched keep running.
+	**/
+	void stop()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		unix_io::close_fd(_control);
+		if (_pid > 0)
+		{
+			while (::waitpid(_pid, nullptr, 0) < 0 && errno == EINTR) {}
+			_pid = 0;
+		}
+	}
+
+	bool running()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _control >= 0;
+	}
+
+	/**
+		@brief  Launches a program through the server
+		@param  path  - Full path of the program
+		@param  argv  - The program name followed by its arguments
+		@param  pipes - The pipes of the child: their child ends are passed to the server
+		@param  reply - Set to the socket on which the wait status will be received, see wait()
+		@retval       - The child pid, 0 if the server is not running (the caller launches the child itself)
+	**/
+	pid_t spawn(const std::string& path, const std::vector<std::string>& argv, unix_io::Pipes& pipes, int& reply)
+	{
+		std::string body = path;
+		body.push_back('\0');
+		for (auto& arg : argv)
+		{
+			body.append(arg);
+			body.push_back('\0');
+		}
+
+		int sockets[2];
+		if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0)
+		{
+			throw std::runtime_error(std::strerror(errno));
+		}
+
+		int fds[4] = { pipes.in[unix_io::READ_END], pipes.out[unix_io::WRITE_END], pipes.err[unix_io::WRITE_END], sockets[1] };
+		bool sent = false;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_control >= 0)
+			{
+				sent = send_request(_control, body, fds);
+				if (!sent)
+				{
+					// the server is gone: from now on the children are launched locally
+					unix_io::close_fd(_control);
+				}
+			}
+		}
+		::close(sockets[1]);
+
+		int32_t pid = 0;
+		if (!sent || !read_int(sockets[0], pid))
+		{
+			::close(sockets[0]);
+			return 0;
+		}
+		if (pid < 0)
+		{
+			::close(sockets[0]);
+			throw std::runtime_error(std::strerror(-pid));
+		}
+
+		reply = sockets[0];
+		return pid;
+	}
+
+	static const int EXPIRED = -2;
+
+	/**
+		@brief  Waits for the end of a child launched by spawn()
+		@param  reply    - The socket returned by spawn(), closed once the status is received
+		@param  deadline - Stop waiting at this time
+		@retval          - The wait status, -1 if the server ended before the child, EXPIRED if the deadline expired first
+	**/
+	static int wait(int& reply, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+	{
+		while (deadline != std::chrono::steady_clock::time_point::max())
+		{
+			auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			if (remaining <= 0)
+			{
+				return EXPIRED;
+			}
+
+			pollfd fd{ reply, POLLIN, 0 };
+			int rc = ::poll(&fd, 1, static_cast<int>(remaining) + 1);
+			if (rc > 0 || (rc < 0 && errno != EINTR)) break;
+		}
+
+		int32_t status = -1;
+		if (!read_int(reply, status))
+		{
+			status = -1;
+		}
+		unix_io::close_fd(reply);
+		return status;
+	}
+
+private:
+	struct Header
+	{
+		uint32_t length;
+	};
+
+	ForkServer() = default;
+
+	static bool send_request(int control, const std::string& body, const int (&fds)[4])
+	{
+		Header header{ static_cast<uint32_t>(body.size()) };
+
+		char control_buffer[CMSG_SPACE(sizeof(fds))] = {};
+		iovec io{ &header, sizeof(header) };
+		msghdr msg{};
+		msg.msg_iov = &io;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control_buffer;
+		msg.msg_controllen = sizeof(control_buffer);
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+		std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+		ssize_t rc = 0;
+		do
+		{
+			rc = ::sendmsg(control, &msg, MSG_NOSIGNAL);
+		} while (rc < 0 && errno == EINTR);
+		if (rc != static_cast<ssize_t>(sizeof(header)))
+		{
+			return false;
+		}
+		return write_all(control, body.data(), body.size());
+	}
+
+	static bool write_all(int fd, const char* data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t rc = ::send(fd, data, size, MSG_NOSIGNAL);
+			if (rc < 0 && errno == EINTR) continue;
+			if (rc <= 0) return false;
+			data += rc;
+			size -= static_cast<size_t>(rc);
+		}
+		return true;
+	}
+
+	static bool read_all(int fd, char* data, size_t size)
+	{
+		while (size > 0)
+		{
+			ssize_t rc = ::read(fd, data, size);
+			if (rc < 0 && errno == EINTR) continue;
+			if (rc <= 0) return false;
+			data += rc;
+			size -= static_cast<size_t>(rc);
+		}
+		return true;
+	}
+
+	static bool read_int(int fd, int32_t& value)
+	{
+		return read_all(fd, reinterpret_cast<char*>(&value), sizeof(value));
+	}
+
+	static void write_int(int fd, int32_t value)
+	{
+		write_all(fd, reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	/*
+	* Server side
+	*/
+	static int& child_signal_fd()
+	{
+		static int fd = -1;
+		return fd;
+	}
+
+	static void on_child_signal(int)
+	{
+		int saved = errno;
+		char one = 1;
+		(void)!::write(child_signal_fd(), &one, 1);
+		errno = saved;
+	}
+
+	/**
+		@brief Receives a request: the header with the child fds, then the body
+	**/
+	static bool receive_request(int control, std::string& body, int (&fds)[4])
+	{
+		Header header{};
+		char control_buffer[CMSG_SPACE(sizeof(fds))] = {};
+		iovec io{ &header, sizeof(header) };
+		msghdr msg{};
+		msg.msg_iov = &io;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control_buffer;
+		msg.msg_controllen = sizeof(control_buffer);
+
+		ssize_t rc = 0;
+		do
+		{
+			rc = ::recvmsg(control, &msg, MSG_CMSG_CLOEXEC);
+		} while (rc < 0 && errno == EINTR);
+		if (rc <= 0)
+		{
+			return false;
+		}
+
+		cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+		{
+			return false;
+		}
+		std::memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		if (rc < static_cast<ssize_t>(sizeof(header)) && !read_all(control, reinterpret_cast<char*>(&header) + rc, sizeof(header) - rc))
+		{
+			return false;
+		}
+		body.resize(header.length);
+		return read_all(control, &body[0], body.size());
+	}
+
+	static pid_t launch(const std::string& body, const int (&fds)[4], int32_t& error)
+	{
+		std::vector<char*> args;
+		const char* path = body.c_str();
+		for (size_t at = std::strlen(path) + 1; at < body.size(); at += std::strlen(body.c_str() + at) + 1)
+		{
+			args.push_back(const_cast<char*>(body.c_str() + at));
+		}
+		args.push_back(nullptr);
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, fds[2], STDERR_FILENO);
+
+		// the children get default signal handling, whatever the server uses
+		sigset_t defaults, empty;
+		sigemptyset(&defaults);
+		sigaddset(&defaults, SIGPIPE);
+		sigaddset(&defaults, SIGCHLD);
+		sigemptyset(&empty);
+
+		posix_spawnattr_t attributes;
+		posix_spawnattr_init(&attributes);
+		posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+		posix_spawnattr_setpgroup(&attributes, 0);
+		posix_spawnattr_setsigdefault(&attributes, &defaults);
+		posix_spawnattr_setsigmask(&attributes, &empty);
+
+		pid_t pid = 0;
+		int rc = ::posix_spawn(&pid, path, &actions, &attributes, args.data(), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attributes);
+
+		error = rc;
+		return rc == 0 ? pid : 0;
+	}
+
+	[[noreturn]] static void serve(int control)
+	{
+#ifdef __linux__
+		::prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif // __linux__
+
+		// keep only the standard streams and the control socket
+		for (int fd = 3, max = static_cast<int>(std::min<long>(::sysconf(_SC_OPEN_MAX), 65536)); fd < max; ++fd)
+		{
+			if (fd != control) ::close(fd);
+		}
+
+		int wakeup[2];
+		if (::pipe2(wakeup, O_CLOEXEC | O_NONBLOCK) < 0)
+		{
+			::_exit(1);
+		}
+		child_signal_fd() = wakeup[1];
+
+		struct sigaction action {};
+		action.sa_handler = on_child_signal;
+		action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+		sigemptyset(&action.sa_mask);
+		::sigaction(SIGCHLD, &action, nullptr);
+		::signal(SIGPIPE, SIG_IGN);
+		sigset_t none;
+		sigemptyset(&none);
+		::pthread_sigmask(SIG_SETMASK, &none, nullptr);
+
+		std::unordered_map<pid_t, int> replies;
+		std::string body;
+
+		while (true)
+		{
+			pollfd fds[2] = { { control, POLLIN, 0 }, { wakeup[0], POLLIN, 0 } };
+			if (::poll(fds, 2, -1) < 0)
+			{
+				if (errno == EINTR) continue;
+				break;
+			}
+
+			if (fds[1].revents)
+			{
+				char drain[64];
+				while (::read(wakeup[0], drain, sizeof(drain)) > 0) {}
+
+				int status = 0;
+				pid_t pid = 0;
+				while ((pid = ::waitpid(-1, &status, WNOHANG)) > 0)
+				{
+					auto it = replies.find(pid);
+					if (it != replies.end())
+					{
+						write_int(it->second, status);
+						::close(it->second);
+						replies.erase(it);
+					}
+				}
+			}
+
+			if (fds[0].revents)
+			{
+				int child_fds[4] = { -1, -1, -1, -1 };
+				if (!receive_request(control, body, child_fds))
+				{
+					break; // the calling process is gone or stopped the server
+				}
+
+				int32_t error = 0;
+				pid_t pid = launch(body, child_fds, error);
+				for (int k = 0; k < 3; ++k) ::close(child_fds[k]);
+
+				write_int(child_fds[3], pid > 0 ? pid : -error);
+				if (pid > 0)
+				{
+					replies[pid] = child_fds[3];
+				}
+				else
+				{
+					::close(child_fds[3]);
+				}
+			}
+		}
+		::_exit(0);
+	}
+
+	std::mutex	_mutex;
+	pid_t		_pid = 0;
+	int			_control = -1;
+};
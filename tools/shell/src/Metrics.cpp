@@ -0,0 +1,318 @@
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+	/*
+	* The counters of one key in one thread. Only the owning thread writes them, so an increment
+	* is a plain load and store: the atomics only make the concurrent snapshot reads safe.
+	*/
+	struct Cell
+	{
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum_ns{ 0 };
+		std::atomic<uint64_t> errors{ 0 };
+		std::atomic<uint64_t> bytes{ 0 };
+		std::atomic<uint64_t> buckets[Metrics::BUCKETS] = {};
+
+		static void add(std::atomic<uint64_t>& counter, uint64_t value)
+		{
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+	};
+
+	/*
+	* The counters of one thread, allocated on the first event of each key
+	*/
+	struct Shard
+	{
+		std::atomic<Cell*> cells[Metrics::MAX_KEYS] = {};
+
+		~Shard()
+		{
+			for (auto& cell : cells) delete cell.load();
+		}
+
+		Cell& cell(Metrics::Key key)
+		{
+			Cell* c = cells[key].load(std::memory_order_acquire);
+			if (!c)
+			{
+				c = new Cell();
+				cells[key].store(c, std::memory_order_release);
+			}
+			return *c;
+		}
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<Metrics::Series> series;	// the names of the keys, counters unused
+		std::vector<Shard*> shards;				// of the running threads
+		Shard retired;							// counters of the ended threads, written under the mutex
+		std::atomic<bool> enabled{ true };
+
+		void merge(Shard& from)
+		{
+			for (size_t k = 0; k < Metrics::MAX_KEYS; ++k)
+			{
+				Cell* c = from.cells[k].load(std::memory_order_acquire);
+				if (!c) continue;
+
+				Cell& to = retired.cell(static_cast<Metrics::Key>(k));
+				Cell::add(to.count, c->count.load(std::memory_order_relaxed));
+				Cell::add(to.sum_ns, c->sum_ns.load(std::memory_order_relaxed));
+				Cell::add(to.errors, c->errors.load(std::memory_order_relaxed));
+				Cell::add(to.bytes, c->bytes.load(std::memory_order_relaxed));
+				for (size_t b = 0; b < Metrics::BUCKETS; ++b)
+				{
+					Cell::add(to.buckets[b], c->buckets[b].load(std::memory_order_relaxed));
+				}
+			}
+		}
+	};
+
+	// never destroyed: threads may still record while the statics are destroyed
+	Registry& registry()
+	{
+		static Registry* r = new Registry();
+		return *r;
+	}
+
+	/*
+	* Registers the shard of the thread and, when the thread ends, moves its counters to the retired ones
+	*/
+	struct ThreadShard
+	{
+		Shard shard;
+
+		ThreadShard()
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			r.shards.push_back(&shard);
+		}
+
+		~ThreadShard()
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			r.merge(shard);
+			for (auto it = r.shards.begin(); it != r.shards.end(); ++it)
+			{
+				if (*it == &shard)
+				{
+					r.shards.erase(it);
+					break;
+				}
+			}
+		}
+	};
+
+	Shard& thread_shard()
+	{
+		thread_local ThreadShard shard;
+		return shard.shard;
+	}
+
+	size_t bucket_of(uint64_t ns)
+	{
+		size_t b = 0;
+		while (b < Metrics::BUCKETS - 1 && (uint64_t(1000) << b) < ns) ++b;
+		return b;
+	}
+
+	void accumulate(Metrics::Series& s, const Cell& c)
+	{
+		s.count += c.count.load(std::memory_order_relaxed);
+		s.sum_ns += c.sum_ns.load(std::memory_order_relaxed);
+		s.errors += c.errors.load(std::memory_order_relaxed);
+		s.bytes += c.bytes.load(std::memory_order_relaxed);
+		for (size_t b = 0; b < Metrics::BUCKETS; ++b)
+		{
+			s.buckets[b] += c.buckets[b].load(std::memory_order_relaxed);
+		}
+	}
+
+	void zero(Shard& shard)
+	{
+		for (auto& cell : shard.cells)
+		{
+			Cell* c = cell.load(std::memory_order_acquire);
+			if (!c) continue;
+			c->count = 0;
+			c->sum_ns = 0;
+			c->errors = 0;
+			c->bytes = 0;
+			for (auto& b : c->buckets) b = 0;
+		}
+	}
+}
+
+double Metrics::Series::quantile_us(double q) const
+{
+	if (count == 0) return 0;
+
+	uint64_t rank = static_cast<uint64_t>(q * count);
+	uint64_t seen = 0;
+	for (size_t b = 0; b < BUCKETS - 1; ++b)
+	{
+		seen += buckets[b];
+		if (seen > rank) return static_cast<double>(uint64_t(1) << b);
+	}
+	return static_cast<double>(uint64_t(1) << (BUCKETS - 2)); // beyond the last bound
+}
+
+Metrics::Key Metrics::key(std::string_view family, std::string_view label_name, std::string_view label_value)
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	for (size_t k = 0; k < r.series.size(); ++k)
+	{
+		const Series& s = r.series[k];
+		if (s.family == family && s.label_name == label_name && s.label_value == label_value)
+		{
+			return static_cast<Key>(k);
+		}
+	}
+	if (r.series.size() == MAX_KEYS)
+	{
+		return INVALID;
+	}
+
+	Series s;
+	s.family = family;
+	s.label_name = label_name;
+	s.label_value = label_value;
+	r.series.push_back(std::move(s));
+	return static_cast<Key>(r.series.size() - 1);
+}
+
+void Metrics::record(Key key, Clock::duration elapsed, bool error, uint64_t bytes)
+{
+	if (key >= MAX_KEYS || !registry().enabled.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+	Cell& c = thread_shard().cell(key);
+	Cell::add(c.count, 1);
+	Cell::add(c.sum_ns, ns);
+	Cell::add(c.buckets[bucket_of(ns)], 1);
+	if (error) Cell::add(c.errors, 1);
+	if (bytes) Cell::add(c.bytes, bytes);
+}
+
+Metrics::Snapshot Metrics::snapshot()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	Snapshot all = r.series;
+	auto sum = [&all](const Shard& shard) {
+		for (size_t k = 0; k < all.size(); ++k)
+		{
+			const Cell* c = shard.cells[k].load(std::memory_order_acquire);
+			if (c) accumulate(all[k], *c);
+		}
+	};
+	sum(r.retired);
+	for (const Shard* shard : r.shards) sum(*shard);
+
+	Snapshot result;
+	result.reserve(all.size());
+	for (auto& s : all)
+	{
+		if (s.count > 0) result.push_back(std::move(s));
+	}
+	return result;
+}
+
+std::string Metrics::prometheus()
+{
+	Snapshot snap = snapshot();
+	std::string out;
+	char number[64];
+
+	auto labels = [](const Series& s) {
+		return s.label_name + "=\"" + s.label_value + "\"";
+	};
+
+	// the series of a family are written together, whatever their registration order
+	std::vector<bool> written(snap.size(), false);
+	for (size_t i = 0; i < snap.size(); ++i)
+	{
+		if (written[i]) continue;
+		const std::string& family = snap[i].family;
+
+		std::vector<const Series*> series;
+		for (size_t j = i; j < snap.size(); ++j)
+		{
+			if (!written[j] && snap[j].family == family)
+			{
+				series.push_back(&snap[j]);
+				written[j] = true;
+			}
+		}
+
+		out += "# TYPE " + family + "_seconds histogram\n";
+		for (const Series* s : series)
+		{
+			uint64_t cumulated = 0;
+			for (size_t b = 0; b < BUCKETS; ++b)
+			{
+				cumulated += s->buckets[b];
+				if (b < BUCKETS - 1)
+				{
+					std::snprintf(number, sizeof(number), "%g", static_cast<double>(uint64_t(1) << b) / 1e6);
+				}
+				else
+				{
+					std::snprintf(number, sizeof(number), "+Inf");
+				}
+				out += family + "_seconds_bucket{" + labels(*s) + ",le=\"" + number + "\"} " + std::to_string(cumulated) + "\n";
+			}
+			std::snprintf(number, sizeof(number), "%.9g", s->sum_ns / 1e9);
+			out += family + "_seconds_sum{" + labels(*s) + "} " + number + "\n";
+			out += family + "_seconds_count{" + labels(*s) + "} " + std::to_string(s->count) + "\n";
+		}
+
+		out += "# TYPE " + family + "_errors_total counter\n";
+		for (const Series* s : series)
+		{
+			out += family + "_errors_total{" + labels(*s) + "} " + std::to_string(s->errors) + "\n";
+		}
+
+		out += "# TYPE " + family + "_bytes_total counter\n";
+		for (const Series* s : series)
+		{
+			out += family + "_bytes_total{" + labels(*s) + "} " + std::to_string(s->bytes) + "\n";
+		}
+	}
+	return out;
+}
+
+void Metrics::reset()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	zero(r.retired);
+	for (Shard* shard : r.shards) zero(*shard);
+}
+
+void Metrics::set_enabled(bool enabled)
+{
+	registry().enabled = enabled;
+}
+
+bool Metrics::enabled()
+{
+	return registry().enabled;
+}
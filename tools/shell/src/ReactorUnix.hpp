@@ -0,0 +1,347 @@
+#pragma once
+
+#include "UnixIO.hpp"
+#include "ForkServerUnix.hpp"
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+/**
+
+	@class   Reactor
+	@brief   Single thread multiplexing any number of running children with epoll.
+	@details ~ Each child is registered with its stdin/stdout/stderr pipe ends and, where the kernel supports it,
+	         a pidfd that becomes readable when the child exits. Without pidfds the exited children are reaped
+			 with non blocking waitpid once their pipes are closed. The children of the fork server are reaped by the
+			 server: their wait status is read from the reply socket of the launch instead.
+			 The completion callbacks run on the reactor thread.
+
+**/
+class Reactor
+{
+public:
+	typedef std::function<void(int exit_status, std::string&& out, std::string&& err)> Completion;
+
+	static Reactor& instance()
+	{
+		static Reactor reactor;
+		return reactor;
+	}
+
+	~Reactor()
+	{
+		_stop = true;
+		wake();
+		if (_thread.joinable()) _thread.join();
+
+		for (auto& job : _jobs)
+		{
+			for (int fd : { job.second->in, job.second->out, job.second->err, job.second->pidfd })
+			{
+				if (fd >= 0) ::close(fd);
+			}
+		}
+		::close(_wakeup);
+		::close(_epoll);
+	}
+
+	/**
+		@brief Hands a started child over to the reactor. The reactor becomes the owner of the file descriptors.
+		@param pid   - The child
+		@param in    - Write end of the child stdin, or -1
+		@param out   - Read end of the child stdout
+		@param err   - Read end of the child stderr
+		@param input - Data to write on the child stdin
+		@param done  - Called on the reactor thread with the exit status and the outputs
+		@param reply - The socket of ForkServer::spawn for a child of the fork server, -1 for a child of the process
+	**/
+	void add(pid_t pid, int in, int out, int err, std::string input, Completion done, int reply = -1)
+	{
+		auto job = std::make_unique<Job>();
+		job->pid = pid;
+		job->in = in;
+		job->out = out;
+		job->err = err;
+		job->input = std::move(input);
+		job->done = std::move(done);
+
+		if (reply >= 0)
+		{
+			job->pidfd = reply; // readable once the server has reaped the child
+			job->remote = true;
+		}
+#ifdef SYS_pidfd_open
+		else
+		{
+			job->pidfd = static_cast<int>(::syscall(SYS_pidfd_open, pid, 0));
+		}
+#endif // SYS_pidfd_open
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_submitted.push_back(std::move(job));
+		}
+		wake();
+	}
+
+private:
+	enum Kind { IN, OUT, ERR, PID, WAKEUP };
+
+	struct Job;
+
+	struct Handle
+	{
+		Job* job;
+		Kind kind;
+	};
+
+	struct Job
+	{
+		pid_t		pid = 0;
+		int			pidfd = -1;
+		int			in = -1;
+		int			out = -1;
+		int			err = -1;
+		bool		remote = false;	// launched by the fork server
+		bool		exited = false;
+		int			exit_status = 0;
+		std::string input;
+		size_t		written = 0;
+		std::string stdout_data;
+		std::string stderr_data;
+		Completion	done;
+		Handle		handles[4];
+	};
+
+	Reactor()
+	{
+		_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+		_wakeup = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (_epoll < 0 || _wakeup < 0)
+		{
+			throw std::runtime_error(std::strerror(errno));
+		}
+
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.ptr = &_wakeup_handle;
+		::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &ev);
+
+		_thread = std::thread([this]() { loop(); });
+	}
+
+	void wake()
+	{
+		uint64_t one = 1;
+		while (::write(_wakeup, &one, sizeof(one)) < 0 && errno == EINTR) {}
+	}
+
+	void watch(Job* job, int fd, Kind kind, uint32_t events)
+	{
+		job->handles[kind] = { job, kind };
+		epoll_event ev{};
+		ev.events = events;
+		ev.data.ptr = &job->handles[kind];
+		::epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+	}
+
+	void unwatch(int& fd)
+	{
+		if (fd >= 0)
+		{
+			::epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+			unix_io::close_fd(fd);
+		}
+	}
+
+	void register_submitted()
+	{
+		std::vector<std::unique_ptr<Job>> submitted;
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			submitted.swap(_submitted);
+		}
+
+		for (auto& job : submitted)
+		{
+			Job* j = job.get();
+
+			if (!j->input.empty() && j->in >= 0)
+			{
+				unix_io::set_non_blocking(j->in);
+				watch(j, j->in, IN, EPOLLOUT);
+			}
+			else
+			{
+				unix_io::close_fd(j->in);
+			}
+
+			unix_io::set_non_blocking(j->out);
+			unix_io::set_non_blocking(j->err);
+			watch(j, j->out, OUT, EPOLLIN);
+			watch(j, j->err, ERR, EPOLLIN);
+			if (j->pidfd >= 0)
+			{
+				watch(j, j->pidfd, PID, EPOLLIN);
+			}
+
+			_jobs.emplace(j, std::move(job));
+		}
+	}
+
+	void handle(Handle* h)
+	{
+		Job* job = h->job;
+		switch (h->kind)
+		{
+		case IN:
+			if (!unix_io::write_some(job->in, job->input, job->written) || job->written == job->input.size())
+			{
+				unwatch(job->in);
+			}
+			break;
+		case OUT:
+			if (!unix_io::read_some(job->out, job->stdout_data)) unwatch(job->out);
+			break;
+		case ERR:
+			if (!unix_io::read_some(job->err, job->stderr_data)) unwatch(job->err);
+			break;
+		case PID:
+			if (job->remote)
+			{
+				receive(job);
+			}
+			else
+			{
+				reap(job, true);
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	bool reap(Job* job, bool blocking)
+	{
+		int status = 0;
+		pid_t rc = 0;
+		do
+		{
+			rc = ::waitpid(job->pid, &status, blocking ? 0 : WNOHANG);
+		} while (rc < 0 && errno == EINTR);
+
+		if (rc == 0)
+		{
+			return false; // still running
+		}
+
+		job->exited = true;
+		job->exit_status = rc < 0 ? -1 : unix_io::exit_status(status);
+		unwatch(job->pidfd);
+		return true;
+	}
+
+	/**
+		@brief  Reads the wait status of a child of the fork server from its reply socket
+	**/
+	void receive(Job* job)
+	{
+		::epoll_ctl(_epoll, EPOLL_CTL_DEL, job->pidfd, nullptr);
+		int status = ForkServer::wait(job->pidfd); // closes the socket
+		job->exited = true;
+		job->exit_status = status < 0 ? -1 : unix_io::exit_status(status);
+	}
+
+	/**
+		@brief  Completes the job if its pipes are closed and the child has been reaped
+		@retval  - True if the job is still pending because the child exit is not known yet
+	**/
+	bool try_complete(Job* job)
+	{
+		if (job->out >= 0 || job->err >= 0)
+		{
+			return false;
+		}
+		if (!job->exited && (job->pidfd >= 0 || !reap(job, false)))
+		{
+			return job->pidfd < 0;
+		}
+
+		unwatch(job->in);
+		try
+		{
+			job->done(job->exit_status, std::move(job->stdout_data), std::move(job->stderr_data));
+		}
+		catch (...)
+		{
+			// the reactor must survive any callback
+		}
+		_jobs.erase(job);
+		return false;
+	}
+
+	void loop()
+	{
+		std::vector<epoll_event> events(64);
+		std::vector<Job*> unreaped; // pipes closed, exit status to be polled (no pidfd)
+
+		while (!_stop)
+		{
+			int n = ::epoll_wait(_epoll, events.data(), static_cast<int>(events.size()), unreaped.empty() ? -1 : 10);
+			if (n < 0 && errno != EINTR)
+			{
+				break;
+			}
+
+			std::vector<Job*> touched;
+			for (int i = 0; i < n; ++i)
+			{
+				auto* h = static_cast<Handle*>(events[i].data.ptr);
+				if (h->kind == WAKEUP)
+				{
+					uint64_t count = 0;
+					while (::read(_wakeup, &count, sizeof(count)) > 0) {}
+					register_submitted();
+					continue;
+				}
+				handle(h);
+				touched.push_back(h->job);
+			}
+
+			touched.insert(touched.end(), unreaped.begin(), unreaped.end());
+			unreaped.clear();
+
+			std::sort(touched.begin(), touched.end());
+			touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+			for (Job* job : touched)
+			{
+				if (_jobs.count(job) && try_complete(job))
+				{
+					unreaped.push_back(job);
+				}
+			}
+		}
+	}
+
+	int										_epoll = -1;
+	int										_wakeup = -1;
+	Handle									_wakeup_handle{ nullptr, WAKEUP };
+	std::atomic<bool>						_stop{ false };
+	std::mutex								_mutex;
+	std::vector<std::unique_ptr<Job>>		_submitted;
+	std::unordered_map<Job*, std::unique_ptr<Job>> _jobs;
+	std::thread								_thread;
+};
@@ -1,4 +1,6 @@
 #include "Shell.h"
+#include "ShellMetrics.hpp"
+#include "CancelState.hpp"
 
 /*
 * Select what implementation to use
@@ -11,44 +13,104 @@
 #endif // USE_UNIX
 
 #include <iostream>
+#include <thread>
+#include <atomic>
 
 /*
 * Define methods using bridge
 */
 Shell::Output Shell::execute()
 {
+	execute_view();
+	return collect_output();
+}
+
+Shell::Output Shell::execute(const Shell::Argv& argv)
+{
+	execute_view(argv);
+	return collect_output();
+}
+
+Shell::View Shell::execute_view(const Input& command)
+{
+	setCommand(command);
+	return execute_view();
+}
+
+Shell::View Shell::execute_view()
+{
+	auto begin = Metrics::now();
 	_pimpl->execute();
-	
-	auto exit_code = _pimpl->ExitStatus;
-	auto error_out = _pimpl->StdErr;
-	auto std_out = _pimpl->StdOut;
-	
-	// clean up output from end final lines
-	if(!error_out.empty() && error_out.back() == '\n') error_out.erase(error_out.end() -1);
-	if(!std_out.empty() && std_out.back() == '\n') std_out.erase(std_out.end() -1);
 
-	// catch the result 
-	if (std_out.empty())
+	View result = view();
+	_exit_status = result.exitCode;
+	Metrics::record(shell_metrics::execution(shell_metrics::BASH), Metrics::now() - begin, result.exitCode != SUCCESS, result.out.size() + result.err.size());
+	return result;
+}
+
+Shell::View Shell::execute_view(const Argv& argv)
+{
+	_command.clear();
+	for (auto& arg : argv)
 	{
-		_result = error_out;
+		if (!_command.empty()) _command += ' ';
+		_command += arg;
 	}
-	else
+
+	auto begin = Metrics::now();
+	_pimpl->spawn(argv);
+
+	View result = view();
+	_exit_status = result.exitCode;
+	Metrics::record(shell_metrics::execution(shell_metrics::SPAWN), Metrics::now() - begin, result.exitCode != SUCCESS, result.out.size() + result.err.size());
+	return result;
+}
+
+Shell::View Shell::view() const noexcept
+{
+	std::string_view out = _pimpl->StdOut;
+	std::string_view err = _pimpl->StdErr;
+
+	// clean up output from end final lines
+	if (!out.empty() && out.back() == '\n') out.remove_suffix(1);
+	if (!err.empty() && err.back() == '\n') err.remove_suffix(1);
+
+	return { static_cast<Exit>(_pimpl->ExitStatus), out, err };
+}
+
+namespace
+{
+	/*
+	* Builds the output of an ended execution: final new lines are trimmed
+	* and the result is stdout, or stderr when stdout is empty
+	*/
+	Shell::Output make_output(int exit_code, std::string std_out, std::string error_out)
 	{
-		_result = std_out;
+		auto begin = Metrics::now();
+
+		// clean up output from end final lines
+		if(!error_out.empty() && error_out.back() == '\n') error_out.erase(error_out.end() -1);
+		if(!std_out.empty() && std_out.back() == '\n') std_out.erase(std_out.end() -1);
+
+		Shell::Output result;
+		result.exitCode = static_cast<Shell::Exit>(exit_code);
+		result.result = std_out.empty() ? std::move(error_out) : std::move(std_out);
+
+		Metrics::record(shell_metrics::phase(shell_metrics::CLEANUP), Metrics::now() - begin);
+		return result;
 	}
+}
+
+Shell::Output Shell::collect_output()
+{
+	auto begin = Metrics::now();
+
+	// a single copy, of the exact size: the buffers stay in the implementation for the next execution
+	View v = view();
+	Shell::Output result{ v.exitCode, std::string(v.result()) };
+	_exit_status = result.exitCode;
 
-	// catch the exit code
-	_exit_status = static_cast<Exit>(exit_code);
-	
-	// clean outputs of pimpl
-	_pimpl->StdErr="";
-	_pimpl->StdOut="";
-	_pimpl->ExitStatus = 0;
-
-	// return 
-	Shell::Output result;
-	result.exitCode = _exit_status;
-	result.result = _result;
+	Metrics::record(shell_metrics::phase(shell_metrics::CLEANUP), Metrics::now() - begin);
 	return result;
 }
 
@@ -58,32 +120,392 @@ Shell::Output Shell::execute(const Shell::Input command)
 	return this->execute();
 }
 
+Shell::Output Shell::execute_coprocess(const Input command)
+{
+	setCommand(command);
+
+	auto begin = Metrics::now();
+	_pimpl->execute_coprocess();
+
+	Output result = collect_output();
+	Metrics::record(shell_metrics::execution(shell_metrics::COPROCESS), Metrics::now() - begin, result.exitCode != SUCCESS, result.result.size());
+	return result;
+}
+
+struct Shell::Session::Impl
+{
+	Shell						shell;	// the limits and the output buffers of the executions
+	Argv						argv;
+	ShellImpl::SessionProcess	process;
+};
+
+Shell::Session::Session(Argv argv)
+	: _impl(std::make_unique<Impl>())
+{
+	_impl->argv = std::move(argv);
+}
+
+Shell::Session::~Session() = default;
+
+Shell::Session::Session(Session&&) noexcept = default;
+
+Shell::Session& Shell::Session::operator=(Session&&) noexcept = default;
+
+Shell::Output Shell::Session::execute(const Input& command)
+{
+	Shell& shell = _impl->shell;
+	shell.setCommand(command);
+
+	auto begin = Metrics::now();
+	shell._pimpl->execute_session(_impl->process, _impl->argv);
+
+	Output result = shell.collect_output();
+	Metrics::record(shell_metrics::execution(shell_metrics::SESSION), Metrics::now() - begin, result.exitCode != SUCCESS, result.result.size());
+	return result;
+}
+
+bool Shell::Session::ping(std::chrono::milliseconds timeout)
+{
+	if (!running())
+	{
+		return false;
+	}
+
+	Shell& shell = _impl->shell;
+	auto limit = shell.get_timeout();
+	shell.set_timeout(timeout);
+	shell.setCommand(":");
+	shell._pimpl->execute_session(_impl->process, _impl->argv);
+	shell.set_timeout(limit);
+
+	if (shell.view().exitCode != SUCCESS)
+	{
+		stop();
+		return false;
+	}
+	return true;
+}
+
+bool Shell::Session::running()
+{
+	return _impl->process.alive();
+}
+
+void Shell::Session::stop()
+{
+	_impl->process.stop();
+}
+
+void Shell::Session::set_timeout(std::chrono::milliseconds timeout)
+{
+	_impl->shell.set_timeout(timeout);
+}
+
+void Shell::Session::set_cancel_token(CancelToken token)
+{
+	_impl->shell.set_cancel_token(std::move(token));
+}
+
+void Shell::Session::clear_cancel_token()
+{
+	_impl->shell.clear_cancel_token();
+}
+
+void Shell::set_coprocesses(size_t max)
+{
+	ShellImpl::set_coprocesses(max);
+}
+
+bool Shell::start_fork_server()
+{
+	return ShellImpl::start_fork_server();
+}
+
+void Shell::stop_fork_server()
+{
+	ShellImpl::stop_fork_server();
+}
+
 Shell::Output Shell::prompt(const Input command)
 {
-	Shell::ShellImpl shell;
+	// the buffers of the thread are reused by all its prompts
+	thread_local Shell shell;
+	View v = shell.execute_view(command);
+
+	// only stdout is reported
+	return { v.exitCode, std::string(v.out) };
+}
+
+Shell::Output Shell::prompt(const Argv& argv)
+{
+	thread_local Shell shell;
+	return shell.execute(argv);
+}
 
-	shell.execute(command);
+/*
+* Streaming
+*/
+namespace
+{
+	const size_t MAX_LINE = 1024 * 1024;
 
-	auto exit_code = shell.ExitStatus;
-	auto error_out = shell.StdErr;
-	auto std_out = shell.StdOut;
+	/*
+	* Splits the chunks of each channel in lines. Complete lines inside a chunk are delivered without copies,
+	* only a line split between two chunks is buffered. Lines longer than MAX_LINE are delivered in pieces.
+	*/
+	class LineFramer
+	{
+		std::string _partial[2];
 
-	// clean up output from end final lines
-	if (!error_out.empty() && error_out.back() == '\n') error_out.erase(error_out.end() - 1);
-	if (!std_out.empty() && std_out.back() == '\n') std_out.erase(std_out.end() - 1);
+	public:
+		bool feed(Shell::Channel channel, std::string_view data, const Shell::StreamCallback& callback)
+		{
+			std::string& partial = _partial[channel];
+
+			size_t eol = 0;
+			while ((eol = data.find('\n')) != std::string_view::npos)
+			{
+				bool keep_going = true;
+				if (partial.empty())
+				{
+					keep_going = callback(channel, data.substr(0, eol));
+				}
+				else
+				{
+					partial.append(data.data(), eol);
+					keep_going = callback(channel, partial);
+					partial.clear();
+				}
+				data.remove_prefix(eol + 1);
+
+				if (!keep_going) return false;
+			}
+
+			partial.append(data.data(), data.size());
+			if (partial.size() >= MAX_LINE)
+			{
+				bool keep_going = callback(channel, partial);
+				partial.clear();
+				return keep_going;
+			}
+			return true;
+		}
+
+		void flush(const Shell::StreamCallback& callback)
+		{
+			for (auto channel : { Shell::STDOUT, Shell::STDERR })
+			{
+				if (!_partial[channel].empty())
+				{
+					callback(channel, _partial[channel]);
+					_partial[channel].clear();
+				}
+			}
+		}
+	};
+}
+
+struct Shell::Stream::State
+{
+	ShellImpl			impl;
+	ShellImpl::Control	control;
+	std::thread			worker;
+	std::atomic<bool>	done{ false };
+	Output				result;
+};
+
+Shell::Stream::Stream() = default;
+
+Shell::Stream::~Stream()
+{
+	if (_state)
+	{
+		cancel();
+		if (_state->worker.joinable()) _state->worker.join();
+	}
+}
 
-	// catch the result 
-	std::string result;
-	std_out.empty() ? result = error_out : result = std_out;
+Shell::Stream::Stream(Stream&&) noexcept = default;
 
-	Shell::Output o;
-	o.exitCode = (Exit)exit_code;
-	o.result = std_out;
+Shell::Stream& Shell::Stream::operator=(Stream&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (_state)
+		{
+			cancel();
+			if (_state->worker.joinable()) _state->worker.join();
+		}
+		_state = std::move(other._state);
+	}
+	return *this;
+}
+
+void Shell::Stream::cancel()
+{
+	if (_state)
+	{
+		ShellImpl::cancel(_state->control);
+	}
+}
+
+bool Shell::Stream::running() const
+{
+	return _state && !_state->done;
+}
 
-	return o;
+Shell::Output Shell::Stream::wait()
+{
+	if (!_state)
+	{
+		return { FAIL, "No command is being streamed" };
+	}
+	if (_state->worker.joinable())
+	{
+		_state->worker.join();
+	}
+	return _state->result;
+}
+
+Shell::Stream Shell::stream(const Input command, StreamCallback callback, Framing framing)
+{
+	Stream s;
+	s._state = std::make_unique<Stream::State>();
+	s._state->impl.Command = command;
+	start_stream(s, false, std::move(callback), framing);
+	return s;
+}
+
+Shell::Stream Shell::stream(const Argv& argv, StreamCallback callback, Framing framing)
+{
+	Stream s;
+	s._state = std::make_unique<Stream::State>();
+	s._state->impl.Argv = argv;
+	start_stream(s, true, std::move(callback), framing);
+	return s;
+}
+
+std::future<Shell::Output> Shell::execute_async(const Input command)
+{
+	auto promise = std::make_shared<std::promise<Output>>();
+	auto future = promise->get_future();
+	execute_async(command, [promise](Output output) { promise->set_value(std::move(output)); });
+	return future;
+}
+
+std::future<Shell::Output> Shell::execute_async(const Argv& argv)
+{
+	auto promise = std::make_shared<std::promise<Output>>();
+	auto future = promise->get_future();
+	execute_async(argv, [promise](Output output) { promise->set_value(std::move(output)); });
+	return future;
+}
+
+void Shell::execute_async(const Input command, Completion on_complete)
+{
+	ShellImpl impl;
+	impl.Command = command;
+	impl.launch_async(false, [on_complete = std::move(on_complete), begin = Metrics::now()](int exit_status, std::string&& out, std::string&& err) {
+		Output result = make_output(exit_status, std::move(out), std::move(err));
+		Metrics::record(shell_metrics::execution(shell_metrics::ASYNC), Metrics::now() - begin, result.exitCode != SUCCESS, result.result.size());
+		on_complete(std::move(result));
+	});
+}
+
+void Shell::execute_async(const Argv& argv, Completion on_complete)
+{
+	ShellImpl impl;
+	impl.Argv = argv;
+	impl.launch_async(true, [on_complete = std::move(on_complete), begin = Metrics::now()](int exit_status, std::string&& out, std::string&& err) {
+		Output result = make_output(exit_status, std::move(out), std::move(err));
+		Metrics::record(shell_metrics::execution(shell_metrics::ASYNC), Metrics::now() - begin, result.exitCode != SUCCESS, result.result.size());
+		on_complete(std::move(result));
+	});
+}
+
+void Shell::start_stream(Stream& stream, bool use_argv, StreamCallback callback, Framing framing)
+{
+	Stream::State* state = stream._state.get();
+
+	state->worker = std::thread([state, use_argv, callback = std::move(callback), framing]() {
+		auto begin = Metrics::now();
+		LineFramer framer;
+		std::string callback_error;
+
+		ShellImpl::Sink sink = [&](int channel, const char* data, size_t size) {
+			Channel ch = channel == 2 ? STDERR : STDOUT;
+			try
+			{
+				if (framing == LINES)
+				{
+					return framer.feed(ch, std::string_view(data, size), callback);
+				}
+				return callback(ch, std::string_view(data, size));
+			}
+			catch (const std::exception& ex)
+			{
+				callback_error = "Exception: " + std::string(ex.what());
+				return false;
+			}
+		};
+
+		state->impl.stream(use_argv, sink, state->control);
+
+		if (framing == LINES && !state->control.cancelled)
+		{
+			try
+			{
+				framer.flush(callback);
+			}
+			catch (const std::exception& ex)
+			{
+				callback_error = "Exception: " + std::string(ex.what());
+			}
+		}
+
+		state->result.exitCode = static_cast<Exit>(state->impl.ExitStatus);
+		state->result.result = callback_error.empty() ? state->impl.StdErr : callback_error;
+		Metrics::record(shell_metrics::execution(shell_metrics::STREAM), Metrics::now() - begin, state->result.exitCode != SUCCESS);
+		state->done = true;
+	});
+}
+
+Shell::CancelToken::CancelToken()
+	: _state(std::make_shared<State>())
+{
+}
+
+void Shell::CancelToken::cancel()
+{
+	_state->cancel();
+}
+
+bool Shell::CancelToken::cancelled() const
+{
+	return _state->is_cancelled();
+}
+
+void Shell::set_timeout(std::chrono::milliseconds timeout)
+{
+	_pimpl->Timeout = timeout.count() > 0 ? timeout : std::chrono::milliseconds(0);
+}
+
+std::chrono::milliseconds Shell::get_timeout() const
+{
+	return _pimpl->Timeout;
+}
+
+void Shell::set_cancel_token(CancelToken token)
+{
+	_pimpl->Token = std::move(token._state);
+}
+
+void Shell::clear_cancel_token()
+{
+	_pimpl->Token.reset();
 }
 
-void Shell::setCommand(const Shell::Input cmd) noexcept
+void Shell::setCommand(const Shell::Input& cmd) noexcept
 {
 	_command = cmd;
 	_pimpl->Command = cmd;
@@ -101,7 +523,7 @@ int Shell::getExitStatus() const noexcept
 
 std::string Shell::getResult() const noexcept
 {
-	return _result;
+	return std::string(view().result());
 }
 
 
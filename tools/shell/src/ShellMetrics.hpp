@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Metrics.h"
+
+/*
+* Keys of the series recorded by the shell
+*/
+namespace shell_metrics
+{
+	enum Phase
+	{
+		PIPES,		// creation of the standard stream pipes
+		LAUNCH,		// fork or posix_spawn, until the parent gets the pid
+		RUN,		// the child runs while its outputs are drained, until both pipes are closed
+		REAP,		// waitpid of the ended child
+		CLEANUP,	// trimming and moving the outputs into the result
+	};
+
+	enum Path
+	{
+		BASH,
+		SPAWN,
+		STREAM,
+		ASYNC,
+		COPROCESS,
+		SESSION,
+	};
+
+	inline Metrics::Key phase(Phase p)
+	{
+		static const Metrics::Key keys[] = {
+			Metrics::key("shell_phase", "phase", "pipes"),
+			Metrics::key("shell_phase", "phase", "launch"),
+			Metrics::key("shell_phase", "phase", "run"),
+			Metrics::key("shell_phase", "phase", "reap"),
+			Metrics::key("shell_phase", "phase", "cleanup"),
+		};
+		return keys[p];
+	}
+
+	inline Metrics::Key execution(Path p)
+	{
+		static const Metrics::Key keys[] = {
+			Metrics::key("shell_execution", "path", "bash"),
+			Metrics::key("shell_execution", "path", "spawn"),
+			Metrics::key("shell_execution", "path", "stream"),
+			Metrics::key("shell_execution", "path", "async"),
+			Metrics::key("shell_execution", "path", "coprocess"),
+			Metrics::key("shell_execution", "path", "session"),
+		};
+		return keys[p];
+	}
+}
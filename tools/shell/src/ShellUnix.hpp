@@ -1,13 +1,35 @@
 #pragma once
 
 #include "Shell.h"
+#include "UnixIO.hpp"
+#include "ReactorUnix.hpp"
+#include "CoprocessUnix.hpp"
+#include "ForkServerUnix.hpp"
+#include "CancelState.hpp"
+#include "ShellMetrics.hpp"
 
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
 #include <cstring>
+#include <cstdlib>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <algorithm>
 #include <array>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+
+extern char** environ;
 
 // struct Shell::ShellImpl
 // {
@@ -56,9 +78,33 @@ class Shell::ShellImpl
 public:
 	int             ExitStatus = 0;
 	std::string     Command;
+	std::vector<std::string> Argv;
 	std::string     StdIn;
 	std::string     StdOut;
 	std::string     StdErr;
+	std::chrono::milliseconds Timeout{ 0 };			// zero: no deadline
+	std::shared_ptr<CancelToken::State> Token;	// null: not cancellable
+
+	/**
+		@brief Receives the output chunks of a streamed execution: channel is STDOUT_FILENO or STDERR_FILENO.
+		       Returning false cancels the execution.
+	**/
+	typedef std::function<bool(int channel, const char* data, size_t size)> Sink;
+
+	/**
+		@brief Handle to cancel a running execution from another thread
+	**/
+	struct Control
+	{
+		typedef std::chrono::steady_clock Clock;
+
+		std::mutex			mutex;
+		pid_t				pid = 0;
+		std::atomic<bool>	cancelled{ false };
+		std::atomic<bool>	revoked{ false };				// cancelled through a CancelToken
+		Clock::time_point	deadline = Clock::time_point::max();
+		bool				timed_out = false;
+	};
 
 	void execute(std::string command)
 	{
@@ -67,117 +113,747 @@ public:
 	}
 
 	void execute()
+	{
+		run(false, nullptr, nullptr);
+	}
+
+	void spawn(const std::vector<std::string>& argv)
+	{
+		Argv = argv; // element-wise assignment: the strings of the previous execution are reused
+		this->spawn();
+	}
+
+	/**
+		@brief Launches Argv directly with posix_spawn (vfork semantics on glibc): no shell and
+		       no copy of the page tables of the calling process. The executable is resolved
+			   once through the PATH and cached.
+	**/
+	void spawn()
+	{
+		run(true, nullptr, nullptr);
+	}
+
+	/**
+		@brief Executes Argv (use_argv) or Command delivering the output to the sink as it is read, instead of
+		       accumulating it. The sink runs on the calling thread: while it runs the pipes are not read,
+			   so a slow sink makes the child block on its writes (backpressure).
+	**/
+	void stream(bool use_argv, const Sink& sink, Control& control)
+	{
+		run(use_argv, &sink, &control);
+	}
+
+	/**
+		@brief Executes Command in one of the long lived bash coprocesses (see CoprocessPool)
+	**/
+	typedef Coprocess SessionProcess;
+
+	/**
+		@brief Executes Command in a session process, starting it if it is not running. The process is stopped
+		       when the command does not complete (timeout, cancellation, broken session): the next execution
+			   starts a new one. A command that could not be sent to an ended process is sent to a new one.
+	**/
+	void execute_session(Coprocess& process, const std::vector<std::string>& argv)
+	{
+		try
+		{
+			Coprocess::Result result;
+			unix_io::recycle(StdOut);
+			unix_io::recycle(StdErr);
+			result.out.swap(StdOut);
+			result.err.swap(StdErr);
+
+			Control control;
+			Limits limits(*this, control);
+			for (int attempt = 0; attempt < 2 && !limits.cancelled(); ++attempt)
+			{
+				result.out.clear();
+				result.err.clear();
+				if (!process.alive())
+				{
+					process.stop();
+					if (!process.start(argv))
+					{
+						result.exit_status = -1;
+						result.err = "Cannot start the session " + (argv.empty() ? std::string() : argv[0]);
+						break;
+					}
+				}
+
+				if (process.run(Command, result, control.deadline, Token ? &control.cancelled : nullptr))
+				{
+					break;
+				}
+				process.stop();
+				control.timed_out = result.exit_status == Shell::TIMEOUT;
+				if (result.delivered) break;
+			}
+			ExitStatus = result.exit_status;
+			StdOut.swap(result.out);
+			StdErr.swap(result.err);
+			limits.report(control);
+		}
+		catch (const std::exception& ex)
+		{
+			ExitStatus = -1;
+			StdOut.clear();
+			StdErr = ex.what();
+		}
+	}
+
+	void execute_coprocess()
 	{
 		try
 		{
-			const int READ_END = 0;
-			const int WRITE_END = 1;
+			// the output buffers go through the pool and come back
+			CoprocessPool::Result result;
+			unix_io::recycle(StdOut);
+			unix_io::recycle(StdErr);
+			result.out.swap(StdOut);
+			result.err.swap(StdErr);
+
+			Control control;
+			Limits limits(*this, control);
+			if (!limits.cancelled())
+			{
+				CoprocessPool::instance().execute(Command, result, control.deadline, Token ? &control.cancelled : nullptr);
+				control.timed_out = result.exit_status == Shell::TIMEOUT;
+			}
+			ExitStatus = result.exit_status;
+			StdOut.swap(result.out);
+			StdErr.swap(result.err);
+			limits.report(control);
+		}
+		catch (const std::exception& ex)
+		{
+			ExitStatus = -1;
+			StdErr = "Exception: " + std::string(ex.what());
+			StdOut = "";
+		}
+	}
 
-			int infd[2] = { 0, 0 };
-			int outfd[2] = { 0, 0 };
-			int errfd[2] = { 0, 0 };
+	static void set_coprocesses(size_t max)
+	{
+		CoprocessPool::instance().set_max(max);
+	}
 
-			auto cleanup = [&]() {
-				::close(infd[READ_END]);
-				::close(infd[WRITE_END]);
+	static bool start_fork_server()
+	{
+		return ForkServer::instance().start();
+	}
 
-				::close(outfd[READ_END]);
-				::close(outfd[WRITE_END]);
+	static void stop_fork_server()
+	{
+		ForkServer::instance().stop();
+	}
+
+	typedef Reactor::Completion Completion;
 
-				::close(errfd[READ_END]);
-				::close(errfd[WRITE_END]);
-				};
+	/**
+		@brief Starts Argv (use_argv) or Command and returns immediately: the running child is handed over to the reactor
+		       thread, which calls done once the child has exited. Launch failures call done on the calling thread.
+			   A child launched by the fork server is reaped by the server: the reactor watches the reply socket instead.
+	**/
+	void launch_async(bool use_argv, Completion done)
+	{
+		int remote = -1;
+		try
+		{
+			Reactor& reactor = Reactor::instance();
 
-			auto rc = ::pipe(infd);
-			if (rc < 0)
+			auto begin = Metrics::now();
+			Pipes pipes;
+			pid_t pid = launch(use_argv, pipes, begin, &remote);
+			if (pid <= 0)
 			{
-				throw std::runtime_error(std::strerror(errno));
+				done(ExitStatus, std::move(StdOut), std::move(StdErr)); // executable not found
+				return;
 			}
 
-			rc = ::pipe(outfd);
-			if (rc < 0)
+			pipes.close_child_ends();
+			reactor.add(pid, pipes.in[WRITE_END], pipes.out[READ_END], pipes.err[READ_END], StdIn, std::move(done), remote);
+			remote = -1;
+
+			// now owned by the reactor
+			pipes.in[WRITE_END] = -1;
+			pipes.out[READ_END] = -1;
+			pipes.err[READ_END] = -1;
+		}
+		catch (const std::exception& ex)
+		{
+			unix_io::close_fd(remote);
+			done(-1, std::string(), "Exception: " + std::string(ex.what()));
+		}
+	}
+
+	/**
+		@brief Terminates the process group of the execution controlled by control, if still running.
+	**/
+	static void cancel(Control& control)
+	{
+		std::lock_guard<std::mutex> lock(control.mutex);
+		control.cancelled = true;
+		if (control.pid > 0)
+		{
+			::kill(-control.pid, SIGTERM);
+		}
+	}
+
+	/**
+		@brief  Get the full path of an executable searching the PATH. Results are cached.
+		@param  name - Name of the executable. Names containing a '/' are returned unchanged
+		@retval      - The full path, empty if not found
+	**/
+	static std::string resolve(const std::string& name)
+	{
+		std::string path;
+		resolve(name, path);
+		return path;
+	}
+
+	/**
+		@brief  As resolve(const std::string&) but the path is assigned to the given string, reusing its memory
+		@retval  - False if not found
+	**/
+	static bool resolve(const std::string& name, std::string& path)
+	{
+		if (name.find('/') != std::string::npos)
+		{
+			path = name;
+			return true;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(cache_mutex());
+			auto it = cache().find(name);
+			if (it != cache().end())
 			{
-				::close(infd[READ_END]);
-				::close(infd[WRITE_END]);
-				throw std::runtime_error(std::strerror(errno));
+				path = it->second;
+				return true;
 			}
+		}
+
+		const char* env_path = std::getenv("PATH");
+		std::string search = env_path ? env_path : "/usr/local/bin:/usr/bin:/bin";
+
+		std::string found;
+		size_t begin = 0;
+		while (begin <= search.size())
+		{
+			size_t end = search.find(':', begin);
+			if (end == std::string::npos) end = search.size();
 
-			rc = ::pipe(errfd);
-			if (rc < 0)
+			std::string dir = search.substr(begin, end - begin);
+			std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+			if (::access(candidate.c_str(), X_OK) == 0)
 			{
-				::close(infd[READ_END]);
-				::close(infd[WRITE_END]);
+				found = candidate;
+				break;
+			}
+			begin = end + 1;
+		}
 
-				::close(outfd[READ_END]);
-				::close(outfd[WRITE_END]);
-				throw std::runtime_error(std::strerror(errno));
+		if (!found.empty())
+		{
+			std::lock_guard<std::mutex> lock(cache_mutex());
+			cache()[name] = found;
+		}
+		path = found;
+		return !found.empty();
+	}
+
+private:
+	static const int READ_END = unix_io::READ_END;
+	static const int WRITE_END = unix_io::WRITE_END;
+	static const int KILL_GRACE_MS = 2000;
+	static const int DRAIN_AFTER_KILL_MS = 500;
+
+	static std::unordered_map<std::string, std::string>& cache()
+	{
+		static std::unordered_map<std::string, std::string> paths;
+		return paths;
+	}
+
+	static std::mutex& cache_mutex()
+	{
+		static std::mutex m;
+		return m;
+	}
+
+	static void forget(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(cache_mutex());
+		cache().erase(name);
+	}
+
+	typedef unix_io::Pipes Pipes;
+
+	// reused by every launch of the object
+	std::string			_path;
+	std::vector<char*>	_args;
+
+	/**
+		@brief Applies the Timeout and the Token of the implementation to an execution while it lives, then
+		       reports the expired or cancelled execution in the outputs
+	**/
+	class Limits
+	{
+		ShellImpl&	_impl;
+		uint64_t	_listener = 0;
+		bool		_cancelled = false;
+
+	public:
+		Limits(ShellImpl& impl, Control& control)
+			: _impl(impl)
+		{
+			if (impl.Timeout.count() > 0)
+			{
+				control.deadline = Control::Clock::now() + impl.Timeout;
 			}
+			if (impl.Token)
+			{
+				_listener = impl.Token->listen([&control]() {
+					control.revoked = true;
+					ShellImpl::cancel(control);
+				});
+				_cancelled = _listener == 0;
+				control.revoked = _cancelled;
+			}
+		}
+
+		~Limits()
+		{
+			if (_listener) _impl.Token->forget(_listener);
+		}
+
+		/**
+			@brief  True if the token was already cancelled: the execution must not start
+		**/
+		bool cancelled() const { return _cancelled; }
 
-			auto pid = fork();
-			if (pid > 0) // PARENT
+		void report(const Control& control)
+		{
+			if (control.timed_out)
+			{
+				_impl.ExitStatus = Shell::TIMEOUT;
+				_impl.StdOut.clear();
+				_impl.StdErr = "Timed out after " + std::to_string(_impl.Timeout.count()) + " ms";
+			}
+			else if (control.revoked)
 			{
-				::close(infd[READ_END]);    // Parent does not read from stdin
-				::close(outfd[WRITE_END]);  // Parent does not write to stdout
-				::close(errfd[WRITE_END]);  // Parent does not write to stderr
+				_impl.ExitStatus = Shell::CANCELLED;
+				_impl.StdOut.clear();
+				_impl.StdErr = "Cancelled";
+			}
+		}
+	};
+
+	void run(bool use_argv, const Sink* sink, Control* control)
+	{
+		unix_io::recycle(StdOut);
+		unix_io::recycle(StdErr);
 
-				if (::write(infd[WRITE_END], StdIn.data(), StdIn.size()) < 0)
+		// a deadline or a cancellation token need a control: streams bring their own
+		Control local;
+		if (!control && (Timeout.count() > 0 || Token))
+		{
+			control = &local;
+		}
+		if (!control)
+		{
+			run_controlled(use_argv, sink, nullptr);
+			return;
+		}
+
+		Limits limits(*this, *control);
+		if (!limits.cancelled())
+		{
+			run_controlled(use_argv, sink, control);
+		}
+		limits.report(*control);
+	}
+
+	void run_controlled(bool use_argv, const Sink* sink, Control* control)
+	{
+		int remote = -1;
+		try
+		{
+
+			auto begin = Metrics::now();
+			Pipes pipes;
+
+			pid_t pid = launch(use_argv, pipes, begin, &remote);
+			if (pid <= 0)
+			{
+				return; // executable not found
+			}
+
+			if (control)
+			{
+				std::lock_guard<std::mutex> lock(control->mutex);
+				control->pid = pid;
+				if (control->cancelled)
 				{
-					throw std::runtime_error(std::strerror(errno));
+					::kill(-pid, SIGTERM);
 				}
-				::close(infd[WRITE_END]); // Done writing
 			}
-			else if (pid == 0) // CHILD
+
+			collect(pid, pipes, sink, control, remote);
+		}
+		catch (const std::exception& ex)
+		{
+			unix_io::close_fd(remote);
+			ExitStatus = -1;
+			StdErr = "Exception: " + std::string(ex.what());
+			StdOut = "";
+			return;
+		}
+	}
+
+	/**
+		@brief  Launches Argv (use_argv) or Command recording the pipes and launch phases
+		@param  begin  - When the creation of the pipes started
+		@param  remote - If given, the child is launched by the fork server when it runs, and remote is set to the
+		                 socket on which its end is notified
+		@retval        - The child pid, 0 if the executable was not found
+	**/
+	pid_t launch(bool use_argv, Pipes& pipes, Metrics::Clock::time_point begin, int* remote = nullptr)
+	{
+		auto piped = Metrics::now();
+		Metrics::record(shell_metrics::phase(shell_metrics::PIPES), piped - begin);
+
+		pid_t pid = remote ? launch_remote(use_argv, pipes, *remote) : -1;
+		if (pid < 0)
+		{
+			pid = use_argv ? launch_argv(pipes) : launch_shell(pipes);
+		}
+		Metrics::record(shell_metrics::phase(shell_metrics::LAUNCH), Metrics::now() - piped, pid <= 0);
+		return pid;
+	}
+
+	/**
+		@brief  Launches Argv (use_argv) or Command through bash from the fork server
+		@retval  - The child pid, 0 if the executable was not found, -1 if the fork server is not running
+	**/
+	pid_t launch_remote(bool use_argv, Pipes& pipes, int& remote)
+	{
+		ForkServer& server = ForkServer::instance();
+		if (!server.running())
+		{
+			return -1;
+		}
+
+		pid_t pid = 0;
+		if (use_argv)
+		{
+			if (Argv.empty())
+			{
+				throw std::runtime_error("Empty argument vector");
+			}
+
+			std::string path = resolve(Argv.front());
+			if (path.empty())
 			{
-				::dup2(infd[READ_END], STDIN_FILENO);
-				::dup2(outfd[WRITE_END], STDOUT_FILENO);
-				::dup2(errfd[WRITE_END], STDERR_FILENO);
+				ExitStatus = 127;
+				StdOut = "";
+				StdErr = Argv.front() + ": command not found";
+				return 0;
+			}
+			pid = server.spawn(path, Argv, pipes, remote);
+		}
+		else
+		{
+			pid = server.spawn("/bin/bash", { "bash", "-c", Command }, pipes, remote);
+		}
+		return pid > 0 ? pid : -1;
+	}
+
+	/**
+		@brief  Runs Command through bash. The child gets its own process group so that it can be terminated as a whole.
+		@retval  - The child pid
+	**/
+	pid_t launch_shell(Pipes& pipes)
+	{
+		auto pid = fork();
+		if (pid == 0) // CHILD
+		{
+			::setpgid(0, 0);
+
+			::dup2(pipes.in[READ_END], STDIN_FILENO);
+			::dup2(pipes.out[WRITE_END], STDOUT_FILENO);
+			::dup2(pipes.err[WRITE_END], STDERR_FILENO);
+
+			// all the pipe ends are O_CLOEXEC: exec closes them, dup2 targets survive
+			::execl("/bin/bash", "bash", "-c", Command.c_str(), nullptr);
+			::_exit(127);
+		}
+
+		// PARENT
+		if (pid < 0)
+		{
+			throw std::runtime_error("Failed to fork");
+		}
+
+		::setpgid(pid, pid); // also from the parent: the group exists before anyone tries to signal it
+		return pid;
+	}
+
+	/**
+		@brief  Runs Argv with posix_spawn in its own process group.
+		@retval  - The child pid, 0 if the executable was not found
+	**/
+	pid_t launch_argv(Pipes& pipes)
+	{
+		if (Argv.empty())
+		{
+			throw std::runtime_error("Empty argument vector");
+		}
+
+		std::string& path = _path;
+		if (!resolve(Argv.front(), path))
+		{
+			ExitStatus = 127;
+			StdOut = "";
+			StdErr = Argv.front() + ": command not found";
+			return 0;
+		}
+
+		std::vector<char*>& args = _args;
+		args.clear();
+		for (auto& arg : Argv) args.push_back(const_cast<char*>(arg.c_str()));
+		args.push_back(nullptr);
 
-				::close(infd[WRITE_END]);   // Child does not write to stdin
-				::close(outfd[READ_END]);   // Child does not read from stdout
-				::close(errfd[READ_END]);   // Child does not read from stderr
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, pipes.in[READ_END], STDIN_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, pipes.out[WRITE_END], STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, pipes.err[WRITE_END], STDERR_FILENO);
 
-				::execl("/bin/bash", "bash", "-c", Command.c_str(), nullptr);
-				::exit(EXIT_SUCCESS);
+		posix_spawnattr_t attributes;
+		posix_spawnattr_init(&attributes);
+		posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+		posix_spawnattr_setpgroup(&attributes, 0);
+
+		pid_t pid = 0;
+		int rc = ::posix_spawn(&pid, path.c_str(), &actions, &attributes, args.data(), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		posix_spawnattr_destroy(&attributes);
+
+		if (rc != 0)
+		{
+			forget(Argv.front());
+			throw std::runtime_error(std::strerror(rc));
+		}
+
+		return pid;
+	}
+
+	/**
+		@brief  Waits for the end of a child
+		@param  deadline - Stop waiting at this time
+		@retval          - False if the deadline expired first
+	**/
+	static bool reap(pid_t pid, int& status, Control::Clock::time_point deadline)
+	{
+		if (deadline == Control::Clock::time_point::max())
+		{
+			while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+			return true;
+		}
+
+		auto delay = std::chrono::microseconds(100);
+		while (true)
+		{
+			pid_t rc = ::waitpid(pid, &status, WNOHANG);
+			if (rc == pid || (rc < 0 && errno != EINTR))
+			{
+				return true;
 			}
 
-			// PARENT
-			if (pid < 0)
+			auto now = Control::Clock::now();
+			if (now >= deadline)
 			{
-				cleanup();
-				throw std::runtime_error("Failed to fork");
+				return false;
 			}
+			std::this_thread::sleep_for(std::min<Control::Clock::duration>(delay, deadline - now));
+			delay = std::min(delay * 2, std::chrono::microseconds(10000));
+		}
+	}
 
-			int inspect_status = 0;
-			::waitpid(pid, &inspect_status, 0);
+	/**
+		@brief Feeds StdIn and drains stdout and stderr at the same time while the child runs, then reaps it.
+		       Draining both pipes together avoids the deadlock of a child blocked on a full pipe
+			   (64 KiB) that is not being read.
+			   Without a sink the outputs are accumulated in StdOut and StdErr, otherwise each chunk read
+			   goes to the sink through a single fixed buffer.
+			   A child launched by the fork server (remote socket given) is reaped by the server, which sends its wait status.
+	**/
+	void collect(pid_t pid, Pipes& pipes, const Sink* sink, Control* control, int& remote)
+	{
+		pipes.close_child_ends();
 
-			std::array<char, 256> buffer;
+		size_t written = 0;
+		if (StdIn.empty())
+		{
+			unix_io::close_fd(pipes.in[WRITE_END]); // Nothing to write
+		}
+		else
+		{
+			unix_io::set_non_blocking(pipes.in[WRITE_END]);
+		}
 
-			ssize_t bytes = 0;
-			do
+		std::vector<char> buffer(sink ? unix_io::READ_CHUNK : 0);
+		uint64_t streamed = 0;
+		auto running = Metrics::now();
+		std::chrono::steady_clock::time_point cancelled_at;
+		std::chrono::steady_clock::time_point killed_at;
+		bool killed = false;
+
+		auto until = [](std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point at) {
+			return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(at - now).count()) + 1;
+		};
+
+		while (pipes.in[WRITE_END] >= 0 || pipes.out[READ_END] >= 0 || pipes.err[READ_END] >= 0)
+		{
+			int timeout = -1;
+			auto now = std::chrono::steady_clock::now();
+			if (control && !killed && now >= control->deadline)
+			{
+				::kill(-pid, SIGKILL);
+				control->timed_out = true;
+				killed = true;
+				killed_at = now;
+			}
+			else if (control && control->cancelled && !killed)
+			{
+				// escalate to SIGKILL if the process group ignores the termination request
+				if (cancelled_at == std::chrono::steady_clock::time_point()) cancelled_at = now;
+				auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - cancelled_at).count();
+				if (elapsed >= KILL_GRACE_MS)
+				{
+					::kill(-pid, SIGKILL);
+					killed = true;
+					killed_at = now;
+				}
+				else
+				{
+					timeout = static_cast<int>(KILL_GRACE_MS - elapsed);
+				}
+			}
+			else if (control && !killed)
 			{
-				bytes = ::read(outfd[READ_END], buffer.data(), buffer.size());
-				StdOut.append(buffer.data(), bytes);
-			} while (bytes > 0);
+				timeout = 100; // look at cancellation requests
+			}
 
-			do
+			if (control && !killed && control->deadline != Control::Clock::time_point::max())
+			{
+				int remaining = until(now, control->deadline);
+				timeout = timeout < 0 ? remaining : std::min(timeout, remaining);
+			}
+			else if (killed)
 			{
-				bytes = ::read(errfd[READ_END], buffer.data(), buffer.size());
-				StdErr.append(buffer.data(), bytes);
-			} while (bytes > 0);
+				// the killed group closes its pipes, unless a process left the group: stop waiting for them
+				if (now - killed_at >= std::chrono::milliseconds(DRAIN_AFTER_KILL_MS))
+				{
+					unix_io::close_fd(pipes.in[WRITE_END]);
+					unix_io::close_fd(pipes.out[READ_END]);
+					unix_io::close_fd(pipes.err[READ_END]);
+					break;
+				}
+				timeout = until(now, killed_at + std::chrono::milliseconds(DRAIN_AFTER_KILL_MS));
+			}
 
-			if (WIFEXITED(inspect_status))
+			pollfd fds[3];
+			nfds_t count = 0;
+			if (pipes.in[WRITE_END] >= 0)  fds[count++] = { pipes.in[WRITE_END], POLLOUT, 0 };
+			if (pipes.out[READ_END] >= 0) fds[count++] = { pipes.out[READ_END], POLLIN, 0 };
+			if (pipes.err[READ_END] >= 0) fds[count++] = { pipes.err[READ_END], POLLIN, 0 };
+
+			if (::poll(fds, count, timeout) < 0)
 			{
-				ExitStatus = WEXITSTATUS(inspect_status);
+				if (errno == EINTR) continue;
+				throw std::runtime_error(std::strerror(errno));
+			}
+
+			for (nfds_t k = 0; k < count; ++k)
+			{
+				if (fds[k].revents == 0) continue;
+
+				if (fds[k].fd == pipes.in[WRITE_END])
+				{
+					if (!unix_io::write_some(pipes.in[WRITE_END], StdIn, written) || written == StdIn.size())
+					{
+						unix_io::close_fd(pipes.in[WRITE_END]); // Done writing (or the child closed its stdin)
+					}
+				}
+				else if (fds[k].fd == pipes.out[READ_END] || fds[k].fd == pipes.err[READ_END])
+				{
+					bool is_out = fds[k].fd == pipes.out[READ_END];
+					int& fd = is_out ? pipes.out[READ_END] : pipes.err[READ_END];
+
+					if (!sink)
+					{
+						if (!unix_io::read_some(fd, is_out ? StdOut : StdErr)) unix_io::close_fd(fd);
+						continue;
+					}
+
+					ssize_t bytes = 0;
+					do
+					{
+						bytes = ::read(fd, buffer.data(), buffer.size());
+					} while (bytes < 0 && errno == EINTR);
+
+					if (bytes <= 0)
+					{
+						unix_io::close_fd(fd);
+						continue;
+					}
+
+					streamed += static_cast<uint64_t>(bytes);
+					if (control && control->cancelled)
+					{
+						continue; // discard what is left while the process group terminates
+					}
+					else if (!(*sink)(is_out ? STDOUT_FILENO : STDERR_FILENO, buffer.data(), static_cast<size_t>(bytes)) && control)
+					{
+						cancel(*control);
+					}
+				}
 			}
+		}
 
-			cleanup();
+		auto drained = Metrics::now();
+		Metrics::record(shell_metrics::phase(shell_metrics::RUN), drained - running, false, sink ? streamed : StdOut.size() + StdErr.size());
+
+		if (control)
+		{
+			// no signal can reach a recycled pid: the child stays a zombie until waitpid
+			// (a child of the fork server may be reaped before: only a late cancellation can miss it)
+			std::lock_guard<std::mutex> lock(control->mutex);
+			control->pid = 0;
 		}
-		catch (const std::exception& ex)
+
+		auto deadline = control && !killed ? control->deadline : Control::Clock::time_point::max();
+		int inspect_status = 0;
+		if (remote >= 0)
 		{
-			ExitStatus = -1;
-			StdErr = "Exception: " + std::string(ex.what());
-			StdOut = "";
-			return;
+			inspect_status = ForkServer::wait(remote, deadline); // reaped by the fork server
+			if (inspect_status == ForkServer::EXPIRED)
+			{
+				::kill(-pid, SIGKILL);
+				control->timed_out = true;
+				inspect_status = ForkServer::wait(remote);
+			}
 		}
+		else if (!reap(pid, inspect_status, deadline))
+		{
+			// the child closed its outputs but is still running
+			::kill(-pid, SIGKILL);
+			control->timed_out = true;
+			reap(pid, inspect_status, Control::Clock::time_point::max());
+		}
+
+		ExitStatus = inspect_status < 0 ? -1 : unix_io::exit_status(inspect_status);
+		Metrics::record(shell_metrics::phase(shell_metrics::REAP), Metrics::now() - drained, ExitStatus != 0);
 	}
 };
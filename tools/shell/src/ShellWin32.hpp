@@ -1,18 +1,27 @@
 #include "Shell.h"
+#include "CancelState.hpp"
 
 #include <windows.h>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
 
 
 struct Shell::ShellImpl
 {
     int             ExitStatus = 0;
     std::string     Command;
+    std::vector<std::string> Argv;
     std::string     StdIn;
     std::string     StdOut;
     std::string     StdErr;
+    std::chrono::milliseconds Timeout{ 0 };            // not enforced on windows
+    std::shared_ptr<Shell::CancelToken::State> Token;  // checked before the launch only
 
     ShellImpl() = default;
     ~ShellImpl() = default;
@@ -23,8 +32,101 @@ struct Shell::ShellImpl
         this->execute();
     }
 
+    typedef std::function<bool(int channel, const char* data, size_t size)> Sink;
+
+    struct Control
+    {
+        std::atomic<bool> cancelled{ false };
+    };
+
+    /**
+        @brief Streaming is not incremental on windows: the output is delivered once the command ends
+    **/
+    void stream(bool use_argv, const Sink& sink, Control& control)
+    {
+        use_argv ? spawn(Argv) : execute();
+
+        bool keep_going = !control.cancelled;
+        if (keep_going && !StdOut.empty()) keep_going = sink(1, StdOut.data(), StdOut.size());
+        if (keep_going && !StdErr.empty()) sink(2, StdErr.data(), StdErr.size());
+        StdErr.clear();
+    }
+
+    static void cancel(Control& control)
+    {
+        control.cancelled = true;
+    }
+
+    typedef std::function<void(int exit_status, std::string&& out, std::string&& err)> Completion;
+
+    /**
+        @brief No reactor on windows: the command runs synchronously and then completes
+    **/
+    void launch_async(bool use_argv, Completion done)
+    {
+        use_argv ? spawn(Argv) : execute();
+        done(ExitStatus, std::move(StdOut), std::move(StdErr));
+    }
+
+    /**
+        @brief No coprocess on windows: the command is executed as usual
+    **/
+    struct SessionProcess
+    {
+        bool alive() { return false; }
+        void stop() {}
+    };
+
+    void execute_session(SessionProcess&, const std::vector<std::string>&)
+    {
+        StdOut = "";
+        StdErr = "Sessions are not supported on windows";
+        ExitStatus = -1;
+    }
+
+    void execute_coprocess()
+    {
+        execute();
+    }
+
+    static void set_coprocesses(size_t)
+    {
+    }
+
+    /**
+        @brief No fork on windows: the processes are always created directly
+    **/
+    static bool start_fork_server()
+    {
+        return false;
+    }
+
+    static void stop_fork_server()
+    {
+    }
+
+    void spawn(const std::vector<std::string>& argv)
+    {
+        // CreateProcess takes a single command line: quote the arguments containing spaces
+        std::string command;
+        for (auto& arg : argv)
+        {
+            if (!command.empty()) command += ' ';
+            command += arg.find_first_of(" \t") == std::string::npos ? arg : "\"" + arg + "\"";
+        }
+        execute(command);
+    }
+
     void execute() 
     {
+        if (Token && Token->is_cancelled())
+        {
+            StdOut = "";
+            StdErr = "Cancelled";
+            ExitStatus = Shell::CANCELLED;
+            return;
+        }
+
         // Create pipe for standard output
         HANDLE hStdoutRead, hStdoutWrite;
         SECURITY_ATTRIBUTES saAttr = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <cstring>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+/*
+* Pipe handling shared by the unix implementations
+*/
+namespace unix_io
+{
+	const int READ_END = 0;
+	const int WRITE_END = 1;
+	const size_t READ_CHUNK = 256 * 1024;
+	const size_t MIN_READ_CHUNK = 4096;
+	const size_t MAX_POOLED = 4 * 1024 * 1024;
+	const int PIPE_SIZE = 1024 * 1024;
+
+	inline void close_fd(int& fd)
+	{
+		if (fd >= 0)
+		{
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+	/*
+	* The three standard stream pipes, created close-on-exec so that concurrent
+	* children never inherit them. Closed on destruction.
+	*/
+	struct Pipes
+	{
+		int in[2] = { -1, -1 };
+		int out[2] = { -1, -1 };
+		int err[2] = { -1, -1 };
+
+		Pipes()
+		{
+			if (::pipe2(in, O_CLOEXEC) < 0 || ::pipe2(out, O_CLOEXEC) < 0 || ::pipe2(err, O_CLOEXEC) < 0)
+			{
+				int e = errno;
+				close_all();
+				throw std::runtime_error(std::strerror(e));
+			}
+
+#ifdef F_SETPIPE_SZ
+			// larger output pipes mean fewer wake ups on big outputs. Best effort: it may exceed the system limit
+			::fcntl(out[READ_END], F_SETPIPE_SZ, PIPE_SIZE);
+			::fcntl(err[READ_END], F_SETPIPE_SZ, PIPE_SIZE);
+#endif // F_SETPIPE_SZ
+		}
+
+		~Pipes()
+		{
+			close_all();
+		}
+
+		Pipes(const Pipes&) = delete;
+		Pipes& operator=(const Pipes&) = delete;
+
+		/**
+			@brief Closes the ends used by the child, to be called by the parent once the child has started
+		**/
+		void close_child_ends()
+		{
+			close_fd(in[READ_END]);    // Parent does not read from stdin
+			close_fd(out[WRITE_END]);  // Parent does not write to stdout
+			close_fd(err[WRITE_END]);  // Parent does not write to stderr
+		}
+
+		void close_all()
+		{
+			for (int* p : { in, out, err })
+			{
+				close_fd(p[READ_END]);
+				close_fd(p[WRITE_END]);
+			}
+		}
+	};
+
+	inline void set_non_blocking(int fd)
+	{
+		::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+	}
+
+	/**
+		@brief  Empties an output buffer to be used again, keeping its memory unless it grew beyond MAX_POOLED
+	**/
+	inline void recycle(std::string& buffer)
+	{
+		if (buffer.capacity() > MAX_POOLED)
+		{
+			std::string().swap(buffer);
+		}
+		else
+		{
+			buffer.clear();
+		}
+	}
+
+	/**
+		@brief  Reads what is available on the pipe directly at the end of the output string.
+		        The string grows by what the pipe holds, so a reused string is not reallocated nor
+				filled beyond the data actually read.
+		@retval  - False on end of file (or error). True also when a non blocking pipe has nothing to read.
+	**/
+	inline bool read_some(int fd, std::string& output)
+	{
+		int available = 0;
+		size_t chunk = MIN_READ_CHUNK;
+		if (::ioctl(fd, FIONREAD, &available) == 0 && available > 0)
+		{
+			chunk = std::min(std::max(static_cast<size_t>(available), MIN_READ_CHUNK), READ_CHUNK);
+		}
+
+		size_t size = output.size();
+		if (output.capacity() - size < chunk)
+		{
+			output.reserve(std::max(output.capacity() * 2, size + chunk));
+		}
+		output.resize(size + chunk);
+
+		ssize_t bytes = 0;
+		do
+		{
+			bytes = ::read(fd, &output[size], chunk);
+		} while (bytes < 0 && errno == EINTR);
+		int err = errno;
+
+		output.resize(size + (bytes > 0 ? bytes : 0));
+		return bytes > 0 || (bytes < 0 && err == EAGAIN);
+	}
+
+	/**
+		@brief  Writes the next part of data without raising SIGPIPE if the child already closed its stdin
+		@param  fd      - Non blocking write end of the pipe
+		@param  data    - The whole data to write
+		@param  written - Bytes already written, updated
+		@retval         - False if the child does not read anymore
+	**/
+	inline bool write_some(int fd, const std::string& data, size_t& written)
+	{
+		sigset_t pipe_mask, old_mask;
+		sigemptyset(&pipe_mask);
+		sigaddset(&pipe_mask, SIGPIPE);
+		::pthread_sigmask(SIG_BLOCK, &pipe_mask, &old_mask);
+
+		ssize_t bytes = 0;
+		do
+		{
+			bytes = ::write(fd, data.data() + written, data.size() - written);
+		} while (bytes < 0 && errno == EINTR);
+		int err = errno;
+
+		if (bytes < 0 && err == EPIPE)
+		{
+			// consume the pending SIGPIPE before restoring the mask
+			timespec no_wait = { 0, 0 };
+			::sigtimedwait(&pipe_mask, nullptr, &no_wait);
+		}
+		::pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+
+		if (bytes < 0)
+		{
+			return err == EAGAIN;
+		}
+		written += static_cast<size_t>(bytes);
+		return true;
+	}
+
+	/**
+		@brief  Converts a waitpid status in an exit status, as a shell reports it
+	**/
+	inline int exit_status(int wait_status)
+	{
+		if (WIFEXITED(wait_status))
+		{
+			return WEXITSTATUS(wait_status);
+		}
+		if (WIFSIGNALED(wait_status))
+		{
+			return 128 + WTERMSIG(wait_status);
+		}
+		return 0;
+	}
+}